@@ -0,0 +1,214 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "AdaptiveSampler.h"
+#include "SensorHealth.h"
+
+AdaptiveSampler::AdaptiveSampler()
+{
+}
+
+// ***
+// *** Starts with every device due now at its minimum interval
+// *** so that the statistics are learned quickly. A non-zero
+// *** fixed interval (ms) turns the adaptation off.
+// ***
+void AdaptiveSampler::begin(uint64_t now, uint32_t fixedInterval)
+{
+  this->_fixedInterval = fixedInterval;
+
+  for (uint8_t i = 0; i < DEVICE_COUNT; i++)
+  {
+    enum sensorDevice device = (enum sensorDevice)i;
+    this->_interval[i] = (fixedInterval > 0) ? fixedInterval : getMinimumInterval(device);
+    this->_nextDue[i] = now;
+  }
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    memset(&this->_channels[i], 0, sizeof(ChannelState));
+    this->_channels[i].interval = getMinimumInterval(getChannelDevice((enum sensorChannel)i));
+  }
+}
+
+// ***
+// *** Returns the devices (a bit per enum sensorDevice)
+// *** that are due to be read.
+// ***
+uint8_t AdaptiveSampler::getDueDevices(uint64_t now)
+{
+  uint8_t returnValue = 0;
+
+  for (uint8_t i = 0; i < DEVICE_COUNT; i++)
+  {
+    if (now >= this->_nextDue[i])
+    {
+      returnValue |= (1 << i);
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Called after the given devices have been read (and the
+// *** quality flags set). Updates the statistics of their channels
+// *** and schedules their next read.
+// ***
+void AdaptiveSampler::update(uint8_t devices, const CloudData& data, uint64_t now)
+{
+  uint32_t interval[DEVICE_COUNT];
+
+  for (uint8_t i = 0; i < DEVICE_COUNT; i++)
+  {
+    interval[i] = getMaximumInterval((enum sensorDevice)i);
+  }
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    enum sensorChannel channel = (enum sensorChannel)i;
+    enum sensorDevice device = getChannelDevice(channel);
+
+    if (devices & (1 << device))
+    {
+      // ***
+      // *** Unusable readings say nothing about the signal.
+      // ***
+      if (!(data.quality[i] & QUALITY_EXCLUDE_MASK))
+      {
+        this->_channels[i].interval = this->getTargetInterval(channel, getChannelValue(data, channel), now);
+      }
+
+      interval[device] = min(interval[device], this->_channels[i].interval);
+    }
+  }
+
+  for (uint8_t i = 0; i < DEVICE_COUNT; i++)
+  {
+    if (devices & (1 << i))
+    {
+      this->_interval[i] = (this->_fixedInterval > 0) ? this->_fixedInterval : interval[i];
+      this->_nextDue[i] = now + this->_interval[i];
+    }
+  }
+}
+
+// ***
+// *** Returns the tick at which the next device is due.
+// ***
+uint64_t AdaptiveSampler::getNextDue()
+{
+  uint64_t returnValue = this->_nextDue[0];
+
+  for (uint8_t i = 1; i < DEVICE_COUNT; i++)
+  {
+    returnValue = min(returnValue, this->_nextDue[i]);
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Returns the interval (ms) a device is being read at.
+// *** This is also the interval of each of its channels.
+// ***
+uint32_t AdaptiveSampler::getDeviceInterval(enum sensorDevice device)
+{
+  return this->_interval[device];
+}
+
+uint32_t AdaptiveSampler::getMinimumInterval(enum sensorDevice device)
+{
+  switch (device)
+  {
+#define DEVICE_MINIMUM_CASE(id, name, minimum, maximum) case id: return minimum;
+    SENSOR_DEVICES(DEVICE_MINIMUM_CASE)
+    default: return 0;
+  }
+}
+
+uint32_t AdaptiveSampler::getMaximumInterval(enum sensorDevice device)
+{
+  switch (device)
+  {
+#define DEVICE_MAXIMUM_CASE(id, name, minimum, maximum) case id: return maximum;
+    SENSOR_DEVICES(DEVICE_MAXIMUM_CASE)
+    default: return 0;
+  }
+}
+
+PGM_P AdaptiveSampler::getDeviceName(enum sensorDevice device)
+{
+  switch (device)
+  {
+#define DEVICE_NAME_CASE(id, name, minimum, maximum) case id: return PSTR(name);
+    SENSOR_DEVICES(DEVICE_NAME_CASE)
+    default: return PSTR("");
+  }
+}
+
+// ***
+// *** Adds a reading to the statistics of a channel and returns
+// *** the interval (ms) the channel should be read at. The signal
+// *** is considered to move at the larger of its smoothed rate of
+// *** change and its spread (standard deviation) per interval.
+// ***
+uint32_t AdaptiveSampler::getTargetInterval(enum sensorChannel channel, float value, uint64_t now)
+{
+  ChannelState& state = this->_channels[channel];
+  enum sensorDevice device = getChannelDevice(channel);
+  uint32_t minimum = getMinimumInterval(device);
+  uint32_t maximum = getMaximumInterval(device);
+  uint32_t returnValue = state.interval;
+
+  if (!state.hasLast)
+  {
+    state.hasLast = true;
+    state.mean = value;
+  }
+  else if (now > state.lastTick)
+  {
+    float elapsed = (float)(now - state.lastTick) / 1000.0;
+    float rate = fabs(value - state.lastValue) / elapsed;
+    state.rate += SAMPLER_SMOOTHING * (rate - state.rate);
+
+    float difference = value - state.mean;
+    state.mean += SAMPLER_SMOOTHING * difference;
+    state.variance = (1.0 - SAMPLER_SMOOTHING) * (state.variance + (SAMPLER_SMOOTHING * difference * difference));
+
+    float step = max(getChannelSensitivity(channel), (float)(SAMPLER_RELATIVE_CHANGE * fabs(value)));
+    float speed = max(state.rate, sqrtf(state.variance) / ((float)state.interval / 1000.0f));
+    float target = (speed > 0.0) ? (step / speed) * 1000.0 : (float)maximum;
+    target = constrain(target, (float)minimum, (float)maximum);
+
+    if (target < state.interval)
+    {
+      returnValue = (uint32_t)target;
+    }
+    else
+    {
+      returnValue = (uint32_t)min(target, (float)(state.interval * SAMPLER_RELAX_FACTOR));
+    }
+
+    returnValue = constrain(returnValue, minimum, maximum);
+  }
+
+  state.lastValue = value;
+  state.lastTick = now;
+
+  return returnValue;
+}
@@ -0,0 +1,98 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef ADAPTIVE_SAMPLER_H
+#define ADAPTIVE_SAMPLER_H
+
+#include <Arduino.h>
+#include "CloudData.h"
+
+// ***
+// *** Weight of a new sample in the moving averages of the
+// *** rate of change and the variance of each channel.
+// ***
+#define SAMPLER_SMOOTHING         0.3
+
+// ***
+// *** A change of this fraction of the value is always
+// *** significant, so that channels with a wide range (light)
+// *** are not read at the minimum interval when the level is
+// *** high and merely noisy.
+// ***
+#define SAMPLER_RELATIVE_CHANGE   0.01
+
+// ***
+// *** The interval drops at once when a channel becomes active
+// *** but only grows by this factor per read when it settles.
+// ***
+#define SAMPLER_RELAX_FACTOR      1.5
+
+// ***
+// *** Chooses how often each sensor device is read from what
+// *** its channels have been doing. A channel's interval is the
+// *** time it is expected to take to change by a significant
+// *** amount (its sensitivity, see SensorChannels.h), estimated
+// *** from the smoothed rate of change and the variance of its
+// *** recent readings. A device is read at the shortest interval
+// *** of its channels, within the bounds set in SENSOR_DEVICES.
+// *** Flat signals drift back to the maximum (the slow floor).
+// ***
+class AdaptiveSampler
+{
+  public:
+    AdaptiveSampler();
+    void begin(uint64_t now, uint32_t fixedInterval = 0);
+    uint8_t getDueDevices(uint64_t now);
+    void update(uint8_t devices, const CloudData& data, uint64_t now);
+    uint64_t getNextDue();
+    uint32_t getDeviceInterval(enum sensorDevice);
+    static uint32_t getMinimumInterval(enum sensorDevice);
+    static uint32_t getMaximumInterval(enum sensorDevice);
+    static PGM_P getDeviceName(enum sensorDevice);
+
+  private:
+    // ***
+    // *** The statistics of one channel.
+    // ***
+    typedef struct channelState
+    {
+      bool hasLast;
+      float lastValue;
+      uint64_t lastTick;
+      float rate;
+      float mean;
+      float variance;
+      uint32_t interval;
+    } ChannelState;
+
+    ChannelState _channels[CHANNEL_COUNT];
+
+    // ***
+    // *** The interval (ms) of each device and when it is next due.
+    // ***
+    uint32_t _interval[DEVICE_COUNT];
+    uint64_t _nextDue[DEVICE_COUNT];
+
+    // ***
+    // *** When not zero every device is read at this interval
+    // *** and the statistics are only kept up to date.
+    // ***
+    uint32_t _fixedInterval = 0;
+
+    uint32_t getTargetInterval(enum sensorChannel, float value, uint64_t now);
+};
+#endif
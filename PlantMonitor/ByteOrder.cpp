@@ -0,0 +1,61 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "ByteOrder.h"
+
+void put16(uint8_t* p, uint16_t v)
+{
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+}
+
+void put32(uint8_t* p, uint32_t v)
+{
+  put16(p, v & 0xFFFF);
+  put16(p + 2, v >> 16);
+}
+
+void put64(uint8_t* p, uint64_t v)
+{
+  put32(p, (uint32_t)v);
+  put32(p + 4, (uint32_t)(v >> 32));
+}
+
+uint16_t get16(const uint8_t* p)
+{
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+uint32_t get32(const uint8_t* p)
+{
+  return (uint32_t)get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+uint64_t get64(const uint8_t* p)
+{
+  return (uint64_t)get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+uint64_t zigzag(int64_t v)
+{
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v)
+{
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
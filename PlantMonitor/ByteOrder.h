@@ -0,0 +1,44 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef BYTE_ORDER_H
+#define BYTE_ORDER_H
+
+// ***
+// *** Little endian and zigzag helpers shared by the telemetry
+// *** packets, the telemetry batches and the update images. This
+// *** file does not depend on the Arduino core so that it can be
+// *** shared with the Linux tools (see Tools).
+// ***
+#include <stdint.h>
+
+void put16(uint8_t* p, uint16_t v);
+void put32(uint8_t* p, uint32_t v);
+void put64(uint8_t* p, uint64_t v);
+uint16_t get16(const uint8_t* p);
+uint32_t get32(const uint8_t* p);
+uint64_t get64(const uint8_t* p);
+
+// ***
+// *** Zigzag encoding maps signed values to unsigned ones so that
+// *** small values either way stay small (0, -1, 1, -2 becomes
+// *** 0, 1, 2, 3).
+// ***
+uint64_t zigzag(int64_t v);
+int64_t unzigzag(uint64_t v);
+
+#endif
@@ -0,0 +1,193 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "Clock.h"
+#include <sys/time.h>
+#include <coredecls.h>
+
+// ***
+// *** Set by the SNTP client each time the system time is set.
+// ***
+static volatile bool _timeWasSet = false;
+
+static void timeSetCallback()
+{
+  _timeWasSet = true;
+}
+
+Clock::Clock()
+{
+}
+
+void Clock::begin()
+{
+  // ***
+  // *** Get notified each time NTP sets the time.
+  // ***
+  settimeofday_cb(timeSetCallback);
+}
+
+// ***
+// *** Called by the loop. Picks up a new NTP time
+// *** and updates the drift diagnostics.
+// ***
+void Clock::process()
+{
+  if (_timeWasSet || (!this->_isSynchronized && time(nullptr) > MINIMUM_VALID_EPOCH))
+  {
+    _timeWasSet = false;
+    this->synchronize();
+  }
+}
+
+// ***
+// *** Milliseconds since the first boot. Does not wrap
+// *** like millis() does after 49 days.
+// ***
+uint64_t Clock::now()
+{
+  return (micros64() / 1000) + this->_tickOffset;
+}
+
+bool Clock::isSynchronized()
+{
+  return this->_isSynchronized;
+}
+
+// ***
+// *** Returns the epoch time (seconds) of a tick or 0
+// *** if the time has not been synchronized yet.
+// ***
+time_t Clock::toEpoch(uint64_t tick)
+{
+  return (time_t)(this->toEpochMillis(tick) / 1000);
+}
+
+uint64_t Clock::toEpochMillis(uint64_t tick)
+{
+  uint64_t returnValue = 0;
+
+  if (this->_isSynchronized)
+  {
+    returnValue = (uint64_t)((int64_t)tick + this->_epochOffset);
+  }
+
+  return returnValue;
+}
+
+uint32_t Clock::getSyncCount()
+{
+  return this->_syncCount;
+}
+
+// ***
+// *** The correction (ms) applied at the last sync. Positive
+// *** means the local clock was running slow.
+// ***
+int32_t Clock::getLastDrift()
+{
+  return this->_lastDrift;
+}
+
+// ***
+// *** The drift of the local oscillator in parts per million
+// *** measured between the last two syncs.
+// ***
+float Clock::getDriftRate()
+{
+  return this->_driftRate;
+}
+
+// ***
+// *** Seconds since the last sync.
+// ***
+uint32_t Clock::getLastSyncAge()
+{
+  return this->_isSynchronized ? (uint32_t)((this->now() - this->_lastSyncTick) / 1000) : 0;
+}
+
+// ***
+// *** Moves the tick forward by time that the system
+// *** timer did not count (e.g. forced light sleep).
+// ***
+void Clock::advance(uint64_t milliseconds)
+{
+  this->_tickOffset += milliseconds;
+}
+
+// ***
+// *** Saves the clock before a deep sleep of the given length (ms).
+// ***
+void Clock::getState(ClockState* state, uint64_t sleepTime)
+{
+  state->tick = this->now() + sleepTime;
+  state->epochOffset = this->_epochOffset;
+  state->lastSyncTick = this->_lastSyncTick;
+  state->syncCount = this->_syncCount;
+  state->driftRate = this->_driftRate;
+  state->isSynchronized = this->_isSynchronized ? 1 : 0;
+  state->reserved = 0;
+}
+
+// ***
+// *** Restores the clock after waking from deep sleep so that
+// *** ticks continue from where they were and keep their
+// *** epoch time until NTP corrects the drift of the sleep.
+// ***
+void Clock::setState(const ClockState* state)
+{
+  this->_tickOffset = state->tick;
+  this->_epochOffset = state->epochOffset;
+  this->_lastSyncTick = state->lastSyncTick;
+  this->_syncCount = state->syncCount;
+  this->_driftRate = state->driftRate;
+  this->_isSynchronized = (state->isSynchronized != 0);
+}
+
+void Clock::synchronize()
+{
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+
+  if (tv.tv_sec > MINIMUM_VALID_EPOCH)
+  {
+    uint64_t tick = this->now();
+    int64_t epochMillis = ((int64_t)tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+    int64_t offset = epochMillis - (int64_t)tick;
+
+    if (this->_isSynchronized)
+    {
+      // ***
+      // *** Compare where our offset predicted the time to
+      // *** be against the time NTP just set.
+      // ***
+      this->_lastDrift = (int32_t)(offset - this->_epochOffset);
+
+      uint64_t elapsed = tick - this->_lastSyncTick;
+
+      if (elapsed > 0)
+      {
+        this->_driftRate = (this->_lastDrift * 1000000.0) / elapsed;
+      }
+    }
+
+    this->_epochOffset = offset;
+    this->_lastSyncTick = tick;
+    this->_isSynchronized = true;
+    this->_syncCount++;
+  }
+}
@@ -0,0 +1,96 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <Arduino.h>
+#include <time.h>
+
+// ***
+// *** Any system time before this (2019-01-01) means
+// *** the time has not been set by NTP yet.
+// ***
+#define MINIMUM_VALID_EPOCH 1546300800
+
+// ***
+// *** The clock state kept in RTC memory across deep sleep
+// *** (see RtcMemory.h). The tick is the tick at which the
+// *** device is expected to wake.
+// ***
+typedef struct clockState
+{
+  uint64_t tick;
+  int64_t epochOffset;
+  uint64_t lastSyncTick;
+  uint32_t syncCount;
+  float driftRate;
+  uint32_t isSynchronized;
+  uint32_t reserved;
+} ClockState;
+
+// ***
+// *** Provides a monotonic millisecond tick that does not wrap
+// *** and maps ticks to epoch time once NTP has synchronized.
+// *** Samples are stamped with the tick when they are captured
+// *** so that they can be converted to epoch time later, even
+// *** if they were captured before the first NTP sync.
+// ***
+class Clock
+{
+  public:
+    Clock();
+    void begin();
+    void process();
+    uint64_t now();
+    bool isSynchronized();
+    time_t toEpoch(uint64_t tick);
+    uint64_t toEpochMillis(uint64_t tick);
+    uint32_t getSyncCount();
+    int32_t getLastDrift();
+    float getDriftRate();
+    uint32_t getLastSyncAge();
+    void advance(uint64_t milliseconds);
+    void getState(ClockState* state, uint64_t sleepTime);
+    void setState(const ClockState* state);
+
+  private:
+    // ***
+    // *** Added to the time since boot to give the tick. This
+    // *** covers time the system timer does not count: deep
+    // *** sleep (the timer restarts) and forced light sleep.
+    // ***
+    uint64_t _tickOffset = 0;
+
+    // ***
+    // *** Epoch time (ms) minus the tick (ms). Adding this
+    // *** to a tick gives the epoch time of that tick.
+    // ***
+    int64_t _epochOffset = 0;
+    bool _isSynchronized = false;
+
+    // ***
+    // *** Sync quality diagnostics.
+    // ***
+    uint32_t _syncCount = 0;
+    uint64_t _lastSyncTick = 0;
+    int32_t _lastDrift = 0;
+    float _driftRate = 0.0;
+
+    void synchronize();
+};
+#endif
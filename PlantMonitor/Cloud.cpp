@@ -17,23 +17,37 @@
 //
 #include "Cloud.h"
 
+// ***
+// *** The data entries of a reading (see hasDataPoint()).
+// ***
+#define CLOUD_DATA_ENTRIES (CHANNEL_COUNT + 1 + METRIC_COUNT)
+
+// ***
+// *** The entries of a rollup with its extremes (see appendRollup()).
+// ***
+#define CLOUD_ROLLUP_ENTRIES (CHANNEL_COUNT * 3)
+
+// ***
+// *** Each device's share of the budget must allow at least a
+// *** one point bulk request above the bulk reserve.
+// ***
+static_assert((IO_RATE_LIMIT / IO_ACCOUNT_DEVICES) > GOVERNOR_BULK_RESERVE, "The publish budget of each device is too small for sensor uploads.");
+
 Cloud::Cloud()
 {
   this->_io = new AdafruitIO_WiFi(IO_USERNAME, IO_KEY, WIFI_SSID, WIFI_PASS);
 
-  this->_environmentalTemperatureFeed = this->_io->feed("plant-monitor.environmental-temperature");
-  this->_environmentalRelativeHumidityFeed = this->_io->feed("plant-monitor.environmental-relative-humidity");
-
-  this->_soilMoistureLevelFeed = this->_io->feed("plant-monitor.soil-moisture-level");
-  this->_soilMoistureQualityFeed = this->_io->feed("plant-monitor.soil-moisture-quality");
-  this->_soilTemperatureFeed = this->_io->feed("plant-monitor.soil-temperature");
+  this->_waterPumpFeed = this->_io->feed("plant-monitor.water-pump");
+  this->_alertFeed = this->_io->feed("plant-monitor.alerts");
 
-  this->_spectrumLuxFeed = this->_io->feed("plant-monitor.spectrum-lux");
-  this->_spectrumIrFeed = this->_io->feed("plant-monitor.spectrum-ir");
-  this->_spectrumFullFeed = this->_io->feed("plant-monitor.spectrum-full");
-  this->_spectrumVisibleFeed = this->_io->feed("plant-monitor.spectrum-visible");
+  // ***
+  // *** The governor is started here because the duty cycled
+  // *** power modes upload without calling begin().
+  // ***
+  this->_governor.begin(IO_RATE_LIMIT, IO_ACCOUNT_DEVICES);
 
-  this->_waterPumpFeed = this->_io->feed("plant-monitor.water-pump");
+  this->_client.setFingerprint(AIO_SSL_FINGERPRINT);
+  this->_http.setReuse(true);
 }
 
 // ***
@@ -62,6 +76,26 @@ void Cloud::begin()
   // ***
   Serial.println();
   Serial.println(_io->statusText());
+
+  // ***
+  // *** Check once if the API server will accept a smaller
+  // *** TLS buffer for the REST uploads.
+  // ***
+  this->_useMaxFragmentLength = BearSSL::WiFiClientSecure::probeMaxFragmentLength(IO_API_HOST, IO_API_PORT, CLOUD_TLS_MFLN_BUFFER);
+
+  if (this->_useMaxFragmentLength)
+  {
+    this->_client.setBufferSizes(CLOUD_TLS_MFLN_BUFFER, CLOUD_TLS_MFLN_BUFFER);
+  }
+
+  // ***
+  // *** A reading with more data points than the governor can
+  // *** grant at once is split into several requests.
+  // ***
+  if (this->_governor.getRequestLimit(PUBLISH_BULK) < CLOUD_DATA_ENTRIES)
+  {
+    Serial.print("Cloud readings are sent in requests of up to "); Serial.print(this->_governor.getRequestLimit(PUBLISH_BULK)); Serial.println(" data points.");
+  }
 }
 
 void Cloud::onWaterPumpChanged(AdafruitIODataCallbackType cb)
@@ -76,31 +110,729 @@ void Cloud::onWaterPumpChanged(AdafruitIODataCallbackType cb)
 void Cloud::process()
 {
   _io->run();
+
+  // ***
+  // *** Close the upload connection once it is idle.
+  // ***
+  if (this->_client.connected() && (millis() - this->_postedAt) >= CLOUD_KEEP_ALIVE)
+  {
+    this->_client.stop();
+  }
+
+  // ***
+  // *** Send what was held back as soon as there are tokens,
+  // *** control messages first.
+  // ***
+  this->sendPendingControl();
+  this->sendPendingData();
 }
 
 // ***
-// ***
+// *** Publishes the water pump speed. Without tokens (or while
+// *** MQTT is not connected) only the latest speed is kept and
+// *** published by process().
 // ***
 void Cloud::setWaterPumpSpeed(uint8_t speed)
 {
-  this->_waterPumpFeed->save(speed);
+  if (this->_pendingPumpSpeed < 0 && this->isConnected() && this->_governor.acquire(PUBLISH_CONTROL, 1))
+  {
+    this->_waterPumpFeed->save(speed);
+  }
+  else
+  {
+    if (this->_pendingPumpSpeed < 0 && this->isConnected())
+    {
+      this->_governor.defer(PUBLISH_CONTROL);
+    }
+
+    this->_pendingPumpSpeed = speed;
+  }
+}
+
+// ***
+// *** Publishes an alert message (sensor faults, etc.). Without
+// *** tokens (or while MQTT is not connected) the alert is
+// *** queued and published by process().
+// ***
+void Cloud::sendAlert(String message)
+{
+  if (this->_alertCount == 0 && this->isConnected() && this->_governor.acquire(PUBLISH_CONTROL, 1))
+  {
+    this->_alertFeed->save(message);
+  }
+  else
+  {
+    if (this->isConnected())
+    {
+      this->_governor.defer(PUBLISH_CONTROL);
+    }
+
+    if (this->_alertCount < CLOUD_ALERT_QUEUE)
+    {
+      strncpy(this->_alerts[this->_alertCount], message.c_str(), CLOUD_ALERT_SIZE - 1);
+      this->_alerts[this->_alertCount][CLOUD_ALERT_SIZE - 1] = 0;
+      this->_alertCount++;
+    }
+    else
+    {
+      this->_droppedAlerts++;
+    }
+  }
+}
+
+// ***
+// *** Posts an alert to its feed through the group data API,
+// *** for the duty cycled power modes which do not connect to
+// *** MQTT.
+// ***
+bool Cloud::postAlert(const char* message)
+{
+  size_t length = this->beginBody(0);
+  length = this->appendFeed(length, PSTR("alerts"), message);
+
+  return this->postBody(PUBLISH_CONTROL, length);
+}
+
+// ***
+// *** True once MQTT is connected; nothing is published over it
+// *** (or takes tokens for it) before.
+// ***
+bool Cloud::isConnected()
+{
+  return this->_io->status() >= AIO_CONNECTED;
+}
+
+PublishGovernor& Cloud::getGovernor()
+{
+  return this->_governor;
+}
+
+uint16_t Cloud::getPendingReadings()
+{
+  return this->_pendingReadings;
+}
+
+uint8_t Cloud::getPendingAlerts()
+{
+  return this->_alertCount;
+}
+
+uint32_t Cloud::getDroppedAlerts()
+{
+  return this->_droppedAlerts;
+}
+
+// ***
+// *** Uploads the sensor readings through the group data API.
+// *** Without a capture time (NTP has not synchronized
+// *** yet) the cloud uses the time they arrive.
+// ***
+bool Cloud::sendData(const CloudData& data)
+{
+  return this->sendData(data, 0);
+}
+
+// ***
+// *** Uploads the sensor readings with the time they were
+// *** captured. Only the channels with the REPORT_CLOUD policy
+// *** are sent and readings from a faulty sensor are skipped.
+// *** The readings are split into requests the governor can
+// *** grant (see PublishGovernor::getRequestLimit()). When one
+// *** of them is held back the ones already sent are remembered
+// *** and the next call for the same reading continues from it.
+// ***
+bool Cloud::sendData(const CloudData& data, time_t createdAt)
+{
+  uint8_t entry = (this->_dataCapturedAt == data.capturedAt) ? this->_dataEntry : 0;
+  bool returnValue = this->sendEntries(data, createdAt, entry);
+
+  this->_dataEntry = entry;
+  this->_dataCapturedAt = data.capturedAt;
+
+  return returnValue;
+}
+
+// ***
+// *** Sends the data entries of a reading from the given one
+// *** on, a request at a time. The entry is left at the first
+// *** one not sent (0 once they all have been).
+// ***
+bool Cloud::sendEntries(const CloudData& data, time_t createdAt, uint8_t& entry)
+{
+  bool returnValue = true;
+  uint16_t limit = this->_governor.getRequestLimit(PUBLISH_BULK);
+
+  while (returnValue && entry < CLOUD_DATA_ENTRIES)
+  {
+    uint8_t first = entry;
+    size_t length = this->beginBody(createdAt);
+
+    while (entry < CLOUD_DATA_ENTRIES && this->_points < limit)
+    {
+      if (this->hasDataPoint(data, entry))
+      {
+        length = this->appendData(length, data, entry);
+      }
+
+      entry++;
+    }
+
+    returnValue = this->postBody(PUBLISH_BULK, length);
+
+    if (!returnValue)
+    {
+      entry = first;
+    }
+  }
+
+  if (returnValue)
+  {
+    entry = 0;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** The data entries of a reading: one per channel, then the
+// *** soil moisture quality, then one per derived metric.
+// ***
+bool Cloud::hasDataPoint(const CloudData& data, uint8_t entry)
+{
+  bool returnValue = false;
+
+  if (entry < CHANNEL_COUNT)
+  {
+    enum sensorChannel channel = (enum sensorChannel)entry;
+    returnValue = (getChannelPolicy(channel) & REPORT_CLOUD) && !(data.quality[channel] & QUALITY_EXCLUDE_MASK);
+  }
+  else if (entry == CHANNEL_COUNT)
+  {
+    returnValue = !(data.quality[CHANNEL_SOIL_MOISTURE_LEVEL] & QUALITY_EXCLUDE_MASK);
+  }
+  else
+  {
+    enum derivedMetric metric = (enum derivedMetric)(entry - CHANNEL_COUNT - 1);
+    returnValue = (getMetricPolicy(metric) & REPORT_CLOUD) && !isnan(getMetricValue(data, metric));
+  }
+
+  return returnValue;
+}
+
+size_t Cloud::appendData(size_t length, const CloudData& data, uint8_t entry)
+{
+  if (entry < CHANNEL_COUNT)
+  {
+    enum sensorChannel channel = (enum sensorChannel)entry;
+    length = this->appendFeed(length, getChannelKey(channel), getChannelValue(data, channel), getChannelDecimals(channel), data.quality[channel]);
+  }
+  else if (entry == CHANNEL_COUNT)
+  {
+    length = this->appendFeed(length, PSTR("soil-moisture-quality"), data.soilMoistureQuality.c_str());
+  }
+  else
+  {
+    enum derivedMetric metric = (enum derivedMetric)(entry - CHANNEL_COUNT - 1);
+    length = this->appendFeed(length, getMetricKey(metric), getMetricValue(data, metric), getMetricDecimals(metric), QUALITY_GOOD);
+  }
+
+  return length;
+}
+
+// ***
+// *** Starts a group data body stamped with the given time (0
+// *** for the time it arrives) and returns its length.
+// ***
+size_t Cloud::beginBody(time_t createdAt)
+{
+  size_t returnValue = 0;
+  this->_points = 0;
+
+  if (createdAt == 0)
+  {
+    returnValue = snprintf_P(this->_body, CLOUD_BODY_SIZE, PSTR("{\"feeds\":["));
+  }
+  else
+  {
+    // ***
+    // *** Format the capture time as ISO 8601 UTC.
+    // ***
+    char timestamp[24];
+    struct tm utc;
+    gmtime_r(&createdAt, &utc);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &utc);
+
+    returnValue = snprintf_P(this->_body, CLOUD_BODY_SIZE, PSTR("{\"created_at\":\"%s\",\"feeds\":["), timestamp);
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Closes the feeds of a body and posts it. A body without
+// *** any data points is not sent, which is not a failure.
+// ***
+bool Cloud::postBody(enum publishPriority priority, size_t length)
+{
+  bool returnValue = (this->_points == 0);
+  this->_isDeferred = false;
+
+  if (this->_points > 0 && length < CLOUD_BODY_SIZE)
+  {
+    // ***
+    // *** Replace the trailing comma and close the array.
+    // ***
+    length--;
+    length += snprintf_P(this->_body + length, CLOUD_BODY_SIZE - length, PSTR("]}"));
+
+    if (length < CLOUD_BODY_SIZE)
+    {
+      returnValue = this->post(priority, IO_GROUP_DATA_URL, this->_body, length);
+    }
+  }
+
+  if (length >= CLOUD_BODY_SIZE)
+  {
+    Serial.println("Cloud upload is too large.");
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Publishes a reading. When the publish budget does not allow
+// *** it the reading is not lost: it is averaged into a pending
+// *** reading that process() sends once there are tokens, so a
+// *** burst of readings degrades into fewer averaged uploads.
+// ***
+bool Cloud::publishData(const CloudData& data, time_t createdAt)
+{
+  bool returnValue = false;
+
+  if (this->_pendingReadings == 0)
+  {
+    returnValue = this->sendData(data, createdAt);
+
+    if (!returnValue && this->_isDeferred)
+    {
+      // ***
+      // *** The average continues where this reading stopped.
+      // ***
+      this->deferData(data, createdAt);
+      this->_pendingEntry = this->_dataEntry;
+    }
+  }
+  else
+  {
+    this->_governor.defer(PUBLISH_BULK);
+    this->deferData(data, createdAt);
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Adds a reading to the pending average.
+// ***
+void Cloud::deferData(const CloudData& data, time_t createdAt)
+{
+  if (this->_pendingReadings == 0)
+  {
+    memset(this->_pendingSum, 0, sizeof(this->_pendingSum));
+    memset(this->_pendingCount, 0, sizeof(this->_pendingCount));
+    memset(this->_pendingMetricSum, 0, sizeof(this->_pendingMetricSum));
+    memset(this->_pendingMetricCount, 0, sizeof(this->_pendingMetricCount));
+    this->_pendingEntry = 0;
+    this->_pendingFirst = createdAt;
+  }
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    if (!(data.quality[i] & QUALITY_EXCLUDE_MASK))
+    {
+      this->_pendingSum[i] += getChannelValue(data, (enum sensorChannel)i);
+      this->_pendingCount[i]++;
+    }
+  }
+
+  for (uint8_t i = 0; i < METRIC_COUNT; i++)
+  {
+    float value = getMetricValue(data, (enum derivedMetric)i);
+
+    if (!isnan(value))
+    {
+      this->_pendingMetricSum[i] += value;
+      this->_pendingMetricCount[i]++;
+    }
+  }
+
+  this->_pending = data;
+  this->_pendingLast = createdAt;
+  this->_pendingReadings++;
+}
+
+// ***
+// *** Sends the average of the pending readings stamped with the
+// *** middle of the time they span. Readings that fail for any
+// *** reason other than the budget are dropped, as a failed
+// *** publishData() would be.
+// ***
+void Cloud::sendPendingData()
+{
+  if (this->_pendingReadings > 0 && this->_governor.isAvailable(PUBLISH_BULK, this->getPendingPoints()))
+  {
+    CloudData average = this->_pending;
+
+    for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+    {
+      if (this->_pendingCount[i] > 0)
+      {
+        setChannelValue(average, (enum sensorChannel)i, this->_pendingSum[i] / this->_pendingCount[i]);
+        average.quality[i] = QUALITY_GOOD;
+      }
+      else
+      {
+        average.quality[i] = QUALITY_INVALID;
+      }
+    }
+
+    for (uint8_t i = 0; i < METRIC_COUNT; i++)
+    {
+      setMetricValue(average, (enum derivedMetric)i, (this->_pendingMetricCount[i] > 0) ? this->_pendingMetricSum[i] / this->_pendingMetricCount[i] : NAN);
+    }
+
+    time_t createdAt = (this->_pendingFirst == 0 || this->_pendingLast == 0) ? 0 : this->_pendingFirst + ((this->_pendingLast - this->_pendingFirst) / 2);
+
+    if (this->sendEntries(average, createdAt, this->_pendingEntry))
+    {
+      Serial.print("Sent "); Serial.print(this->_pendingReadings); Serial.println(" deferred reading(s) as one average.");
+    }
+
+    if (!this->_isDeferred)
+    {
+      this->_pendingReadings = 0;
+    }
+  }
+}
+
+// ***
+// *** The data points in the next request sendPendingData()
+// *** will make (the average has a channel or metric when at
+// *** least one pending reading had it).
+// ***
+uint16_t Cloud::getPendingPoints()
+{
+  uint16_t returnValue = 0;
+  uint16_t limit = this->_governor.getRequestLimit(PUBLISH_BULK);
+
+  for (uint8_t entry = this->_pendingEntry; entry < CLOUD_DATA_ENTRIES && returnValue < limit; entry++)
+  {
+    if (entry < CHANNEL_COUNT)
+    {
+      returnValue += ((getChannelPolicy((enum sensorChannel)entry) & REPORT_CLOUD) && this->_pendingCount[entry] > 0) ? 1 : 0;
+    }
+    else if (entry == CHANNEL_COUNT)
+    {
+      returnValue += (this->_pendingCount[CHANNEL_SOIL_MOISTURE_LEVEL] > 0) ? 1 : 0;
+    }
+    else
+    {
+      uint8_t metric = entry - CHANNEL_COUNT - 1;
+      returnValue += ((getMetricPolicy((enum derivedMetric)metric) & REPORT_CLOUD) && this->_pendingMetricCount[metric] > 0) ? 1 : 0;
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Publishes the latest pump speed and the queued alerts.
+// ***
+void Cloud::sendPendingControl()
+{
+  if (this->_pendingPumpSpeed >= 0 && this->isConnected() && this->_governor.acquire(PUBLISH_CONTROL, 1))
+  {
+    this->_waterPumpFeed->save((uint8_t)this->_pendingPumpSpeed);
+    this->_pendingPumpSpeed = -1;
+  }
+
+  while (this->_alertCount > 0 && this->isConnected() && this->_governor.acquire(PUBLISH_CONTROL, 1))
+  {
+    this->_alertFeed->save(this->_alerts[0]);
+    this->_alertCount--;
+    memmove(this->_alerts[0], this->_alerts[1], this->_alertCount * CLOUD_ALERT_SIZE);
+  }
 }
 
 // ***
-// *** Takes the cloud data structure and upload
-// *** each individual sensor reading to the cloud.
+// *** Uploads one rollup bucket per channel (indexed by channel)
+// *** stamped with the start of the period. The mean is sent to
+// *** the regular feed; when extremes is set the minimum and
+// *** maximum are also sent to the "-min" and "-max" feeds. The
+// *** means go first and the rollup is split into requests the
+// *** governor can grant, so the extremes follow as the budget
+// *** allows. When a request is held back the next call for the
+// *** same period continues from it.
 // ***
-void Cloud::sendData(CloudData data)
+bool Cloud::sendRollup(const RollupBucket* buckets, time_t createdAt, bool extremes)
 {
-  this->_environmentalTemperatureFeed->save(data.environmentalTemperature);
-  this->_environmentalRelativeHumidityFeed->save(data.environmentalRelativeHumidity);
+  bool returnValue = true;
+  uint16_t limit = this->_governor.getRequestLimit(PUBLISH_BULK);
+  uint8_t entries = extremes ? CLOUD_ROLLUP_ENTRIES : CHANNEL_COUNT;
+  uint8_t entry = (this->_rollupCreatedAt == createdAt) ? this->_rollupEntry : 0;
 
-  this->_soilMoistureLevelFeed->save(data.soilMoistureLevel);
-  this->_soilMoistureQualityFeed->save(data.soilMoistureQuality);
-  this->_soilTemperatureFeed->save(data.soilTemperature);
+  while (returnValue && entry < entries)
+  {
+    uint8_t first = entry;
+    size_t length = this->beginBody(createdAt);
+
+    while (entry < entries && this->_points < limit)
+    {
+      length = this->appendRollup(length, buckets, entry);
+      entry++;
+    }
+
+    returnValue = this->postBody(PUBLISH_BULK, length);
+
+    if (!returnValue)
+    {
+      entry = first;
+    }
+  }
 
-  this->_spectrumLuxFeed->save(data.spectrumLux);
-  this->_spectrumIrFeed->save(data.spectrumIr);
-  this->_spectrumFullFeed->save(data.spectrumFull);
-  this->_spectrumVisibleFeed->save(data.spectrumVisible);
+  this->_rollupEntry = returnValue ? 0 : entry;
+  this->_rollupCreatedAt = createdAt;
+
+  return returnValue;
+}
+
+// ***
+// *** The rollup entries: the mean of each channel, then the
+// *** minimum and maximum of each channel.
+// ***
+size_t Cloud::appendRollup(size_t length, const RollupBucket* buckets, uint8_t entry)
+{
+  uint8_t index = (entry < CHANNEL_COUNT) ? entry : (entry - CHANNEL_COUNT) / 2;
+  enum sensorChannel channel = (enum sensorChannel)index;
+
+  if (buckets[index].count > 0 && (getChannelPolicy(channel) & REPORT_CLOUD) && length < CLOUD_BODY_SIZE)
+  {
+    char key[CHANNEL_TEXT_SIZE];
+    getChannelText(key, sizeof(key), getChannelKey(channel));
+
+    if (entry < CHANNEL_COUNT)
+    {
+      length += snprintf(this->_body + length, CLOUD_BODY_SIZE - length, "{\"key\":\"%s\",\"value\":\"%.2f\"},", key, buckets[index].mean);
+    }
+    else if (((entry - CHANNEL_COUNT) % 2) == 0)
+    {
+      length += snprintf(this->_body + length, CLOUD_BODY_SIZE - length, "{\"key\":\"%s-min\",\"value\":\"%.2f\"},", key, buckets[index].minimum);
+    }
+    else
+    {
+      length += snprintf(this->_body + length, CLOUD_BODY_SIZE - length, "{\"key\":\"%s-max\",\"value\":\"%.2f\"},", key, buckets[index].maximum);
+    }
+
+    this->_points++;
+  }
+
+  return length;
+}
+
+// ***
+// *** Uploads a single value to a feed in the group (the key
+// *** is a string in flash). A createdAt of 0 uses the time
+// *** it arrives.
+// ***
+bool Cloud::sendValue(PGM_P key, float value, uint8_t decimals, time_t createdAt)
+{
+  size_t length = this->beginBody(createdAt);
+  length = this->appendFeed(length, key, value, decimals, QUALITY_GOOD);
+
+  return this->postBody(PUBLISH_STATUS, length);
+}
+
+// ***
+// *** Appends a feed value to the body and returns the new
+// *** length. The key is a string in flash.
+// ***
+size_t Cloud::appendFeed(size_t length, PGM_P key, const char* value)
+{
+  if (length < CLOUD_BODY_SIZE)
+  {
+    char text[CHANNEL_TEXT_SIZE];
+    length += snprintf(this->_body + length, CLOUD_BODY_SIZE - length, "{\"key\":\"%s\",\"value\":\"%s\"},", getChannelText(text, sizeof(text), key), value);
+    this->_points++;
+  }
+
+  return length;
+}
+
+size_t Cloud::appendFeed(size_t length, PGM_P key, float value, uint8_t decimals, uint8_t quality)
+{
+  if (length < CLOUD_BODY_SIZE && !(quality & QUALITY_EXCLUDE_MASK))
+  {
+    char text[CHANNEL_TEXT_SIZE];
+    length += snprintf(this->_body + length, CLOUD_BODY_SIZE - length, "{\"key\":\"%s\",\"value\":\"%.*f\"},", getChannelText(text, sizeof(text), key), decimals, value);
+    this->_points++;
+  }
+
+  return length;
+}
+
+// ***
+// *** Posts a JSON body to the Adafruit IO REST API once the
+// *** governor has granted the data points in it (_points).
+// *** A 429 response means the account is over its limit (other
+// *** devices may share it) and holds all publishing back. An
+// *** upload that does not reach the server is held back too and
+// *** nothing is tried until the retry delay has passed.
+// ***
+bool Cloud::post(enum publishPriority priority, const char* url, const char* body, size_t length)
+{
+  int code = 0;
+  bool isWaiting = (this->_retryDelay > 0 && (millis() - this->_failedAt) < this->_retryDelay);
+  this->_isDeferred = isWaiting || !this->_governor.acquire(priority, this->_points);
+
+  if (this->_isDeferred)
+  {
+    if (!isWaiting)
+    {
+      this->_governor.defer(priority);
+      Serial.print("Cloud upload deferred; "); Serial.print(this->_governor.getTokens(), 1); Serial.println(" token(s) available.");
+    }
+  }
+  else if (!this->canConnect())
+  {
+    // ***
+    // *** Not enough heap for a second TLS connection next to
+    // *** the MQTT one. The data points are published to their
+    // *** feeds over MQTT instead (the tokens cover them) or, when
+    // *** that is not connected either, held back.
+    // ***
+    if (this->isConnected() && this->publishBody(body))
+    {
+      code = HTTP_CODE_OK;
+      Serial.println("Cloud upload sent over MQTT for lack of heap.");
+    }
+    else
+    {
+      this->_governor.release(this->_points);
+      this->_isDeferred = true;
+      this->retryLater();
+      Serial.print("Cloud upload held back; "); Serial.print(ESP.getMaxFreeBlockSize()); Serial.println(" byte(s) of heap in one block.");
+    }
+  }
+  else
+  {
+    if (this->_http.begin(this->_client, url))
+    {
+      this->_http.addHeader("Content-Type", "application/json");
+      this->_http.addHeader("X-AIO-Key", IO_KEY);
+      code = this->_http.POST((const uint8_t*)body, length);
+      this->_http.end();
+    }
+
+    this->_postedAt = millis();
+
+    if (code == 429)
+    {
+      // ***
+      // *** The request counts against the account but the data
+      // *** was not stored; keep it for later.
+      // ***
+      this->_governor.throttle();
+      this->_governor.defer(priority);
+      this->_isDeferred = true;
+      Serial.println("Cloud account is being throttled; holding uploads back.");
+    }
+    else if (code <= 0)
+    {
+      // ***
+      // *** Only a request that never reached the server gives
+      // *** its tokens back; one that timed out may have been
+      // *** counted (and stored). Either way the data is kept and
+      // *** sent again after the retry delay.
+      // ***
+      if (code == HTTPC_ERROR_CONNECTION_REFUSED)
+      {
+        this->_governor.release(this->_points);
+      }
+
+      this->_client.stop();
+      this->_isDeferred = true;
+      this->retryLater();
+    }
+
+    if ((code < 200 || code >= 300) && code != 429)
+    {
+      Serial.print("Cloud upload failed with code "); Serial.println(code);
+    }
+  }
+
+  if (code >= 200 && code < 300)
+  {
+    this->_retryDelay = 0;
+  }
+
+  return (code >= 200 && code < 300);
+}
+
+// ***
+// *** True if the upload connection is open or there is enough
+// *** heap to open it.
+// ***
+bool Cloud::canConnect()
+{
+  uint32_t buffer = this->_useMaxFragmentLength ? CLOUD_TLS_MFLN_BUFFER : CLOUD_TLS_BUFFER;
+
+  return this->_client.connected() || (ESP.getMaxFreeBlockSize() >= buffer && ESP.getFreeHeap() >= buffer + CLOUD_TLS_OVERHEAD);
+}
+
+// ***
+// *** Publishes the entries of a body to their feeds in the group
+// *** over MQTT. MQTT has no created_at so the data points carry
+// *** the time they arrive.
+// ***
+bool Cloud::publishBody(const char* body)
+{
+  bool returnValue = true;
+  const char* entry = strstr(body, "{\"key\":\"");
+
+  while (returnValue && entry != nullptr)
+  {
+    const char* key = entry + 8;
+    const char* keyEnd = strchr(key, '"');
+    const char* value = (keyEnd != nullptr) ? strstr(keyEnd, "\"value\":\"") : nullptr;
+    const char* valueEnd = (value != nullptr) ? strchr(value + 9, '"') : nullptr;
+
+    if (valueEnd != nullptr)
+    {
+      char name[sizeof(IO_GROUP_KEY) + CHANNEL_TEXT_SIZE + 4];
+      char text[CHANNEL_TEXT_SIZE];
+      snprintf(name, sizeof(name), "%s.%.*s", IO_GROUP_KEY, (int)(keyEnd - key), key);
+      snprintf(text, sizeof(text), "%.*s", (int)(valueEnd - value - 9), value + 9);
+
+      AdafruitIO_Feed* feed = this->_io->feed(name);
+      returnValue = feed->save(text);
+      delete feed;
+
+      entry = strstr(valueEnd, "{\"key\":\"");
+    }
+    else
+    {
+      entry = nullptr;
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Starts (or doubles) the delay before the next upload.
+// ***
+void Cloud::retryLater()
+{
+  this->_failedAt = millis();
+  this->_retryDelay = (this->_retryDelay == 0) ? CLOUD_RETRY_DELAY : min(this->_retryDelay * 2, (uint32_t)CLOUD_RETRY_MAXIMUM);
 }
@@ -18,27 +18,72 @@
 #ifndef CLOUD_H
 #define CLOUD_H
 
-
 #include "Credentials.h"
 #include "AdafruitIO_WiFi.h"
+#include "CloudData.h"
+#include "SensorHealth.h"
+#include "Rollup.h"
+#include "PublishGovernor.h"
+#include <ESP8266HTTPClient.h>
+#include <WiFiClientSecureBearSSL.h>
+#include <time.h>
 
-typedef struct cloudData
-{
-  bool initialized;
+// ***
+// *** The Adafruit IO REST API is used for uploads that carry
+// *** their own timestamp (created_at). All of the sensor feeds
+// *** belong to this group.
+// ***
+#define IO_API_HOST       "io.adafruit.com"
+#define IO_API_PORT       443
+#define IO_GROUP_KEY      "plant-monitor"
+#define IO_GROUP_DATA_URL "https://" IO_API_HOST "/api/v2/" IO_USERNAME "/groups/" IO_GROUP_KEY "/data"
+
+// ***
+// *** Size of the buffer used to build the JSON body. This
+// *** is large enough for a rollup with the minimum and
+// *** maximum of every channel.
+// ***
+#define CLOUD_BODY_SIZE   1664
 
-  float environmentalTemperature;
-  float environmentalRelativeHumidity;
+// ***
+// *** The most data points an uploaded reading can use: the
+// *** channels and derived metrics with the REPORT_CLOUD policy
+// *** and the soil moisture quality.
+// ***
+#define CLOUD_CHANNEL_POINT(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) + (((policy) & REPORT_CLOUD) ? 1 : 0)
+#define CLOUD_METRIC_POINT(id, field, key, label, name, unit, decimals, policy) + (((policy) & REPORT_CLOUD) ? 1 : 0)
+#define CLOUD_READING_POINTS (1 SENSOR_CHANNELS(CLOUD_CHANNEL_POINT) DERIVED_METRICS(CLOUD_METRIC_POINT))
 
-  float soilMoistureLevel;
-  String soilMoistureQuality;
-  float soilTemperature;
+// ***
+// *** Alerts that could not be published for lack of tokens
+// *** are queued (up to this many, the rest are dropped).
+// ***
+#define CLOUD_ALERT_QUEUE 4
+#define CLOUD_ALERT_SIZE  64
 
-  uint16_t spectrumIr;
-  uint16_t spectrumFull;
-  float spectrumLux;
-  uint16_t spectrumVisible;
+// ***
+// *** The REST uploads share one TLS connection which is closed
+// *** once it has been idle this long (ms) to free its buffers.
+// ***
+#define CLOUD_KEEP_ALIVE  15000
 
-} CloudData;
+// ***
+// *** A new TLS connection needs its receive buffer (16 KB, or
+// *** 1 KB when the server accepts the smaller fragment length)
+// *** in one block and about this much more heap for the send
+// *** buffer and the BearSSL state. Without it the upload goes
+// *** through MQTT when it is connected.
+// ***
+#define CLOUD_TLS_BUFFER      16384
+#define CLOUD_TLS_MFLN_BUFFER 1024
+#define CLOUD_TLS_OVERHEAD    6144
+
+// ***
+// *** Uploads that do not reach the server are retried after
+// *** this delay (ms), doubled on each failure up to the maximum.
+// ***
+#define CLOUD_RETRY_DELAY   5000
+#define CLOUD_RETRY_MAXIMUM 300000
 
 class Cloud
 {
@@ -46,31 +91,130 @@ class Cloud
     Cloud();
     void begin();
     void process();
-    void sendData(CloudData);
+    bool sendData(const CloudData&);
+    bool sendData(const CloudData&, time_t);
+    bool publishData(const CloudData&, time_t);
+    bool sendRollup(const RollupBucket*, time_t, bool);
+    bool sendValue(PGM_P, float, uint8_t, time_t);
     void onWaterPumpChanged(AdafruitIODataCallbackType);
     void setWaterPumpSpeed(uint8_t speed);
-    
+    void sendAlert(String);
+    bool postAlert(const char*);
+    PublishGovernor& getGovernor();
+    uint16_t getPendingReadings();
+    uint8_t getPendingAlerts();
+    uint32_t getDroppedAlerts();
+
   private:
     // ***
-    // *** Setup an instance of ther IO service.
+    // *** True if the server supports a smaller TLS fragment
+    // *** length which saves RAM on each HTTPS request.
     // ***
-    AdafruitIO_WiFi* _io;
+    bool _useMaxFragmentLength = false;
 
     // ***
-    // *** Create the data feeds.
+    // *** The connection used by the REST uploads, kept open
+    // *** between requests, and when it was last used.
     // ***
-    AdafruitIO_Feed* _environmentalTemperatureFeed;
-    AdafruitIO_Feed* _environmentalRelativeHumidityFeed;
+    BearSSL::WiFiClientSecure _client;
+    HTTPClient _http;
+    uint32_t _postedAt = 0;
 
-    AdafruitIO_Feed* _soilMoistureLevelFeed;
-    AdafruitIO_Feed* _soilMoistureQualityFeed;
-    AdafruitIO_Feed* _soilTemperatureFeed;
+    // ***
+    // *** Set when an upload did not reach the server; no other
+    // *** is tried until the delay has passed.
+    // ***
+    uint32_t _failedAt = 0;
+    uint32_t _retryDelay = 0;
 
-    AdafruitIO_Feed* _spectrumLuxFeed;
-    AdafruitIO_Feed* _spectrumIrFeed;
-    AdafruitIO_Feed* _spectrumFullFeed;
-    AdafruitIO_Feed* _spectrumVisibleFeed;
+    // ***
+    // *** Buffer used to build request bodies.
+    // ***
+    char _body[CLOUD_BODY_SIZE];
 
+    // ***
+    // *** The data points in the body being built.
+    // ***
+    uint8_t _points = 0;
+
+    // ***
+    // *** The reading (capture tick) partly sent by sendData()
+    // *** and the data entry it is to continue from.
+    // ***
+    uint64_t _dataCapturedAt = 0;
+    uint8_t _dataEntry = 0;
+
+    // ***
+    // *** The same for the rollup (period start) partly sent by
+    // *** sendRollup().
+    // ***
+    time_t _rollupCreatedAt = 0;
+    uint8_t _rollupEntry = 0;
+
+    // ***
+    // *** Every publish goes through the governor. This is set
+    // *** when the last request was held back for lack of tokens
+    // *** (or because the server is throttling the account).
+    // ***
+    PublishGovernor _governor;
+    bool _isDeferred = false;
+
+    // ***
+    // *** Readings held back by publishData(), averaged per
+    // *** channel and derived metric, the capture times of the
+    // *** first and last and the data entry the average is to
+    // *** continue from when it was partly sent. Readings added
+    // *** while it is partly sent only change the entries not
+    // *** sent yet.
+    // ***
+    CloudData _pending;
+    float _pendingSum[CHANNEL_COUNT];
+    uint16_t _pendingCount[CHANNEL_COUNT];
+    float _pendingMetricSum[METRIC_COUNT];
+    uint16_t _pendingMetricCount[METRIC_COUNT];
+    uint8_t _pendingEntry = 0;
+    uint16_t _pendingReadings = 0;
+    time_t _pendingFirst = 0;
+    time_t _pendingLast = 0;
+
+    // ***
+    // *** Control messages waiting for tokens or for MQTT to
+    // *** connect. Only the latest pump speed matters; alerts
+    // *** are kept in order.
+    // ***
+    int16_t _pendingPumpSpeed = -1;
+    char _alerts[CLOUD_ALERT_QUEUE][CLOUD_ALERT_SIZE];
+    uint8_t _alertCount = 0;
+    uint32_t _droppedAlerts = 0;
+
+    size_t beginBody(time_t);
+    bool postBody(enum publishPriority, size_t);
+    bool sendEntries(const CloudData&, time_t, uint8_t&);
+    bool hasDataPoint(const CloudData&, uint8_t);
+    size_t appendData(size_t, const CloudData&, uint8_t);
+    size_t appendRollup(size_t, const RollupBucket*, uint8_t);
+    uint16_t getPendingPoints();
+    size_t appendFeed(size_t, PGM_P, const char*);
+    size_t appendFeed(size_t, PGM_P, float, uint8_t, uint8_t);
+    bool post(enum publishPriority, const char*, const char*, size_t);
+    bool canConnect();
+    bool isConnected();
+    bool publishBody(const char*);
+    void retryLater();
+    void deferData(const CloudData&, time_t);
+    void sendPendingData();
+    void sendPendingControl();
+
+    // ***
+    // *** Setup an instance of ther IO service.
+    // ***
+    AdafruitIO_WiFi* _io;
+
+    // ***
+    // *** The MQTT feeds. The sensor channels are uploaded
+    // *** through the group data API (see SensorChannels.h).
+    // ***
     AdafruitIO_Feed* _waterPumpFeed;
+    AdafruitIO_Feed* _alertFeed;
 };
 #endif
@@ -0,0 +1,203 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "CloudData.h"
+
+// ***
+// *** Everything below is generated from SENSOR_CHANNELS so the
+// *** compiler builds a switch per property; the strings are
+// *** placed in flash and nothing is stored in RAM.
+// ***
+float getChannelValue(const CloudData &data, enum sensorChannel channel)
+{
+  switch (channel)
+  {
+#define CHANNEL_VALUE_CASE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) case id: return data.field;
+    SENSOR_CHANNELS(CHANNEL_VALUE_CASE)
+    default: return NAN;
+  }
+}
+
+void setChannelValue(CloudData &data, enum sensorChannel channel, float value)
+{
+  switch (channel)
+  {
+#define CHANNEL_SET_CASE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) case id: data.field = (type)((decimals) == 0 ? roundf(value) : value); break;
+    SENSOR_CHANNELS(CHANNEL_SET_CASE)
+    default: break;
+  }
+}
+
+PGM_P getChannelKey(enum sensorChannel channel)
+{
+  switch (channel)
+  {
+#define CHANNEL_KEY_CASE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) case id: return PSTR(key);
+    SENSOR_CHANNELS(CHANNEL_KEY_CASE)
+    default: return PSTR("");
+  }
+}
+
+PGM_P getChannelLabel(enum sensorChannel channel)
+{
+  switch (channel)
+  {
+#define CHANNEL_LABEL_CASE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) case id: return PSTR(label);
+    SENSOR_CHANNELS(CHANNEL_LABEL_CASE)
+    default: return PSTR("");
+  }
+}
+
+PGM_P getChannelName(enum sensorChannel channel)
+{
+  switch (channel)
+  {
+#define CHANNEL_NAME_CASE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) case id: return PSTR(name);
+    SENSOR_CHANNELS(CHANNEL_NAME_CASE)
+    default: return PSTR("");
+  }
+}
+
+char* getChannelText(char* buffer, size_t size, PGM_P text)
+{
+  strncpy_P(buffer, text, size - 1);
+  buffer[size - 1] = 0;
+  return buffer;
+}
+
+enum channelUnit getChannelUnit(enum sensorChannel channel)
+{
+  switch (channel)
+  {
+#define CHANNEL_UNIT_CASE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) case id: return unit;
+    SENSOR_CHANNELS(CHANNEL_UNIT_CASE)
+    default: return UNIT_COUNTS;
+  }
+}
+
+uint8_t getChannelDecimals(enum sensorChannel channel)
+{
+  switch (channel)
+  {
+#define CHANNEL_DECIMALS_CASE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) case id: return decimals;
+    SENSOR_CHANNELS(CHANNEL_DECIMALS_CASE)
+    default: return 2;
+  }
+}
+
+uint8_t getChannelPolicy(enum sensorChannel channel)
+{
+  switch (channel)
+  {
+#define CHANNEL_POLICY_CASE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) case id: return policy;
+    SENSOR_CHANNELS(CHANNEL_POLICY_CASE)
+    default: return 0;
+  }
+}
+
+enum sensorDevice getChannelDevice(enum sensorChannel channel)
+{
+  switch (channel)
+  {
+#define CHANNEL_DEVICE_CASE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) case id: return device;
+    SENSOR_CHANNELS(CHANNEL_DEVICE_CASE)
+    default: return DEVICE_COUNT;
+  }
+}
+
+float getChannelSensitivity(enum sensorChannel channel)
+{
+  switch (channel)
+  {
+#define CHANNEL_SENSITIVITY_CASE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) case id: return sensitivity;
+    SENSOR_CHANNELS(CHANNEL_SENSITIVITY_CASE)
+    default: return 0.0;
+  }
+}
+
+// ***
+// *** The same for the derived metrics (see DERIVED_METRICS).
+// ***
+float getMetricValue(const CloudData &data, enum derivedMetric metric)
+{
+  switch (metric)
+  {
+#define METRIC_VALUE_CASE(id, field, key, label, name, unit, decimals, policy) case id: return data.field;
+    DERIVED_METRICS(METRIC_VALUE_CASE)
+    default: return NAN;
+  }
+}
+
+void setMetricValue(CloudData &data, enum derivedMetric metric, float value)
+{
+  switch (metric)
+  {
+#define METRIC_SET_CASE(id, field, key, label, name, unit, decimals, policy) case id: data.field = value; break;
+    DERIVED_METRICS(METRIC_SET_CASE)
+    default: break;
+  }
+}
+
+PGM_P getMetricKey(enum derivedMetric metric)
+{
+  switch (metric)
+  {
+#define METRIC_KEY_CASE(id, field, key, label, name, unit, decimals, policy) case id: return PSTR(key);
+    DERIVED_METRICS(METRIC_KEY_CASE)
+    default: return PSTR("");
+  }
+}
+
+PGM_P getMetricLabel(enum derivedMetric metric)
+{
+  switch (metric)
+  {
+#define METRIC_LABEL_CASE(id, field, key, label, name, unit, decimals, policy) case id: return PSTR(label);
+    DERIVED_METRICS(METRIC_LABEL_CASE)
+    default: return PSTR("");
+  }
+}
+
+enum channelUnit getMetricUnit(enum derivedMetric metric)
+{
+  switch (metric)
+  {
+#define METRIC_UNIT_CASE(id, field, key, label, name, unit, decimals, policy) case id: return unit;
+    DERIVED_METRICS(METRIC_UNIT_CASE)
+    default: return UNIT_COUNTS;
+  }
+}
+
+uint8_t getMetricDecimals(enum derivedMetric metric)
+{
+  switch (metric)
+  {
+#define METRIC_DECIMALS_CASE(id, field, key, label, name, unit, decimals, policy) case id: return decimals;
+    DERIVED_METRICS(METRIC_DECIMALS_CASE)
+    default: return 2;
+  }
+}
+
+uint8_t getMetricPolicy(enum derivedMetric metric)
+{
+  switch (metric)
+  {
+#define METRIC_POLICY_CASE(id, field, key, label, name, unit, decimals, policy) case id: return policy;
+    DERIVED_METRICS(METRIC_POLICY_CASE)
+    default: return 0;
+  }
+}
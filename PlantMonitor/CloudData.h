@@ -0,0 +1,145 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef CLOUD_DATA_H
+#define CLOUD_DATA_H
+
+#include <Arduino.h>
+#include "SensorChannels.h"
+
+// ***
+// *** Identifies each numeric sensor channel (see SensorChannels.h).
+// *** These are used to index the per channel quality flags and
+// *** health monitors.
+// ***
+#define CHANNEL_ENUM(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) id,
+
+enum sensorChannel {
+  SENSOR_CHANNELS(CHANNEL_ENUM)
+  CHANNEL_COUNT
+};
+
+// ***
+// *** Identifies each derived metric (see SensorChannels.h).
+// ***
+#define METRIC_ENUM(id, field, key, label, name, unit, decimals, policy) id,
+
+enum derivedMetric {
+  DERIVED_METRICS(METRIC_ENUM)
+  METRIC_COUNT
+};
+
+typedef struct cloudData
+{
+  bool initialized;
+
+  // ***
+  // *** The monotonic tick (ms, see Clock.h) when the
+  // *** readings were captured.
+  // ***
+  uint64_t capturedAt;
+
+  // ***
+  // *** One member per channel.
+  // ***
+#define CHANNEL_FIELD(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) type field;
+  SENSOR_CHANNELS(CHANNEL_FIELD)
+
+  // ***
+  // *** One member per derived metric (see DerivedMetrics.h).
+  // ***
+#define METRIC_FIELD(id, field, key, label, name, unit, decimals, policy) float field;
+  DERIVED_METRICS(METRIC_FIELD)
+
+  String soilMoistureQuality;
+
+  // ***
+  // *** The quality flags (see SensorHealth.h) of each
+  // *** channel at the time it was read.
+  // ***
+  uint8_t quality[CHANNEL_COUNT];
+
+  // ***
+  // *** The interval (seconds) at which each channel is being
+  // *** read (see AdaptiveSampler.h).
+  // ***
+  uint16_t interval[CHANNEL_COUNT];
+
+} CloudData;
+
+// ***
+// *** Returns the value of a channel from the data structure.
+// ***
+float getChannelValue(const CloudData &data, enum sensorChannel channel);
+
+// ***
+// *** Sets the value of a channel (rounded for integer channels).
+// ***
+void setChannelValue(CloudData &data, enum sensorChannel channel, float value);
+
+// ***
+// *** The size of the buffer needed for the longest
+// *** channel key, label or name (see getChannelText()).
+// ***
+#define CHANNEL_TEXT_SIZE 40
+
+// ***
+// *** Returns the feed key, status label and display name of a
+// *** channel. These are stored in flash (use the _P functions or
+// *** getChannelText() to copy them to RAM).
+// ***
+PGM_P getChannelKey(enum sensorChannel channel);
+PGM_P getChannelLabel(enum sensorChannel channel);
+PGM_P getChannelName(enum sensorChannel channel);
+
+// ***
+// *** Copies a string returned by the functions above into a
+// *** buffer and returns the buffer.
+// ***
+char* getChannelText(char* buffer, size_t size, PGM_P text);
+
+// ***
+// *** Returns the units, decimal places and REPORT_* flags of a channel.
+// ***
+enum channelUnit getChannelUnit(enum sensorChannel channel);
+uint8_t getChannelDecimals(enum sensorChannel channel);
+uint8_t getChannelPolicy(enum sensorChannel channel);
+
+// ***
+// *** Returns the device a channel is read from and the
+// *** smallest change of the channel that is significant.
+// ***
+enum sensorDevice getChannelDevice(enum sensorChannel channel);
+float getChannelSensitivity(enum sensorChannel channel);
+
+// ***
+// *** Returns and sets the value of a derived metric.
+// ***
+float getMetricValue(const CloudData &data, enum derivedMetric metric);
+void setMetricValue(CloudData &data, enum derivedMetric metric, float value);
+
+// ***
+// *** Returns the feed key and status label (in flash), units,
+// *** decimal places and REPORT_* flags of a derived metric.
+// ***
+PGM_P getMetricKey(enum derivedMetric metric);
+PGM_P getMetricLabel(enum derivedMetric metric);
+enum channelUnit getMetricUnit(enum derivedMetric metric);
+uint8_t getMetricDecimals(enum derivedMetric metric);
+uint8_t getMetricPolicy(enum derivedMetric metric);
+
+#endif
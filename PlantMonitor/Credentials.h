@@ -33,4 +33,16 @@
 #define IO_USERNAME   ""
 #define IO_KEY        ""
 
+// ***
+// *** The public key firmware update images are checked with
+// *** (see OtaUpdater.h and Tools/Ota), the PEM text of an
+// *** RSA-2048 key, one string per line:
+// ***
+// ***   "-----BEGIN PUBLIC KEY-----\n" "MIIBIjANBgkqhkiG9w0BAQEFAAOC..." ...
+// ***
+// *** The private key stays with whoever builds the images.
+// *** Updates are turned off while it is empty.
+// ***
+#define OTA_PUBLIC_KEY ""
+
 #endif
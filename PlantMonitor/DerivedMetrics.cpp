@@ -0,0 +1,183 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "DerivedMetrics.h"
+#include "SensorHealth.h"
+
+// ***
+// *** The saturation vapor pressure table: the Magnus formula
+// *** 610.94 * exp(17.625 * T / (T + 243.04)) Pa (Alduchov and
+// *** Eskridge, 1996) from SATURATION_MINIMUM to SATURATION_MAXIMUM
+// *** (Celsius) in steps of one degree. It is in flash (484 bytes)
+// *** so no exp() or log() is needed on the device.
+// ***
+#define SATURATION_MINIMUM  -40
+#define SATURATION_MAXIMUM  80
+#define SATURATION_COUNT    (SATURATION_MAXIMUM - SATURATION_MINIMUM + 1)
+
+static const float _saturationPressure[SATURATION_COUNT] PROGMEM = {
+  18.97, 21.03, 23.30, 25.79, 28.51, 31.49, 34.75, 38.32,
+  42.20, 46.44, 51.06, 56.09, 61.56, 67.51, 73.97, 80.98,
+  88.57, 96.81, 105.72, 115.36, 125.78, 137.04, 149.19, 162.30,
+  176.43, 191.65, 208.03, 225.65, 244.59, 264.93, 286.77, 310.20,
+  335.33, 362.24, 391.06, 421.91, 454.90, 490.16, 527.82, 568.03,
+  610.94, 656.70, 705.46, 757.41, 812.71, 871.56, 934.14, 1000.66,
+  1071.34, 1146.38, 1226.02, 1310.50, 1400.07, 1495.00, 1595.54, 1701.98,
+  1814.62, 1933.77, 2059.73, 2192.84, 2333.44, 2481.89, 2638.55, 2803.81,
+  2978.07, 3161.74, 3355.23, 3559.01, 3773.52, 3999.24, 4236.65, 4486.27,
+  4748.62, 5024.24, 5313.70, 5617.57, 5936.45, 6270.96, 6621.73, 6989.42,
+  7374.72, 7778.31, 8200.93, 8643.31, 9106.22, 9590.45, 10096.80, 10626.12,
+  11179.26, 11757.11, 12360.58, 12990.59, 13648.12, 14334.15, 15049.69, 15795.79,
+  16573.50, 17383.94, 18228.23, 19107.52, 20023.00, 20975.89, 21967.42, 22998.88,
+  24071.58, 25186.85, 26346.08, 27550.65, 28802.02, 30101.66, 31451.07, 32851.80,
+  34305.42, 35813.55, 37377.83, 38999.95, 40681.63, 42424.63, 44230.75, 46101.82,
+  48039.71
+};
+
+float calculateSaturationPressure(float celsius)
+{
+  float returnValue = NAN;
+
+  if (!isnan(celsius))
+  {
+    float position = constrain(celsius, (float)SATURATION_MINIMUM, (float)SATURATION_MAXIMUM) - SATURATION_MINIMUM;
+    uint8_t index = min((uint8_t)position, (uint8_t)(SATURATION_COUNT - 2));
+    float low = pgm_read_float(&_saturationPressure[index]);
+    float high = pgm_read_float(&_saturationPressure[index + 1]);
+
+    returnValue = low + ((high - low) * (position - index));
+  }
+
+  return returnValue;
+}
+
+float calculateDewPoint(float pressure)
+{
+  float returnValue = NAN;
+
+  if (pressure > 0.0 && pressure < pgm_read_float(&_saturationPressure[0]))
+  {
+    // ***
+    // *** The dew point is below the table (very dry, cold air);
+    // *** use the inverse of the formula.
+    // ***
+    float ratio = logf(pressure / 610.94);
+    returnValue = 243.04 * ratio / (17.625 - ratio);
+  }
+  else if (pressure > 0.0)
+  {
+    // ***
+    // *** Find the step of the table the pressure falls in (the
+    // *** last step when above the table) and interpolate.
+    // ***
+    uint8_t low = 0;
+    uint8_t high = SATURATION_COUNT - 1;
+
+    while ((high - low) > 1)
+    {
+      uint8_t middle = (low + high) / 2;
+
+      if (pgm_read_float(&_saturationPressure[middle]) <= pressure)
+      {
+        low = middle;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+
+    float lowPressure = pgm_read_float(&_saturationPressure[low]);
+    float highPressure = pgm_read_float(&_saturationPressure[high]);
+
+    returnValue = SATURATION_MINIMUM + low + ((pressure - lowPressure) / (highPressure - lowPressure));
+  }
+
+  return returnValue;
+}
+
+float calculateHeatIndex(float fahrenheit, float humidity)
+{
+  // ***
+  // *** Ported/converted from Adafruit DHT library.
+  // *** Using both Rothfusz and Steadman's equations
+  // *** http://www.wpc.ncep.noaa.gov/html/heatindex_equation.shtml
+  // ***
+  float returnValue = 0.5 * (fahrenheit + 61.0 + ((fahrenheit - 68.0) * 1.2) + (humidity * 0.094));
+
+  if (returnValue > 79)
+  {
+    // ***
+    // *** The Rothfusz regression with its terms grouped (Horner's
+    // *** rule) so it needs ten multiplications and no pow().
+    // ***
+    returnValue = -42.379 +
+                  fahrenheit * (2.04901523 + (fahrenheit * -0.00683783)) +
+                  humidity * (10.14333127 + (humidity * -0.05481717)) +
+                  fahrenheit * humidity * (-0.22475541 + (fahrenheit * 0.00122874) + (humidity * 0.00085282) + (fahrenheit * humidity * -0.00000199));
+
+    if ((humidity < 13) && (fahrenheit >= 80.0) && (fahrenheit <= 112.0))
+    {
+      returnValue -= ((13.0 - humidity) * 0.25) * sqrtf((17.0 - fabsf(fahrenheit - 95.0)) * 0.05882);
+    }
+    else if ((humidity > 85.0) && (fahrenheit >= 80.0) && (fahrenheit <= 87.0))
+    {
+      returnValue += ((humidity - 85.0) * 0.1) * ((87.0 - fahrenheit) * 0.2);
+    }
+  }
+
+  return returnValue;
+}
+
+void calculateDerivedMetrics(CloudData& data, enum temperatureUnit unit)
+{
+#define METRIC_CLEAR(id, field, key, label, name, unit, decimals, policy) data.field = NAN;
+  DERIVED_METRICS(METRIC_CLEAR)
+
+  if (!(data.quality[CHANNEL_ENVIRONMENTAL_TEMPERATURE] & QUALITY_EXCLUDE_MASK) && !(data.quality[CHANNEL_ENVIRONMENTAL_RELATIVE_HUMIDITY] & QUALITY_EXCLUDE_MASK))
+  {
+    float fahrenheit = (unit == FAHRENHEIT) ? data.environmentalTemperature : (data.environmentalTemperature * 1.8) + 32.0;
+    float celsius = (unit == FAHRENHEIT) ? (data.environmentalTemperature - 32.0) / 1.8 : data.environmentalTemperature;
+    float humidity = constrain(data.environmentalRelativeHumidity, 0.0f, 100.0f);
+
+    // ***
+    // *** The saturation pressure is looked up once and the
+    // *** actual vapor pressure is used for the rest.
+    // ***
+    float saturation = calculateSaturationPressure(celsius);
+    float pressure = saturation * humidity / 100.0;
+
+    // ***
+    // *** The leaf is cooler than the air while the plant is lit.
+    // ***
+    float leafCelsius = celsius;
+
+    if (!(data.quality[CHANNEL_SPECTRUM_LUX] & QUALITY_EXCLUDE_MASK) && data.spectrumLux >= LEAF_LIGHT_LEVEL)
+    {
+      leafCelsius += LEAF_TEMPERATURE_OFFSET;
+    }
+
+    float dewPoint = calculateDewPoint(pressure);
+    float heatIndex = calculateHeatIndex(fahrenheit, humidity);
+
+    data.heatIndex = (unit == FAHRENHEIT) ? heatIndex : (heatIndex - 32.0) / 1.8;
+    data.dewPoint = (unit == FAHRENHEIT) ? (dewPoint * 1.8) + 32.0 : dewPoint;
+    data.airVpd = (saturation - pressure) / 1000.0;
+    data.leafVpd = (calculateSaturationPressure(leafCelsius) - pressure) / 1000.0;
+    data.absoluteHumidity = 2.16679 * pressure / (celsius + 273.15);
+  }
+}
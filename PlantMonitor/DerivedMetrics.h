@@ -0,0 +1,66 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef DERIVED_METRICS_H
+#define DERIVED_METRICS_H
+
+#include <Arduino.h>
+#include "CloudData.h"
+#include "Temperature.h"
+
+// ***
+// *** The leaf temperature used for the leaf VPD. There is no
+// *** leaf (IR) thermometer so the leaf is taken to be at the
+// *** air temperature plus this offset (Celsius) while the plant
+// *** is lit (the light level, lux, is at least LEAF_LIGHT_LEVEL)
+// *** and its stomata are open and cooling it, and at the air
+// *** temperature in the dark.
+// ***
+#define LEAF_TEMPERATURE_OFFSET -2.0
+#define LEAF_LIGHT_LEVEL        1000.0
+
+// ***
+// *** The saturation vapor pressure (Pa) over water at the given
+// *** temperature (Celsius, limited to the DHT22's -40 to 80).
+// *** It is interpolated from a table of the Magnus formula at
+// *** each whole degree; the interpolation adds less than 0.12%
+// *** (at -40 C, less than 0.05% above 20 C) to the formula.
+// ***
+float calculateSaturationPressure(float celsius);
+
+// ***
+// *** The dew point (Celsius) of air with the given vapor
+// *** pressure (Pa). The inverse of the table above (within
+// *** 0.02 C of the formula); NAN when the pressure is not above
+// *** zero.
+// ***
+float calculateDewPoint(float pressure);
+
+// ***
+// *** The heat index (Fahrenheit) of the given temperature
+// *** (Fahrenheit) and relative humidity (%), using Rothfusz and
+// *** Steadman's equations as in the Adafruit DHT library.
+// ***
+float calculateHeatIndex(float fahrenheit, float humidity);
+
+// ***
+// *** Calculates the derived metrics (see DERIVED_METRICS) of a
+// *** sample from its channels. Temperatures in the sample, and
+// *** the temperatures calculated, are in the given units.
+// ***
+void calculateDerivedMetrics(CloudData& data, enum temperatureUnit unit);
+#endif
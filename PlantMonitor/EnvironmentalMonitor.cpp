@@ -16,6 +16,7 @@
 // along with this software. If not, see http://www.gnu.org/licenses/.
 //
 #include "EnvironmentalMonitor.h"
+#include "DerivedMetrics.h"
 
 EnvironmentalMonitor::EnvironmentalMonitor(uint8_t temperaturePin)
 {
@@ -76,36 +77,20 @@ float EnvironmentalMonitor::getRelativeHumidity(bool forceReading)
 float EnvironmentalMonitor::getHeatIndex(enum temperatureUnit unit)
 {
   // ***
-  // *** Ported/converted from Adafruit DHT library.
-  // *** Using both Rothfusz and Steadman's equations
-  // *** http://www.wpc.ncep.noaa.gov/html/heatindex_equation.shtml
+  // *** See DerivedMetrics.h. The sample's heat index is
+  // *** calculated once with the other derived metrics; this is
+  // *** for the last reading of this sensor.
   // ***
-  float temperature = this->convertCtoF(this->_lastReading.temperature);
-  float percentHumidity = this->_lastReading.humidity;
-
-  float hi = 0.5 * (temperature + 61.0 + ((temperature - 68.0) * 1.2) + (percentHumidity * 0.094));
-
-  if (hi > 79)
-  {
-    hi = -42.379 +
-         2.04901523 * temperature +
-         10.14333127 * percentHumidity +
-         -0.22475541 * temperature * percentHumidity +
-         -0.00683783 * pow(temperature, 2) +
-         -0.05481717 * pow(percentHumidity, 2) +
-         0.00122874 * pow(temperature, 2) * percentHumidity +
-         0.00085282 * temperature * pow(percentHumidity, 2) +
-         -0.00000199 * pow(temperature, 2) * pow(percentHumidity, 2);
-
-    if ((percentHumidity < 13) && (temperature >= 80.0) && (temperature <= 112.0))
-    {
-      hi -= ((13.0 - percentHumidity) * 0.25) * sqrt((17.0 - abs(temperature - 95.0)) * 0.05882);
-    }
-    else if ((percentHumidity > 85.0) && (temperature >= 80.0) && (temperature <= 87.0))
-    {
-      hi += ((percentHumidity - 85.0) * 0.1) * ((87.0 - temperature) * 0.2);
-    }
-  }
+  float hi = calculateHeatIndex(this->convertCtoF(this->_lastReading.temperature), this->_lastReading.humidity);
 
   return (unit == FAHRENHEIT) ? hi : this->convertFtoC(hi);
 }
+
+TempAndHumidity EnvironmentalMonitor::getLastReading()
+{
+  // ***
+  // *** Returns the last reading as it came from the sensor
+  // *** (Celsius).
+  // ***
+  return this->_lastReading;
+}
@@ -29,6 +29,7 @@ class EnvironmentalMonitor : Temperature
     float getTemperature(enum temperatureUnit, bool = true);
     float getRelativeHumidity(bool = false);
     float getHeatIndex(enum temperatureUnit);
+    TempAndHumidity getLastReading();
 
   private:
     // ***
@@ -0,0 +1,252 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "OtaImage.h"
+#include "ByteOrder.h"
+#include <string.h>
+
+// ***
+// *** Writes the header with an empty signature. Returns the
+// *** number of bytes written or 0 if the buffer is too small.
+// ***
+size_t otaHeaderWrite(const OtaHeader* header, uint8_t* buffer, size_t size)
+{
+  size_t returnValue = 0;
+
+  if (size >= OTA_HEADER_SIZE)
+  {
+    put32(buffer, OTA_MAGIC);
+    buffer[4] = OTA_VERSION;
+    buffer[5] = header->type;
+    put16(buffer + 6, 0);
+    put32(buffer + 8, header->version);
+    put32(buffer + 12, header->baseVersion);
+    put32(buffer + 16, header->size);
+    put32(buffer + 20, header->baseSize);
+    put32(buffer + 24, header->payloadSize);
+    memcpy(buffer + 28, header->hash, OTA_HASH_SIZE);
+    memcpy(buffer + 60, header->baseHash, OTA_HASH_SIZE);
+    memset(buffer + OTA_SIGNED_SIZE, 0, OTA_SIGNATURE_SIZE);
+    returnValue = OTA_HEADER_SIZE;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Reads the header. The caller checks the signature.
+// ***
+enum otaResult otaHeaderRead(const uint8_t* buffer, size_t length, OtaHeader* header)
+{
+  enum otaResult returnValue = OTA_OK;
+
+  if (length < OTA_HEADER_SIZE)
+  {
+    returnValue = OTA_TOO_SHORT;
+  }
+  else if (get32(buffer) != OTA_MAGIC)
+  {
+    returnValue = OTA_BAD_MAGIC;
+  }
+  else if (buffer[4] != OTA_VERSION || buffer[5] > OTA_TYPE_DELTA)
+  {
+    returnValue = OTA_BAD_VERSION;
+  }
+  else
+  {
+    header->type = buffer[5];
+    header->version = get32(buffer + 8);
+    header->baseVersion = get32(buffer + 12);
+    header->size = get32(buffer + 16);
+    header->baseSize = get32(buffer + 20);
+    header->payloadSize = get32(buffer + 24);
+    memcpy(header->hash, buffer + 28, OTA_HASH_SIZE);
+    memcpy(header->baseHash, buffer + 60, OTA_HASH_SIZE);
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Operation states.
+// ***
+#define OTA_STATE_CONTROL   0
+#define OTA_STATE_OFFSET    1
+#define OTA_STATE_DATA      2
+
+void otaDecoderBegin(OtaDecoder* decoder, const OtaHeader* header, uint8_t* window, otaReadBase readBase, otaWriteOutput writeOutput, void* context)
+{
+  memset(decoder, 0, sizeof(OtaDecoder));
+  decoder->header = header;
+  decoder->window = window;
+  decoder->readBase = readBase;
+  decoder->writeOutput = writeOutput;
+  decoder->context = context;
+  decoder->bit = 8;
+  decoder->state = OTA_STATE_CONTROL;
+  decoder->isValid = (window != NULL && writeOutput != NULL && (header->type == OTA_TYPE_FULL || readBase != NULL));
+}
+
+static void flushOutput(OtaDecoder* decoder)
+{
+  if (decoder->outputLength > 0)
+  {
+    decoder->isValid = decoder->writeOutput(decoder->context, decoder->output, decoder->outputLength);
+    decoder->outputLength = 0;
+  }
+}
+
+static void outputByte(OtaDecoder* decoder, uint8_t b)
+{
+  decoder->output[decoder->outputLength++] = b;
+  decoder->produced++;
+  decoder->remaining--;
+
+  if (decoder->remaining == 0)
+  {
+    decoder->state = OTA_STATE_CONTROL;
+  }
+
+  if (decoder->outputLength == OTA_OUTPUT_SIZE)
+  {
+    flushOutput(decoder);
+  }
+}
+
+// ***
+// *** Applies one expanded payload byte to the operations.
+// ***
+static void applyByte(OtaDecoder* decoder, uint8_t b)
+{
+  if (decoder->state == OTA_STATE_DATA)
+  {
+    outputByte(decoder, (decoder->op == OTA_OP_ADD) ? (uint8_t)(b + decoder->readBase(decoder->context, decoder->basePosition++)) : b);
+  }
+  else if (decoder->shift > 28)
+  {
+    decoder->isValid = false;
+  }
+  else
+  {
+    decoder->value |= (uint32_t)(b & 0x7F) << decoder->shift;
+    decoder->shift += 7;
+
+    if ((b & 0x80) == 0 && decoder->state == OTA_STATE_CONTROL)
+    {
+      decoder->op = decoder->value & 3;
+      decoder->remaining = decoder->value >> 2;
+      decoder->isValid = (decoder->remaining <= decoder->header->size - decoder->produced) &&
+                         (decoder->op == OTA_OP_LITERAL || (decoder->header->type == OTA_TYPE_DELTA && decoder->op <= OTA_OP_ADD));
+      decoder->state = (decoder->op != OTA_OP_LITERAL) ? OTA_STATE_OFFSET : (decoder->remaining > 0 ? OTA_STATE_DATA : OTA_STATE_CONTROL);
+      decoder->value = 0;
+      decoder->shift = 0;
+    }
+    else if ((b & 0x80) == 0)
+    {
+      // ***
+      // *** The base position moves by a zigzag encoded amount.
+      // ***
+      int64_t position = (int64_t)decoder->basePosition + unzigzag(decoder->value);
+      decoder->isValid = (position >= 0 && position + decoder->remaining <= decoder->header->baseSize);
+      decoder->basePosition = (uint32_t)position;
+      decoder->state = (decoder->remaining > 0) ? OTA_STATE_DATA : OTA_STATE_CONTROL;
+      decoder->value = 0;
+      decoder->shift = 0;
+
+      // ***
+      // *** A copy takes nothing more from the payload.
+      // ***
+      while (decoder->isValid && decoder->op == OTA_OP_COPY && decoder->state == OTA_STATE_DATA)
+      {
+        outputByte(decoder, decoder->readBase(decoder->context, decoder->basePosition++));
+      }
+    }
+  }
+}
+
+// ***
+// *** Keeps an expanded byte in the window for later references
+// *** and applies it.
+// ***
+static void expandByte(OtaDecoder* decoder, uint8_t b)
+{
+  decoder->window[decoder->windowPosition % OTA_WINDOW_SIZE] = b;
+  decoder->windowPosition++;
+  applyByte(decoder, b);
+}
+
+// ***
+// *** Expands the next part of the payload (see
+// *** telemetryBatchExpand()). Returns false when the payload is
+// *** not valid or the output has stopped the update.
+// ***
+bool otaDecoderAdd(OtaDecoder* decoder, const uint8_t* data, size_t length)
+{
+  decoder->isValid = decoder->isValid && (length <= decoder->header->payloadSize - decoder->payloadRead);
+  decoder->payloadRead += decoder->isValid ? length : 0;
+
+  for (size_t i = 0; decoder->isValid && i < length; i++)
+  {
+    if (decoder->bit == 8)
+    {
+      decoder->control = data[i];
+      decoder->bit = 0;
+    }
+    else if (decoder->control & (1 << decoder->bit))
+    {
+      decoder->token[decoder->tokenLength++] = data[i];
+
+      if (decoder->tokenLength == 2)
+      {
+        uint32_t offset = (decoder->token[0] | ((uint32_t)(decoder->token[1] >> 4) << 8)) + 1;
+        uint8_t count = (decoder->token[1] & 0x0F) + 3;
+        decoder->isValid = (offset <= decoder->windowPosition);
+
+        for (uint8_t k = 0; decoder->isValid && k < count; k++)
+        {
+          expandByte(decoder, decoder->window[(decoder->windowPosition - offset) % OTA_WINDOW_SIZE]);
+        }
+
+        decoder->tokenLength = 0;
+        decoder->bit++;
+      }
+    }
+    else
+    {
+      expandByte(decoder, data[i]);
+      decoder->bit++;
+    }
+  }
+
+  return decoder->isValid;
+}
+
+// ***
+// *** Writes the last of the firmware. Returns true if the whole
+// *** payload was read and it produced a firmware of the size in
+// *** the header.
+// ***
+bool otaDecoderFinish(OtaDecoder* decoder)
+{
+  if (decoder->isValid)
+  {
+    flushOutput(decoder);
+  }
+
+  return decoder->isValid && decoder->payloadRead == decoder->header->payloadSize && decoder->tokenLength == 0 &&
+         decoder->state == OTA_STATE_CONTROL && decoder->shift == 0 && decoder->produced == decoder->header->size;
+}
@@ -0,0 +1,185 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef OTA_IMAGE_H
+#define OTA_IMAGE_H
+
+// ***
+// *** The firmware update image format. This file does not depend
+// *** on the Arduino core so that it can be shared with the Linux
+// *** tool that builds the images (see Tools/Ota).
+// ***
+#include <stdint.h>
+#include <stddef.h>
+
+#define OTA_MAGIC             0x544F4D50    // "PMOT" (little endian)
+#define OTA_VERSION           2
+
+// ***
+// *** Image types. A full image rebuilds the firmware from the
+// *** image alone; a delta image also reads the firmware that is
+// *** running (the base), which must be the one it was built from.
+// ***
+#define OTA_TYPE_FULL         0
+#define OTA_TYPE_DELTA        1
+
+// ***
+// *** Image layout (all fields little endian):
+// ***
+// ***   0  uint32  magic
+// ***   4  uint8   version
+// ***   5  uint8   type
+// ***   6  uint16  reserved
+// ***   8  uint32  firmware version of the image
+// ***  12  uint32  firmware version of the base (delta only)
+// ***  16  uint32  firmware size (bytes)
+// ***  20  uint32  base size (delta only)
+// ***  24  uint32  payload size (bytes following the header)
+// ***  28  uint8   SHA-256 of the firmware [32]
+// ***  60  uint8   SHA-256 of the base [32] (delta only)
+// ***  92  uint8   signature of bytes 0 to 91 [256]
+// *** 348  payload
+// ***
+// *** The signature is RSA-2048 (PKCS #1 v1.5 over the SHA-256 of
+// *** the bytes). The images are signed with a private key that
+// *** only the tool that builds them reads; the devices hold the
+// *** public key and check the signature with the core's BearSSL
+// *** (see OtaUpdater.cpp). The header carries the hash of the
+// *** firmware, which is checked before the update is committed,
+// *** so the whole image is authenticated.
+// ***
+// *** The payload is a list of operations compressed with LZSS
+// *** (the same tokens as the telemetry batches, see
+// *** TelemetryBatch.h, with an OTA_WINDOW_SIZE window). Each
+// *** operation starts with a varint of (length << 2 | op):
+// ***
+// ***   OTA_OP_LITERAL  length bytes of the firmware follow.
+// ***   OTA_OP_COPY     a zigzag varint moves the base position,
+// ***                   then length bytes are copied from the
+// ***                   base.
+// ***   OTA_OP_ADD      a zigzag varint moves the base position,
+// ***                   then length bytes follow; each one is
+// ***                   added to the base byte at that position
+// ***                   (bsdiff style, so code that has moved
+// ***                   and changed a few addresses is mostly
+// ***                   zeros and compresses well).
+// ***
+// *** The base position starts at 0 and is left after the last
+// *** byte used. A full image is a single literal.
+// ***
+#define OTA_HEADER_SIZE       348
+#define OTA_SIGNED_SIZE       92
+#define OTA_SIGNATURE_SIZE    256
+#define OTA_HASH_SIZE         32
+#define OTA_OP_LITERAL        0
+#define OTA_OP_COPY           1
+#define OTA_OP_ADD            2
+
+// ***
+// *** The decompression window (bytes of RAM) and the size of
+// *** the chunks the firmware is written in.
+// ***
+#define OTA_WINDOW_SIZE       4096
+#define OTA_OUTPUT_SIZE       256
+
+typedef struct otaHeader
+{
+  uint8_t type;
+  uint32_t version;
+  uint32_t baseVersion;
+  uint32_t size;
+  uint32_t baseSize;
+  uint32_t payloadSize;
+  uint8_t hash[OTA_HASH_SIZE];
+  uint8_t baseHash[OTA_HASH_SIZE];
+} OtaHeader;
+
+enum otaResult {
+  OTA_OK,
+  OTA_TOO_SHORT,
+  OTA_BAD_MAGIC,
+  OTA_BAD_VERSION,
+  OTA_BAD_SIGNATURE,
+  OTA_BAD_BASE,
+  OTA_BAD_PAYLOAD,
+  OTA_BAD_HASH,
+  OTA_NO_MEMORY,
+  OTA_NO_UPDATE,
+  OTA_NOT_FOUND,
+  OTA_TRANSFER_FAILED,
+  OTA_WRITE_FAILED
+};
+
+// ***
+// *** The signature is left to the caller: otaHeaderWrite() clears
+// *** it and otaHeaderRead() does not check it.
+// ***
+size_t otaHeaderWrite(const OtaHeader* header, uint8_t* buffer, size_t size);
+enum otaResult otaHeaderRead(const uint8_t* buffer, size_t length, OtaHeader* header);
+
+// ***
+// *** Rebuilds the firmware from the payload as it arrives, in
+// *** pieces of any size. The caller provides the window and two
+// *** functions: one reads a byte of the base, the other receives
+// *** the firmware in chunks of up to OTA_OUTPUT_SIZE bytes and
+// *** returns false to stop.
+// ***
+typedef uint8_t (*otaReadBase)(void* context, uint32_t position);
+typedef bool (*otaWriteOutput)(void* context, const uint8_t* data, size_t length);
+
+typedef struct otaDecoder
+{
+  const OtaHeader* header;
+  otaReadBase readBase;
+  otaWriteOutput writeOutput;
+  void* context;
+  bool isValid;
+
+  // ***
+  // *** LZSS state.
+  // ***
+  uint8_t* window;
+  uint32_t windowPosition;
+  uint8_t control;
+  uint8_t bit;
+  uint8_t token[2];
+  uint8_t tokenLength;
+  uint32_t payloadRead;
+
+  // ***
+  // *** Operation state.
+  // ***
+  uint8_t state;
+  uint8_t op;
+  uint8_t shift;
+  uint32_t value;
+  uint32_t remaining;
+  uint32_t basePosition;
+
+  // ***
+  // *** The firmware bytes rebuilt so far.
+  // ***
+  uint32_t produced;
+  uint8_t output[OTA_OUTPUT_SIZE];
+  uint16_t outputLength;
+} OtaDecoder;
+
+void otaDecoderBegin(OtaDecoder* decoder, const OtaHeader* header, uint8_t* window, otaReadBase readBase, otaWriteOutput writeOutput, void* context);
+bool otaDecoderAdd(OtaDecoder* decoder, const uint8_t* data, size_t length);
+bool otaDecoderFinish(OtaDecoder* decoder);
+
+#endif
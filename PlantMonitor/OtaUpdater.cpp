@@ -0,0 +1,591 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "OtaUpdater.h"
+#include <Updater.h>
+#include <new>
+
+OtaStream::OtaStream(OtaUpdater& otaUpdater) : _otaUpdater(otaUpdater)
+{
+}
+
+// ***
+// *** Returning less than was given stops the transfer.
+// ***
+size_t OtaStream::write(uint8_t value)
+{
+  return this->write(&value, 1);
+}
+
+size_t OtaStream::write(const uint8_t* data, size_t length)
+{
+  return this->_otaUpdater.receive(data, length) ? length : 0;
+}
+
+int OtaStream::available()
+{
+  return 0;
+}
+
+int OtaStream::read()
+{
+  return -1;
+}
+
+int OtaStream::peek()
+{
+  return -1;
+}
+
+void OtaStream::flush()
+{
+}
+
+OtaUpdater::OtaUpdater(RtcMemory& rtcMemory) : _rtcMemory(rtcMemory), _stream(*this)
+{
+}
+
+// ***
+// *** Counts the boots of a new firmware. The state in RTC memory
+// *** must have been loaded (see RtcMemory::begin()).
+// ***
+void OtaUpdater::begin(uint32_t version, const char* url, const char* publicKey)
+{
+  this->_version = version;
+  this->_url = url;
+  this->_publicKey = publicKey;
+
+  RtcOta& ota = this->_rtcMemory.getState().ota;
+
+  if (ota.magic != RTC_OTA_MAGIC)
+  {
+    memset(&ota, 0, sizeof(RtcOta));
+    ota.magic = RTC_OTA_MAGIC;
+    ota.version = version;
+  }
+  else if (ota.state == OTA_BOOT_PENDING && ota.version != version)
+  {
+    // ***
+    // *** The boot loader did not install the new firmware.
+    // ***
+    ota.state = OTA_BOOT_NONE;
+    ota.failedVersion = ota.version;
+    ota.version = version;
+  }
+  else if (ota.state == OTA_BOOT_PENDING)
+  {
+    ota.attempts++;
+
+    if (ota.attempts > OTA_BOOT_ATTEMPTS)
+    {
+      ota.state = OTA_BOOT_ROLLBACK;
+      ota.failedVersion = version;
+    }
+  }
+  else if (ota.state == OTA_BOOT_ROLLBACK && ota.version != version)
+  {
+    // ***
+    // *** Another firmware was installed (over the serial port).
+    // ***
+    ota.state = OTA_BOOT_NONE;
+    ota.version = version;
+  }
+  else if (ota.state == OTA_BOOT_NONE)
+  {
+    ota.version = version;
+  }
+
+  this->saveState();
+}
+
+bool OtaUpdater::isEnabled()
+{
+  return this->_url[0] != 0 && this->_publicKey[0] != 0;
+}
+
+uint32_t OtaUpdater::getVersion()
+{
+  return this->_version;
+}
+
+// ***
+// *** Asks the server for the latest version. Returns it when
+// *** it is not the firmware running (or one that was rolled
+// *** back), otherwise 0.
+// ***
+uint32_t OtaUpdater::checkForUpdate()
+{
+  uint32_t returnValue = 0;
+
+  if (this->isEnabled())
+  {
+    char url[128];
+    snprintf_P(url, sizeof(url), PSTR("%s/latest"), this->_url);
+
+    WiFiClient client;
+    HTTPClient http;
+    http.setTimeout(OTA_TIMEOUT);
+
+    if (http.begin(client, url))
+    {
+      if (http.GET() == HTTP_CODE_OK)
+      {
+        uint32_t latest = strtoul(http.getString().c_str(), NULL, 10);
+        returnValue = (latest != this->_version && latest != this->_rtcMemory.getState().ota.failedVersion) ? latest : 0;
+      }
+
+      http.end();
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Installs the version, from a delta image when the server
+// *** has one for the firmware running. The new firmware runs
+// *** after a restart.
+// ***
+enum otaResult OtaUpdater::update(uint32_t version)
+{
+  enum otaResult returnValue = OTA_NO_UPDATE;
+
+  if (this->isEnabled() && version != 0 && version != this->_version)
+  {
+    returnValue = this->install(version, true);
+
+    if (returnValue == OTA_OK)
+    {
+      RtcOta& ota = this->_rtcMemory.getState().ota;
+      ota.state = OTA_BOOT_PENDING;
+      ota.attempts = 0;
+      ota.previousVersion = this->_version;
+      ota.version = version;
+      this->saveState();
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Installs the firmware that ran before the one that failed
+// *** (a full image; the delta images start from released
+// *** firmware).
+// ***
+enum otaResult OtaUpdater::rollback()
+{
+  enum otaResult returnValue = OTA_NO_UPDATE;
+  RtcOta& ota = this->_rtcMemory.getState().ota;
+
+  if (this->isEnabled() && ota.state == OTA_BOOT_ROLLBACK && ota.previousVersion != 0)
+  {
+    returnValue = this->install(ota.previousVersion, false);
+
+    if (returnValue == OTA_OK)
+    {
+      ota.state = OTA_BOOT_NONE;
+      ota.attempts = 0;
+      ota.version = ota.previousVersion;
+      this->saveState();
+    }
+  }
+
+  return returnValue;
+}
+
+bool OtaUpdater::isPending()
+{
+  return this->_rtcMemory.getState().ota.state == OTA_BOOT_PENDING;
+}
+
+bool OtaUpdater::isRollbackNeeded()
+{
+  return this->_rtcMemory.getState().ota.state == OTA_BOOT_ROLLBACK;
+}
+
+// ***
+// *** The new firmware works; it is no longer rolled back.
+// ***
+void OtaUpdater::confirm()
+{
+  if (this->isPending())
+  {
+    this->_rtcMemory.getState().ota.state = OTA_BOOT_NONE;
+    this->saveState();
+  }
+}
+
+uint8_t OtaUpdater::getBootAttempts()
+{
+  return this->_rtcMemory.getState().ota.attempts;
+}
+
+uint32_t OtaUpdater::getPreviousVersion()
+{
+  return this->_rtcMemory.getState().ota.previousVersion;
+}
+
+uint32_t OtaUpdater::getFailedVersion()
+{
+  return this->_rtcMemory.getState().ota.failedVersion;
+}
+
+// ***
+// *** The last transfer: the type of image, the size of the
+// *** firmware it held, the bytes received and the time (ms).
+// ***
+uint8_t OtaUpdater::getImageType()
+{
+  return this->_imageType;
+}
+
+uint32_t OtaUpdater::getFirmwareSize()
+{
+  return this->_firmwareSize;
+}
+
+uint32_t OtaUpdater::getTransferSize()
+{
+  return this->_transferSize;
+}
+
+uint32_t OtaUpdater::getTransferTime()
+{
+  return this->_transferTime;
+}
+
+PGM_P OtaUpdater::getResultName(enum otaResult result)
+{
+  PGM_P returnValue = PSTR("unknown");
+
+  switch (result)
+  {
+    case OTA_OK:              returnValue = PSTR("ok"); break;
+    case OTA_TOO_SHORT:       returnValue = PSTR("image too short"); break;
+    case OTA_BAD_MAGIC:       returnValue = PSTR("not an image"); break;
+    case OTA_BAD_VERSION:     returnValue = PSTR("wrong version"); break;
+    case OTA_BAD_SIGNATURE:   returnValue = PSTR("bad signature"); break;
+    case OTA_BAD_BASE:        returnValue = PSTR("built for another firmware"); break;
+    case OTA_BAD_PAYLOAD:     returnValue = PSTR("bad payload"); break;
+    case OTA_BAD_HASH:        returnValue = PSTR("firmware hash mismatch"); break;
+    case OTA_NO_MEMORY:       returnValue = PSTR("out of memory or flash"); break;
+    case OTA_NO_UPDATE:       returnValue = PSTR("no update"); break;
+    case OTA_NOT_FOUND:       returnValue = PSTR("not found"); break;
+    case OTA_TRANSFER_FAILED: returnValue = PSTR("transfer failed"); break;
+    case OTA_WRITE_FAILED:    returnValue = PSTR("flash write failed"); break;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Receives the next part of the image. Returns false to stop
+// *** the transfer.
+// ***
+bool OtaUpdater::receive(const uint8_t* data, size_t length)
+{
+  bool returnValue = (this->_result == OTA_OK);
+  size_t used = 0;
+
+  if (returnValue && this->_transferSize < OTA_HEADER_SIZE)
+  {
+    used = min(length, (size_t)(OTA_HEADER_SIZE - this->_transferSize));
+    memcpy(this->_workspace->headerData + this->_transferSize, data, used);
+
+    if (this->_transferSize + used == OTA_HEADER_SIZE)
+    {
+      this->startUpdate();
+      returnValue = (this->_result == OTA_OK);
+    }
+  }
+
+  this->_transferSize += length;
+
+  if (returnValue && used < length)
+  {
+    returnValue = otaDecoderAdd(&this->_workspace->decoder, data + used, length - used);
+
+    if (!returnValue && this->_result == OTA_OK)
+    {
+      this->_result = OTA_BAD_PAYLOAD;
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Allocates the buffers and tries the delta image (when
+// *** allowed) then the full image.
+// ***
+enum otaResult OtaUpdater::install(uint32_t version, bool useDelta)
+{
+  enum otaResult returnValue = OTA_NO_MEMORY;
+  this->_workspace = new (std::nothrow) OtaWorkspace;
+
+  if (this->_workspace)
+  {
+    returnValue = OTA_NOT_FOUND;
+
+    if (useDelta)
+    {
+      this->computeBaseHash();
+      returnValue = this->fetch(version, true);
+    }
+
+    if (returnValue == OTA_NOT_FOUND || returnValue == OTA_BAD_BASE)
+    {
+      returnValue = this->fetch(version, false);
+    }
+
+    delete this->_workspace;
+    this->_workspace = NULL;
+  }
+
+  return returnValue;
+}
+
+enum otaResult OtaUpdater::fetch(uint32_t version, bool isDelta)
+{
+  char url[128];
+
+  if (isDelta)
+  {
+    snprintf_P(url, sizeof(url), PSTR("%s/%lu-%lu.pmota"), this->_url, (unsigned long)this->_version, (unsigned long)version);
+  }
+  else
+  {
+    snprintf_P(url, sizeof(url), PSTR("%s/%lu.pmota"), this->_url, (unsigned long)version);
+  }
+
+  this->_result = OTA_OK;
+  this->_requestedVersion = version;
+  this->_heldLength = 0;
+  this->_flashAddress = UINT32_MAX;
+  this->_firmwareSize = 0;
+  this->_transferSize = 0;
+  uint32_t startedAt = millis();
+  int code = 0;
+
+  WiFiClient client;
+  HTTPClient http;
+  http.setTimeout(OTA_TIMEOUT);
+
+  if (http.begin(client, url))
+  {
+    code = http.GET();
+
+    if (code == HTTP_CODE_OK && http.writeToStream(&this->_stream) < 0 && this->_result == OTA_OK)
+    {
+      this->_result = OTA_TRANSFER_FAILED;
+    }
+
+    http.end();
+  }
+
+  if (code == HTTP_CODE_NOT_FOUND)
+  {
+    this->_result = OTA_NOT_FOUND;
+  }
+  else if (code != HTTP_CODE_OK)
+  {
+    this->_result = OTA_TRANSFER_FAILED;
+  }
+  else if (this->_result == OTA_OK && this->_transferSize < OTA_HEADER_SIZE)
+  {
+    this->_result = OTA_TOO_SHORT;
+  }
+  else if (this->_result == OTA_OK)
+  {
+    this->finishUpdate();
+  }
+
+  // ***
+  // *** An update that is not complete is abandoned.
+  // ***
+  if (Update.isRunning())
+  {
+    Update.end();
+  }
+
+  this->_transferTime = millis() - startedAt;
+
+  return this->_result;
+}
+
+// ***
+// *** Called when the header has arrived.
+// ***
+void OtaUpdater::startUpdate()
+{
+  OtaHeader& header = this->_workspace->header;
+  this->_result = otaHeaderRead(this->_workspace->headerData, OTA_HEADER_SIZE, &header);
+
+  if (this->_result == OTA_OK && !this->isSigned())
+  {
+    this->_result = OTA_BAD_SIGNATURE;
+  }
+  else if (this->_result == OTA_OK && header.version != this->_requestedVersion)
+  {
+    this->_result = OTA_BAD_VERSION;
+  }
+  else if (this->_result == OTA_OK && header.type == OTA_TYPE_DELTA &&
+           (header.baseVersion != this->_version || header.baseSize != ESP.getSketchSize() || !this->_hasBaseHash ||
+            memcmp(header.baseHash, this->_baseHash, OTA_HASH_SIZE) != 0))
+  {
+    this->_result = OTA_BAD_BASE;
+  }
+  else if (this->_result == OTA_OK && !Update.begin(header.size))
+  {
+    this->_result = OTA_NO_MEMORY;
+  }
+  else if (this->_result == OTA_OK)
+  {
+    this->_imageType = header.type;
+    this->_firmwareSize = header.size;
+    this->_workspace->hash.begin();
+    otaDecoderBegin(&this->_workspace->decoder, &header, this->_workspace->window, OtaUpdater::readBase, OtaUpdater::writeOutput, this);
+  }
+}
+
+// ***
+// *** Checks the signature of the header with the public key
+// *** (an RSA-2048 key, see OtaImage.h).
+// ***
+bool OtaUpdater::isSigned()
+{
+  BearSSL::PublicKey key(this->_publicKey);
+  BearSSL::SigningVerifier verifier(&key);
+  BearSSL::HashSHA256 hash;
+
+  hash.begin();
+  hash.add(this->_workspace->headerData, OTA_SIGNED_SIZE);
+  hash.end();
+
+  return key.isRSA() && verifier.verify(&hash, this->_workspace->headerData + OTA_SIGNED_SIZE, OTA_SIGNATURE_SIZE);
+}
+
+// ***
+// *** The last piece of the firmware is held back until the
+// *** firmware matches the hash in the header; without it the
+// *** update cannot be committed.
+// ***
+bool OtaUpdater::finishUpdate()
+{
+  bool isExpanded = otaDecoderFinish(&this->_workspace->decoder);
+
+  if (isExpanded)
+  {
+    this->_workspace->hash.end();
+  }
+
+  if (!isExpanded)
+  {
+    this->_result = (this->_result == OTA_OK) ? OTA_BAD_PAYLOAD : this->_result;
+  }
+  else if (memcmp(this->_workspace->hash.hash(), this->_workspace->header.hash, OTA_HASH_SIZE) != 0)
+  {
+    this->_result = OTA_BAD_HASH;
+  }
+  else if (Update.write(this->_workspace->held, this->_heldLength) != this->_heldLength || !Update.end())
+  {
+    this->_result = OTA_WRITE_FAILED;
+  }
+
+  return this->_result == OTA_OK;
+}
+
+// ***
+// *** The hash of the firmware running, which a delta image must
+// *** have been built from. It does not change until a restart.
+// ***
+void OtaUpdater::computeBaseHash()
+{
+  if (!this->_hasBaseHash)
+  {
+    uint32_t size = ESP.getSketchSize();
+    BearSSL::HashSHA256& hash = this->_workspace->hash;
+    hash.begin();
+
+    for (uint32_t address = 0; address < size; address += OTA_FLASH_READ_SIZE)
+    {
+      ESP.flashRead(address, this->_workspace->flash, OTA_FLASH_READ_SIZE);
+      hash.add(this->_workspace->flash, min((uint32_t)OTA_FLASH_READ_SIZE, size - address));
+      yield();
+    }
+
+    hash.end();
+    memcpy(this->_baseHash, hash.hash(), OTA_HASH_SIZE);
+    this->_hasBaseHash = true;
+  }
+}
+
+// ***
+// *** Writes the piece held back and holds this one. A copy from
+// *** the base can write the whole firmware without reading from
+// *** the network, so the other tasks are given time here.
+// ***
+bool OtaUpdater::writeFirmware(const uint8_t* data, size_t length)
+{
+  bool returnValue = (this->_heldLength == 0 || Update.write(this->_workspace->held, this->_heldLength) == this->_heldLength);
+  yield();
+
+  if (returnValue)
+  {
+    this->_workspace->hash.add(data, length);
+    memcpy(this->_workspace->held, data, length);
+    this->_heldLength = length;
+  }
+  else
+  {
+    this->_result = OTA_WRITE_FAILED;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** The firmware running starts at address 0 of the flash.
+// ***
+uint8_t OtaUpdater::readFlash(uint32_t position)
+{
+  uint32_t address = position - (position % OTA_FLASH_READ_SIZE);
+
+  if (address != this->_flashAddress)
+  {
+    ESP.flashRead(address, this->_workspace->flash, OTA_FLASH_READ_SIZE);
+    this->_flashAddress = address;
+  }
+
+  return ((const uint8_t*)this->_workspace->flash)[position - address];
+}
+
+void OtaUpdater::saveState()
+{
+  this->_rtcMemory.write(&this->_rtcMemory.getState().ota, sizeof(RtcOta));
+}
+
+uint8_t OtaUpdater::readBase(void* context, uint32_t position)
+{
+  return ((OtaUpdater*)context)->readFlash(position);
+}
+
+bool OtaUpdater::writeOutput(void* context, const uint8_t* data, size_t length)
+{
+  return ((OtaUpdater*)context)->writeFirmware(data, length);
+}
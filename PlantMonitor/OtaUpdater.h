@@ -0,0 +1,169 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef OTA_UPDATER_H
+#define OTA_UPDATER_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266HTTPClient.h>
+#include <BearSSLHelpers.h>
+#include "OtaImage.h"
+#include "RtcMemory.h"
+
+// ***
+// *** The update server is a plain HTTP server on the local
+// *** network (any static file server will do) holding:
+// ***
+// ***   <url>/latest              The latest firmware version (text).
+// ***   <url>/<from>-<to>.pmota   Delta images from each released
+// ***                             version to the latest.
+// ***   <url>/<to>.pmota          A full image of each version.
+// ***
+// *** Images are built and signed by Tools/Ota/otadelta. An
+// *** empty URL (or public key, see Credentials.h) turns updates
+// *** off.
+// ***
+#define OTA_SERVER_URL        ""
+#define OTA_TIMEOUT           10000
+
+// ***
+// *** A new firmware is confirmed once it has run for
+// *** OTA_CONFIRM_TIME (or completed a duty cycle). If it restarts
+// *** more than OTA_BOOT_ATTEMPTS times first, the previous
+// *** firmware is installed again.
+// ***
+#define OTA_BOOT_ATTEMPTS     3
+#define OTA_CONFIRM_TIME      1000 * 60 * 5
+
+// ***
+// *** Flash is read for delta images this many bytes at a time.
+// ***
+#define OTA_FLASH_READ_SIZE   256
+
+// ***
+// *** The buffers used while an update runs. They are allocated
+// *** for the update only, about 5 KB.
+// ***
+typedef struct otaWorkspace
+{
+  OtaHeader header;
+  OtaDecoder decoder;
+  BearSSL::HashSHA256 hash;
+  uint8_t headerData[OTA_HEADER_SIZE];
+  uint8_t window[OTA_WINDOW_SIZE];
+  uint8_t held[OTA_OUTPUT_SIZE];
+  uint32_t flash[OTA_FLASH_READ_SIZE / 4];
+} OtaWorkspace;
+
+// ***
+// *** Receives the response of the update server.
+// ***
+class OtaUpdater;
+
+class OtaStream : public Stream
+{
+  public:
+    OtaStream(OtaUpdater&);
+    size_t write(uint8_t);
+    size_t write(const uint8_t*, size_t);
+    int available();
+    int read();
+    int peek();
+    void flush();
+
+  private:
+    OtaUpdater& _otaUpdater;
+};
+
+// ***
+// *** Installs new firmware from the update server. A delta image
+// *** (built from the firmware that is running) is used when the
+// *** server has one, otherwise a full image. The image is
+// *** expanded and written to flash as it arrives, the signature
+// *** of the header is checked with the public key and the
+// *** firmware is checked against the hash in it before the
+// *** update is committed; the boot loader copies the new
+// *** firmware into place on the next restart.
+// ***
+// *** The ESP8266 cannot boot the old firmware once the new one
+// *** has been copied, so a rollback downloads a full image of
+// *** the previous version. The boot count is kept in RTC memory,
+// *** which power loss clears (a new firmware is then trusted).
+// ***
+class OtaUpdater
+{
+  public:
+    OtaUpdater(RtcMemory&);
+    void begin(uint32_t version, const char* url, const char* publicKey);
+    bool isEnabled();
+    uint32_t getVersion();
+    uint32_t checkForUpdate();
+    enum otaResult update(uint32_t version);
+    enum otaResult rollback();
+    bool isPending();
+    bool isRollbackNeeded();
+    void confirm();
+    uint8_t getBootAttempts();
+    uint32_t getPreviousVersion();
+    uint32_t getFailedVersion();
+    uint8_t getImageType();
+    uint32_t getFirmwareSize();
+    uint32_t getTransferSize();
+    uint32_t getTransferTime();
+    static PGM_P getResultName(enum otaResult);
+    bool receive(const uint8_t*, size_t);
+
+  private:
+    RtcMemory& _rtcMemory;
+    OtaStream _stream;
+    OtaWorkspace* _workspace = NULL;
+    uint32_t _version = 0;
+    const char* _url = "";
+    const char* _publicKey = "";
+
+    // ***
+    // *** The update being received.
+    // ***
+    enum otaResult _result = OTA_OK;
+    uint32_t _requestedVersion = 0;
+    uint8_t _baseHash[OTA_HASH_SIZE];
+    bool _hasBaseHash = false;
+    uint16_t _heldLength = 0;
+    uint32_t _flashAddress = 0;
+
+    // ***
+    // *** The last transfer.
+    // ***
+    uint8_t _imageType = OTA_TYPE_FULL;
+    uint32_t _firmwareSize = 0;
+    uint32_t _transferSize = 0;
+    uint32_t _transferTime = 0;
+
+    enum otaResult install(uint32_t version, bool useDelta);
+    enum otaResult fetch(uint32_t version, bool isDelta);
+    void startUpdate();
+    bool isSigned();
+    bool finishUpdate();
+    void computeBaseHash();
+    bool writeFirmware(const uint8_t*, size_t);
+    uint8_t readFlash(uint32_t);
+    void saveState();
+    static uint8_t readBase(void*, uint32_t);
+    static bool writeOutput(void*, const uint8_t*, size_t);
+};
+#endif
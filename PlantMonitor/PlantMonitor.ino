@@ -20,10 +20,45 @@
 #include "EnvironmentalMonitor.h"
 #include "SpectrumMonitor.h"
 #include "WaterPumpController.h"
+#include "SensorHealth.h"
+#include "DerivedMetrics.h"
+#include "Clock.h"
+#include "Rollup.h"
+#include "Telemetry.h"
+#include "StatusServer.h"
+#include "WateringController.h"
+#include "WaterAccount.h"
+#include "TraceRecorder.h"
+#include "RtcMemory.h"
+#include "PowerManager.h"
+#include "AdaptiveSampler.h"
+#include "Watchdog.h"
+#include "OtaUpdater.h"
 #include "MyPins.h"
 #include <time.h>
 #include <WiFiManager.h>
 
+// ***
+// *** Define TRACE_TO_FILE to record the raw sensor readings to
+// *** TRACE_FILE on the flash file system or TRACE_TO_SERIAL to
+// *** write them to the serial port (as lines starting with "#T ").
+// *** A trace can be replayed on Linux by Tools/Replay.
+// ***
+//#define TRACE_TO_FILE
+//#define TRACE_TO_SERIAL
+#define TRACE_FILE        "/trace.bin"
+#define TRACE_FILE_LIMIT  1024 * 1024
+#ifdef TRACE_TO_FILE
+#include <LittleFS.h>
+#endif
+
+// ***
+// *** The version of this firmware. Increase it for each
+// *** release that is published on the update server (see
+// *** OtaUpdater.h).
+// ***
+#define FIRMWARE_VERSION 1
+
 // ***
 // *** Temperature units to use.
 // ***
@@ -70,21 +105,124 @@ SpectrumMonitor _spectrumMonitor;
 // ***
 WaterPumpController _waterPumpController(WATER_PUMP_PIN);
 
+// ***
+// *** Create an instance of the Watering Controller.
+// ***
+WateringController _wateringController(_soilMonitor, _waterPumpController);
+
+// ***
+// *** Create an instance of the Water Account.
+// ***
+WaterAccount _waterAccount(_waterPumpController);
+
 // ***
 // *** Holds the most recent set of sensor readings.
 // ***
 CloudData _sensorData;
 
+// ***
+// *** A streaming health monitor for each sensor channel and
+// *** the fault state last reported to the cloud.
+// ***
+SensorHealth _sensorHealth[CHANNEL_COUNT];
+bool _reportedFault[CHANNEL_COUNT];
+
+// ***
+// *** The alerts (RTC_ALERT_*) and the channels whose fault state
+// *** changed that the duty cycled modes keep for the next
+// *** upload (see raiseAlert()).
+// ***
+uint16_t _pendingAlerts = 0;
+uint8_t _pendingFaultAlerts = 0;
+
+// ***
+// *** Minute, hour and day rollups of each channel.
+// ***
+Rollup _rollups[CHANNEL_COUNT];
+
+// ***
+// *** Define UPLOAD_ROLLUPS to upload the mean of each closed
+// *** minute instead of a single reading every send interval.
+// *** Define UPLOAD_ROLLUP_EXTREMES to also upload the minimum
+// *** and maximum (to the "-min" and "-max" feeds).
+// ***
+//#define UPLOAD_ROLLUPS
+//#define UPLOAD_ROLLUP_EXTREMES
+uint32_t _lastUploadedPeriod = 0;
+
+// ***
+// *** Buffer for commands received on the serial port.
+// ***
+#define SERIAL_COMMAND_SIZE 32
+char _serialCommand[SERIAL_COMMAND_SIZE];
+uint8_t _serialCommandLength = 0;
+
 // ***
 // *** Create an instance of Cloud.
 // ***
 Cloud _cloud;
 
 // ***
-// *** Setup a timer to read sensors every 10 seconds
-// *** and display the results on the serial port.
+// *** Create an instance of the clock used to
+// *** timestamp the sensor readings.
+// ***
+Clock _clock;
+
+// ***
+// *** The state kept in RTC memory and the power manager
+// *** used by the duty cycled power modes.
+// ***
+RtcMemory _rtcMemory;
+PowerManager _powerManager(_clock, _rtcMemory);
+
+// ***
+// *** Create an instance of the loop watchdog. It leaves
+// *** breadcrumbs in RTC memory (see Watchdog.h).
+// ***
+Watchdog _watchdog(_rtcMemory);
+
+// ***
+// *** Create an instance of the firmware updater.
+// ***
+OtaUpdater _otaUpdater(_rtcMemory);
+
+// ***
+// *** Decides how often each sensor device is read.
+// ***
+AdaptiveSampler _sampler;
+
+// ***
+// *** Create an instance of the LAN telemetry stream.
+// ***
+Telemetry _telemetry;
+
+// ***
+// *** Define ENABLE_STATUS_SERVER to serve /metrics and
+// *** /status.json on the local network.
+// ***
+#define ENABLE_STATUS_SERVER
+#ifdef ENABLE_STATUS_SERVER
+StatusServer _statusServer(STATUS_SERVER_PORT);
+#endif
+
+// ***
+// *** Create an instance of the trace recorder and keep
+// *** track of the clock synchronizations recorded.
 // ***
-#define READ_SENSOR_DATA_INTERVAL 1000 * 10
+TraceRecorder _traceRecorder;
+uint32_t _tracedSyncCount = 0;
+#ifdef TRACE_TO_FILE
+File _traceFile;
+#endif
+
+// ***
+// *** Setup a timer to check every second which sensors are
+// *** due to be read. Each device is read at an interval that
+// *** follows how fast its readings are changing (see
+// *** AdaptiveSampler.h and SENSOR_DEVICES in SensorChannels.h).
+// *** The readings are displayed on the serial port.
+// ***
+#define READ_SENSOR_DATA_INTERVAL 1000
 os_timer_t _readSensorDataTimer;
 volatile bool _readSensorData = false;
 
@@ -103,9 +241,63 @@ volatile bool _sendSensorData = false;
 #define CHECK_SOIL_QUALITY_INTERVAL 1000 * 60 * 10
 os_timer_t _checkSoilQualityTimer;
 volatile bool _checkSoilQuality = false;
+// ***
+// *** Setup a timer to check the update server
+// *** every 6 hours.
+// ***
+#define CHECK_FOR_UPDATE_INTERVAL 1000 * 60 * 60 * 6
+os_timer_t _checkForUpdateTimer;
+volatile bool _checkForUpdate = false;
+
 #define WATER_PUMP_RUN_TIME  1000 * 30
 #define WATER_PUMP_RUN_LEVEL 200
 
+// ***
+// *** Water accounting (see WaterAccount.h): the most water (ml)
+// *** to deliver in a day, the size of the reservoir (ml) and the
+// *** water to leave in it so that the pump never runs dry. Set
+// *** the budget or the capacity to 0 to turn them off. Use the
+// *** "water refill" command after filling the reservoir.
+// ***
+#define WATER_DAILY_BUDGET        1500
+#define WATER_RESERVOIR_CAPACITY  4000
+#define WATER_RESERVOIR_RESERVE   200
+
+// ***
+// *** The power mode (see PowerManager.h). In the duty cycled modes
+// *** the timers above are not used; the sensors are read, the soil
+// *** is checked and the kept readings are uploaded on the intervals
+// *** below and the device sleeps in between. The water pump feed,
+// *** the serial commands and the status server only work while
+// *** the device is awake.
+// ***
+#define POWER_MODE            POWER_ALWAYS_ON
+#define POWER_READ_INTERVAL   1000 * 60 * 5
+#define POWER_SEND_INTERVAL   1000 * 60 * 10
+#define POWER_CHECK_INTERVAL  CHECK_SOIL_QUALITY_INTERVAL
+
+// ***
+// *** An upload starts with a full publish bucket (see
+// *** PublishGovernor.h) and has to fit in it: the readings kept
+// *** since the last upload, then the awake time and the water
+// *** totals. What does not fit waits for the next upload and a
+// *** full buffer turns the radio on early, so the upload interval
+// *** is held to the readings the budget allows (2 on a free
+// *** account, more with IO+ or fewer devices).
+// ***
+#define POWER_UPLOAD_STATUS_POINTS  3
+#define POWER_UPLOAD_READINGS       (((IO_RATE_LIMIT / IO_ACCOUNT_DEVICES) - GOVERNOR_STATUS_RESERVE - POWER_UPLOAD_STATUS_POINTS) / CLOUD_READING_POINTS)
+
+static_assert(POWER_UPLOAD_READINGS >= 1, "The publish budget of each device is too small for a reading per upload.");
+static_assert(((POWER_SEND_INTERVAL) / (POWER_READ_INTERVAL)) <= POWER_UPLOAD_READINGS, "The upload interval keeps more readings than the publish budget allows in one upload.");
+static_assert(((POWER_SEND_INTERVAL) / (POWER_READ_INTERVAL)) <= RTC_SAMPLE_COUNT, "The upload interval keeps more readings than RTC memory holds.");
+
+// ***
+// *** How long an upload waits for NTP when the clock
+// *** has not been synchronized yet.
+// ***
+#define NTP_WAIT_TIME 1000 * 5
+
 // ***
 // *** Keep track of the last watering time.
 // ***
@@ -126,30 +318,72 @@ void setup()
   }
 
   // ***
-  // *** Let the system stabilize. This prevents (or minimizes)
-  // *** garbage output on the serial port.
+  // *** Load the state kept in RTC memory. In deep sleep mode
+  // *** this restores the clock and the schedule on a wake up.
   // ***
-  delay(1000);
+  _rtcMemory.begin();
+  _watchdog.begin();
+  _watchdog.enter(STAGE_SETUP);
+  _otaUpdater.begin(FIRMWARE_VERSION, OTA_SERVER_URL, OTA_PUBLIC_KEY);
+  bool isWake = _powerManager.begin(POWER_MODE, POWER_READ_INTERVAL, POWER_SEND_INTERVAL, POWER_CHECK_INTERVAL);
 
-  // ***
-  // *** WiFi Manager is used to get WiFi credentials setup using another
-  // *** computer or mobile phone. Local initialization. Once its business
-  // *** is done, there is no need to keep it around
-  // ***
-  WiFiManager wifiManager;
-  String ssid = "PlantMonitor-" + String(ESP.getFlashChipId(), HEX);
-  wifiManager.autoConnect(ssid.c_str());
+  if (!isWake)
+  {
+    // ***
+    // *** Let the system stabilize. This prevents (or minimizes)
+    // *** garbage output on the serial port.
+    // ***
+    delay(1000);
 
-  // ***
-  // *** Show the startup message.
-  // ***
-  Serial.println();
-  Serial.println("Initializing Plant Monitoring System...");
+    // ***
+    // *** WiFi Manager is used to get WiFi credentials setup using another
+    // *** computer or mobile phone. Local initialization. Once its business
+    // *** is done, there is no need to keep it around
+    // ***
+    _watchdog.enter(STAGE_WIFI);
+    WiFiManager wifiManager;
+    String ssid = "PlantMonitor-" + String(ESP.getFlashChipId(), HEX);
+    wifiManager.autoConnect(ssid.c_str());
+    _watchdog.enter(STAGE_SETUP);
+
+    // ***
+    // *** Show the startup message.
+    // ***
+    Serial.println();
+    Serial.print("Initializing Plant Monitoring System (firmware "); Serial.print(FIRMWARE_VERSION); Serial.println(")...");
+
+    // ***
+    // *** A new firmware that keeps restarting is
+    // *** replaced by the one that ran before it.
+    // ***
+    if (_otaUpdater.isRollbackNeeded())
+    {
+      _watchdog.enter(STAGE_OTA);
+      rollbackFirmware();
+      _watchdog.enter(STAGE_SETUP);
+    }
+  }
+  else
+  {
+    Serial.println();
+    Serial.print("Woke up for cycle "); Serial.print(_powerManager.getCycleCount()); Serial.println(".");
+  }
 
   // ***
   // *** Initialize the water pump controller.
   // ***
   _waterPumpController.begin();
+  _wateringController.begin(WATER_PUMP_RUN_LEVEL, WATER_PUMP_RUN_TIME);
+
+  // ***
+  // *** Load the water totals.
+  // ***
+  if (!_waterAccount.begin(WATER_DAILY_BUDGET, WATER_RESERVOIR_CAPACITY, WATER_RESERVOIR_RESERVE))
+  {
+    Serial.println("Starting new water totals.");
+  }
+
+  _wateringController.setAccount(&_waterAccount);
 
   // ***
   // *** Initialize the Soil Monitor.
@@ -170,66 +404,168 @@ void setup()
   _spectrumMonitor.begin();
 
   // ***
-  // *** Initialize the cloud.
+  // *** Initialize the sensor health monitors.
   // ***
-  _cloud.begin();
-  _cloud.onWaterPumpChanged(handleWaterPumpMessage);
-  _cloud.setWaterPumpSpeed(0);
+  configureSensorHealth(_sensorHealth, _myUnits);
+  restoreControllerState();
 
   // ***
-  // *** Initialize the sensor data read timer.
+  // *** Start recording the raw sensor readings.
   // ***
-  os_timer_setfn(&_readSensorDataTimer, readSensorDataTimerCallback, NULL);
-  os_timer_arm(&_readSensorDataTimer, READ_SENSOR_DATA_INTERVAL, true);
+  startTrace();
 
   // ***
-  // *** Initialize the sensor data send timer.
+  // *** Initialize the cloud. The duty cycled modes only
+  // *** upload (see uploadSamples()) and do not stay connected.
   // ***
-  os_timer_setfn(&_sendSensorDataTimer, _sendSensorDataTimerCallback, NULL);
-  os_timer_arm(&_sendSensorDataTimer, SEND_SENSOR_DATA_INTERVAL, true);
+  if (!_powerManager.isDutyCycled())
+  {
+    _watchdog.enter(STAGE_CLOUD_CONNECT);
+    _cloud.begin();
+    _watchdog.enter(STAGE_SETUP);
+    _cloud.onWaterPumpChanged(handleWaterPumpMessage);
+    _cloud.setWaterPumpSpeed(0);
+  }
+
+  // ***
+  // *** Report a crash or a watchdog reset and where
+  // *** the firmware was when it happened.
+  // ***
+  reportLastReset();
+
+  // ***
+  // *** Initialize the LAN telemetry stream.
+  // ***
+  _telemetry.begin();
 
+#ifdef ENABLE_STATUS_SERVER
   // ***
-  // *** Initialize the check soil quality timer.
+  // *** Initialize the status server.
   // ***
-  os_timer_setfn(&_checkSoilQualityTimer, _checkSoilQualityTimerCallback, NULL);
-  os_timer_arm(&_checkSoilQualityTimer, CHECK_SOIL_QUALITY_INTERVAL, true);
+  _statusServer.begin();
+#endif
+
+  if (!_powerManager.isDutyCycled())
+  {
+    // ***
+    // *** Initialize the sensor data read timer.
+    // ***
+    os_timer_setfn(&_readSensorDataTimer, readSensorDataTimerCallback, NULL);
+    os_timer_arm(&_readSensorDataTimer, READ_SENSOR_DATA_INTERVAL, true);
+
+    // ***
+    // *** Initialize the sensor data send timer.
+    // ***
+    os_timer_setfn(&_sendSensorDataTimer, _sendSensorDataTimerCallback, NULL);
+    os_timer_arm(&_sendSensorDataTimer, SEND_SENSOR_DATA_INTERVAL, true);
+
+    // ***
+    // *** Initialize the check soil quality timer.
+    // ***
+    os_timer_setfn(&_checkSoilQualityTimer, _checkSoilQualityTimerCallback, NULL);
+    os_timer_arm(&_checkSoilQualityTimer, CHECK_SOIL_QUALITY_INTERVAL, true);
+
+    // ***
+    // *** Initialize the update check timer.
+    // ***
+    os_timer_setfn(&_checkForUpdateTimer, _checkForUpdateTimerCallback, NULL);
+    os_timer_arm(&_checkForUpdateTimer, CHECK_FOR_UPDATE_INTERVAL, true);
+  }
 
   // ***
   // *** Configure the device to get the time from the Internet.
   // ***
+  _clock.begin();
   configTime(TZ_SEC, DST_SEC, "pool.ntp.org");
 
+  // ***
+  // *** The duty cycled modes read every sensor on each wake up.
+  // ***
+  _sampler.begin(_clock.now(), _powerManager.isDutyCycled() ? POWER_READ_INTERVAL : 0);
+
   // ***
   // *** The system is initialized and ready to go.
   // ***
   Serial.println("Ready.");
+  _watchdog.progress();
 }
 
 void loop()
 {
+  // ***
+  // *** The duty cycled power modes run one cycle
+  // *** and sleep until the next task is due.
+  // ***
+  if (_powerManager.isDutyCycled())
+  {
+    runDutyCycle();
+    return;
+  }
+
   // ***
   // *** This is required for all sketches. It should always be
   // *** present at the top of the loop function. It keeps
   // *** the client connected to io.adafruit.com, and processes
   // *** any incoming data.
   // ***
+  _watchdog.enter(STAGE_CLOUD);
   _cloud.process();
 
+  // ***
+  // *** Pick up any new time from NTP.
+  // ***
+  _watchdog.enter(STAGE_CLOCK);
+  _clock.process();
+
+#ifdef ENABLE_STATUS_SERVER
+  // ***
+  // *** Serve status requests.
+  // ***
+  _watchdog.enter(STAGE_STATUS);
+  _statusServer.process();
+#endif
+
   // ***
   // *** Read the data if the flag is set.
   // ***
+  _watchdog.enter(STAGE_READ);
   readSensorData();
 
   // ***
   // *** Send the data to the cloud if the flag is set.
   // ***
+  _watchdog.enter(STAGE_SEND);
   sendSensorData();
 
   // ***
   // *** Check if the pklant needs water.
   // ***
+  _watchdog.enter(STAGE_CHECK);
   checkSoilQuality();
 
+  // ***
+  // *** Keep account of the water delivered.
+  // ***
+  _watchdog.enter(STAGE_WATER);
+  processWaterAccount();
+
+  // ***
+  // *** Confirm a new firmware and install updates.
+  // ***
+  _watchdog.enter(STAGE_OTA);
+  processUpdates();
+
+  // ***
+  // *** Handle any commands from the serial port.
+  // ***
+  _watchdog.enter(STAGE_SERIAL);
+  processSerialCommands();
+
+  // ***
+  // *** The iteration is complete.
+  // ***
+  _watchdog.progress();
+
   // ***
   // *** Yield to the microcontroller.
   // ***
@@ -237,181 +573,1030 @@ void loop()
 }
 
 // ***
-// *** Called by the timer.
-// ***
-void readSensorDataTimerCallback(void *pArg)
-{
-  _readSensorData = true;
-}
-
-// ***
-// *** Called by the timer.
+// *** One cycle of the duty cycled power modes. Runs the tasks
+// *** that are due, uploads the kept readings when an upload is
+// *** due (or the buffer is full) and sleeps until the next task.
+// *** In deep sleep mode the device restarts after the sleep.
 // ***
-void _sendSensorDataTimerCallback(void *pArg)
+void runDutyCycle()
 {
-  _sendSensorData = true;
-}
+  _watchdog.enter(STAGE_CLOCK);
+  _clock.process();
 
-// ***
-// *** Called by the timer.
-// ***
-void _checkSoilQualityTimerCallback(void *pArg)
-{
-  _checkSoilQuality = true;
-}
+  uint8_t tasks = _powerManager.getDueTasks();
 
-// ***
-// *** Called by the loop to get sensor data.
-// ***
-void checkSoilQuality()
-{
-  if (_checkSoilQuality)
+  // ***
+  // *** After a deep sleep the soil check needs a reading
+  // *** even when one is not scheduled.
+  // ***
+  if ((tasks & POWER_TASK_READ) || ((tasks & POWER_TASK_CHECK) && !_sensorData.initialized))
   {
-    // ***
-    // *** Reset the flag.
-    // ***
-    _checkSoilQuality = false;
-
-    Serial.print("Checking soil quality.");
+    _watchdog.enter(STAGE_READ);
+    _readSensorData = true;
+    readSensorData();
 
-    // ***
-    // *** Check if the soil is dry.
-    // ***
-    if (_soilMonitor.getQuality() == "Dry")
-    {
-      // ***
-      // *** Run the water pump.
-      // ***
-      Serial.print("Running water pump for "); Serial.print(WATER_PUMP_RUN_TIME / 1000); Serial.print(" seconds at "); Serial.print(WATER_PUMP_RUN_LEVEL / 255 * 100); Serial.println("%.");
-      _waterPumpController.on(WATER_PUMP_RUN_LEVEL, WATER_PUMP_RUN_TIME);
-      Serial.println("Stopping water pump.");
-    }
-    else
+    if (tasks & POWER_TASK_READ)
     {
-      Serial.print("Soil quality is "); Serial.print(_soilMonitor.getQuality()); Serial.println(".");
+      _powerManager.addSample(_sensorData);
     }
   }
-}
 
-// ***
-// *** Called by the loop to get sensor data.
-// ***
-void readSensorData()
-{
+  if (tasks & POWER_TASK_CHECK)
+  {
+    _watchdog.enter(STAGE_CHECK);
+    _checkSoilQuality = true;
+    checkSoilQuality();
+  }
+
+  _watchdog.enter(STAGE_WATER);
+  processWaterAccount();
+
   // ***
-  // *** Read the data if the flag is set.
+  // *** The report of a crash or watchdog reset is sent right
+  // *** away; the breadcrumbs it is made from are overwritten on
+  // *** the next wake.
   // ***
-  if (_readSensorData)
+  if ((tasks & POWER_TASK_SEND) || _powerManager.isBufferFull() || ((_pendingAlerts & RTC_ALERT_RESET) && _watchdog.isAbnormalReset()))
   {
-    // ***
-    // *** Reset the flag.
-    // ***
-    _readSensorData = false;
+    _watchdog.enter(STAGE_UPLOAD);
+    uploadSamples();
+  }
 
-    Serial.println("Reading sensor data.");
+  _watchdog.enter(STAGE_SERIAL);
+  processSerialCommands();
+  saveControllerState();
 
-    // ***
-    // *** Read the sensor data.
-    // ***
-    getSensorData();
+  // ***
+  // *** A new firmware that completes a cycle works.
+  // ***
+  _otaUpdater.confirm();
 
-    // ***
-    // *** Show the data on the serial port.
-    // ***
-    Serial.println("Displaying sensor data.");
-    displaySensorData();
-  }
+  Serial.print("Awake for "); Serial.print(_powerManager.getAwakeTime()); Serial.print(" ms (cycle "); Serial.print(_powerManager.getCycleCount());
+  Serial.print("), sleeping for "); Serial.print(_powerManager.getSleepTime()); Serial.println(" ms.");
+
+  _watchdog.progress();
+  _watchdog.enter(STAGE_SLEEP);
+  _powerManager.sleep();
 }
 
 // ***
-// *** Called by the loop to send sensor data.
+// *** Turns WiFi on and uploads the kept alerts, then the kept
+// *** readings, oldest first, each stamped with the time it was
+// *** captured, followed by the average time awake per cycle.
+// *** Alerts and readings that could not be sent are kept for
+// *** the next upload.
 // ***
-void sendSensorData()
+void uploadSamples()
 {
-  // ***
-  // *** Send the data to the cloud if the flag is set.
-  // ***
-  if (_sendSensorData)
+  if (_powerManager.getSampleCount() > 0 || _pendingAlerts != 0 || _pendingFaultAlerts != 0)
   {
-    // ***
-    // *** Reset the flag.
-    // ***
-    _sendSensorData = false;
+    Serial.println("Sending sensor data to the cloud.");
 
-    if (_sensorData.initialized)
+    if (_powerManager.startRadio())
     {
-      Serial.println("Sending sensor data to the cloud.");
-
       // ***
-      // *** Send the data tot he cloud.
+      // *** Give NTP a moment if the time is not known yet.
       // ***
-      _cloud.sendData(_sensorData);
-    }
+      uint32_t start = millis();
 
-    // ***
-    // *** Reset the is active flag.
-    // ***
-    Serial.println("Data send to cloud completed.");
-    Serial.println();
+      while (!_clock.isSynchronized() && (millis() - start) < NTP_WAIT_TIME)
+      {
+        delay(100);
+        _clock.process();
+      }
+
+      sendPendingAlerts();
+
+      CloudData sample;
+      uint8_t sent = 0;
+      bool isSending = true;
+
+      while (isSending && sent < _powerManager.getSampleCount())
+      {
+        // ***
+        // *** The derived metrics are not kept in RTC memory.
+        // ***
+        _powerManager.getSample(sent, sample);
+        calculateDerivedMetrics(sample, _myUnits);
+        isSending = _cloud.sendData(sample, _clock.toEpoch(sample.capturedAt));
+
+        if (isSending)
+        {
+          sent++;
+        }
+      }
+
+      sendTelemetryBatch(sent);
+      _powerManager.removeSamples(sent);
+      Serial.print("Sent "); Serial.print(sent); Serial.print(" reading(s), "); Serial.print(_powerManager.getSampleCount()); Serial.println(" waiting.");
+
+      if (_cloud.sendValue(PSTR("awake-time"), _powerManager.getAverageAwakeTime(), 0, 0))
+      {
+        _powerManager.resetAwakeTime();
+      }
+
+      sendWaterTotals();
+    }
+    else
+    {
+      Serial.println("WiFi did not connect; the readings will be sent next time.");
+    }
   }
 }
 
 // ***
-// *** Reads the sensors into the data structure.
+// *** Shows the reset reason and, after a crash or a watchdog
+// *** reset, the stages that ran before it and publishes them
+// *** as an alert.
 // ***
-void getSensorData()
+void reportLastReset()
 {
-  _sensorData.environmentalTemperature = _envMonitor.getTemperature(_myUnits);
-  _sensorData.environmentalRelativeHumidity = _envMonitor.getRelativeHumidity();
-  _sensorData.soilMoistureLevel = _soilMonitor.getMoistureLevel();
-  _sensorData.soilMoistureQuality = _soilMonitor.getQuality();
-  _sensorData.soilTemperature = _soilMonitor.getTemperature(_myUnits);
-  _sensorData.spectrumFull = _spectrumMonitor.getFull(true);
-  _sensorData.spectrumIr = _spectrumMonitor.getIr();
-  _sensorData.spectrumLux = _spectrumMonitor.getLux();
-  _sensorData.spectrumVisible = _spectrumMonitor.getVisible();
-  _sensorData.initialized = true;
+  Serial.print("Reset reason: "); Serial.println(ESP.getResetReason());
+
+  if (_watchdog.isAbnormalReset())
+  {
+    raiseAlert(RTC_ALERT_RESET);
+    displayBreadcrumbs();
+  }
 }
 
 // ***
-// *** Display the last sensor data readings
-// *** on the serial port.
+// *** Publishes an alert (RTC_ALERT_*). The duty cycled modes
+// *** are not connected to MQTT so they keep it in RTC memory
+// *** for sendPendingAlerts().
 // ***
-void displaySensorData()
+void raiseAlert(uint16_t alert)
 {
-  if (_sensorData.initialized)
-  {
-    // ***
-    // *** Insert a blank line.
-    // ***
-    Serial.println();
+  char message[CLOUD_ALERT_SIZE];
+  formatAlert(alert, message, sizeof(message));
+  Serial.println(message);
 
-    // ***
-    // *** Display the current time.
-    // ***
-    time_t now = time(nullptr);
-    Serial.print("Current Date and Time: "); Serial.println(ctime(&now));
+  if (_powerManager.isDutyCycled())
+  {
+    _pendingAlerts |= alert;
+  }
+  else
+  {
+    _cloud.sendAlert(message);
+  }
+}
+
+// ***
+// *** The text of an alert. The reset report can only be made
+// *** in the boot that follows the reset.
+// ***
+void formatAlert(uint16_t alert, char* buffer, size_t size)
+{
+  if (alert == RTC_ALERT_RESET && _watchdog.isAbnormalReset())
+  {
+    _watchdog.formatReport(buffer, size);
+  }
+  else if (alert == RTC_ALERT_RESET)
+  {
+    snprintf_P(buffer, size, PSTR("The device restarted after a crash or watchdog reset."));
+  }
+  else if (alert == RTC_ALERT_WATER_BUDGET)
+  {
+    snprintf_P(buffer, size, PSTR("The daily water budget is used up."));
+  }
+  else
+  {
+    snprintf_P(buffer, size, PSTR("The water reservoir is low."));
+  }
+}
+
+void formatFaultAlert(enum sensorChannel channel, char* buffer, size_t size)
+{
+  char name[CHANNEL_TEXT_SIZE];
+  snprintf_P(buffer, size, PSTR("%s sensor %s."), getChannelText(name, sizeof(name), getChannelName(channel)), _reportedFault[channel] ? "is faulty" : "has recovered");
+}
+
+// ***
+// *** Posts the alerts kept by the duty cycled modes through
+// *** the REST API, the sensor faults with the state they are
+// *** in now. The ones that could not be posted are kept.
+// ***
+void sendPendingAlerts()
+{
+  char message[CLOUD_ALERT_SIZE];
+  bool isSending = true;
+
+  for (uint16_t alert = RTC_ALERT_RESET; isSending && alert <= RTC_ALERT_RESERVOIR_LOW; alert <<= 1)
+  {
+    if (_pendingAlerts & alert)
+    {
+      formatAlert(alert, message, sizeof(message));
+      isSending = _cloud.postAlert(message);
+
+      if (isSending)
+      {
+        _pendingAlerts &= ~alert;
+      }
+    }
+  }
+
+  for (uint8_t i = 0; isSending && i < CHANNEL_COUNT; i++)
+  {
+    if (_pendingFaultAlerts & (1 << i))
+    {
+      formatFaultAlert((enum sensorChannel)i, message, sizeof(message));
+      isSending = _cloud.postAlert(message);
+
+      if (isSending)
+      {
+        _pendingFaultAlerts &= ~(1 << i);
+      }
+    }
+  }
+}
+
+// ***
+// *** Displays the stages that ran before the last reset,
+// *** newest first, with how long each ran and the free heap
+// *** when it started.
+// ***
+void displayBreadcrumbs()
+{
+  char name[12];
+  RtcBreadcrumb breadcrumb;
+  uint32_t duration = 0;
+
+  if (_watchdog.getStalledStage() != STAGE_NONE)
+  {
+    Serial.print(F("The watchdog restarted the device in stage ")); Serial.print(getChannelText(name, sizeof(name), Watchdog::getStageName(_watchdog.getStalledStage()))); Serial.println(F("."));
+  }
+
+  for (uint8_t i = 0; i < _watchdog.getBreadcrumbCount(); i++)
+  {
+    _watchdog.getBreadcrumb(i, breadcrumb, duration);
+    Serial.print(F("  ")); Serial.print(getChannelText(name, sizeof(name), Watchdog::getStageName((enum watchdogStage)breadcrumb.stage)));
+    Serial.print(F(" at ")); Serial.print(breadcrumb.enteredAt);
+    Serial.print(F(" ms for ")); Serial.print(duration);
+    Serial.print(i == 0 ? F("+ ms, ") : F(" ms, ")); Serial.print(breadcrumb.freeHeap); Serial.print(F(" bytes free"));
+    Serial.println((breadcrumb.flags & BREADCRUMB_OVERRUN) ? F(", over budget") : F(""));
+  }
+}
+
+// ***
+// *** The controller state is kept in RTC memory so
+// *** that it survives deep sleep.
+// ***
+void restoreControllerState()
+{
+  RtcController& controller = _rtcMemory.getState().controller;
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    _reportedFault[i] = (controller.reportedFaults & (1 << i)) != 0;
+  }
+
+  _pendingAlerts = controller.alerts;
+  _pendingFaultAlerts = controller.faultAlerts;
+}
+
+void saveControllerState()
+{
+  RtcController& controller = _rtcMemory.getState().controller;
+  controller.reportedFaults = 0;
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    controller.reportedFaults |= _reportedFault[i] ? (1 << i) : 0;
+  }
+
+  controller.alerts = _pendingAlerts;
+  controller.faultAlerts = _pendingFaultAlerts;
+}
+
+// ***
+// *** Called by the timer.
+// ***
+void readSensorDataTimerCallback(void *pArg)
+{
+  _readSensorData = true;
+}
+
+// ***
+// *** Called by the timer.
+// ***
+void _sendSensorDataTimerCallback(void *pArg)
+{
+  _sendSensorData = true;
+}
+
+// ***
+// *** Called by the timer.
+// ***
+void _checkSoilQualityTimerCallback(void *pArg)
+{
+  _checkSoilQuality = true;
+}
+
+// ***
+// *** Called by the timer.
+// ***
+void _checkForUpdateTimerCallback(void *pArg)
+{
+  _checkForUpdate = true;
+}
+
+// ***
+// *** Confirms a new firmware once it has run for a while
+// *** and installs the latest firmware when the timer is due.
+// ***
+void processUpdates()
+{
+  if (_otaUpdater.isPending() && millis() > OTA_CONFIRM_TIME)
+  {
+    _otaUpdater.confirm();
+    Serial.print("Firmware "); Serial.print(FIRMWARE_VERSION); Serial.println(" confirmed.");
+  }
+
+  if (_checkForUpdate)
+  {
+    _checkForUpdate = false;
+    installLatestFirmware();
+  }
+}
+
+// ***
+// *** Asks the update server for the latest firmware and
+// *** installs it. The device restarts into the new firmware.
+// ***
+void installLatestFirmware()
+{
+  uint32_t version = _otaUpdater.checkForUpdate();
+
+  if (version != 0)
+  {
+    Serial.print("Installing firmware "); Serial.print(version); Serial.println("...");
+    enum otaResult result = _otaUpdater.update(version);
+    displayUpdateResult(result);
+
+    if (result == OTA_OK)
+    {
+      ESP.restart();
+    }
+  }
+  else if (_otaUpdater.isEnabled())
+  {
+    Serial.println("The firmware is up to date.");
+  }
+}
+
+// ***
+// *** Installs the firmware that ran before the
+// *** one that failed and restarts into it.
+// ***
+void rollbackFirmware()
+{
+  Serial.print("Firmware "); Serial.print(FIRMWARE_VERSION); Serial.print(" restarted "); Serial.print(_otaUpdater.getBootAttempts() - 1);
+  Serial.print(" times before it was confirmed; reinstalling firmware "); Serial.print(_otaUpdater.getPreviousVersion()); Serial.println("...");
+  enum otaResult result = _otaUpdater.rollback();
+  displayUpdateResult(result);
+
+  if (result == OTA_OK)
+  {
+    ESP.restart();
+  }
+}
+
+// ***
+// *** Shows the result of an update and what the transfer
+// *** cost compared with sending the whole firmware.
+// ***
+void displayUpdateResult(enum otaResult result)
+{
+  char name[32];
+  Serial.print(F("Update result: ")); Serial.print(getChannelText(name, sizeof(name), OtaUpdater::getResultName(result))); Serial.println(F("."));
+
+  if (_otaUpdater.getFirmwareSize() > 0)
+  {
+    uint32_t size = _otaUpdater.getFirmwareSize();
+    uint32_t transferred = _otaUpdater.getTransferSize();
+    uint32_t time = _otaUpdater.getTransferTime();
+
+    Serial.print(_otaUpdater.getImageType() == OTA_TYPE_DELTA ? F("Delta") : F("Full")); Serial.print(F(" image: "));
+    Serial.print(transferred); Serial.print(F(" bytes (")); Serial.print(transferred * 100.0 / size, 1); Serial.print(F("% of the "));
+    Serial.print(size); Serial.print(F(" byte firmware) in ")); Serial.print(time); Serial.print(F(" ms, about "));
+    Serial.print(transferred > 0 ? (uint32_t)((uint64_t)time * size / transferred) : 0); Serial.println(F(" ms for the whole firmware."));
+  }
+}
+
+// ***
+// *** Called by the loop to get sensor data.
+// ***
+void checkSoilQuality()
+{
+  if (_checkSoilQuality)
+  {
+    // ***
+    // *** Reset the flag.
+    // ***
+    _checkSoilQuality = false;
+
+    Serial.print("Checking soil quality.");
+
+    enum wateringDecision decision = _wateringController.decide(_sensorData.quality[CHANNEL_SOIL_MOISTURE_LEVEL], _sensorData.soilMoistureLevel);
+    _traceRecorder.recordCheck(_clock.now(), decision == WATERING_SKIPPED ? TRACE_NO_CODE : _soilMonitor.getLastQualityCode());
+
+    if (decision == WATERING_SKIPPED)
+    {
+      Serial.println(" Soil moisture sensor is not reliable; skipping watering.");
+    }
+    else if (decision == WATERING_NEEDED)
+    {
+      // ***
+      // *** Run the water pump.
+      // ***
+      Serial.print("Running water pump for up to "); Serial.print(WATER_PUMP_RUN_TIME / 1000); Serial.print(" seconds at "); Serial.print(WATER_PUMP_RUN_LEVEL * 100 / 255); Serial.println("%.");
+      _wateringController.water();
+      Serial.println("Stopping water pump.");
+
+      RtcController& controller = _rtcMemory.getState().controller;
+      controller.lastWaterTick = _clock.now();
+      controller.wateringCount++;
+
+      processWaterAccount();
+    }
+    else if (decision == WATERING_OVER_BUDGET)
+    {
+      Serial.println(" Soil is dry but today's water budget is used up.");
+    }
+    else if (decision == WATERING_RESERVOIR_LOW)
+    {
+      Serial.println(" Soil is dry but the water reservoir is low.");
+    }
+    else
+    {
+      Serial.print("Soil quality is "); Serial.print(_wateringController.getLastQuality()); Serial.println(".");
+    }
+  }
+}
+
+// ***
+// *** Books the watering events that have ended, stops the
+// *** pump when no more water is allowed and raises an alert
+// *** when the budget is used up or the reservoir gets low.
+// ***
+void processWaterAccount()
+{
+  uint32_t eventCount = _waterAccount.getEventCount();
+  bool wasOverBudget = _waterAccount.isOverBudget();
+  bool wasReservoirLow = _waterAccount.isReservoirLow();
+
+  if (_waterAccount.process(getLocalDay()))
+  {
+    Serial.println("Stopped the water pump; no more water is allowed.");
+
+    if (!_powerManager.isDutyCycled())
+    {
+      _cloud.setWaterPumpSpeed(0);
+    }
+  }
+
+  if (_waterAccount.getEventCount() != eventCount)
+  {
+    Serial.print("Delivered "); Serial.print(_waterAccount.getLastEventVolume(), 0); Serial.print(" ml, ");
+    Serial.print(_waterAccount.getDayVolume(), 0); Serial.print(" ml today");
+
+    if (_waterAccount.getBudget() > 0.0)
+    {
+      Serial.print(" of "); Serial.print(_waterAccount.getBudget(), 0); Serial.print(" ml");
+    }
+
+    if (_waterAccount.getReservoirCapacity() > 0.0)
+    {
+      Serial.print(", reservoir at about "); Serial.print(_waterAccount.getReservoirLevel(), 0); Serial.print(" ml");
+    }
+
+    Serial.println(".");
+
+    if (!_powerManager.isDutyCycled())
+    {
+      sendWaterTotals();
+    }
+  }
+
+  if (!wasOverBudget && _waterAccount.isOverBudget())
+  {
+    raiseAlert(RTC_ALERT_WATER_BUDGET);
+  }
+
+  if (!wasReservoirLow && _waterAccount.isReservoirLow())
+  {
+    raiseAlert(RTC_ALERT_RESERVOIR_LOW);
+  }
+}
+
+// ***
+// *** Uploads today's water volume and the estimated
+// *** reservoir level.
+// ***
+void sendWaterTotals()
+{
+  _cloud.sendValue(PSTR("water-today"), _waterAccount.getDayVolume(), 0, 0);
+
+  if (_waterAccount.getReservoirCapacity() > 0.0)
+  {
+    _cloud.sendValue(PSTR("reservoir-level"), _waterAccount.getReservoirPercent(), 0, 0);
+  }
+}
+
+// ***
+// *** The number of days since the epoch in local time,
+// *** or 0 when the clock has not been set.
+// ***
+uint32_t getLocalDay()
+{
+  uint32_t returnValue = 0;
+
+  if (_clock.isSynchronized())
+  {
+    returnValue = (uint32_t)((_clock.toEpoch(_clock.now()) + TZ_SEC + DST_SEC) / 86400);
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Called by the loop to get sensor data.
+// ***
+void readSensorData()
+{
+  // ***
+  // *** Read the data if the flag is set.
+  // ***
+  if (_readSensorData)
+  {
+    // ***
+    // *** Reset the flag.
+    // ***
+    _readSensorData = false;
+
+    // ***
+    // *** The duty cycled modes read every device each time.
+    // ***
+    uint8_t devices = _powerManager.isDutyCycled() ? DEVICE_ALL : _sampler.getDueDevices(_clock.now());
+
+    if (devices != 0)
+    {
+      Serial.println("Reading sensor data.");
+
+      // ***
+      // *** Read the sensor data.
+      // ***
+      getSensorData(devices);
+
+      // ***
+      // *** Stream the data to the local network.
+      // ***
+      sendTelemetry();
+
+#ifdef ENABLE_STATUS_SERVER
+      // ***
+      // *** Render the status responses from the new data.
+      // ***
+      updateStatus();
+#endif
+
+      // ***
+      // *** Show the data on the serial port.
+      // ***
+      Serial.println("Displaying sensor data.");
+      displaySensorData();
+    }
+  }
+}
+
+// ***
+// *** Sends the last sensor data to the local network. The packet
+// *** carries epoch time once NTP has synchronized.
+// ***
+void sendTelemetry()
+{
+  bool isEpoch = _clock.isSynchronized();
+  uint64_t timestamp = isEpoch ? _clock.toEpochMillis(_sensorData.capturedAt) : _sensorData.capturedAt;
+  _telemetry.send(_sensorData, timestamp, isEpoch, _myUnits == FAHRENHEIT);
+}
+
+// ***
+// *** Sends the first count kept readings to the local network
+// *** in as few packets as possible (see TelemetryBatch.h). Only
+// *** the readings the cloud accepted are sent so that each one
+// *** reaches the collector once.
+// ***
+void sendTelemetryBatch(uint8_t count)
+{
+  bool isEpoch = _clock.isSynchronized();
+  CloudData sample;
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    _powerManager.getSample(i, sample);
+    uint64_t timestamp = isEpoch ? _clock.toEpochMillis(sample.capturedAt) : sample.capturedAt;
+
+    if (!_telemetry.addToBatch(sample, timestamp, isEpoch, _myUnits == FAHRENHEIT))
+    {
+      _telemetry.sendBatch();
+      _telemetry.addToBatch(sample, timestamp, isEpoch, _myUnits == FAHRENHEIT);
+    }
+  }
+
+  _telemetry.sendBatch();
+}
+
+#ifdef ENABLE_STATUS_SERVER
+// ***
+// *** Gives the status server a snapshot of the last sensor
+// *** data and the system state.
+// ***
+void updateStatus()
+{
+  StatusSnapshot snapshot;
+  snapshot.data = &_sensorData;
+  snapshot.isFahrenheit = (_myUnits == FAHRENHEIT);
+  snapshot.capturedAt = _clock.toEpoch(_sensorData.capturedAt);
+  snapshot.uptime = (uint32_t)(_clock.now() / 1000);
+  snapshot.freeHeap = ESP.getFreeHeap();
+  snapshot.rssi = WiFi.RSSI();
+  snapshot.isPumpOn = _waterPumpController.isOn();
+  snapshot.isClockSynchronized = _clock.isSynchronized();
+  snapshot.clockSyncCount = _clock.getSyncCount();
+  snapshot.clockDriftRate = _clock.getDriftRate();
+  snapshot.cloudTokens = _cloud.getGovernor().getTokens();
+  snapshot.cloudPendingReadings = _cloud.getPendingReadings();
+  snapshot.cloudPendingAlerts = _cloud.getPendingAlerts();
+  snapshot.cloudThrottleCount = _cloud.getGovernor().getThrottleCount();
+
+  for (uint8_t i = 0; i < PUBLISH_PRIORITY_COUNT; i++)
+  {
+    snapshot.cloudDeferred[i] = _cloud.getGovernor().getDeferred((enum publishPriority)i);
+  }
+
+  snapshot.waterDayVolume = _waterAccount.getDayVolume();
+  snapshot.waterTotalVolume = _waterAccount.getTotalVolume();
+  snapshot.waterBudget = _waterAccount.getBudget();
+  snapshot.waterEventCount = _waterAccount.getEventCount();
+  snapshot.reservoirLevel = _waterAccount.getReservoirLevel();
+  snapshot.reservoirPercent = _waterAccount.getReservoirPercent();
+
+  _statusServer.update(snapshot);
+}
+#endif
+
+// ***
+// *** Called by the loop to send sensor data.
+// ***
+void sendSensorData()
+{
+  // ***
+  // *** Send the data to the cloud if the flag is set.
+  // ***
+  if (_sendSensorData)
+  {
+    // ***
+    // *** Reset the flag.
+    // ***
+    _sendSensorData = false;
+
+    if (_sensorData.initialized)
+    {
+      Serial.println("Sending sensor data to the cloud.");
+
+#ifdef UPLOAD_ROLLUPS
+      // ***
+      // *** Send the minutes that have closed since the last send.
+      // ***
+      sendRollups();
+#else
+      // ***
+      // *** Send the data to the cloud stamped with the time it
+      // *** was captured. When the publish budget is used up the
+      // *** reading is averaged with the next ones and sent later.
+      // ***
+      _cloud.publishData(_sensorData, _clock.toEpoch(_sensorData.capturedAt));
+#endif
+    }
+
+    PublishGovernor& governor = _cloud.getGovernor();
+    Serial.print("Cloud tokens: "); Serial.print(governor.getTokens(), 1); Serial.print(" of "); Serial.print(governor.getCapacity());
+    Serial.print(", deferred: "); Serial.print(governor.getDeferred(PUBLISH_BULK)); Serial.print(" bulk, "); Serial.print(governor.getDeferred(PUBLISH_CONTROL));
+    Serial.print(" control, pending: "); Serial.print(_cloud.getPendingReadings()); Serial.println(" reading(s).");
+
+    // ***
+    // *** Reset the is active flag.
+    // ***
+    Serial.println("Data send to cloud completed.");
+    Serial.println();
+  }
+}
+
+// ***
+// *** Uploads each closed minute rollup that has not been sent
+// *** yet, oldest first. Rollups wait (up to ROLLUP_MINUTE_BUCKETS
+// *** minutes) until NTP has synchronized so that they can be
+// *** stamped with the start of their minute.
+// ***
+void sendRollups()
+{
+  alignRollups();
+
+  if (_clock.isSynchronized())
+  {
+    RollupBucket buckets[CHANNEL_COUNT];
+    uint8_t count = _rollups[0].getCount(ROLLUP_MINUTE);
+
+    for (int16_t age = count - 1; age >= 0; age--)
+    {
+      uint32_t period = _rollups[0].getPeriod(ROLLUP_MINUTE, age);
+
+      if (period > _lastUploadedPeriod || _lastUploadedPeriod == 0)
+      {
+        for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+        {
+          buckets[i] = _rollups[i].getBucket(ROLLUP_MINUTE, age);
+        }
+
+#ifdef UPLOAD_ROLLUP_EXTREMES
+        bool extremes = true;
+#else
+        bool extremes = false;
+#endif
+        time_t createdAt = _clock.toEpoch(_rollups[0].getPeriodStart(ROLLUP_MINUTE, period));
+
+        if (!_cloud.sendRollup(buckets, createdAt, extremes))
+        {
+          // ***
+          // *** Try again on the next send.
+          // ***
+          break;
+        }
+
+        _lastUploadedPeriod = period;
+      }
+    }
+  }
+  else
+  {
+    Serial.println("Waiting for NTP before sending rollups.");
+  }
+}
+
+// ***
+// *** Moves the rollup periods onto local time the first time
+// *** NTP has synchronized so that hours start on the clock hour
+// *** and days at local midnight.
+// ***
+void alignRollups()
+{
+  if (_clock.isSynchronized() && !_rollups[0].isAligned())
+  {
+    uint64_t tick = _clock.now();
+    int64_t offset = (int64_t)_clock.toEpochMillis(tick) - (int64_t)tick + ((int64_t)(TZ_SEC + DST_SEC) * 1000);
+
+    for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+    {
+      _rollups[i].align(offset);
+    }
+  }
+}
+
+// ***
+// *** Reads the given devices (a bit per enum sensorDevice) into
+// *** the data structure. The channels of the other devices keep
+// *** their last readings.
+// ***
+void getSensorData(uint8_t devices)
+{
+  _sensorData.capturedAt = _clock.now();
+
+  // ***
+  // *** Read each channel (see SensorChannels.h).
+  // ***
+#define READ_CHANNEL(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) \
+  if (devices & (1 << (device))) \
+  { \
+    _sensorData.field = read; \
+  }
+
+  SENSOR_CHANNELS(READ_CHANNEL)
+
+  if (devices & (1 << DEVICE_SOIL_MOISTURE))
+  {
+    _sensorData.soilMoistureQuality = _soilMonitor.getQuality();
+  }
+
+  _sensorData.initialized = true;
+
+  // ***
+  // *** Record the raw readings and, when the clock has been
+  // *** set, the epoch time so a replay can show real times.
+  // ***
+  _traceRecorder.recordSample(_sensorData.capturedAt, _soilMonitor, _envMonitor, _spectrumMonitor);
+
+  if (_clock.getSyncCount() != _tracedSyncCount && _clock.isSynchronized())
+  {
+    _tracedSyncCount = _clock.getSyncCount();
+    _traceRecorder.recordEpoch(_sensorData.capturedAt, _clock.toEpoch(_sensorData.capturedAt));
+  }
+
+  // ***
+  // *** Check the health of each channel that was read.
+  // ***
+  checkSensorHealth(devices);
+
+  // ***
+  // *** Calculate the derived metrics (see DerivedMetrics.h) once
+  // *** for this sample; everything else uses the stored values.
+  // ***
+  if (devices & ((1 << DEVICE_ENVIRONMENT) | (1 << DEVICE_SPECTRUM)))
+  {
+    calculateDerivedMetrics(_sensorData, _myUnits);
+  }
+
+  // ***
+  // *** Schedule the next read of each device from how its
+  // *** channels are changing.
+  // ***
+  _sampler.update(devices, _sensorData, _sensorData.capturedAt);
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    _sensorData.interval[i] = _sampler.getDeviceInterval(getChannelDevice((enum sensorChannel)i)) / 1000;
+  }
+}
+
+// ***
+// *** Runs each channel of the given devices through its health
+// *** monitor, stores the quality flags with the sample and raises
+// *** an alert when a channel fails or recovers.
+// ***
+void checkSensorHealth(uint8_t devices)
+{
+  uint32_t now = (uint32_t)_sensorData.capturedAt;
+  alignRollups();
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    enum sensorChannel channel = (enum sensorChannel)i;
+
+    if (devices & (1 << getChannelDevice(channel)))
+    {
+      float value = getChannelValue(_sensorData, channel);
+      _sensorData.quality[i] = _sensorHealth[i].check(value, now);
+
+      // ***
+      // *** Only usable samples are added to the rollups.
+      // ***
+      _rollups[i].add((_sensorData.quality[i] & QUALITY_EXCLUDE_MASK) ? NAN : value, _sensorData.capturedAt);
+
+      bool faulty = _sensorHealth[i].isFaulty();
+
+      if (faulty != _reportedFault[i])
+      {
+        _reportedFault[i] = faulty;
+
+        char message[CLOUD_ALERT_SIZE];
+        formatFaultAlert(channel, message, sizeof(message));
+        Serial.println(message);
+
+        if (_powerManager.isDutyCycled())
+        {
+          _pendingFaultAlerts |= (1 << i);
+        }
+        else
+        {
+          _cloud.sendAlert(message);
+        }
+      }
+    }
+    else
+    {
+      // ***
+      // *** Move the periods of the channels that were not read
+      // *** forward as well so that every rollup stays aligned
+      // *** (sendRollups() looks the buckets up by age).
+      // ***
+      _rollups[i].add(NAN, _sensorData.capturedAt);
+    }
+  }
+}
+
+// ***
+// *** Displays a marker after a reading that did
+// *** not pass the health checks.
+// ***
+void printQuality(enum sensorChannel channel)
+{
+  uint8_t quality = _sensorData.quality[channel];
+
+  if (quality & QUALITY_EXCLUDE_MASK)
+  {
+    Serial.print(F(" [FAULT 0x")); Serial.print(quality, HEX); Serial.print(F("]"));
+  }
+  else if (quality & QUALITY_SUSPECT_MASK)
+  {
+    Serial.print(F(" [SUSPECT 0x")); Serial.print(quality, HEX); Serial.print(F("]"));
+  }
+}
+
+// ***
+// *** Displays the units after a reading.
+// ***
+void printUnit(enum channelUnit unit)
+{
+  switch (unit)
+  {
+    case UNIT_TEMPERATURE:
+      Serial.print(_myUnits == FAHRENHEIT ? F(" F") : F(" C"));
+      break;
+    case UNIT_PERCENT:
+      Serial.print(F(" %"));
+      break;
+    case UNIT_LUX:
+      Serial.print(F(" lux"));
+      break;
+    case UNIT_KILOPASCALS:
+      Serial.print(F(" kPa"));
+      break;
+    case UNIT_GRAMS_PER_CUBIC_METER:
+      Serial.print(F(" g/m3"));
+      break;
+    default:
+      break;
+  }
+}
+
+// ***
+// *** Display the last sensor data readings
+// *** on the serial port.
+// ***
+void displaySensorData()
+{
+  if (_sensorData.initialized)
+  {
+    // ***
+    // *** Insert a blank line.
+    // ***
+    Serial.println();
 
     // ***
-    // *** Read the environmental temperature and humidity.
+    // *** Display the time the data was captured.
     // ***
-    Serial.print(F("Air Temperature: ")); Serial.print(_sensorData.environmentalTemperature); Serial.println(_myUnits == FAHRENHEIT ? F(" F") : F(" C"));
-    Serial.print(F("Humidity: ")); Serial.print(_sensorData.environmentalRelativeHumidity); Serial.println(F("%"));
+    if (_clock.isSynchronized())
+    {
+      time_t capturedAt = _clock.toEpoch(_sensorData.capturedAt);
+      Serial.print("Captured Date and Time: "); Serial.print(ctime(&capturedAt));
+      Serial.print(F("Clock Syncs: ")); Serial.print(_clock.getSyncCount());
+      Serial.print(F(", Last Sync: ")); Serial.print(_clock.getLastSyncAge()); Serial.print(F(" s ago"));
+      Serial.print(F(", Last Correction: ")); Serial.print(_clock.getLastDrift()); Serial.print(F(" ms"));
+      Serial.print(F(", Drift: ")); Serial.print(_clock.getDriftRate(), 1); Serial.println(F(" ppm"));
+      Serial.println();
+    }
+    else
+    {
+      Serial.print(F("Captured at Tick: ")); Serial.print((uint32_t)_sensorData.capturedAt); Serial.println(F(" ms (waiting for NTP)"));
+      Serial.println();
+    }
 
     // ***
-    // *** Get Soil Readings
+    // *** Display each channel (see SensorChannels.h).
     // ***
-    Serial.print(F("Soil Temperature is: ")); Serial.print(_sensorData.soilTemperature); Serial.println(_myUnits == FAHRENHEIT ? F(" F") : F(" C"));
-    Serial.print(F("Soil Moisture Level: ")); Serial.print(_sensorData.soilMoistureLevel); Serial.println(F(" %"));
+#define DISPLAY_CHANNEL(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) \
+    if ((policy) & REPORT_DISPLAY) \
+    { \
+      Serial.print(F(name ": ")); Serial.print((float)_sensorData.field, decimals); printUnit(unit); printQuality(id); Serial.println(); \
+    }
+
+    SENSOR_CHANNELS(DISPLAY_CHANNEL)
+
     Serial.print(F("Soil Moisture Quality: ")); Serial.println(_sensorData.soilMoistureQuality);
 
     // ***
-    // *** Get Light Spectrum Readings
+    // *** Display each derived metric that could be calculated.
+    // ***
+#define DISPLAY_METRIC(id, field, key, label, name, unit, decimals, policy) \
+    if (((policy) & REPORT_DISPLAY) && !isnan(_sensorData.field)) \
+    { \
+      Serial.print(F(name ": ")); Serial.print(_sensorData.field, decimals); printUnit(unit); Serial.println(); \
+    }
+
+    DERIVED_METRICS(DISPLAY_METRIC)
+
+    // ***
+    // *** Display how often each device is being read.
     // ***
-    Serial.print(F("Full: ")); Serial.println(_spectrumMonitor.getFull(true));
-    Serial.print(F("IR: ")); Serial.println(_spectrumMonitor.getIr());
-    Serial.print(F("Visible: ")); Serial.println(_spectrumMonitor.getVisible());
-    Serial.print(F("Lux: ")); Serial.println(_spectrumMonitor.getLux(), 2);
+    Serial.print(F("Read Intervals:"));
+
+    for (uint8_t i = 0; i < DEVICE_COUNT; i++)
+    {
+      enum sensorDevice device = (enum sensorDevice)i;
+      Serial.print(i == 0 ? F(" ") : F(", ")); Serial.print(FPSTR(AdaptiveSampler::getDeviceName(device)));
+      Serial.print(F(" ")); Serial.print(_sampler.getDeviceInterval(device) / 1000); Serial.print(F(" s"));
+    }
+
+    Serial.println();
 
     // ***
     // *** Put an extra blank line in the serial output between readings.
@@ -429,6 +1614,277 @@ void handleWaterPumpMessage(AdafruitIO_Data *data)
 {
   Serial.print("Received speed value of "); Serial.print(data->value()); Serial.println(" from the cloud.");
   uint8_t speed = data->toUnsignedInt();
-  Serial.print("Setting water pump speed to "); Serial.println(speed);
-  _waterPumpController.on(speed);
+  if (speed > 0 && _waterAccount.getAllowance() < WATER_MINIMUM_VOLUME)
+  {
+    Serial.println("No more water is allowed; the water pump stays off.");
+  }
+  else
+  {
+    Serial.print("Setting water pump speed to "); Serial.println(speed);
+    _waterPumpController.on(speed);
+  }
+}
+
+// ***
+// *** Reads commands from the serial port one character at a
+// *** time so that the loop is never blocked. Supported commands:
+// ***
+// *** rollup m|h|d    Show the minute, hour or day rollups.
+// *** trace dump       Write the trace file to the serial port.
+// *** trace clear      Delete the trace file and start a new one.
+// *** watchdog         Show the loop statistics and the stages
+// ***                  that ran before the last reset.
+// *** water            Show the water totals.
+// *** water refill     Reset the reservoir estimate after filling it.
+// *** pump calibrate n Scale the flow so that the last watering
+// ***                  delivered n ml (measured).
+// *** ota              Show the firmware version and update state.
+// *** ota update       Install the latest firmware now.
+// ***
+void processSerialCommands()
+{
+  while (Serial.available() > 0)
+  {
+    char c = Serial.read();
+
+    if (c == '\r' || c == '\n')
+    {
+      if (_serialCommandLength > 0)
+      {
+        _serialCommand[_serialCommandLength] = 0;
+        runSerialCommand(_serialCommand);
+        _serialCommandLength = 0;
+      }
+    }
+    else if (_serialCommandLength < SERIAL_COMMAND_SIZE - 1)
+    {
+      _serialCommand[_serialCommandLength++] = c;
+    }
+  }
+}
+
+void runSerialCommand(const char* command)
+{
+  if (strncmp(command, "rollup ", 7) == 0)
+  {
+    enum rollupResolution resolution = ROLLUP_MINUTE;
+
+    if (command[7] == 'h')
+    {
+      resolution = ROLLUP_HOUR;
+    }
+    else if (command[7] == 'd')
+    {
+      resolution = ROLLUP_DAY;
+    }
+
+    displayRollups(resolution);
+  }
+  else if (strcmp(command, "trace dump") == 0)
+  {
+    _watchdog.enter(STAGE_DUMP);
+    dumpTrace();
+  }
+  else if (strcmp(command, "trace clear") == 0)
+  {
+    clearTrace();
+  }
+  else if (strcmp(command, "watchdog") == 0)
+  {
+    Serial.print(F("Stage overruns: ")); Serial.print(_watchdog.getOverrunCount());
+    Serial.print(F(", slow iterations: ")); Serial.print(_watchdog.getSlowIterations());
+    Serial.print(F(", longest iteration: ")); Serial.print(_watchdog.getLongestIteration()); Serial.println(F(" ms"));
+    Serial.print(F("Reset reason: ")); Serial.println(ESP.getResetReason());
+    displayBreadcrumbs();
+  }
+  else if (strcmp(command, "water") == 0)
+  {
+    displayWaterTotals();
+  }
+  else if (strcmp(command, "water refill") == 0)
+  {
+    _waterAccount.refill();
+    displayWaterTotals();
+  }
+  else if (strncmp(command, "pump calibrate ", 15) == 0)
+  {
+    if (_waterAccount.calibrate(atof(command + 15)))
+    {
+      Serial.print(F("Pump flow scale is now ")); Serial.print(_waterPumpController.getFlowScale(), 3); Serial.println(F("."));
+    }
+    else
+    {
+      Serial.println(F("Run the pump and measure the water delivered first."));
+    }
+  }
+  else if (strcmp(command, "ota") == 0)
+  {
+    Serial.print(F("Firmware ")); Serial.print(FIRMWARE_VERSION);
+    Serial.print(_otaUpdater.isEnabled() ? F(", updates from ") : F(", updates are off")); Serial.println(OTA_SERVER_URL);
+
+    if (_otaUpdater.isPending())
+    {
+      Serial.print(F("Not confirmed yet, started ")); Serial.print(_otaUpdater.getBootAttempts()); Serial.print(F(" time(s); replaces firmware "));
+      Serial.println(_otaUpdater.getPreviousVersion());
+    }
+
+    if (_otaUpdater.getFailedVersion() != 0)
+    {
+      Serial.print(F("Firmware ")); Serial.print(_otaUpdater.getFailedVersion()); Serial.println(F(" failed and will not be installed again."));
+    }
+  }
+  else if (strcmp(command, "ota update") == 0)
+  {
+    _watchdog.enter(STAGE_OTA);
+    installLatestFirmware();
+  }
+  else
+  {
+    Serial.print(F("Unknown command: ")); Serial.println(command);
+  }
+}
+
+// ***
+// *** Display the water totals on the serial port.
+// ***
+void displayWaterTotals()
+{
+  Serial.print(F("Water today: ")); Serial.print(_waterAccount.getDayVolume(), 0); Serial.print(F(" ml"));
+
+  if (_waterAccount.getBudget() > 0.0)
+  {
+    Serial.print(F(" of ")); Serial.print(_waterAccount.getBudget(), 0); Serial.print(F(" ml"));
+  }
+
+  Serial.println();
+  Serial.print(F("Water total: ")); Serial.print(_waterAccount.getTotalVolume(), 0); Serial.print(F(" ml in ")); Serial.print(_waterAccount.getEventCount()); Serial.println(F(" event(s)"));
+  Serial.print(F("Last event: ")); Serial.print(_waterAccount.getLastEventVolume(), 0); Serial.println(F(" ml"));
+
+  if (_waterAccount.getReservoirCapacity() > 0.0)
+  {
+    Serial.print(F("Reservoir: about ")); Serial.print(_waterAccount.getReservoirLevel(), 0); Serial.print(F(" ml (")); Serial.print(_waterAccount.getReservoirPercent(), 0); Serial.println(F("%)"));
+  }
+}
+
+// ***
+// *** Display the closed rollups of every channel,
+// *** newest first, on the serial port.
+// ***
+void displayRollups(enum rollupResolution resolution)
+{
+  Serial.println();
+
+  if (!_rollups[0].isAligned())
+  {
+    Serial.println(F("Periods start at boot until NTP has synchronized."));
+  }
+
+#if POWER_MODE == POWER_DEEP_SLEEP
+  Serial.println(F("Rollups are kept in RAM and start over on every wake."));
+#endif
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    Serial.println(FPSTR(getChannelName((enum sensorChannel)i)));
+
+    for (uint8_t age = 0; age < _rollups[i].getCount(resolution); age++)
+    {
+      RollupBucket bucket = _rollups[i].getBucket(resolution, age);
+      uint64_t start = _rollups[i].getPeriodStart(resolution, _rollups[i].getPeriod(resolution, age));
+
+      if (_clock.isSynchronized())
+      {
+        time_t epoch = _clock.toEpoch(start);
+        char text[20];
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M", localtime(&epoch));
+        Serial.print(F("  ")); Serial.print(text);
+      }
+      else
+      {
+        Serial.print(F("  T+")); Serial.print((uint32_t)(start / 1000)); Serial.print(F("s"));
+      }
+
+      Serial.print(F("  n=")); Serial.print(bucket.count);
+
+      if (bucket.count > 0)
+      {
+        Serial.print(F("  min=")); Serial.print(bucket.minimum);
+        Serial.print(F("  mean=")); Serial.print(bucket.mean);
+        Serial.print(F("  max=")); Serial.print(bucket.maximum);
+      }
+
+      Serial.println();
+    }
+  }
+
+  Serial.println();
+}
+
+// ***
+// *** Opens the trace output and writes the header.
+// ***
+void startTrace()
+{
+#if defined(TRACE_TO_FILE)
+  if (LittleFS.begin())
+  {
+    _traceFile = LittleFS.open(TRACE_FILE, "a");
+
+    if (_traceFile && _traceFile.size() < TRACE_FILE_LIMIT)
+    {
+      _traceRecorder.begin(&_traceFile, false, TRACE_FILE_LIMIT - _traceFile.size());
+      Serial.print(F("Recording trace to ")); Serial.print(TRACE_FILE); Serial.print(F(" (")); Serial.print(_traceFile.size()); Serial.println(F(" bytes)."));
+    }
+    else
+    {
+      Serial.println(F("The trace file could not be opened or is full."));
+    }
+  }
+#elif defined(TRACE_TO_SERIAL)
+  _traceRecorder.begin(&Serial, true, 0xFFFFFFFF);
+#endif
+
+  _traceRecorder.writeHeader(_clock.now(), _myUnits, SOIL_MOISTURE_DRY, SOIL_MOISTURE_WET);
+  _tracedSyncCount = 0;
+}
+
+// ***
+// *** Writes the trace file to the serial port as "#T " lines
+// *** that Tools/Replay can read from a captured log.
+// ***
+void dumpTrace()
+{
+#ifdef TRACE_TO_FILE
+  _traceRecorder.flush();
+
+  File file = LittleFS.open(TRACE_FILE, "r");
+
+  if (file)
+  {
+    uint8_t buffer[64];
+    size_t length = 0;
+
+    while ((length = file.read(buffer, sizeof(buffer))) > 0)
+    {
+      TraceRecorder::writeText(&Serial, buffer, length);
+    }
+
+    file.close();
+  }
+#else
+  Serial.println(F("Define TRACE_TO_FILE to record a trace file."));
+#endif
+}
+
+// ***
+// *** Deletes the trace file and starts a new one.
+// ***
+void clearTrace()
+{
+#ifdef TRACE_TO_FILE
+  _traceRecorder.end();
+  _traceFile.close();
+  LittleFS.remove(TRACE_FILE);
+  startTrace();
+#endif
 }
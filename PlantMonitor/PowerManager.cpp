@@ -0,0 +1,373 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "PowerManager.h"
+
+extern "C" {
+#include <user_interface.h>
+}
+
+// ***
+// *** Called by the SDK when a forced light sleep ends.
+// ***
+static void lightSleepWakeCallback()
+{
+}
+
+PowerManager::PowerManager(Clock& clock, RtcMemory& rtcMemory) : _clock(clock), _rtcMemory(rtcMemory)
+{
+}
+
+// ***
+// *** Sets the mode and the task intervals (ms). Call after
+// *** RtcMemory::begin(). In deep sleep mode the state is restored
+// *** when the device has woken from deep sleep; returns true if
+// *** it was (false on a cold boot).
+// ***
+bool PowerManager::begin(uint8_t mode, uint32_t readInterval, uint32_t sendInterval, uint32_t checkInterval)
+{
+  bool returnValue = false;
+
+  this->_mode = mode;
+  this->_readInterval = readInterval;
+  this->_sendInterval = sendInterval;
+  this->_checkInterval = checkInterval;
+
+  RtcState& state = this->_rtcMemory.getState();
+
+  if (mode == POWER_DEEP_SLEEP && this->_rtcMemory.isValid() && ESP.getResetInfoPtr()->reason == REASON_DEEP_SLEEP_AWAKE)
+  {
+    this->_clock.setState(&state.clock);
+    returnValue = true;
+  }
+  else
+  {
+    // ***
+    // *** Read and check now. The first upload goes with the
+    // *** reading that completes the first interval's readings
+    // *** (the one at the end of the interval would be one more)
+    // *** so that every upload carries the same number of them.
+    // ***
+    uint64_t now = this->_clock.now();
+    memset(&state.schedule, 0, sizeof(RtcSchedule));
+    state.schedule.nextRead = now;
+    state.schedule.nextCheck = now;
+    state.schedule.nextSend = now + sendInterval - min(readInterval, sendInterval);
+    state.sampleCount = 0;
+  }
+
+  this->_cycleStart = this->_clock.now();
+  this->_isRadioOn = (mode == POWER_ALWAYS_ON || !returnValue);
+
+  return returnValue;
+}
+
+uint8_t PowerManager::getMode()
+{
+  return this->_mode;
+}
+
+bool PowerManager::isDutyCycled()
+{
+  return this->_mode != POWER_ALWAYS_ON;
+}
+
+// ***
+// *** Returns the POWER_TASK_* flags of the tasks that are due
+// *** and schedules their next run. A task that fell behind (for
+// *** example after a long upload) is not run more than once.
+// ***
+uint8_t PowerManager::getDueTasks()
+{
+  uint8_t returnValue = 0;
+  uint64_t now = this->_clock.now();
+  RtcSchedule& schedule = this->_rtcMemory.getState().schedule;
+
+  if (now >= schedule.nextRead)
+  {
+    returnValue |= POWER_TASK_READ;
+    schedule.nextRead = max(schedule.nextRead + this->_readInterval, now + 1);
+  }
+
+  if (now >= schedule.nextCheck)
+  {
+    returnValue |= POWER_TASK_CHECK;
+    schedule.nextCheck = max(schedule.nextCheck + this->_checkInterval, now + 1);
+  }
+
+  if (now >= schedule.nextSend)
+  {
+    returnValue |= POWER_TASK_SEND;
+    schedule.nextSend = max(schedule.nextSend + this->_sendInterval, now + 1);
+  }
+
+  return returnValue;
+}
+
+uint64_t PowerManager::getNextTask()
+{
+  RtcSchedule& schedule = this->_rtcMemory.getState().schedule;
+  return min(schedule.nextRead, min(schedule.nextSend, schedule.nextCheck));
+}
+
+// ***
+// *** The time (ms) until the next task is due.
+// ***
+uint32_t PowerManager::getSleepTime()
+{
+  uint64_t now = this->_clock.now();
+  uint64_t next = this->getNextTask();
+  return next > now ? (uint32_t)(next - now) : 0;
+}
+
+// ***
+// *** Ends the cycle and sleeps until the next task is due. In deep
+// *** sleep mode this does not return; the device restarts.
+// ***
+void PowerManager::sleep()
+{
+  if (this->isDutyCycled())
+  {
+    RtcSchedule& schedule = this->_rtcMemory.getState().schedule;
+    uint32_t awakeTime = this->getAwakeTime();
+
+    schedule.cycleCount++;
+    schedule.lastAwakeTime = awakeTime;
+    schedule.awakeTimeTotal += awakeTime;
+    schedule.awakeCycles++;
+
+    if (this->_isRadioOn)
+    {
+      this->stopRadio();
+    }
+
+    uint32_t sleepTime = this->getSleepTime();
+
+    if (this->_mode == POWER_DEEP_SLEEP)
+    {
+      this->deepSleep(sleepTime);
+    }
+    else if (sleepTime >= POWER_MINIMUM_SLEEP)
+    {
+      this->lightSleep(sleepTime);
+    }
+
+    this->_cycleStart = this->_clock.now();
+  }
+}
+
+// ***
+// *** Forced light sleep with the radio off. The system timer may
+// *** not count while asleep; any time it missed is added to the
+// *** clock so the schedule and the timestamps stay right.
+// ***
+void PowerManager::lightSleep(uint32_t sleepTime)
+{
+  Serial.flush();
+
+  while (sleepTime >= POWER_MINIMUM_SLEEP)
+  {
+    uint32_t period = min(sleepTime, (uint32_t)POWER_MAXIMUM_LIGHT_SLEEP);
+    uint64_t start = micros64();
+
+    wifi_set_opmode_current(NULL_MODE);
+    wifi_fpm_set_sleep_type(LIGHT_SLEEP_T);
+    wifi_fpm_open();
+    wifi_fpm_set_wakeup_cb(lightSleepWakeCallback);
+    wifi_fpm_do_sleep(period * 1000);
+    delay(period + 1);
+    wifi_fpm_close();
+
+    uint32_t counted = (uint32_t)((micros64() - start) / 1000);
+
+    if (counted < period)
+    {
+      this->_clock.advance(period - counted);
+    }
+
+    sleepTime -= period;
+  }
+}
+
+// ***
+// *** Saves the state and goes into deep sleep. The radio is only
+// *** enabled at the next wake up if that wake up will upload.
+// ***
+void PowerManager::deepSleep(uint32_t sleepTime)
+{
+  RtcState& state = this->_rtcMemory.getState();
+  uint32_t maximum = (uint32_t)(ESP.deepSleepMax() / 1000);
+  sleepTime = min(sleepTime, maximum);
+
+  uint64_t wake = this->_clock.now() + sleepTime;
+  bool willUpload = (wake >= state.schedule.nextSend) ||
+                    (wake >= state.schedule.nextRead && state.sampleCount + 1 >= RTC_SAMPLE_COUNT);
+
+  this->_clock.getState(&state.clock, sleepTime);
+  this->_rtcMemory.save();
+
+  Serial.flush();
+  ESP.deepSleep((uint64_t)sleepTime * 1000, willUpload ? WAKE_RF_DEFAULT : WAKE_RF_DISABLED);
+}
+
+// ***
+// *** Keeps a reading to upload later. When the buffer is full
+// *** the oldest reading is dropped and false is returned.
+// ***
+bool PowerManager::addSample(const CloudData& data)
+{
+  bool returnValue = true;
+  RtcState& state = this->_rtcMemory.getState();
+
+  if (state.sampleCount >= RTC_SAMPLE_COUNT)
+  {
+    this->removeSamples(1);
+    returnValue = false;
+  }
+
+  RtcSample& sample = state.samples[state.sampleCount++];
+  sample.capturedAt = (uint32_t)(data.capturedAt / 1000);
+#define RTC_SAMPLE_SAVE(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) sample.field = data.field;
+  SENSOR_CHANNELS(RTC_SAMPLE_SAVE)
+  memcpy(sample.quality, data.quality, CHANNEL_COUNT);
+  sample.isSoilDry = (data.soilMoistureQuality == "Dry") ? 1 : 0;
+
+  return returnValue;
+}
+
+uint8_t PowerManager::getSampleCount()
+{
+  return this->_rtcMemory.getState().sampleCount;
+}
+
+bool PowerManager::isBufferFull()
+{
+  return this->_rtcMemory.getState().sampleCount >= RTC_SAMPLE_COUNT;
+}
+
+// ***
+// *** Gets a kept reading (0 is the oldest).
+// ***
+void PowerManager::getSample(uint8_t index, CloudData& data)
+{
+  const RtcSample& sample = this->_rtcMemory.getState().samples[index];
+
+  data.initialized = true;
+  data.capturedAt = (uint64_t)sample.capturedAt * 1000;
+#define RTC_SAMPLE_LOAD(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) data.field = sample.field;
+  SENSOR_CHANNELS(RTC_SAMPLE_LOAD)
+  memcpy(data.quality, sample.quality, CHANNEL_COUNT);
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    data.interval[i] = this->_readInterval / 1000;
+  }
+
+  data.soilMoistureQuality = sample.isSoilDry ? "Dry" : "Good";
+}
+
+// ***
+// *** Removes the oldest readings (e.g. once they are uploaded).
+// ***
+void PowerManager::removeSamples(uint8_t count)
+{
+  RtcState& state = this->_rtcMemory.getState();
+  count = min(count, state.sampleCount);
+  memmove(&state.samples[0], &state.samples[count], (state.sampleCount - count) * sizeof(RtcSample));
+  state.sampleCount -= count;
+}
+
+// ***
+// *** Turns WiFi on and waits for it to connect using the
+// *** saved credentials. Returns true when connected.
+// ***
+bool PowerManager::startRadio()
+{
+  if (!this->_isRadioOn)
+  {
+    WiFi.forceSleepWake();
+    WiFi.mode(WIFI_STA);
+    WiFi.begin();
+    this->_isRadioOn = true;
+  }
+
+  uint32_t start = millis();
+
+  while (WiFi.status() != WL_CONNECTED && (millis() - start) < POWER_WIFI_TIMEOUT)
+  {
+    delay(100);
+  }
+
+  return WiFi.status() == WL_CONNECTED;
+}
+
+// ***
+// *** Turns WiFi off. Does nothing when always on.
+// ***
+void PowerManager::stopRadio()
+{
+  if (this->isDutyCycled() && this->_isRadioOn)
+  {
+    WiFi.disconnect();
+    WiFi.mode(WIFI_OFF);
+    WiFi.forceSleepBegin();
+    delay(1);
+    this->_isRadioOn = false;
+  }
+}
+
+bool PowerManager::isRadioOn()
+{
+  return this->_isRadioOn;
+}
+
+// ***
+// *** The time (ms) awake in this cycle so far.
+// ***
+uint32_t PowerManager::getAwakeTime()
+{
+  return (uint32_t)(this->_clock.now() - this->_cycleStart);
+}
+
+// ***
+// *** The time (ms) awake in the previous cycle.
+// ***
+uint32_t PowerManager::getLastAwakeTime()
+{
+  return this->_rtcMemory.getState().schedule.lastAwakeTime;
+}
+
+// ***
+// *** The average time (ms) awake per cycle since resetAwakeTime().
+// ***
+uint32_t PowerManager::getAverageAwakeTime()
+{
+  RtcSchedule& schedule = this->_rtcMemory.getState().schedule;
+  return schedule.awakeCycles > 0 ? schedule.awakeTimeTotal / schedule.awakeCycles : 0;
+}
+
+void PowerManager::resetAwakeTime()
+{
+  RtcSchedule& schedule = this->_rtcMemory.getState().schedule;
+  schedule.awakeTimeTotal = 0;
+  schedule.awakeCycles = 0;
+}
+
+uint32_t PowerManager::getCycleCount()
+{
+  return this->_rtcMemory.getState().schedule.cycleCount;
+}
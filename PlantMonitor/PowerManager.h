@@ -0,0 +1,118 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include "Clock.h"
+#include "CloudData.h"
+#include "RtcMemory.h"
+
+// ***
+// *** Power modes.
+// ***
+// ***   POWER_ALWAYS_ON    The CPU and WiFi run continuously and the
+// ***                      tasks are run by timers (the default).
+// ***   POWER_LIGHT_SLEEP  Forced light sleep between tasks. RAM is
+// ***                      kept; WiFi is only on while uploading.
+// ***   POWER_DEEP_SLEEP   Deep sleep between tasks. The device
+// ***                      restarts on each wake up and the schedule,
+// ***                      clock, readings and controller state are
+// ***                      kept in RTC memory. GPIO16 (D0) must be
+// ***                      connected to RST for the device to wake.
+// ***
+#define POWER_ALWAYS_ON   0
+#define POWER_LIGHT_SLEEP 1
+#define POWER_DEEP_SLEEP  2
+
+// ***
+// *** The tasks returned by getDueTasks().
+// ***
+#define POWER_TASK_READ   0x01
+#define POWER_TASK_SEND   0x02
+#define POWER_TASK_CHECK  0x04
+
+// ***
+// *** How long to wait for WiFi to connect (ms).
+// ***
+#define POWER_WIFI_TIMEOUT        1000 * 15
+
+// ***
+// *** Shorter sleeps are not worth it (ms).
+// ***
+#define POWER_MINIMUM_SLEEP       50
+
+// ***
+// *** The longest forced light sleep the SDK allows (ms).
+// ***
+#define POWER_MAXIMUM_LIGHT_SLEEP 268000
+
+// ***
+// *** Schedules the tasks in the duty cycled power modes, keeps
+// *** the readings waiting to be uploaded, turns WiFi on only to
+// *** upload and puts the device to sleep between tasks.
+// ***
+class PowerManager
+{
+  public:
+    PowerManager(Clock&, RtcMemory&);
+    bool begin(uint8_t mode, uint32_t readInterval, uint32_t sendInterval, uint32_t checkInterval);
+    uint8_t getMode();
+    bool isDutyCycled();
+    uint8_t getDueTasks();
+    uint32_t getSleepTime();
+    void sleep();
+
+    bool addSample(const CloudData&);
+    uint8_t getSampleCount();
+    bool isBufferFull();
+    void getSample(uint8_t index, CloudData&);
+    void removeSamples(uint8_t count);
+
+    bool startRadio();
+    void stopRadio();
+    bool isRadioOn();
+
+    uint32_t getAwakeTime();
+    uint32_t getLastAwakeTime();
+    uint32_t getAverageAwakeTime();
+    void resetAwakeTime();
+    uint32_t getCycleCount();
+
+  private:
+    Clock& _clock;
+    RtcMemory& _rtcMemory;
+
+    uint8_t _mode = POWER_ALWAYS_ON;
+    uint32_t _readInterval = 0;
+    uint32_t _sendInterval = 0;
+    uint32_t _checkInterval = 0;
+
+    // ***
+    // *** The tick when this cycle started (boot or wake up).
+    // ***
+    uint64_t _cycleStart = 0;
+
+    bool _isRadioOn = false;
+
+    uint64_t getNextTask();
+    void lightSleep(uint32_t);
+    void deepSleep(uint32_t);
+};
+#endif
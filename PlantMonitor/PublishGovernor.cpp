@@ -0,0 +1,181 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "PublishGovernor.h"
+
+PublishGovernor::PublishGovernor()
+{
+  memset(this->_published, 0, sizeof(this->_published));
+  memset(this->_deferred, 0, sizeof(this->_deferred));
+}
+
+// ***
+// *** Starts with a full bucket holding this device's share
+// *** of one minute of the account's budget.
+// ***
+void PublishGovernor::begin(uint16_t pointsPerMinute, uint8_t devices)
+{
+  this->_capacity = (float)pointsPerMinute / max(devices, (uint8_t)1);
+  this->_rate = this->_capacity / (1000.0 * 60.0);
+  this->_tokens = this->_capacity;
+  this->_lastRefill = millis();
+  this->_isHolding = false;
+}
+
+// ***
+// *** Returns true if a request of the given number of data
+// *** points could be published now. Nothing is taken.
+// ***
+bool PublishGovernor::isAvailable(enum publishPriority priority, uint16_t points)
+{
+  this->refill();
+  return !this->_isHolding && (this->_tokens - points) >= this->getReserve(priority);
+}
+
+// ***
+// *** Takes the tokens for a request. Returns false when the
+// *** budget does not allow it; nothing is taken.
+// ***
+bool PublishGovernor::acquire(enum publishPriority priority, uint16_t points)
+{
+  bool returnValue = this->isAvailable(priority, points);
+
+  if (returnValue)
+  {
+    this->_tokens -= points;
+    this->_published[priority] += points;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Gives back tokens taken for a request that did not reach
+// *** the server (e.g. the connection failed).
+// ***
+void PublishGovernor::release(uint16_t points)
+{
+  this->_tokens = min(this->_capacity, this->_tokens + points);
+}
+
+// ***
+// *** Counts a request that was kept to be sent later (or
+// *** folded into another one) because there were no tokens.
+// ***
+void PublishGovernor::defer(enum publishPriority priority)
+{
+  this->_deferred[priority]++;
+}
+
+// ***
+// *** Called when the server reports that the account is over
+// *** its limit (e.g. by other devices). The bucket is emptied
+// *** and nothing is published for GOVERNOR_THROTTLE_HOLD.
+// ***
+void PublishGovernor::throttle()
+{
+  this->_tokens = 0.0;
+  this->_isHolding = true;
+  this->_holdStart = millis();
+  this->_lastRefill = this->_holdStart;
+  this->_throttleCount++;
+}
+
+bool PublishGovernor::isThrottled()
+{
+  this->refill();
+  return this->_isHolding;
+}
+
+float PublishGovernor::getTokens()
+{
+  this->refill();
+  return this->_tokens;
+}
+
+uint16_t PublishGovernor::getCapacity()
+{
+  return (uint16_t)this->_capacity;
+}
+
+// ***
+// *** The largest request (data points) of a priority that can
+// *** ever be granted: a full bucket less the reserve. Larger
+// *** requests must be split. It is at least one.
+// ***
+uint16_t PublishGovernor::getRequestLimit(enum publishPriority priority)
+{
+  uint16_t reserve = this->getReserve(priority);
+  uint16_t capacity = this->getCapacity();
+
+  return (capacity > reserve) ? capacity - reserve : 1;
+}
+
+// ***
+// *** Returns the tokens a priority must leave in the bucket.
+// ***
+uint16_t PublishGovernor::getReserve(enum publishPriority priority)
+{
+  uint16_t returnValue = 0;
+
+  if (priority == PUBLISH_STATUS)
+  {
+    returnValue = GOVERNOR_STATUS_RESERVE;
+  }
+  else if (priority == PUBLISH_BULK)
+  {
+    returnValue = GOVERNOR_BULK_RESERVE;
+  }
+
+  return returnValue;
+}
+
+uint32_t PublishGovernor::getPublished(enum publishPriority priority)
+{
+  return this->_published[priority];
+}
+
+uint32_t PublishGovernor::getDeferred(enum publishPriority priority)
+{
+  return this->_deferred[priority];
+}
+
+uint32_t PublishGovernor::getThrottleCount()
+{
+  return this->_throttleCount;
+}
+
+// ***
+// *** Adds the tokens earned since the last refill. The bucket
+// *** stays empty while holding after throttling.
+// ***
+void PublishGovernor::refill()
+{
+  uint32_t now = millis();
+
+  if (this->_isHolding && (now - this->_holdStart) >= GOVERNOR_THROTTLE_HOLD)
+  {
+    this->_isHolding = false;
+    this->_lastRefill = now;
+  }
+
+  if (!this->_isHolding)
+  {
+    this->_tokens = min(this->_capacity, this->_tokens + ((now - this->_lastRefill) * this->_rate));
+    this->_lastRefill = now;
+  }
+}
@@ -0,0 +1,114 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef PUBLISH_GOVERNOR_H
+#define PUBLISH_GOVERNOR_H
+
+#include <Arduino.h>
+
+// ***
+// *** The Adafruit IO data rate limit of the account in data
+// *** points per minute (30 on a free account, 60 with IO+).
+// *** Each feed value counts as a data point, including every
+// *** value of a group upload. The limit is shared by all of
+// *** the devices on the account so each device only uses its
+// *** share of it.
+// ***
+#ifndef IO_RATE_LIMIT
+#define IO_RATE_LIMIT             30
+#endif
+
+#ifndef IO_ACCOUNT_DEVICES
+#define IO_ACCOUNT_DEVICES        1
+#endif
+
+// ***
+// *** Tokens (data points) that lower priorities must leave
+// *** in the bucket for the higher ones.
+// ***
+#define GOVERNOR_STATUS_RESERVE   2
+#define GOVERNOR_BULK_RESERVE     4
+
+// ***
+// *** How long (ms) nothing is published after the server has
+// *** reported that the account is being throttled.
+// ***
+#define GOVERNOR_THROTTLE_HOLD    1000 * 60
+
+// ***
+// *** Priority classes, highest first.
+// ***
+enum publishPriority {
+  PUBLISH_CONTROL,    // The water pump state and alerts.
+  PUBLISH_STATUS,     // Single device status values.
+  PUBLISH_BULK,       // Sensor readings and rollups.
+  PUBLISH_PRIORITY_COUNT
+};
+
+// ***
+// *** A token bucket that keeps the data points published by
+// *** all feeds within this device's share of the account's
+// *** rate limit. The bucket holds one minute of budget and
+// *** refills continuously. Lower priorities can only use the
+// *** tokens above the reserves kept for the higher ones, so a
+// *** burst of readings never delays an alert.
+// ***
+class PublishGovernor
+{
+  public:
+    PublishGovernor();
+    void begin(uint16_t pointsPerMinute, uint8_t devices);
+    bool isAvailable(enum publishPriority, uint16_t points);
+    bool acquire(enum publishPriority, uint16_t points);
+    void release(uint16_t points);
+    void defer(enum publishPriority);
+    void throttle();
+    bool isThrottled();
+    float getTokens();
+    uint16_t getCapacity();
+    uint16_t getRequestLimit(enum publishPriority);
+    uint16_t getReserve(enum publishPriority);
+    uint32_t getPublished(enum publishPriority);
+    uint32_t getDeferred(enum publishPriority);
+    uint32_t getThrottleCount();
+
+  private:
+    // ***
+    // *** The bucket: its size, the tokens in it, the refill
+    // *** rate (tokens per ms) and when it was last refilled.
+    // ***
+    float _capacity = 0.0;
+    float _tokens = 0.0;
+    float _rate = 0.0;
+    uint32_t _lastRefill = 0;
+
+    // ***
+    // *** Set when the server reports throttling.
+    // ***
+    bool _isHolding = false;
+    uint32_t _holdStart = 0;
+    uint32_t _throttleCount = 0;
+
+    // ***
+    // *** Data points published and requests deferred per priority.
+    // ***
+    uint32_t _published[PUBLISH_PRIORITY_COUNT];
+    uint32_t _deferred[PUBLISH_PRIORITY_COUNT];
+
+    void refill();
+};
+#endif
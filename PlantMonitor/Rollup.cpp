@@ -0,0 +1,230 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "Rollup.h"
+
+Rollup::Rollup()
+{
+  for (uint8_t i = 0; i < ROLLUP_RESOLUTION_COUNT; i++)
+  {
+    this->_head[i] = 0;
+    this->_count[i] = 0;
+    this->_openPeriod[i] = 0;
+    Rollup::clear(&this->_open[i]);
+  }
+}
+
+// ***
+// *** Adds a sample taken at the given tick (ms). Pass NAN for
+// *** a sample that failed its health checks; it is not counted
+// *** but still moves the periods forward so that every channel
+// *** stays aligned.
+// ***
+void Rollup::add(float value, uint64_t tick)
+{
+  for (uint8_t i = 0; i < ROLLUP_RESOLUTION_COUNT; i++)
+  {
+    enum rollupResolution resolution = (enum rollupResolution)i;
+    uint32_t period = (uint32_t)((uint64_t)((int64_t)tick + this->_offset) / Rollup::getPeriodLength(resolution));
+
+    if (!this->_isStarted)
+    {
+      this->_openPeriod[i] = period;
+    }
+
+    // ***
+    // *** Close the open bucket and any empty periods
+    // *** in between. There is no point closing more empty
+    // *** buckets than the ring holds.
+    // ***
+    uint8_t size = 0;
+    this->getRing(resolution, &size);
+
+    for (uint16_t gap = 0; this->_openPeriod[i] < period && gap <= size; gap++)
+    {
+      this->close(resolution);
+      this->_openPeriod[i]++;
+    }
+
+    this->_openPeriod[i] = period;
+
+    if (!isnan(value))
+    {
+      RollupBucket* bucket = &this->_open[i];
+
+      if (bucket->count == 0 || value < bucket->minimum)
+      {
+        bucket->minimum = value;
+      }
+
+      if (bucket->count == 0 || value > bucket->maximum)
+      {
+        bucket->maximum = value;
+      }
+
+      if (bucket->count < 0xFFFF)
+      {
+        bucket->count++;
+        bucket->mean += (value - bucket->mean) / bucket->count;
+      }
+    }
+  }
+
+  this->_lastTick = tick;
+  this->_isStarted = true;
+}
+
+// ***
+// *** Aligns the periods to the tick plus the offset (ms), for
+// *** example local time once NTP has synchronized. The open
+// *** buckets carry on in the period of the last sample and the
+// *** closed buckets are renumbered from there; only the first
+// *** alignment counts.
+// ***
+void Rollup::align(int64_t offset)
+{
+  if (!this->_isAligned)
+  {
+    this->_offset = offset;
+    this->_isAligned = true;
+
+    for (uint8_t i = 0; i < ROLLUP_RESOLUTION_COUNT && this->_isStarted; i++)
+    {
+      enum rollupResolution resolution = (enum rollupResolution)i;
+      this->_openPeriod[i] = (uint32_t)((uint64_t)((int64_t)this->_lastTick + offset) / Rollup::getPeriodLength(resolution));
+    }
+  }
+}
+
+bool Rollup::isAligned()
+{
+  return this->_isAligned;
+}
+
+// ***
+// *** The number of closed buckets available.
+// ***
+uint8_t Rollup::getCount(enum rollupResolution resolution)
+{
+  return this->_count[resolution];
+}
+
+// ***
+// *** Returns a closed bucket where an age of 0 is
+// *** the most recently closed bucket.
+// ***
+RollupBucket Rollup::getBucket(enum rollupResolution resolution, uint8_t age)
+{
+  RollupBucket returnValue;
+  Rollup::clear(&returnValue);
+
+  if (age < this->_count[resolution])
+  {
+    uint8_t size = 0;
+    RollupBucket* ring = this->getRing(resolution, &size);
+    returnValue = ring[(this->_head[resolution] + size - 1 - age) % size];
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Returns the period index of a closed bucket.
+// ***
+uint32_t Rollup::getPeriod(enum rollupResolution resolution, uint8_t age)
+{
+  return this->_openPeriod[resolution] - 1 - age;
+}
+
+RollupBucket Rollup::getOpenBucket(enum rollupResolution resolution)
+{
+  return this->_open[resolution];
+}
+
+// ***
+// *** Period length in milliseconds.
+// ***
+uint32_t Rollup::getPeriodLength(enum rollupResolution resolution)
+{
+  uint32_t returnValue = 60UL * 1000UL;
+
+  if (resolution == ROLLUP_HOUR)
+  {
+    returnValue = 60UL * 60UL * 1000UL;
+  }
+  else if (resolution == ROLLUP_DAY)
+  {
+    returnValue = 24UL * 60UL * 60UL * 1000UL;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** The tick at which a period started.
+// ***
+uint64_t Rollup::getPeriodStart(enum rollupResolution resolution, uint32_t period)
+{
+  return (uint64_t)((int64_t)((uint64_t)period * Rollup::getPeriodLength(resolution)) - this->_offset);
+}
+
+RollupBucket* Rollup::getRing(enum rollupResolution resolution, uint8_t* size)
+{
+  RollupBucket* returnValue = this->_minutes;
+  *size = ROLLUP_MINUTE_BUCKETS;
+
+  if (resolution == ROLLUP_HOUR)
+  {
+    returnValue = this->_hours;
+    *size = ROLLUP_HOUR_BUCKETS;
+  }
+  else if (resolution == ROLLUP_DAY)
+  {
+    returnValue = this->_days;
+    *size = ROLLUP_DAY_BUCKETS;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Moves the open bucket into the ring, overwriting
+// *** the oldest bucket when the ring is full.
+// ***
+void Rollup::close(enum rollupResolution resolution)
+{
+  uint8_t size = 0;
+  RollupBucket* ring = this->getRing(resolution, &size);
+
+  ring[this->_head[resolution]] = this->_open[resolution];
+  this->_head[resolution] = (this->_head[resolution] + 1) % size;
+
+  if (this->_count[resolution] < size)
+  {
+    this->_count[resolution]++;
+  }
+
+  Rollup::clear(&this->_open[resolution]);
+}
+
+void Rollup::clear(RollupBucket* bucket)
+{
+  bucket->minimum = 0.0;
+  bucket->maximum = 0.0;
+  bucket->mean = 0.0;
+  bucket->count = 0;
+}
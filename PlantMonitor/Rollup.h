@@ -0,0 +1,108 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <Arduino.h>
+
+// ***
+// *** Number of closed buckets kept at each resolution. Each
+// *** bucket is 16 bytes so a channel uses (10 + 24 + 7 + 3) * 16
+// *** = 704 bytes with the default sizes.
+// ***
+#define ROLLUP_MINUTE_BUCKETS 10
+#define ROLLUP_HOUR_BUCKETS   24
+#define ROLLUP_DAY_BUCKETS    7
+
+enum rollupResolution {
+  ROLLUP_MINUTE,
+  ROLLUP_HOUR,
+  ROLLUP_DAY,
+  ROLLUP_RESOLUTION_COUNT
+};
+
+// ***
+// *** Summary of the samples in one period. A count of
+// *** zero means no valid samples were received.
+// ***
+typedef struct rollupBucket
+{
+  float minimum;
+  float maximum;
+  float mean;
+  uint16_t count;
+} RollupBucket;
+
+// ***
+// *** Aggregates the samples of one channel into minute, hour
+// *** and day buckets held in fixed size circular buffers.
+// *** Periods start at boot (the monotonic tick, see Clock.h)
+// *** until align() moves them onto local time, so that hours
+// *** start on the clock hour and days at local midnight. The
+// *** buckets are kept in RAM; in the deep sleep power mode
+// *** they only cover the current wake.
+// ***
+class Rollup
+{
+  public:
+    Rollup();
+    void add(float value, uint64_t tick);
+    void align(int64_t offset);
+    bool isAligned();
+    uint8_t getCount(enum rollupResolution);
+    RollupBucket getBucket(enum rollupResolution, uint8_t age);
+    uint32_t getPeriod(enum rollupResolution, uint8_t age);
+    RollupBucket getOpenBucket(enum rollupResolution);
+    static uint32_t getPeriodLength(enum rollupResolution);
+    uint64_t getPeriodStart(enum rollupResolution, uint32_t period);
+
+  private:
+    // ***
+    // *** Closed buckets for each resolution.
+    // ***
+    RollupBucket _minutes[ROLLUP_MINUTE_BUCKETS];
+    RollupBucket _hours[ROLLUP_HOUR_BUCKETS];
+    RollupBucket _days[ROLLUP_DAY_BUCKETS];
+
+    // ***
+    // *** The index of the next bucket to be written and the
+    // *** number of closed buckets in each ring.
+    // ***
+    uint8_t _head[ROLLUP_RESOLUTION_COUNT];
+    uint8_t _count[ROLLUP_RESOLUTION_COUNT];
+
+    // ***
+    // *** The bucket currently being filled and its period.
+    // ***
+    RollupBucket _open[ROLLUP_RESOLUTION_COUNT];
+    uint32_t _openPeriod[ROLLUP_RESOLUTION_COUNT];
+    bool _isStarted = false;
+
+    // ***
+    // *** Added to the tick to give the time the periods are
+    // *** aligned to and the tick of the last sample.
+    // ***
+    int64_t _offset = 0;
+    bool _isAligned = false;
+    uint64_t _lastTick = 0;
+
+    RollupBucket* getRing(enum rollupResolution, uint8_t*);
+    void close(enum rollupResolution);
+    static void clear(RollupBucket*);
+};
+#endif
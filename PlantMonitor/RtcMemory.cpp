@@ -0,0 +1,101 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "RtcMemory.h"
+#include "TelemetryPacket.h"
+
+static_assert(sizeof(RtcState) <= RTC_STATE_SIZE, "The RTC state does not fit in the user RTC memory.");
+static_assert((sizeof(RtcState) % 4) == 0, "The RTC state must be a whole number of blocks.");
+static_assert(CHANNEL_COUNT <= 8, "There is one reported fault bit per channel.");
+static_assert((offsetof(RtcState, watchdog) % 4) == 0 && (offsetof(RtcWatchdog, head) % 4) == 0 && (sizeof(RtcBreadcrumb) % 4) == 0, "The watchdog writes whole blocks.");
+static_assert((offsetof(RtcState, ota) % 4) == 0 && (sizeof(RtcOta) % 4) == 0, "The OTA updater writes whole blocks.");
+
+RtcMemory::RtcMemory()
+{
+}
+
+// ***
+// *** Reads the state from RTC memory. Returns true if it
+// *** holds a valid state; otherwise the state is cleared.
+// ***
+bool RtcMemory::begin()
+{
+  this->_isValid = ESP.rtcUserMemoryRead(RTC_STATE_OFFSET, (uint32_t*)&this->_state, sizeof(RtcState)) &&
+                   this->_state.magic == RTC_STATE_MAGIC &&
+                   this->_state.version == RTC_STATE_VERSION &&
+                   this->_state.size == sizeof(RtcState) &&
+                   this->_state.checksum == this->computeChecksum();
+
+  if (!this->_isValid)
+  {
+    this->clear();
+  }
+
+  return this->_isValid;
+}
+
+bool RtcMemory::isValid()
+{
+  return this->_isValid;
+}
+
+RtcState& RtcMemory::getState()
+{
+  return this->_state;
+}
+
+// ***
+// *** Writes the state to RTC memory.
+// ***
+void RtcMemory::save()
+{
+  this->_state.magic = RTC_STATE_MAGIC;
+  this->_state.version = RTC_STATE_VERSION;
+  this->_state.size = sizeof(RtcState);
+  this->_state.checksum = this->computeChecksum();
+  ESP.rtcUserMemoryWrite(RTC_STATE_OFFSET, (uint32_t*)&this->_state, sizeof(RtcState));
+}
+
+// ***
+// *** Writes part of the state (a whole number of blocks) to RTC
+// *** memory without updating the checksum. Only used for the
+// *** watchdog and OTA sections.
+// ***
+void RtcMemory::write(const void* data, size_t size)
+{
+  size_t offset = (const uint8_t*)data - (const uint8_t*)&this->_state;
+  ESP.rtcUserMemoryWrite(RTC_STATE_OFFSET + (offset / 4), (uint32_t*)data, size);
+}
+
+// ***
+// *** Clears the checked state. The watchdog and OTA sections are
+// *** kept; they are validated on their own by their owners.
+// ***
+void RtcMemory::clear()
+{
+  memset(&this->_state, 0, offsetof(RtcState, watchdog));
+  memset(&this->_state.clock, 0, sizeof(RtcState) - offsetof(RtcState, clock));
+}
+
+// ***
+// *** CRC-32 of everything after the header.
+// ***
+uint32_t RtcMemory::computeChecksum()
+{
+  const uint8_t* data = (const uint8_t*)&this->_state.clock;
+  return telemetryCrc32(data, sizeof(RtcState) - offsetof(RtcState, clock));
+}
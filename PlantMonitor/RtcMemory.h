@@ -0,0 +1,187 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef RTC_MEMORY_H
+#define RTC_MEMORY_H
+
+#include <Arduino.h>
+#include "CloudData.h"
+#include "Clock.h"
+
+// ***
+// *** The ESP8266 has 512 bytes of user RTC memory which keeps
+// *** its contents through deep sleep and resets (but not power
+// *** loss). The first 128 bytes are left for the OTA boot
+// *** loader so the state starts at block 32 (blocks are 4 bytes).
+// ***
+#define RTC_STATE_OFFSET  32
+#define RTC_STATE_SIZE    (512 - (RTC_STATE_OFFSET * 4))
+#define RTC_STATE_MAGIC   0x54524D50
+#define RTC_STATE_VERSION 3
+
+// ***
+// *** The number of readings that can be held between uploads.
+// ***
+#define RTC_SAMPLE_COUNT  4
+
+// ***
+// *** A reading kept in RTC memory. The members are generated
+// *** from the channel registry (see SensorChannels.h).
+// ***
+typedef struct rtcSample
+{
+  uint32_t capturedAt;    // Tick (seconds).
+#define RTC_SAMPLE_FIELD(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) type field;
+  SENSOR_CHANNELS(RTC_SAMPLE_FIELD)
+  uint8_t quality[CHANNEL_COUNT];
+  uint8_t isSoilDry;
+} RtcSample;
+
+// ***
+// *** The task schedule (ticks, ms) and duty cycle statistics.
+// ***
+typedef struct rtcSchedule
+{
+  uint64_t nextRead;
+  uint64_t nextSend;
+  uint64_t nextCheck;
+  uint32_t cycleCount;
+  uint32_t lastAwakeTime;   // ms
+  uint32_t awakeTimeTotal;  // ms since the last upload
+  uint16_t awakeCycles;     // cycles since the last upload
+  uint16_t reserved;
+} RtcSchedule;
+
+// ***
+// *** The loop stages last entered, written by the watchdog (see
+// *** Watchdog.h) as they are entered so that they are still
+// *** there after a crash or a watchdog reset.
+// ***
+#define RTC_BREADCRUMB_COUNT  8
+#define RTC_WATCHDOG_MAGIC    0x44574D50
+
+#define BREADCRUMB_OVERRUN    0x01    // The stage ran over its budget.
+
+typedef struct rtcBreadcrumb
+{
+  uint32_t enteredAt;       // ms since boot.
+  uint16_t freeHeap;        // bytes
+  uint8_t stage;            // enum watchdogStage
+  uint8_t flags;
+} RtcBreadcrumb;
+
+typedef struct rtcWatchdog
+{
+  uint32_t magic;
+  uint32_t checkedAt;       // ms since boot of the last watchdog check.
+  uint8_t head;             // The next breadcrumb to write.
+  uint8_t count;
+  uint8_t stalledStage;     // The stage the watchdog restarted in.
+  uint8_t reserved;
+  RtcBreadcrumb breadcrumbs[RTC_BREADCRUMB_COUNT];
+} RtcWatchdog;
+
+// ***
+// *** The state of a firmware update (see OtaUpdater.h). It is
+// *** written when an update has been installed and on each boot
+// *** until the new firmware is confirmed, so it has its own magic
+// *** and is not covered by the checksum.
+// ***
+#define RTC_OTA_MAGIC         0x4F544D50
+
+#define OTA_BOOT_NONE         0       // The firmware is confirmed.
+#define OTA_BOOT_PENDING      1       // A new firmware has not been confirmed yet.
+#define OTA_BOOT_ROLLBACK     2       // The new firmware failed; reinstall the previous one.
+
+typedef struct rtcOta
+{
+  uint32_t magic;
+  uint32_t version;         // The firmware installed.
+  uint32_t previousVersion; // The firmware it replaced.
+  uint32_t failedVersion;   // The last firmware rolled back (not installed again).
+  uint8_t state;            // OTA_BOOT_*
+  uint8_t attempts;         // Boots since it was installed.
+  uint16_t reserved;
+} RtcOta;
+
+// ***
+// *** Controller state carried between wake ups. The duty cycled
+// *** modes are not connected to MQTT so their alerts are kept
+// *** here as flags until the next upload posts them.
+// ***
+#define RTC_ALERT_RESET           0x0001  // A crash or watchdog reset.
+#define RTC_ALERT_WATER_BUDGET    0x0002  // The daily water budget is used up.
+#define RTC_ALERT_RESERVOIR_LOW   0x0004  // The water reservoir is low.
+
+typedef struct rtcController
+{
+  uint64_t lastWaterTick;
+  uint32_t wateringCount;
+  uint8_t reportedFaults;   // One bit per channel.
+  uint8_t faultAlerts;      // One bit per channel whose fault state changed.
+  uint16_t alerts;          // RTC_ALERT_*
+} RtcController;
+
+// ***
+// *** The layout of the RTC memory. Other modules that need to
+// *** keep state through a reset add their section here so that
+// *** there is one layout and one checksum. The watchdog and OTA
+// *** sections are written on their own (the watchdog's a few
+// *** bytes at a time while the device runs) so they have their
+// *** own magic and are not covered by the checksum.
+// ***
+typedef struct rtcState
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  uint32_t checksum;
+  uint32_t reserved;
+
+  RtcWatchdog watchdog;
+  RtcOta ota;
+
+  ClockState clock;
+  RtcSchedule schedule;
+  RtcController controller;
+
+  uint8_t sampleCount;
+  uint8_t sampleReserved[3];
+  RtcSample samples[RTC_SAMPLE_COUNT];
+} RtcState;
+
+// ***
+// *** Loads, validates and saves the RTC state.
+// ***
+class RtcMemory
+{
+  public:
+    RtcMemory();
+    bool begin();
+    bool isValid();
+    RtcState& getState();
+    void save();
+    void write(const void*, size_t);
+    void clear();
+
+  private:
+    RtcState _state;
+    bool _isValid = false;
+
+    uint32_t computeChecksum();
+};
+#endif
@@ -0,0 +1,130 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef SENSOR_CHANNELS_H
+#define SENSOR_CHANNELS_H
+
+// ***
+// *** The units of a channel. Temperatures are in the
+// *** configured units (Fahrenheit or Celsius).
+// ***
+enum channelUnit {
+  UNIT_TEMPERATURE,
+  UNIT_PERCENT,
+  UNIT_COUNTS,
+  UNIT_LUX,
+  UNIT_KILOPASCALS,
+  UNIT_GRAMS_PER_CUBIC_METER
+};
+
+// ***
+// *** Where a channel is reported.
+// ***
+#define REPORT_CLOUD    0x01    // Uploaded to Adafruit IO.
+#define REPORT_LAN      0x02    // Sent in the LAN telemetry and served by the status server.
+#define REPORT_DISPLAY  0x04    // Shown on the serial port.
+#define REPORT_ALL      (REPORT_CLOUD | REPORT_LAN | REPORT_DISPLAY)
+
+// ***
+// *** The physical sensors. One read of a device returns all of
+// *** its channels. The adaptive sampler reads each device at an
+// *** interval between its minimum and maximum (ms); the minimum
+// *** respects what the part can do (the DHT22 needs two seconds
+// *** between reads and self heats when read often, the DS18B20
+// *** blocks for 750 ms per conversion).
+// ***
+// ***   X(id, name, minimum, maximum)
+// ***
+#define SENSOR_DEVICES(X) \
+  X(DEVICE_ENVIRONMENT,      "DHT22",         1000 * 10, 1000 * 60 * 2) \
+  X(DEVICE_SOIL_MOISTURE,    "Soil Moisture", 1000 * 10, 1000 * 60 * 5) \
+  X(DEVICE_SOIL_TEMPERATURE, "DS18B20",       1000 * 30, 1000 * 60 * 10) \
+  X(DEVICE_SPECTRUM,         "TSL2591",       1000 * 5,  1000 * 60 * 2)
+
+#define DEVICE_ENUM(id, name, minimum, maximum) id,
+enum sensorDevice {
+  SENSOR_DEVICES(DEVICE_ENUM)
+  DEVICE_COUNT
+};
+
+#define DEVICE_ALL ((1 << DEVICE_COUNT) - 1)
+
+// ***
+// *** The sensor channel registry.Every channel is declared here
+// *** once and the code that handles the channels (the CloudData
+// *** members, acquisition, display, upload, status pages) is
+// *** generated from this list by the preprocessor, so there are
+// *** no per channel tables in RAM and no virtual calls. To add a
+// *** sensor add a line here (and, if needed, its monitor to
+// *** PlantMonitor.ino).
+// ***
+// ***   X(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read)
+// ***
+// ***   id          The enum sensorChannel value.
+// ***   type        The type of the CloudData member.
+// ***   field       The CloudData member.
+// ***   key         The Adafruit IO feed key (in the plant-monitor group).
+// ***   label       The label used by the status server.
+// ***   name        The name shown on the serial port and in alerts.
+// ***   unit        The channelUnit.
+// ***   decimals    The decimal places displayed and uploaded.
+// ***   policy      REPORT_* flags.
+// ***   device      The sensorDevice the channel is read from. The
+// ***               channels of a device are always read together.
+// ***   sensitivity The smallest change (in the channel's units) that
+// ***               is significant. The adaptive sampler (see
+// ***               AdaptiveSampler.h) reads a device often enough
+// ***               to see changes of this size. It should be above
+// ***               the noise of the sensor.
+// ***   read        The expression that reads the sensor. It is only
+// ***               expanded in PlantMonitor.ino where the monitors
+// ***               are defined. Channels are read in this order and
+// ***               the first read of each device takes a new reading.
+// ***
+#define SENSOR_CHANNELS(X) \
+  X(CHANNEL_ENVIRONMENTAL_TEMPERATURE,       float,    environmentalTemperature,      "environmental-temperature",       "environmental_temperature",       "Air Temperature",     UNIT_TEMPERATURE, 2, REPORT_ALL, DEVICE_ENVIRONMENT,      0.5,  _envMonitor.getTemperature(_myUnits)) \
+  X(CHANNEL_ENVIRONMENTAL_RELATIVE_HUMIDITY, float,    environmentalRelativeHumidity, "environmental-relative-humidity", "environmental_relative_humidity", "Humidity",            UNIT_PERCENT,     2, REPORT_ALL, DEVICE_ENVIRONMENT,      1.0,  _envMonitor.getRelativeHumidity()) \
+  X(CHANNEL_SOIL_MOISTURE_LEVEL,             float,    soilMoistureLevel,             "soil-moisture-level",             "soil_moisture_level",             "Soil Moisture Level", UNIT_PERCENT,     2, REPORT_ALL, DEVICE_SOIL_MOISTURE,    1.0,  _soilMonitor.getMoistureLevel()) \
+  X(CHANNEL_SOIL_TEMPERATURE,                float,    soilTemperature,               "soil-temperature",                "soil_temperature",                "Soil Temperature",    UNIT_TEMPERATURE, 2, REPORT_ALL, DEVICE_SOIL_TEMPERATURE, 0.25, _soilMonitor.getTemperature(_myUnits)) \
+  X(CHANNEL_SPECTRUM_IR,                     uint16_t, spectrumIr,                    "spectrum-ir",                     "spectrum_ir",                     "IR",                  UNIT_COUNTS,      0, REPORT_ALL, DEVICE_SPECTRUM,         20.0, _spectrumMonitor.getIr(true)) \
+  X(CHANNEL_SPECTRUM_FULL,                   uint16_t, spectrumFull,                  "spectrum-full",                   "spectrum_full",                   "Full",                UNIT_COUNTS,      0, REPORT_ALL, DEVICE_SPECTRUM,         20.0, _spectrumMonitor.getFull()) \
+  X(CHANNEL_SPECTRUM_LUX,                    float,    spectrumLux,                   "spectrum-lux",                    "spectrum_lux",                    "Lux",                 UNIT_LUX,         2, REPORT_ALL, DEVICE_SPECTRUM,         5.0,  _spectrumMonitor.getLux()) \
+  X(CHANNEL_SPECTRUM_VISIBLE,                uint16_t, spectrumVisible,               "spectrum-visible",                "spectrum_visible",                "Visible",             UNIT_COUNTS,      0, REPORT_ALL, DEVICE_SPECTRUM,         20.0, _spectrumMonitor.getVisible())
+
+// ***
+// *** The derived metrics registry. These are calculated from the
+// *** channels of a sample, once, by calculateDerivedMetrics() (see
+// *** DerivedMetrics.h) and kept with the sample so that display,
+// *** upload and control use the same values. A metric is NAN when
+// *** a channel it needs was excluded by the health checks. They
+// *** are not channels: they have no health monitor, no quality
+// *** flags and are not kept in RTC memory or sent in the LAN
+// *** telemetry packets.
+// ***
+// ***   X(id, field, key, label, name, unit, decimals, policy)
+// ***
+// ***   The arguments are the same as those of SENSOR_CHANNELS. The
+// ***   CloudData member is always a float.
+// ***
+#define DERIVED_METRICS(X) \
+  X(METRIC_HEAT_INDEX,        heatIndex,        "heat-index",                  "heat_index",                  "Heat Index",        UNIT_TEMPERATURE,           2, REPORT_LAN | REPORT_DISPLAY) \
+  X(METRIC_DEW_POINT,         dewPoint,         "dew-point",                   "dew_point",                   "Dew Point",         UNIT_TEMPERATURE,           2, REPORT_ALL) \
+  X(METRIC_AIR_VPD,           airVpd,           "vapor-pressure-deficit",      "vapor_pressure_deficit",      "Air VPD",           UNIT_KILOPASCALS,           2, REPORT_ALL) \
+  X(METRIC_LEAF_VPD,          leafVpd,          "leaf-vapor-pressure-deficit", "leaf_vapor_pressure_deficit", "Leaf VPD",          UNIT_KILOPASCALS,           2, REPORT_LAN | REPORT_DISPLAY) \
+  X(METRIC_ABSOLUTE_HUMIDITY, absoluteHumidity, "absolute-humidity",           "absolute_humidity",           "Absolute Humidity", UNIT_GRAMS_PER_CUBIC_METER, 2, REPORT_LAN | REPORT_DISPLAY)
+
+#endif
@@ -0,0 +1,280 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "SensorHealth.h"
+#include "CloudData.h"
+
+SensorHealth::SensorHealth()
+{
+}
+
+void SensorHealth::begin(float minimum, float maximum, float maximumRate, uint32_t stuckTime, float outlierSigma)
+{
+  this->_minimum = minimum;
+  this->_maximum = maximum;
+  this->_maximumRate = maximumRate;
+  this->_stuckTime = stuckTime;
+  this->_outlierSigma = outlierSigma;
+}
+
+// ***
+// *** Checks a new sample and returns its quality flags. The
+// *** timestamp is in milliseconds.
+// ***
+uint8_t SensorHealth::check(float value, uint32_t timestamp)
+{
+  uint8_t returnValue = QUALITY_GOOD;
+
+  if (isnan(value))
+  {
+    returnValue |= QUALITY_INVALID;
+  }
+  else
+  {
+    // ***
+    // *** Plausibility range.
+    // ***
+    if (value < this->_minimum || value > this->_maximum)
+    {
+      returnValue |= QUALITY_OUT_OF_RANGE;
+    }
+
+    // ***
+    // *** Stuck value detection.
+    // ***
+    if (this->_hasLastValue && value == this->_lastValue)
+    {
+      if (this->_stuckCount < 0xFFFF)
+      {
+        this->_stuckCount++;
+      }
+    }
+    else
+    {
+      this->_stuckCount = 0;
+      this->_stuckSince = timestamp;
+    }
+
+    if (this->_stuckTime > 0 && this->_stuckCount >= HEALTH_STUCK_MINIMUM_SAMPLES && (timestamp - this->_stuckSince) >= this->_stuckTime)
+    {
+      returnValue |= QUALITY_STUCK;
+    }
+
+    // ***
+    // *** Rate of change limit relative to the last accepted value.
+    // ***
+    if (returnValue == QUALITY_GOOD && this->_hasReference && this->_maximumRate > 0.0)
+    {
+      float seconds = (timestamp - this->_referenceTimestamp) / 1000.0;
+
+      if (seconds > 0.0 && (fabs(value - this->_referenceValue) / seconds) > this->_maximumRate)
+      {
+        returnValue |= QUALITY_RATE;
+      }
+    }
+
+    // ***
+    // *** Outlier test against the running mean and variance. The
+    // *** deviation has a floor of 1% of the range so that a very
+    // *** flat signal does not flag every small change.
+    // ***
+    if (returnValue == QUALITY_GOOD && this->_outlierSigma > 0.0 && this->_count >= HEALTH_MINIMUM_SAMPLES)
+    {
+      float deviation = max(this->getStandardDeviation(), (this->_maximum - this->_minimum) * 0.01f);
+
+      if (fabs(value - this->_mean) > (this->_outlierSigma * deviation))
+      {
+        returnValue |= QUALITY_OUTLIER;
+      }
+    }
+  }
+
+  // ***
+  // *** A run of suspect samples in the same direction is a real
+  // *** step change (watering, lights on). Start the statistics
+  // *** over at the new level instead of flagging it forever.
+  // ***
+  if (returnValue & QUALITY_SUSPECT_MASK)
+  {
+    int8_t direction = (value > this->_mean) ? 1 : -1;
+
+    if (direction != this->_outlierDirection)
+    {
+      this->_outlierCount = 0;
+      this->_outlierDirection = direction;
+    }
+
+    if (++this->_outlierCount >= HEALTH_STEP_CHANGE_COUNT)
+    {
+      this->resetStatistics(value, timestamp);
+      this->_outlierCount = 0;
+      this->_outlierDirection = 0;
+    }
+  }
+  else
+  {
+    this->_outlierCount = 0;
+    this->_outlierDirection = 0;
+  }
+
+  // ***
+  // *** Only clean samples update the statistics and the
+  // *** reference value for the rate check.
+  // ***
+  if (returnValue == QUALITY_GOOD)
+  {
+    this->updateStatistics(value);
+    this->_referenceValue = value;
+    this->_referenceTimestamp = timestamp;
+    this->_hasReference = true;
+  }
+
+  if (!isnan(value))
+  {
+    this->_lastValue = value;
+    this->_hasLastValue = true;
+  }
+
+  // ***
+  // *** Track the faulty state of the channel.
+  // ***
+  if (returnValue & QUALITY_EXCLUDE_MASK)
+  {
+    this->_goodCount = 0;
+
+    if (this->_badCount < 0xFF)
+    {
+      this->_badCount++;
+    }
+
+    if (this->_badCount >= HEALTH_FAULT_THRESHOLD)
+    {
+      this->_isFaulty = true;
+    }
+  }
+  else
+  {
+    this->_badCount = 0;
+
+    if (this->_goodCount < 0xFF)
+    {
+      this->_goodCount++;
+    }
+
+    if (this->_goodCount >= HEALTH_RECOVERY_THRESHOLD)
+    {
+      this->_isFaulty = false;
+    }
+  }
+
+  if (this->_isFaulty)
+  {
+    returnValue |= QUALITY_FAULTY;
+  }
+
+  this->_quality = returnValue;
+  return returnValue;
+}
+
+bool SensorHealth::isFaulty()
+{
+  return this->_isFaulty;
+}
+
+uint8_t SensorHealth::getQuality()
+{
+  return this->_quality;
+}
+
+float SensorHealth::getMean()
+{
+  return this->_mean;
+}
+
+float SensorHealth::getStandardDeviation()
+{
+  return this->_count > 1 ? sqrt(this->_m2 / (this->_count - 1)) : 0.0;
+}
+
+// ***
+// *** Welford's online algorithm. Once the window is full the
+// *** count is held constant which turns the running statistics
+// *** into an exponentially weighted mean and variance.
+// ***
+void SensorHealth::updateStatistics(float value)
+{
+  if (this->_count < HEALTH_STATISTICS_WINDOW)
+  {
+    this->_count++;
+  }
+  else
+  {
+    this->_m2 -= this->_m2 / this->_count;
+  }
+
+  float delta = value - this->_mean;
+  this->_mean += delta / this->_count;
+  this->_m2 += delta * (value - this->_mean);
+}
+
+void SensorHealth::resetStatistics(float value, uint32_t timestamp)
+{
+  this->_count = 0;
+  this->_mean = 0.0;
+  this->_m2 = 0.0;
+  this->updateStatistics(value);
+
+  this->_referenceValue = value;
+  this->_referenceTimestamp = timestamp;
+  this->_hasReference = true;
+}
+
+// ***
+// *** Converts a Celsius temperature (or difference) to the
+// *** given units.
+// ***
+static float toUnits(float celsius, enum temperatureUnit unit)
+{
+  return unit == FAHRENHEIT ? (celsius * 1.8) + 32.0 : celsius;
+}
+
+static float toUnitsDelta(float celsius, enum temperatureUnit unit)
+{
+  return unit == FAHRENHEIT ? celsius * 1.8 : celsius;
+}
+
+// ***
+// *** Sets the plausibility range, rate of change limit (per second),
+// *** stuck time (ms) and outlier threshold of each channel. Ranges
+// *** are the physical limits of each sensor.
+// ***
+void configureSensorHealth(SensorHealth* health, enum temperatureUnit unit)
+{
+  health[CHANNEL_ENVIRONMENTAL_TEMPERATURE].begin(toUnits(-40.0, unit), toUnits(80.0, unit), toUnitsDelta(0.5, unit), 1000UL * 60 * 30, 4.0);
+  health[CHANNEL_ENVIRONMENTAL_RELATIVE_HUMIDITY].begin(0.0, 100.0, 2.0, 1000UL * 60 * 30, 4.0);
+  health[CHANNEL_SOIL_MOISTURE_LEVEL].begin(0.0, 100.0, 0.0, 1000UL * 60 * 60, 4.0);
+  health[CHANNEL_SOIL_TEMPERATURE].begin(toUnits(-55.0, unit), toUnits(125.0, unit), toUnitsDelta(0.1, unit), 1000UL * 60 * 120, 4.0);
+
+  // ***
+  // *** Light changes instantly and is constant at night so only
+  // *** the range is checked. 0xFFFF means the sensor is saturated.
+  // ***
+  health[CHANNEL_SPECTRUM_IR].begin(0, 0xFFFE, 0.0, 0, 0.0);
+  health[CHANNEL_SPECTRUM_FULL].begin(0, 0xFFFE, 0.0, 0, 0.0);
+  health[CHANNEL_SPECTRUM_LUX].begin(0.0, 88000.0, 0.0, 0, 0.0);
+  health[CHANNEL_SPECTRUM_VISIBLE].begin(0, 0xFFFE, 0.0, 0, 0.0);
+}
@@ -0,0 +1,162 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef SENSOR_HEALTH_H
+#define SENSOR_HEALTH_H
+
+#include <Arduino.h>
+#include "Temperature.h"
+
+// ***
+// *** Quality flags attached to each sample. A value of
+// *** QUALITY_GOOD means every check passed.
+// ***
+#define QUALITY_GOOD          0x00
+#define QUALITY_INVALID       0x01  // The sensor did not return a number (NaN).
+#define QUALITY_OUT_OF_RANGE  0x02  // The value is outside the physical range of the sensor.
+#define QUALITY_STUCK         0x04  // The value has not changed for too long.
+#define QUALITY_RATE          0x08  // The value changed faster than is physically plausible.
+#define QUALITY_OUTLIER       0x10  // The value is too far from the running mean.
+#define QUALITY_FAULTY        0x80  // The channel has failed repeatedly and is considered dead.
+
+// ***
+// *** Samples with any of these flags are not usable at all
+// *** and are never uploaded. Suspect samples are uploaded but
+// *** are not used to make control decisions.
+// ***
+#define QUALITY_EXCLUDE_MASK  (QUALITY_INVALID | QUALITY_OUT_OF_RANGE | QUALITY_STUCK | QUALITY_FAULTY)
+#define QUALITY_SUSPECT_MASK  (QUALITY_RATE | QUALITY_OUTLIER)
+
+// ***
+// *** Number of consecutive bad samples before a channel
+// *** is marked faulty and the number of consecutive good
+// *** samples before it is considered recovered.
+// ***
+#define HEALTH_FAULT_THRESHOLD    3
+#define HEALTH_RECOVERY_THRESHOLD 3
+
+// ***
+// *** The mean and variance are weighted over roughly this many
+// *** samples so that slow drift (day/night) is tracked.
+// ***
+#define HEALTH_STATISTICS_WINDOW  60
+
+// ***
+// *** Minimum number of samples before the outlier test is
+// *** applied and the number of consecutive outliers that are
+// *** accepted as a genuine step change (e.g. after watering).
+// ***
+#define HEALTH_MINIMUM_SAMPLES    10
+#define HEALTH_STEP_CHANGE_COUNT  3
+
+// ***
+// *** Minimum number of identical samples before a channel can
+// *** be considered stuck, however long they span (e.g. a few
+// *** readings far apart after deep sleep).
+// ***
+#define HEALTH_STUCK_MINIMUM_SAMPLES 6
+
+// ***
+// *** Streaming health monitor for a single sensor channel. Uses
+// *** a fixed amount of memory regardless of how many samples
+// *** have been checked.
+// ***
+class SensorHealth
+{
+  public:
+    SensorHealth();
+    void begin(float minimum, float maximum, float maximumRate, uint32_t stuckTime, float outlierSigma);
+    uint8_t check(float value, uint32_t timestamp);
+    bool isFaulty();
+    uint8_t getQuality();
+    float getMean();
+    float getStandardDeviation();
+
+  private:
+    // ***
+    // *** Plausibility range of the channel.
+    // ***
+    float _minimum = 0.0;
+    float _maximum = 0.0;
+
+    // ***
+    // *** Maximum change per second. Zero disables the check.
+    // ***
+    float _maximumRate = 0.0;
+
+    // ***
+    // *** How long (ms) the value must stay the same before the
+    // *** channel is considered stuck. It is a time rather than a
+    // *** number of samples because the read interval of a device
+    // *** changes (see AdaptiveSampler.h). Zero disables the check.
+    // ***
+    uint32_t _stuckTime = 0;
+
+    // ***
+    // *** Number of standard deviations from the mean before
+    // *** a sample is an outlier. Zero disables the check.
+    // ***
+    float _outlierSigma = 0.0;
+
+    // ***
+    // *** Welford running mean and sum of squared differences.
+    // ***
+    uint16_t _count = 0;
+    float _mean = 0.0;
+    float _m2 = 0.0;
+
+    // ***
+    // *** The previous value read (used for stuck detection).
+    // ***
+    bool _hasLastValue = false;
+    float _lastValue = 0.0;
+
+    // ***
+    // *** When the current run of identical values started.
+    // ***
+    uint32_t _stuckSince = 0;
+
+    // ***
+    // *** The last accepted value and when it was read (used
+    // *** for the rate of change limit).
+    // ***
+    bool _hasReference = false;
+    float _referenceValue = 0.0;
+    uint32_t _referenceTimestamp = 0;
+
+    // ***
+    // *** Run length counters.
+    // ***
+    uint16_t _stuckCount = 0;
+    uint8_t _outlierCount = 0;
+    int8_t _outlierDirection = 0;
+    uint8_t _badCount = 0;
+    uint8_t _goodCount = 0;
+
+    bool _isFaulty = false;
+    uint8_t _quality = QUALITY_GOOD;
+
+    void updateStatistics(float value);
+    void resetStatistics(float value, uint32_t timestamp);
+};
+
+// ***
+// *** Configures the health monitor of each channel (an array
+// *** of CHANNEL_COUNT, see CloudData.h) for the given units.
+// ***
+void configureSensorHealth(SensorHealth* health, enum temperatureUnit unit);
+#endif
@@ -82,6 +82,7 @@ float SoilMonitor::getMoistureLevel()
   // *** on the MCP3008.
   // ***
   int value0 = this->_adc.readADC(this->_levelPin);
+  this->_lastLevelCode = value0;
   float voltage0 = (value0 / 1024.0) * 3.3;
   returnValue = mapF(voltage0, this->_dryReading, this->_wetReading, 0.0, 100.0);
 
@@ -109,6 +110,7 @@ String SoilMonitor::getQuality()
   // *** to reserve digital pins on the microcontroller.
   // ***
   int value1 = _adc.readADC(this->_qualityPin);
+  this->_lastQualityCode = value1;
   float voltage1 = (value1 / 1024.0) * 3.3;
 
   if (voltage1 >= 2.4)
@@ -129,6 +131,7 @@ float SoilMonitor::getTemperature(enum temperatureUnit unit)
 
   this->_ds18b20.requestTemperatures();
   returnValue = _ds18b20.getTempCByIndex(0);
+  this->_lastTemperature = returnValue;
 
   if (unit == FAHRENHEIT)
   {
@@ -137,3 +140,18 @@ float SoilMonitor::getTemperature(enum temperatureUnit unit)
 
   return returnValue;
 }
+
+uint16_t SoilMonitor::getLastLevelCode()
+{
+  return this->_lastLevelCode;
+}
+
+uint16_t SoilMonitor::getLastQualityCode()
+{
+  return this->_lastQualityCode;
+}
+
+float SoilMonitor::getLastTemperature()
+{
+  return this->_lastTemperature;
+}
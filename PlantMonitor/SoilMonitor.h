@@ -34,6 +34,9 @@ class SoilMonitor : Temperature
     float getMoistureLevel();
     String getQuality();
     float getTemperature(enum temperatureUnit);
+    uint16_t getLastLevelCode();
+    uint16_t getLastQualityCode();
+    float getLastTemperature();
 
   private:
     // ***
@@ -67,6 +70,15 @@ class SoilMonitor : Temperature
     // ***
     float _wetReading = 0.0;
 
+    // ***
+    // *** The raw values of the last readings (ADC codes and
+    // *** the DS18B20 temperature in Celsius). These are what
+    // *** the trace recorder captures.
+    // ***
+    uint16_t _lastLevelCode = 0;
+    uint16_t _lastQualityCode = 0;
+    float _lastTemperature = NAN;
+
     // ***
     // *** Use the Adafruit library to connect to the MCP3008.
     // ***
@@ -0,0 +1,439 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "StatusServer.h"
+#include <stdarg.h>
+
+// ***
+// *** Unit label of a channel. Temperatures use the
+// *** configured units.
+// ***
+static const char* getUnitLabel(enum channelUnit unit, bool isFahrenheit)
+{
+  switch (unit)
+  {
+    case UNIT_TEMPERATURE: return isFahrenheit ? "fahrenheit" : "celsius";
+    case UNIT_PERCENT: return "percent";
+    case UNIT_LUX: return "lux";
+    case UNIT_KILOPASCALS: return "kilopascals";
+    case UNIT_GRAMS_PER_CUBIC_METER: return "grams_per_cubic_meter";
+    default: return "counts";
+  }
+}
+
+// ***
+// *** Fixed responses.
+// ***
+static const char _notFound[] = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\nConnection: close\r\n\r\nNot found\n";
+static const char _notReady[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Type: text/plain\r\nContent-Length: 10\r\nConnection: close\r\n\r\nNo data.\r\n";
+
+// ***
+// *** Appends formatted text to a buffer and returns the new
+// *** length. Once the buffer is full the length stays at size.
+// ***
+static size_t append(char* buffer, size_t size, size_t length, const char* format, ...)
+{
+  if (length < size)
+  {
+    va_list arguments;
+    va_start(arguments, format);
+    int count = vsnprintf(buffer + length, size - length, format, arguments);
+    va_end(arguments);
+
+    length = (count < 0 || (size_t)count >= (size - length)) ? size : length + count;
+  }
+
+  return length;
+}
+
+StatusServer::StatusServer(uint16_t port) : _server(port)
+{
+}
+
+void StatusServer::begin()
+{
+  this->_server.begin();
+  this->_server.setNoDelay(true);
+}
+
+// ***
+// *** Renders the responses from a new snapshot. A client that
+// *** is still receiving the previous response is disconnected
+// *** rather than sent a mix of the old and new data.
+// ***
+void StatusServer::update(const StatusSnapshot& snapshot)
+{
+  if (this->_state == STATE_WRITING && this->_response != _notFound && this->_response != _notReady)
+  {
+    this->disconnect();
+  }
+
+  size_t length = this->renderMetrics(snapshot, this->_metrics + STATUS_HEADER_SIZE, STATUS_METRICS_SIZE - STATUS_HEADER_SIZE);
+  this->_metricsResponse = StatusServer::finish(this->_metrics, STATUS_METRICS_SIZE, length, "text/plain; version=0.0.4", &this->_metricsLength);
+
+  length = this->renderJson(snapshot, this->_json + STATUS_HEADER_SIZE, STATUS_JSON_SIZE - STATUS_HEADER_SIZE);
+  this->_jsonResponse = StatusServer::finish(this->_json, STATUS_JSON_SIZE, length, "application/json", &this->_jsonLength);
+}
+
+// ***
+// *** Called by the loop. Does a bounded amount of work
+// *** and never waits for the client.
+// ***
+void StatusServer::process()
+{
+  if (this->_state == STATE_IDLE)
+  {
+    this->_client = this->_server.available();
+
+    if (this->_client)
+    {
+      this->_state = STATE_READING;
+      this->_clientStarted = millis();
+      this->_requestLength = 0;
+    }
+  }
+
+  if (this->_state == STATE_READING)
+  {
+    // ***
+    // *** Read what has arrived up to the end of the request
+    // *** line. The headers that follow are ignored.
+    // ***
+    int available = this->_client.available();
+
+    while (available-- > 0 && this->_state == STATE_READING)
+    {
+      char c = this->_client.read();
+
+      if (c == '\n')
+      {
+        this->_request[this->_requestLength] = 0;
+        this->route();
+      }
+      else if (c != '\r' && this->_requestLength < (STATUS_REQUEST_SIZE - 1))
+      {
+        this->_request[this->_requestLength++] = c;
+      }
+    }
+  }
+
+  if (this->_state == STATE_WRITING)
+  {
+    // ***
+    // *** Only write as much as the socket will take now.
+    // ***
+    size_t space = this->_client.availableForWrite();
+    size_t remaining = this->_responseLength - this->_responseSent;
+    size_t count = (space < remaining) ? space : remaining;
+
+    if (count > 0)
+    {
+      this->_responseSent += this->_client.write((const uint8_t*)this->_response + this->_responseSent, count);
+    }
+
+    if (this->_responseSent >= this->_responseLength)
+    {
+      this->_requestCount++;
+      this->disconnect();
+    }
+  }
+
+  if (this->_state != STATE_IDLE)
+  {
+    if ((millis() - this->_clientStarted) > STATUS_CLIENT_TIMEOUT || (!this->_client.connected() && this->_client.available() == 0))
+    {
+      this->disconnect();
+    }
+  }
+}
+
+uint32_t StatusServer::getRequestCount()
+{
+  return this->_requestCount;
+}
+
+// ***
+// *** Picks the response for the request line.
+// ***
+void StatusServer::route()
+{
+  this->_response = _notFound;
+  this->_responseLength = sizeof(_notFound) - 1;
+
+  if (strncmp(this->_request, "GET /metrics ", 13) == 0)
+  {
+    if (this->_metricsResponse)
+    {
+      this->_response = this->_metricsResponse;
+      this->_responseLength = this->_metricsLength;
+    }
+    else
+    {
+      this->_response = _notReady;
+      this->_responseLength = sizeof(_notReady) - 1;
+    }
+  }
+  else if (strncmp(this->_request, "GET /status.json ", 17) == 0)
+  {
+    if (this->_jsonResponse)
+    {
+      this->_response = this->_jsonResponse;
+      this->_responseLength = this->_jsonLength;
+    }
+    else
+    {
+      this->_response = _notReady;
+      this->_responseLength = sizeof(_notReady) - 1;
+    }
+  }
+
+  this->_responseSent = 0;
+  this->_state = STATE_WRITING;
+}
+
+void StatusServer::disconnect()
+{
+  this->_client.stop();
+  this->_state = STATE_IDLE;
+}
+
+size_t StatusServer::renderMetrics(const StatusSnapshot& snapshot, char* buffer, size_t size)
+{
+  size_t length = 0;
+  char label[CHANNEL_TEXT_SIZE];
+
+  length = append(buffer, size, length, "# HELP plantmonitor_reading Latest sensor reading.\n# TYPE plantmonitor_reading gauge\n");
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    enum sensorChannel channel = (enum sensorChannel)i;
+
+    if ((getChannelPolicy(channel) & REPORT_LAN) && !(snapshot.data->quality[i] & QUALITY_EXCLUDE_MASK))
+    {
+      length = append(buffer, size, length, "plantmonitor_reading{channel=\"%s\",unit=\"%s\"} %.*f\n",
+                      getChannelText(label, sizeof(label), getChannelLabel(channel)),
+                      getUnitLabel(getChannelUnit(channel), snapshot.isFahrenheit),
+                      getChannelDecimals(channel),
+                      getChannelValue(*snapshot.data, channel));
+    }
+  }
+
+  length = append(buffer, size, length, "# HELP plantmonitor_derived Metric derived from the latest readings.\n# TYPE plantmonitor_derived gauge\n");
+
+  for (uint8_t i = 0; i < METRIC_COUNT; i++)
+  {
+    enum derivedMetric metric = (enum derivedMetric)i;
+    float value = getMetricValue(*snapshot.data, metric);
+
+    if ((getMetricPolicy(metric) & REPORT_LAN) && !isnan(value))
+    {
+      length = append(buffer, size, length, "plantmonitor_derived{metric=\"%s\",unit=\"%s\"} %.*f\n",
+                      getChannelText(label, sizeof(label), getMetricLabel(metric)),
+                      getUnitLabel(getMetricUnit(metric), snapshot.isFahrenheit),
+                      getMetricDecimals(metric),
+                      value);
+    }
+  }
+
+  length = append(buffer, size, length, "# HELP plantmonitor_quality Quality flags of the latest reading (0 is good).\n# TYPE plantmonitor_quality gauge\n");
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    enum sensorChannel channel = (enum sensorChannel)i;
+
+    if (getChannelPolicy(channel) & REPORT_LAN)
+    {
+      length = append(buffer, size, length, "plantmonitor_quality{channel=\"%s\"} %u\n", getChannelText(label, sizeof(label), getChannelLabel(channel)), snapshot.data->quality[i]);
+    }
+  }
+
+  length = append(buffer, size, length, "# HELP plantmonitor_sample_interval_seconds Interval the channel is being read at.\n# TYPE plantmonitor_sample_interval_seconds gauge\n");
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    enum sensorChannel channel = (enum sensorChannel)i;
+
+    if (getChannelPolicy(channel) & REPORT_LAN)
+    {
+      length = append(buffer, size, length, "plantmonitor_sample_interval_seconds{channel=\"%s\"} %u\n", getChannelText(label, sizeof(label), getChannelLabel(channel)), snapshot.data->interval[i]);
+    }
+  }
+
+  length = append(buffer, size, length,
+                  "# TYPE plantmonitor_soil_dry gauge\nplantmonitor_soil_dry %d\n"
+                  "# TYPE plantmonitor_pump_on gauge\nplantmonitor_pump_on %d\n"
+                  "# TYPE plantmonitor_sample_timestamp_seconds gauge\nplantmonitor_sample_timestamp_seconds %lu\n"
+                  "# TYPE plantmonitor_uptime_seconds gauge\nplantmonitor_uptime_seconds %lu\n"
+                  "# TYPE plantmonitor_free_heap_bytes gauge\nplantmonitor_free_heap_bytes %lu\n"
+                  "# TYPE plantmonitor_wifi_rssi_dbm gauge\nplantmonitor_wifi_rssi_dbm %ld\n"
+                  "# TYPE plantmonitor_clock_synchronized gauge\nplantmonitor_clock_synchronized %d\n"
+                  "# TYPE plantmonitor_clock_syncs_total counter\nplantmonitor_clock_syncs_total %lu\n"
+                  "# TYPE plantmonitor_clock_drift_ppm gauge\nplantmonitor_clock_drift_ppm %.1f\n",
+                  snapshot.data->soilMoistureQuality == "Dry" ? 1 : 0,
+                  snapshot.isPumpOn ? 1 : 0,
+                  (unsigned long)snapshot.capturedAt,
+                  (unsigned long)snapshot.uptime,
+                  (unsigned long)snapshot.freeHeap,
+                  (long)snapshot.rssi,
+                  snapshot.isClockSynchronized ? 1 : 0,
+                  (unsigned long)snapshot.clockSyncCount,
+                  snapshot.clockDriftRate);
+
+  length = append(buffer, size, length,
+                  "# HELP plantmonitor_cloud_tokens Data points the cloud publish budget allows now.\n# TYPE plantmonitor_cloud_tokens gauge\nplantmonitor_cloud_tokens %.1f\n"
+                  "# TYPE plantmonitor_cloud_pending_readings gauge\nplantmonitor_cloud_pending_readings %u\n"
+                  "# TYPE plantmonitor_cloud_pending_alerts gauge\nplantmonitor_cloud_pending_alerts %u\n"
+                  "# TYPE plantmonitor_cloud_throttled_total counter\nplantmonitor_cloud_throttled_total %lu\n"
+                  "# HELP plantmonitor_cloud_deferred_total Publishes held back for lack of tokens.\n# TYPE plantmonitor_cloud_deferred_total counter\n"
+                  "plantmonitor_cloud_deferred_total{priority=\"control\"} %lu\n"
+                  "plantmonitor_cloud_deferred_total{priority=\"status\"} %lu\n"
+                  "plantmonitor_cloud_deferred_total{priority=\"bulk\"} %lu\n",
+                  snapshot.cloudTokens,
+                  snapshot.cloudPendingReadings,
+                  snapshot.cloudPendingAlerts,
+                  (unsigned long)snapshot.cloudThrottleCount,
+                  (unsigned long)snapshot.cloudDeferred[PUBLISH_CONTROL],
+                  (unsigned long)snapshot.cloudDeferred[PUBLISH_STATUS],
+                  (unsigned long)snapshot.cloudDeferred[PUBLISH_BULK]);
+
+  length = append(buffer, size, length,
+                  "# HELP plantmonitor_water_delivered_ml_total Water delivered by the pump.\n# TYPE plantmonitor_water_delivered_ml_total counter\nplantmonitor_water_delivered_ml_total %.0f\n"
+                  "# TYPE plantmonitor_water_today_ml gauge\nplantmonitor_water_today_ml %.0f\n"
+                  "# TYPE plantmonitor_water_budget_ml gauge\nplantmonitor_water_budget_ml %.0f\n"
+                  "# TYPE plantmonitor_water_events_total counter\nplantmonitor_water_events_total %lu\n"
+                  "# HELP plantmonitor_reservoir_ml Estimated water left in the reservoir.\n# TYPE plantmonitor_reservoir_ml gauge\nplantmonitor_reservoir_ml %.0f\n"
+                  "# TYPE plantmonitor_reservoir_percent gauge\nplantmonitor_reservoir_percent %.0f\n",
+                  snapshot.waterTotalVolume,
+                  snapshot.waterDayVolume,
+                  snapshot.waterBudget,
+                  (unsigned long)snapshot.waterEventCount,
+                  snapshot.reservoirLevel,
+                  snapshot.reservoirPercent);
+
+  return length;
+}
+
+size_t StatusServer::renderJson(const StatusSnapshot& snapshot, char* buffer, size_t size)
+{
+  size_t length = 0;
+  char label[CHANNEL_TEXT_SIZE];
+  const char* separator = "";
+
+  length = append(buffer, size, length, "{\"capturedAt\":%lu,\"units\":\"%s\",\"readings\":{", (unsigned long)snapshot.capturedAt, snapshot.isFahrenheit ? "F" : "C");
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    enum sensorChannel channel = (enum sensorChannel)i;
+
+    if (getChannelPolicy(channel) & REPORT_LAN)
+    {
+      getChannelText(label, sizeof(label), getChannelLabel(channel));
+
+      if (snapshot.data->quality[i] & QUALITY_EXCLUDE_MASK)
+      {
+        length = append(buffer, size, length, "%s\"%s\":{\"value\":null,\"quality\":%u,\"interval\":%u}", separator, label, snapshot.data->quality[i], snapshot.data->interval[i]);
+      }
+      else
+      {
+        length = append(buffer, size, length, "%s\"%s\":{\"value\":%.*f,\"quality\":%u,\"interval\":%u}", separator, label, getChannelDecimals(channel), getChannelValue(*snapshot.data, channel), snapshot.data->quality[i], snapshot.data->interval[i]);
+      }
+
+      separator = ",";
+    }
+  }
+
+  length = append(buffer, size, length, "},\"derived\":{");
+  separator = "";
+
+  for (uint8_t i = 0; i < METRIC_COUNT; i++)
+  {
+    enum derivedMetric metric = (enum derivedMetric)i;
+    float value = getMetricValue(*snapshot.data, metric);
+
+    if (getMetricPolicy(metric) & REPORT_LAN)
+    {
+      getChannelText(label, sizeof(label), getMetricLabel(metric));
+
+      if (isnan(value))
+      {
+        length = append(buffer, size, length, "%s\"%s\":null", separator, label);
+      }
+      else
+      {
+        length = append(buffer, size, length, "%s\"%s\":%.*f", separator, label, getMetricDecimals(metric), value);
+      }
+
+      separator = ",";
+    }
+  }
+
+  length = append(buffer, size, length,
+                  "},\"soilMoistureQuality\":\"%s\",\"pumpOn\":%s,\"uptime\":%lu,\"freeHeap\":%lu,\"rssi\":%ld,"
+                  "\"clock\":{\"synchronized\":%s,\"syncs\":%lu,\"driftPpm\":%.1f},"
+                  "\"cloud\":{\"tokens\":%.1f,\"pendingReadings\":%u,\"pendingAlerts\":%u,\"throttled\":%lu,\"deferred\":[%lu,%lu,%lu]},"
+                  "\"water\":{\"today\":%.0f,\"budget\":%.0f,\"total\":%.0f,\"events\":%lu,\"reservoir\":%.0f,\"reservoirPercent\":%.0f}}\n",
+                  snapshot.data->soilMoistureQuality.c_str(),
+                  snapshot.isPumpOn ? "true" : "false",
+                  (unsigned long)snapshot.uptime,
+                  (unsigned long)snapshot.freeHeap,
+                  (long)snapshot.rssi,
+                  snapshot.isClockSynchronized ? "true" : "false",
+                  (unsigned long)snapshot.clockSyncCount,
+                  snapshot.clockDriftRate,
+                  snapshot.cloudTokens,
+                  snapshot.cloudPendingReadings,
+                  snapshot.cloudPendingAlerts,
+                  (unsigned long)snapshot.cloudThrottleCount,
+                  (unsigned long)snapshot.cloudDeferred[PUBLISH_CONTROL],
+                  (unsigned long)snapshot.cloudDeferred[PUBLISH_STATUS],
+                  (unsigned long)snapshot.cloudDeferred[PUBLISH_BULK],
+                  snapshot.waterDayVolume,
+                  snapshot.waterBudget,
+                  snapshot.waterTotalVolume,
+                  (unsigned long)snapshot.waterEventCount,
+                  snapshot.reservoirLevel,
+                  snapshot.reservoirPercent);
+
+  return length;
+}
+
+// ***
+// *** Writes the HTTP headers immediately in front of a body that
+// *** was rendered at STATUS_HEADER_SIZE and returns the start
+// *** of the complete response. A truncated body is replaced with
+// *** a 500 response.
+// ***
+const char* StatusServer::finish(char* buffer, size_t size, size_t bodyLength, const char* contentType, size_t* responseLength)
+{
+  char header[STATUS_HEADER_SIZE];
+  const char* status = "200 OK";
+
+  if (bodyLength >= (size - STATUS_HEADER_SIZE))
+  {
+    status = "500 Internal Server Error";
+    bodyLength = 0;
+  }
+
+  int headerLength = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\nConnection: close\r\n\r\n",
+                              status, contentType, (unsigned)bodyLength);
+
+  char* start = buffer + STATUS_HEADER_SIZE - headerLength;
+  memcpy(start, header, headerLength);
+  *responseLength = headerLength + bodyLength;
+
+  return start;
+}
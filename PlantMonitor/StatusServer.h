@@ -0,0 +1,145 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef STATUS_SERVER_H
+#define STATUS_SERVER_H
+
+#include <ESP8266WiFi.h>
+#include "CloudData.h"
+#include "SensorHealth.h"
+#include "PublishGovernor.h"
+
+// ***
+// *** The port the status server listens on.
+// ***
+#ifndef STATUS_SERVER_PORT
+#define STATUS_SERVER_PORT      80
+#endif
+
+// ***
+// *** Size of the pre-rendered responses (headers included).
+// ***
+#define STATUS_METRICS_SIZE     4864
+#define STATUS_JSON_SIZE        1408
+
+// ***
+// *** Space reserved in front of each body for the HTTP headers.
+// ***
+#define STATUS_HEADER_SIZE      128
+
+// ***
+// *** Only the request line is needed; anything longer is cut off.
+// ***
+#define STATUS_REQUEST_SIZE     64
+
+// ***
+// *** A client that has not sent its request line or received
+// *** its response within this time (ms) is disconnected.
+// ***
+#define STATUS_CLIENT_TIMEOUT   1000
+
+// ***
+// *** The values rendered into the responses. Everything is
+// *** captured when the snapshot is taken, not per request.
+// ***
+typedef struct statusSnapshot
+{
+  const CloudData* data;
+  bool isFahrenheit;
+  time_t capturedAt;
+  uint32_t uptime;
+  uint32_t freeHeap;
+  int32_t rssi;
+  bool isPumpOn;
+  bool isClockSynchronized;
+  uint32_t clockSyncCount;
+  float clockDriftRate;
+  float cloudTokens;
+  uint16_t cloudPendingReadings;
+  uint8_t cloudPendingAlerts;
+  uint32_t cloudThrottleCount;
+  uint32_t cloudDeferred[PUBLISH_PRIORITY_COUNT];
+  float waterDayVolume;
+  float waterTotalVolume;
+  float waterBudget;
+  uint32_t waterEventCount;
+  float reservoirLevel;
+  float reservoirPercent;
+} StatusSnapshot;
+
+// ***
+// *** A small HTTP server that answers /metrics (Prometheus text
+// *** format) and /status.json. Responses are rendered once per
+// *** snapshot into static buffers so a request only costs the
+// *** copy to the socket. process() never waits on the network;
+// *** it serves one client at a time and only writes what the
+// *** socket will accept without blocking.
+// ***
+class StatusServer
+{
+  public:
+    StatusServer(uint16_t);
+    void begin();
+    void update(const StatusSnapshot&);
+    void process();
+    uint32_t getRequestCount();
+
+  private:
+    enum clientState {
+      STATE_IDLE,
+      STATE_READING,
+      STATE_WRITING
+    };
+
+    WiFiServer _server;
+    WiFiClient _client;
+    enum clientState _state = STATE_IDLE;
+    uint32_t _clientStarted = 0;
+
+    // ***
+    // *** The request line of the current client.
+    // ***
+    char _request[STATUS_REQUEST_SIZE];
+    uint8_t _requestLength = 0;
+
+    // ***
+    // *** The response being sent to the current client.
+    // ***
+    const char* _response = nullptr;
+    size_t _responseLength = 0;
+    size_t _responseSent = 0;
+
+    // ***
+    // *** Pre-rendered responses.
+    // ***
+    char _metrics[STATUS_METRICS_SIZE];
+    const char* _metricsResponse = nullptr;
+    size_t _metricsLength = 0;
+
+    char _json[STATUS_JSON_SIZE];
+    const char* _jsonResponse = nullptr;
+    size_t _jsonLength = 0;
+
+    uint32_t _requestCount = 0;
+
+    void route();
+    void disconnect();
+    size_t renderMetrics(const StatusSnapshot&, char*, size_t);
+    size_t renderJson(const StatusSnapshot&, char*, size_t);
+    static const char* finish(char*, size_t, size_t, const char*, size_t*);
+};
+#endif
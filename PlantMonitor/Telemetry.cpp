@@ -0,0 +1,176 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "Telemetry.h"
+
+static_assert(TELEMETRY_CHANNELS == CHANNEL_COUNT, "The telemetry packet must carry every channel.");
+
+Telemetry::Telemetry()
+{
+}
+
+void Telemetry::begin()
+{
+  this->_deviceId = ESP.getChipId();
+
+  // ***
+  // *** The session changes on every boot so that the collector
+  // *** does not discard packets as duplicates after a reset.
+  // ***
+  this->_session = RANDOM_REG32;
+
+  this->_isMulticast = (strlen(TELEMETRY_HOST) == 0);
+  this->_address.fromString(this->_isMulticast ? TELEMETRY_MULTICAST : TELEMETRY_HOST);
+
+  this->beginBatch();
+}
+
+// ***
+// *** Encodes and sends one set of readings. The timestamp is epoch
+// *** time (ms) if isEpoch is set, otherwise the tick since boot.
+// ***
+bool Telemetry::send(const CloudData& data, uint64_t timestamp, bool isEpoch, bool isFahrenheit)
+{
+  TelemetryRecord record;
+  this->toRecord(data, timestamp, isEpoch, isFahrenheit, record);
+  this->_sequence++;
+
+  size_t length = telemetryEncode(&record, this->_buffer, sizeof(this->_buffer));
+
+  return this->sendPacket(this->_buffer, length);
+}
+
+// ***
+// *** Starts a batch of readings, which are sent in one packet
+// *** by sendBatch().
+// ***
+void Telemetry::beginBatch()
+{
+  uint8_t decimals[TELEMETRY_CHANNELS];
+
+  for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+  {
+    decimals[i] = getChannelDecimals((enum sensorChannel)i);
+  }
+
+  telemetryBatchBegin(&this->_batch, this->_batchBuffer, sizeof(this->_batchBuffer), decimals);
+}
+
+// ***
+// *** Adds a set of readings to the batch. Returns false when the
+// *** batch is full; send it and begin another.
+// ***
+bool Telemetry::addToBatch(const CloudData& data, uint64_t timestamp, bool isEpoch, bool isFahrenheit)
+{
+  bool returnValue = false;
+
+  TelemetryRecord record;
+  this->toRecord(data, timestamp, isEpoch, isFahrenheit, record);
+
+  if (telemetryBatchAdd(&this->_batch, &record))
+  {
+    this->_sequence++;
+    returnValue = true;
+  }
+
+  return returnValue;
+}
+
+bool Telemetry::sendBatch()
+{
+  bool returnValue = false;
+  size_t length = telemetryBatchFinish(&this->_batch);
+
+  if (length > 0)
+  {
+#ifdef TELEMETRY_COMPRESS_BATCH
+    uint8_t compressed[TELEMETRY_BATCH_SIZE];
+    size_t compressedLength = telemetryBatchCompress(this->_batchBuffer, length, compressed, sizeof(compressed));
+
+    if (compressedLength > 0)
+    {
+      returnValue = this->sendPacket(compressed, compressedLength);
+    }
+    else
+    {
+      returnValue = this->sendPacket(this->_batchBuffer, length);
+    }
+#else
+    returnValue = this->sendPacket(this->_batchBuffer, length);
+#endif
+  }
+
+  this->beginBatch();
+
+  return returnValue;
+}
+
+// ***
+// *** Channels without the REPORT_LAN policy or with an
+// *** unusable reading are sent without a value.
+// ***
+void Telemetry::toRecord(const CloudData& data, uint64_t timestamp, bool isEpoch, bool isFahrenheit, TelemetryRecord& record)
+{
+  record.flags = (isEpoch ? TELEMETRY_FLAG_EPOCH : 0) |
+                 (isFahrenheit ? TELEMETRY_FLAG_FAHRENHEIT : 0) |
+                 (data.soilMoistureQuality == "Dry" ? TELEMETRY_FLAG_SOIL_DRY : 0);
+  record.deviceId = this->_deviceId;
+  record.session = this->_session;
+  record.sequence = this->_sequence;
+  record.timestamp = timestamp;
+
+#define TELEMETRY_CHANNEL(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) \
+  record.quality[id] = data.quality[id]; \
+  record.interval[id] = data.interval[id]; \
+  record.value[id] = (((policy) & REPORT_LAN) && !(data.quality[id] & QUALITY_EXCLUDE_MASK)) ? telemetryScale(data.field) : TELEMETRY_NO_VALUE;
+
+  SENSOR_CHANNELS(TELEMETRY_CHANNEL)
+}
+
+bool Telemetry::sendPacket(const uint8_t* buffer, size_t length)
+{
+  bool returnValue = false;
+
+  if (WiFi.status() == WL_CONNECTED)
+  {
+    int started = this->_isMulticast ? this->_udp.beginPacketMulticast(this->_address, TELEMETRY_PORT, WiFi.localIP())
+                                     : this->_udp.beginPacket(this->_address, TELEMETRY_PORT);
+
+    if (started)
+    {
+      this->_udp.write(buffer, length);
+      returnValue = this->_udp.endPacket();
+    }
+  }
+
+  if (!returnValue)
+  {
+    this->_failures++;
+  }
+
+  return returnValue;
+}
+
+uint32_t Telemetry::getSequence()
+{
+  return this->_sequence;
+}
+
+uint32_t Telemetry::getFailures()
+{
+  return this->_failures;
+}
@@ -0,0 +1,101 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include "CloudData.h"
+#include "SensorHealth.h"
+#include "TelemetryPacket.h"
+#include "TelemetryBatch.h"
+
+// ***
+// *** Where the telemetry packets are sent. Leave TELEMETRY_HOST
+// *** empty to send to the multicast group, otherwise set it to
+// *** the IP address of the collector.
+// ***
+#define TELEMETRY_HOST      ""
+#define TELEMETRY_MULTICAST "239.255.80.77"
+#define TELEMETRY_PORT      5077
+
+// ***
+// *** Size of the buffer a batch of readings is written to (see
+// *** TelemetryBatch.h). A reading takes about 10 bytes in a batch.
+// *** Define TELEMETRY_COMPRESS_BATCH to compress the batch as well
+// *** (it needs a second buffer of this size on the stack and pays
+// *** off for long batches of slowly changing readings).
+// ***
+#define TELEMETRY_BATCH_SIZE 512
+// #define TELEMETRY_COMPRESS_BATCH
+
+// ***
+// *** Streams each set of sensor readings to the local network
+// *** as a small binary UDP packet (see TelemetryPacket.h).
+// ***
+class Telemetry
+{
+  public:
+    Telemetry();
+    void begin();
+    bool send(const CloudData&, uint64_t timestamp, bool isEpoch, bool isFahrenheit);
+    void beginBatch();
+    bool addToBatch(const CloudData&, uint64_t timestamp, bool isEpoch, bool isFahrenheit);
+    bool sendBatch();
+    uint32_t getSequence();
+    uint32_t getFailures();
+
+  private:
+    // ***
+    // *** UDP socket.
+    // ***
+    WiFiUDP _udp;
+
+    // ***
+    // *** The destination address.
+    // ***
+    IPAddress _address;
+    bool _isMulticast = true;
+
+    // ***
+    // *** Identifies this device and this boot.
+    // ***
+    uint32_t _deviceId = 0;
+    uint32_t _session = 0;
+
+    // ***
+    // *** The sequence number of the next packet.
+    // ***
+    uint32_t _sequence = 0;
+    uint32_t _failures = 0;
+
+    // ***
+    // *** The packet is encoded here.
+    // ***
+    uint8_t _buffer[TELEMETRY_PACKET_SIZE];
+
+    // ***
+    // *** The batch being built.
+    // ***
+    TelemetryBatch _batch;
+    uint8_t _batchBuffer[TELEMETRY_BATCH_SIZE];
+
+    void toRecord(const CloudData&, uint64_t timestamp, bool isEpoch, bool isFahrenheit, TelemetryRecord&);
+    bool sendPacket(const uint8_t*, size_t);
+};
+#endif
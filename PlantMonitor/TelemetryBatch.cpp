@@ -0,0 +1,629 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "TelemetryBatch.h"
+#include "ByteOrder.h"
+#include <string.h>
+
+// ***
+// *** Varints hold 7 bits per byte, low bits first. Signed values
+// *** are zigzag encoded first so that small changes either way
+// *** take few bytes.
+// ***
+static uint8_t* putVarint(uint8_t* p, uint64_t v)
+{
+  do
+  {
+    *p = v & 0x7F;
+    v >>= 7;
+
+    if (v)
+    {
+      *p |= 0x80;
+    }
+
+    p++;
+  } while (v);
+
+  return p;
+}
+
+// ***
+// *** The telemetry value of a channel is the column value
+// *** times this.
+// ***
+static int32_t columnDivisor(uint8_t decimals)
+{
+  int32_t returnValue = TELEMETRY_SCALE;
+
+  for (uint8_t i = 0; i < decimals && returnValue > 1; i++)
+  {
+    returnValue /= 10;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Turns a decoded column value back into a telemetry value.
+// *** Returns false when it does not fit (a corrupt or hostile
+// *** batch) instead of overflowing.
+// ***
+static bool fromColumn(int32_t column, uint8_t decimals, int32_t* value)
+{
+  bool returnValue = false;
+  int64_t scaled = (int64_t)column * columnDivisor(decimals);
+
+  if (scaled > INT32_MIN && scaled <= INT32_MAX)
+  {
+    *value = (int32_t)scaled;
+    returnValue = true;
+  }
+
+  return returnValue;
+}
+
+static int32_t toColumn(int32_t value, uint8_t decimals)
+{
+  int32_t divisor = columnDivisor(decimals);
+  return (value >= 0 ? value + (divisor / 2) : value - (divisor / 2)) / divisor;
+}
+
+// ***
+// *** Starts a batch in the buffer. The decimals of each channel
+// *** set the precision kept (see TelemetryBatch.h).
+// ***
+void telemetryBatchBegin(TelemetryBatch* batch, uint8_t* buffer, size_t size, const uint8_t* decimals)
+{
+  memset(batch, 0, sizeof(TelemetryBatch));
+  batch->buffer = buffer;
+
+  if (size >= TELEMETRY_BATCH_HEADER_SIZE + 4)
+  {
+    batch->size = size;
+    batch->length = TELEMETRY_BATCH_HEADER_SIZE;
+    memset(buffer, 0, TELEMETRY_BATCH_HEADER_SIZE);
+    put16(buffer, TELEMETRY_BATCH_MAGIC);
+    buffer[2] = TELEMETRY_BATCH_VERSION;
+
+    for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+    {
+      batch->decimals[i] = decimals[i];
+      buffer[18 + i] = decimals[i];
+    }
+  }
+}
+
+// ***
+// *** Appends a record. Returns false, leaving the batch as it
+// *** was, when the record does not fit or does not follow on
+// *** from the last one (same device and session, next sequence).
+// ***
+bool telemetryBatchAdd(TelemetryBatch* batch, const TelemetryRecord* record)
+{
+  bool returnValue = false;
+
+  bool isNext = (batch->count == 0) || (record->deviceId == batch->deviceId && record->session == batch->session &&
+                                        record->sequence == batch->sequence + batch->count);
+
+  if (batch->size > 0 && isNext && batch->count < UINT16_MAX)
+  {
+    uint8_t encoded[TELEMETRY_BATCH_RECORD_SIZE];
+    int32_t value[TELEMETRY_CHANNELS];
+    uint8_t missing = 0;
+    uint8_t qualityChanged = 0;
+    uint8_t intervalChanged = 0;
+    uint8_t valueChanged = 0;
+
+    for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+    {
+      value[i] = batch->value[i];
+
+      if (record->value[i] == TELEMETRY_NO_VALUE)
+      {
+        missing |= (1 << i);
+      }
+      else
+      {
+        value[i] = toColumn(record->value[i], batch->decimals[i]);
+      }
+
+      valueChanged |= (value[i] != batch->value[i]) ? (1 << i) : 0;
+      qualityChanged |= (record->quality[i] != batch->quality[i]) ? (1 << i) : 0;
+      intervalChanged |= (record->interval[i] != batch->interval[i]) ? (1 << i) : 0;
+    }
+
+    int64_t step = (int64_t)(record->timestamp - batch->timestamp);
+    uint8_t* p = putVarint(encoded, zigzag(step - batch->step));
+    uint8_t* control = p++;
+    *control = 0;
+
+    if (record->flags != batch->flags)
+    {
+      *control |= TELEMETRY_BATCH_HAS_FLAGS;
+      *p++ = record->flags;
+    }
+
+    if (missing != batch->missing)
+    {
+      *control |= TELEMETRY_BATCH_HAS_MISSING;
+      *p++ = missing;
+    }
+
+    if (qualityChanged)
+    {
+      *control |= TELEMETRY_BATCH_HAS_QUALITY;
+      *p++ = qualityChanged;
+
+      for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+      {
+        if (qualityChanged & (1 << i))
+        {
+          *p++ = record->quality[i];
+        }
+      }
+    }
+
+    if (intervalChanged)
+    {
+      *control |= TELEMETRY_BATCH_HAS_INTERVAL;
+      *p++ = intervalChanged;
+
+      for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+      {
+        if (intervalChanged & (1 << i))
+        {
+          p = putVarint(p, record->interval[i]);
+        }
+      }
+    }
+
+    if (valueChanged)
+    {
+      *control |= TELEMETRY_BATCH_HAS_VALUE;
+      *p++ = valueChanged;
+
+      for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+      {
+        if (valueChanged & (1 << i))
+        {
+          p = putVarint(p, zigzag((int64_t)value[i] - batch->value[i]));
+        }
+      }
+    }
+
+    size_t length = p - encoded;
+
+    if (batch->length + length + 4 <= batch->size)
+    {
+      memcpy(batch->buffer + batch->length, encoded, length);
+      batch->length += length;
+
+      if (batch->count == 0)
+      {
+        batch->deviceId = record->deviceId;
+        batch->session = record->session;
+        batch->sequence = record->sequence;
+      }
+
+      // ***
+      // *** The time of the first record is not a step.
+      // ***
+      batch->step = (batch->count == 0) ? 0 : step;
+      batch->timestamp = record->timestamp;
+      batch->flags = record->flags;
+      batch->missing = missing;
+      memcpy(batch->value, value, sizeof(value));
+      memcpy(batch->quality, record->quality, sizeof(batch->quality));
+      memcpy(batch->interval, record->interval, sizeof(batch->interval));
+      batch->count++;
+
+      returnValue = true;
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Completes the header and checksum and returns the length of
+// *** the batch, or 0 if it holds no records.
+// ***
+size_t telemetryBatchFinish(TelemetryBatch* batch)
+{
+  size_t returnValue = 0;
+
+  if (batch->count > 0)
+  {
+    put32(batch->buffer + 4, batch->deviceId);
+    put32(batch->buffer + 8, batch->session);
+    put32(batch->buffer + 12, batch->sequence);
+    put16(batch->buffer + 16, batch->count);
+    put32(batch->buffer + batch->length, telemetryCrc32(batch->buffer, batch->length));
+    returnValue = batch->length + 4;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Compresses the records of a finished batch into the buffer
+// *** (LZSS: a control byte for each eight items, each item being
+// *** a literal byte or a two byte reference to an earlier run of
+// *** 3 to 18 bytes). Returns the length of the compressed batch or
+// *** 0 if it would not be smaller (send the batch as it is).
+// ***
+size_t telemetryBatchCompress(const uint8_t* batch, size_t length, uint8_t* buffer, size_t size)
+{
+  size_t returnValue = 0;
+
+  if (length >= TELEMETRY_BATCH_HEADER_SIZE + 4 && !(batch[3] & TELEMETRY_BATCH_COMPRESSED) && size >= TELEMETRY_BATCH_HEADER_SIZE + 2 + 4)
+  {
+    const uint8_t* records = batch + TELEMETRY_BATCH_HEADER_SIZE;
+    size_t recordLength = length - TELEMETRY_BATCH_HEADER_SIZE - 4;
+    size_t limit = (size < length ? size : length - 1) - 4;
+    size_t out = TELEMETRY_BATCH_HEADER_SIZE + 2;
+    size_t control = 0;
+    uint8_t bit = 8;
+    size_t i = 0;
+    bool fits = true;
+
+    memcpy(buffer, batch, TELEMETRY_BATCH_HEADER_SIZE);
+    buffer[3] |= TELEMETRY_BATCH_COMPRESSED;
+    put16(buffer + TELEMETRY_BATCH_HEADER_SIZE, recordLength);
+
+    while (fits && i < recordLength)
+    {
+      if (bit == 8)
+      {
+        control = out++;
+        buffer[control] = 0;
+        bit = 0;
+      }
+
+      // ***
+      // *** Find the longest earlier run that matches.
+      // ***
+      size_t best = 0;
+      size_t offset = 0;
+
+      for (size_t j = (i > TELEMETRY_BATCH_WINDOW ? i - TELEMETRY_BATCH_WINDOW : 0); j < i; j++)
+      {
+        size_t k = 0;
+
+        while (k < 18 && (i + k) < recordLength && records[j + k] == records[i + k])
+        {
+          k++;
+        }
+
+        if (k > best)
+        {
+          best = k;
+          offset = i - j;
+        }
+      }
+
+      if (best >= 3 && out + 2 <= limit)
+      {
+        buffer[control] |= (1 << bit);
+        buffer[out++] = (offset - 1) & 0xFF;
+        buffer[out++] = (((offset - 1) >> 8) << 4) | (best - 3);
+        i += best;
+      }
+      else if (best < 3 && out + 1 <= limit)
+      {
+        buffer[out++] = records[i++];
+      }
+      else
+      {
+        fits = false;
+      }
+
+      bit++;
+    }
+
+    if (fits)
+    {
+      put32(buffer + out, telemetryCrc32(buffer, out));
+      returnValue = out + 4;
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Expands a compressed batch into the buffer and returns the
+// *** length of the batch or 0 if it is not a valid compressed
+// *** batch or does not fit.
+// ***
+size_t telemetryBatchExpand(const uint8_t* batch, size_t length, uint8_t* buffer, size_t size)
+{
+  size_t returnValue = 0;
+
+  if (length >= TELEMETRY_BATCH_HEADER_SIZE + 2 + 4 && get16(batch) == TELEMETRY_BATCH_MAGIC && batch[2] == TELEMETRY_BATCH_VERSION &&
+      (batch[3] & TELEMETRY_BATCH_COMPRESSED) && get32(batch + length - 4) == telemetryCrc32(batch, length - 4))
+  {
+    size_t recordLength = get16(batch + TELEMETRY_BATCH_HEADER_SIZE);
+
+    if (size >= TELEMETRY_BATCH_HEADER_SIZE + recordLength + 4)
+    {
+      uint8_t* records = buffer + TELEMETRY_BATCH_HEADER_SIZE;
+      size_t in = TELEMETRY_BATCH_HEADER_SIZE + 2;
+      size_t end = length - 4;
+      size_t out = 0;
+      uint8_t control = 0;
+      uint8_t bit = 8;
+      bool isValid = true;
+
+      memcpy(buffer, batch, TELEMETRY_BATCH_HEADER_SIZE);
+      buffer[3] &= ~TELEMETRY_BATCH_COMPRESSED;
+
+      while (isValid && out < recordLength)
+      {
+        if (bit == 8)
+        {
+          isValid = (in < end);
+          control = isValid ? batch[in++] : 0;
+          bit = 0;
+        }
+
+        if (isValid && (control & (1 << bit)))
+        {
+          size_t offset = (in + 2 <= end) ? (batch[in] | ((size_t)(batch[in + 1] >> 4) << 8)) + 1 : 0;
+          size_t count = (in + 2 <= end) ? (batch[in + 1] & 0x0F) + 3 : 0;
+          isValid = (offset > 0 && offset <= out && out + count <= recordLength);
+
+          if (isValid)
+          {
+            in += 2;
+
+            // ***
+            // *** A run may overlap the bytes it produces.
+            // ***
+            for (size_t k = 0; k < count; k++)
+            {
+              records[out] = records[out - offset];
+              out++;
+            }
+          }
+        }
+        else if (isValid)
+        {
+          isValid = (in < end);
+
+          if (isValid)
+          {
+            records[out++] = batch[in++];
+          }
+        }
+
+        bit++;
+      }
+
+      if (isValid)
+      {
+        put32(buffer + TELEMETRY_BATCH_HEADER_SIZE + recordLength, telemetryCrc32(buffer, TELEMETRY_BATCH_HEADER_SIZE + recordLength));
+        returnValue = TELEMETRY_BATCH_HEADER_SIZE + recordLength + 4;
+      }
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** True if the buffer starts like a batch (rather than a
+// *** telemetry packet).
+// ***
+bool telemetryBatchIsBatch(const uint8_t* buffer, size_t length)
+{
+  return length >= 2 && get16(buffer) == TELEMETRY_BATCH_MAGIC;
+}
+
+// ***
+// *** Checks a batch and prepares to read its records. A
+// *** compressed batch must be expanded first.
+// ***
+enum telemetryResult telemetryBatchOpen(TelemetryBatchReader* reader, const uint8_t* buffer, size_t length)
+{
+  enum telemetryResult returnValue = TELEMETRY_OK;
+
+  if (length < 4)
+  {
+    returnValue = TELEMETRY_TOO_SHORT;
+  }
+  else if (get16(buffer) != TELEMETRY_BATCH_MAGIC)
+  {
+    returnValue = TELEMETRY_BAD_MAGIC;
+  }
+  else if (buffer[2] != TELEMETRY_BATCH_VERSION)
+  {
+    returnValue = TELEMETRY_BAD_VERSION;
+  }
+  else if (length < TELEMETRY_BATCH_HEADER_SIZE + 4)
+  {
+    returnValue = TELEMETRY_TOO_SHORT;
+  }
+  else if (get32(buffer + length - 4) != telemetryCrc32(buffer, length - 4))
+  {
+    returnValue = TELEMETRY_BAD_CRC;
+  }
+  else if (buffer[3] & TELEMETRY_BATCH_COMPRESSED)
+  {
+    returnValue = TELEMETRY_COMPRESSED;
+  }
+  else
+  {
+    memset(reader, 0, sizeof(TelemetryBatchReader));
+    reader->buffer = buffer;
+    reader->length = length - 4;
+    reader->position = TELEMETRY_BATCH_HEADER_SIZE;
+    reader->deviceId = get32(buffer + 4);
+    reader->session = get32(buffer + 8);
+    reader->sequence = get32(buffer + 12);
+    reader->count = get16(buffer + 16);
+    memcpy(reader->decimals, buffer + 18, TELEMETRY_CHANNELS);
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Reads a byte or a varint, returning false at the end
+// *** of the records.
+// ***
+static bool getByte(TelemetryBatchReader* reader, uint8_t* value)
+{
+  bool returnValue = reader->position < reader->length;
+
+  if (returnValue)
+  {
+    *value = reader->buffer[reader->position++];
+  }
+
+  return returnValue;
+}
+
+static bool getVarint(TelemetryBatchReader* reader, uint64_t* value)
+{
+  bool returnValue = false;
+  uint8_t shift = 0;
+  uint8_t b = 0x80;
+  *value = 0;
+
+  while ((b & 0x80) && shift < 64 && getByte(reader, &b))
+  {
+    *value |= (uint64_t)(b & 0x7F) << shift;
+    shift += 7;
+    returnValue = !(b & 0x80);
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Reads the next record. Returns false after the last record
+// *** or if the batch is malformed.
+// ***
+bool telemetryBatchNext(TelemetryBatchReader* reader, TelemetryRecord* record)
+{
+  bool returnValue = false;
+
+  if (reader->index < reader->count)
+  {
+    uint64_t change = 0;
+    uint64_t v = 0;
+    uint8_t control = 0;
+    uint8_t changed = 0;
+    bool isValid = getVarint(reader, &change) && getByte(reader, &control);
+
+    if (isValid && (control & TELEMETRY_BATCH_HAS_FLAGS))
+    {
+      isValid = getByte(reader, &reader->flags);
+    }
+
+    if (isValid && (control & TELEMETRY_BATCH_HAS_MISSING))
+    {
+      isValid = getByte(reader, &reader->missing);
+    }
+
+    if (isValid && (control & TELEMETRY_BATCH_HAS_QUALITY))
+    {
+      isValid = getByte(reader, &changed);
+
+      for (uint8_t i = 0; isValid && i < TELEMETRY_CHANNELS; i++)
+      {
+        if (changed & (1 << i))
+        {
+          isValid = getByte(reader, &reader->quality[i]);
+        }
+      }
+    }
+
+    if (isValid && (control & TELEMETRY_BATCH_HAS_INTERVAL))
+    {
+      isValid = getByte(reader, &changed);
+
+      for (uint8_t i = 0; isValid && i < TELEMETRY_CHANNELS; i++)
+      {
+        if (changed & (1 << i))
+        {
+          isValid = getVarint(reader, &v);
+          reader->interval[i] = (uint16_t)v;
+        }
+      }
+    }
+
+    if (isValid && (control & TELEMETRY_BATCH_HAS_VALUE))
+    {
+      isValid = getByte(reader, &changed);
+
+      for (uint8_t i = 0; isValid && i < TELEMETRY_CHANNELS; i++)
+      {
+        if (changed & (1 << i))
+        {
+          isValid = getVarint(reader, &v);
+
+          // ***
+          // *** A column never moves by more than 32 bits.
+          // ***
+          int64_t delta = unzigzag(v);
+          int64_t value = reader->value[i] + delta;
+          isValid = isValid && delta >= -(int64_t)UINT32_MAX && delta <= (int64_t)UINT32_MAX && value >= INT32_MIN && value <= INT32_MAX;
+          reader->value[i] = (int32_t)value;
+        }
+      }
+    }
+
+    for (uint8_t i = 0; isValid && i < TELEMETRY_CHANNELS; i++)
+    {
+      if (reader->missing & (1 << i))
+      {
+        record->value[i] = TELEMETRY_NO_VALUE;
+      }
+      else
+      {
+        isValid = fromColumn(reader->value[i], reader->decimals[i], &record->value[i]);
+      }
+    }
+
+    if (isValid)
+    {
+      int64_t step = reader->step + unzigzag(change);
+      reader->timestamp += (uint64_t)step;
+      reader->step = (reader->index == 0) ? 0 : step;
+
+      record->flags = reader->flags;
+      record->deviceId = reader->deviceId;
+      record->session = reader->session;
+      record->sequence = reader->sequence + reader->index;
+      record->timestamp = reader->timestamp;
+
+      for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+      {
+        record->quality[i] = reader->quality[i];
+        record->interval[i] = reader->interval[i];
+      }
+
+      reader->index++;
+      returnValue = true;
+    }
+  }
+
+  return returnValue;
+}
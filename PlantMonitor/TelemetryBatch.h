@@ -0,0 +1,157 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef TELEMETRY_BATCH_H
+#define TELEMETRY_BATCH_H
+
+// ***
+// *** This file does not depend on the Arduino core so that it
+// *** can be shared with the Linux collector (see Tools/Collector).
+// ***
+#include "TelemetryPacket.h"
+
+// ***
+// *** A batch carries a run of telemetry records from one device
+// *** session (readings kept while the radio was off, for example)
+// *** in far fewer bytes than a packet per record. Each record
+// *** only holds what changed since the record before it.
+// ***
+#define TELEMETRY_BATCH_MAGIC       0x4250    // "PB" (little endian)
+#define TELEMETRY_BATCH_VERSION     1
+
+// ***
+// *** Flags.
+// ***
+#define TELEMETRY_BATCH_COMPRESSED  0x01      // The records are compressed (see telemetryBatchCompress()).
+
+// ***
+// *** Batch layout (all fields little endian):
+// ***
+// ***  0  uint16  magic
+// ***  2  uint8   version
+// ***  3  uint8   flags
+// ***  4  uint32  device id (chip id)
+// ***  8  uint32  session
+// *** 12  uint32  sequence of the first record (the others follow on)
+// *** 16  uint16  record count
+// *** 18  uint8   decimals[TELEMETRY_CHANNELS]
+// *** 26  ...     records
+// ***  n  uint32  CRC-32 of bytes 0 to n - 1
+// ***
+// *** Channel values are stored as integers scaled by 10 to the
+// *** power of the channel's decimals (at most 2, the precision of
+// *** the telemetry packet). Each record is:
+// ***
+// ***   varint  change in the time (ms) between records, zigzag
+// ***           encoded, so readings taken at a steady interval
+// ***           take one byte
+// ***   uint8   what follows (TELEMETRY_BATCH_HAS_* bits)
+// ***   uint8   flags
+// ***   uint8   channels without a value (bitmap)
+// ***   uint8   channels whose quality changed (bitmap), then the
+// ***           new quality of each
+// ***   uint8   channels whose interval changed (bitmap), then the
+// ***           new interval (varint) of each
+// ***   uint8   channels whose value changed (bitmap), then the
+// ***           change (zigzag varint) of each
+// ***
+// *** Anything not present is the same as in the record before;
+// *** the first record is compared with a record of zeros. A
+// *** compressed batch holds the uint16 length of the records
+// *** followed by the compressed records in place of the records.
+// ***
+#define TELEMETRY_BATCH_HAS_FLAGS    0x01
+#define TELEMETRY_BATCH_HAS_MISSING  0x02
+#define TELEMETRY_BATCH_HAS_QUALITY  0x04
+#define TELEMETRY_BATCH_HAS_INTERVAL 0x08
+#define TELEMETRY_BATCH_HAS_VALUE    0x10
+
+#define TELEMETRY_BATCH_HEADER_SIZE  (18 + TELEMETRY_CHANNELS)
+#define TELEMETRY_BATCH_RECORD_SIZE  (10 + 3 + (1 + TELEMETRY_CHANNELS) + (1 + (3 * TELEMETRY_CHANNELS)) + (1 + (5 * TELEMETRY_CHANNELS)))
+
+// ***
+// *** The largest batch; it must fit in a single datagram on an
+// *** Ethernet network without fragmenting.
+// ***
+#define TELEMETRY_BATCH_MAX_SIZE     1400
+
+// ***
+// *** The compressor looks for repeats this far back (bytes).
+// ***
+#define TELEMETRY_BATCH_WINDOW       256
+
+// ***
+// *** The state of a batch being written. The buffer belongs to
+// *** the caller; nothing is allocated.
+// ***
+typedef struct telemetryBatch
+{
+  uint8_t* buffer;
+  size_t size;
+  size_t length;
+  uint16_t count;
+  uint32_t deviceId;
+  uint32_t session;
+  uint32_t sequence;
+  uint8_t decimals[TELEMETRY_CHANNELS];
+
+  // ***
+  // *** The record before (values are scaled).
+  // ***
+  uint64_t timestamp;
+  int64_t step;
+  uint8_t flags;
+  uint8_t missing;
+  int32_t value[TELEMETRY_CHANNELS];
+  uint8_t quality[TELEMETRY_CHANNELS];
+  uint16_t interval[TELEMETRY_CHANNELS];
+} TelemetryBatch;
+
+// ***
+// *** The state of a batch being read.
+// ***
+typedef struct telemetryBatchReader
+{
+  const uint8_t* buffer;
+  size_t length;
+  size_t position;
+  uint16_t count;
+  uint16_t index;
+  uint32_t deviceId;
+  uint32_t session;
+  uint32_t sequence;
+  uint8_t decimals[TELEMETRY_CHANNELS];
+
+  uint64_t timestamp;
+  int64_t step;
+  uint8_t flags;
+  uint8_t missing;
+  int32_t value[TELEMETRY_CHANNELS];
+  uint8_t quality[TELEMETRY_CHANNELS];
+  uint16_t interval[TELEMETRY_CHANNELS];
+} TelemetryBatchReader;
+
+void telemetryBatchBegin(TelemetryBatch* batch, uint8_t* buffer, size_t size, const uint8_t* decimals);
+bool telemetryBatchAdd(TelemetryBatch* batch, const TelemetryRecord* record);
+size_t telemetryBatchFinish(TelemetryBatch* batch);
+size_t telemetryBatchCompress(const uint8_t* batch, size_t length, uint8_t* buffer, size_t size);
+size_t telemetryBatchExpand(const uint8_t* batch, size_t length, uint8_t* buffer, size_t size);
+bool telemetryBatchIsBatch(const uint8_t* buffer, size_t length);
+enum telemetryResult telemetryBatchOpen(TelemetryBatchReader* reader, const uint8_t* buffer, size_t length);
+bool telemetryBatchNext(TelemetryBatchReader* reader, TelemetryRecord* record);
+
+#endif
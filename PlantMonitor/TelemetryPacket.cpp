@@ -0,0 +1,134 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "TelemetryPacket.h"
+#include "ByteOrder.h"
+#include <math.h>
+
+// ***
+// *** Writes the record into the buffer and returns the number
+// *** of bytes written or 0 if the buffer is too small.
+// ***
+size_t telemetryEncode(const TelemetryRecord* record, uint8_t* buffer, size_t size)
+{
+  size_t returnValue = 0;
+
+  if (size >= TELEMETRY_PACKET_SIZE)
+  {
+    put16(buffer, TELEMETRY_MAGIC);
+    buffer[2] = TELEMETRY_VERSION;
+    buffer[3] = record->flags;
+    put32(buffer + 4, record->deviceId);
+    put32(buffer + 8, record->session);
+    put32(buffer + 12, record->sequence);
+    put64(buffer + 16, record->timestamp);
+
+    for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+    {
+      put32(buffer + 24 + (i * 4), (uint32_t)record->value[i]);
+      buffer[56 + i] = record->quality[i];
+      put16(buffer + 64 + (i * 2), record->interval[i]);
+    }
+
+    put32(buffer + 80, telemetryCrc32(buffer, 80));
+    returnValue = TELEMETRY_PACKET_SIZE;
+  }
+
+  return returnValue;
+}
+
+enum telemetryResult telemetryDecode(const uint8_t* buffer, size_t length, TelemetryRecord* record)
+{
+  enum telemetryResult returnValue = TELEMETRY_OK;
+
+  if (length < 4)
+  {
+    returnValue = TELEMETRY_TOO_SHORT;
+  }
+  else if (get16(buffer) != TELEMETRY_MAGIC)
+  {
+    returnValue = TELEMETRY_BAD_MAGIC;
+  }
+  else if (buffer[2] != TELEMETRY_VERSION)
+  {
+    returnValue = TELEMETRY_BAD_VERSION;
+  }
+  else if (length < TELEMETRY_PACKET_SIZE)
+  {
+    returnValue = TELEMETRY_TOO_SHORT;
+  }
+  else if (get32(buffer + 80) != telemetryCrc32(buffer, 80))
+  {
+    returnValue = TELEMETRY_BAD_CRC;
+  }
+  else
+  {
+    record->flags = buffer[3];
+    record->deviceId = get32(buffer + 4);
+    record->session = get32(buffer + 8);
+    record->sequence = get32(buffer + 12);
+    record->timestamp = get64(buffer + 16);
+
+    for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+    {
+      record->value[i] = (int32_t)get32(buffer + 24 + (i * 4));
+      record->quality[i] = buffer[56 + i];
+      record->interval[i] = get16(buffer + 64 + (i * 2));
+    }
+  }
+
+  return returnValue;
+}
+
+int32_t telemetryScale(float value)
+{
+  int32_t returnValue = TELEMETRY_NO_VALUE;
+
+  if (!isnan(value) && fabs(value) < (INT32_MAX / TELEMETRY_SCALE))
+  {
+    returnValue = (int32_t)lroundf(value * TELEMETRY_SCALE);
+  }
+
+  return returnValue;
+}
+
+float telemetryUnscale(int32_t value)
+{
+  return (value == TELEMETRY_NO_VALUE) ? NAN : (float)value / TELEMETRY_SCALE;
+}
+
+// ***
+// *** Standard CRC-32 (IEEE 802.3, reflected, polynomial 0xEDB88320)
+// *** computed a nibble at a time to keep the table small.
+// ***
+uint32_t telemetryCrc32(const uint8_t* buffer, size_t length)
+{
+  static const uint32_t table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+  };
+
+  uint32_t crc = 0xFFFFFFFF;
+
+  for (size_t i = 0; i < length; i++)
+  {
+    crc = table[(crc ^ buffer[i]) & 0x0F] ^ (crc >> 4);
+    crc = table[(crc ^ (buffer[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+
+  return ~crc;
+}
@@ -0,0 +1,103 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef TELEMETRY_PACKET_H
+#define TELEMETRY_PACKET_H
+
+// ***
+// *** This file does not depend on the Arduino core so that it
+// *** can be shared with the Linux collector (see Tools/Collector).
+// ***
+#include <stdint.h>
+#include <stddef.h>
+
+// ***
+// *** Packet identification. The version must be incremented
+// *** whenever the layout below changes.
+// ***
+#define TELEMETRY_MAGIC           0x4D50    // "PM" (little endian)
+#define TELEMETRY_VERSION         2
+
+// ***
+// *** Number of channels carried in each packet. This must
+// *** match CHANNEL_COUNT in CloudData.h.
+// ***
+#define TELEMETRY_CHANNELS        8
+
+// ***
+// *** Flags.
+// ***
+#define TELEMETRY_FLAG_EPOCH      0x01      // The timestamp is epoch time (ms), otherwise it is the tick since boot.
+#define TELEMETRY_FLAG_FAHRENHEIT 0x02      // Temperatures are in Fahrenheit, otherwise Celsius.
+#define TELEMETRY_FLAG_SOIL_DRY   0x04      // The soil moisture sensor reports dry soil.
+
+// ***
+// *** Channel values are sent as signed integers scaled by this
+// *** factor (two decimal places). A value that was not usable
+// *** is sent as TELEMETRY_NO_VALUE.
+// ***
+#define TELEMETRY_SCALE           100
+#define TELEMETRY_NO_VALUE        INT32_MIN
+
+// ***
+// *** Packet layout (all fields little endian):
+// ***
+// ***  0  uint16  magic
+// ***  2  uint8   version
+// ***  3  uint8   flags
+// ***  4  uint32  device id (chip id)
+// ***  8  uint32  session (random, changes on every boot)
+// *** 12  uint32  sequence (starts at 0 each session)
+// *** 16  uint64  timestamp (ms)
+// *** 24  int32   value[TELEMETRY_CHANNELS]
+// *** 56  uint8   quality[TELEMETRY_CHANNELS]
+// *** 64  uint16  interval[TELEMETRY_CHANNELS] (seconds between reads)
+// *** 80  uint32  CRC-32 of bytes 0 to 79
+// ***
+#define TELEMETRY_PACKET_SIZE     84
+
+typedef struct telemetryRecord
+{
+  uint8_t flags;
+  uint32_t deviceId;
+  uint32_t session;
+  uint32_t sequence;
+  uint64_t timestamp;
+  int32_t value[TELEMETRY_CHANNELS];
+  uint8_t quality[TELEMETRY_CHANNELS];
+  uint16_t interval[TELEMETRY_CHANNELS];
+} TelemetryRecord;
+
+// ***
+// *** Result of decoding a packet.
+// ***
+enum telemetryResult {
+  TELEMETRY_OK,
+  TELEMETRY_TOO_SHORT,
+  TELEMETRY_BAD_MAGIC,
+  TELEMETRY_BAD_VERSION,
+  TELEMETRY_BAD_CRC,
+  TELEMETRY_COMPRESSED
+};
+
+size_t telemetryEncode(const TelemetryRecord* record, uint8_t* buffer, size_t size);
+enum telemetryResult telemetryDecode(const uint8_t* buffer, size_t length, TelemetryRecord* record);
+int32_t telemetryScale(float value);
+float telemetryUnscale(int32_t value);
+uint32_t telemetryCrc32(const uint8_t* buffer, size_t length);
+
+#endif
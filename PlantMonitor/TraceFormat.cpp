@@ -0,0 +1,263 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "TraceFormat.h"
+#include <math.h>
+#include <string.h>
+
+// ***
+// *** Little endian helpers.
+// ***
+static uint8_t* put16(uint8_t* p, uint16_t v)
+{
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  return p + 2;
+}
+
+static uint8_t* put32(uint8_t* p, uint32_t v)
+{
+  put16(p, v & 0xFFFF);
+  return put16(p + 2, v >> 16);
+}
+
+static uint8_t* putFloat(uint8_t* p, float v)
+{
+  uint32_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return put32(p, bits);
+}
+
+static uint16_t get16(const uint8_t* p)
+{
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+  return (uint32_t)get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static float getFloat(const uint8_t* p)
+{
+  float returnValue;
+  uint32_t bits = get32(p);
+  memcpy(&returnValue, &bits, sizeof(returnValue));
+  return returnValue;
+}
+
+// ***
+// *** Returns the payload length of a record type or -1
+// *** if the type is unknown.
+// ***
+static int payloadLength(uint8_t type)
+{
+  switch (type)
+  {
+    case TRACE_HEADER: return 14;
+    case TRACE_SAMPLE: return 14;
+    case TRACE_CHECK: return 2;
+    case TRACE_EPOCH: return 4;
+    default: return -1;
+  }
+}
+
+// ***
+// *** Writes the record into the buffer and returns the number
+// *** of bytes written or 0 if the buffer is too small.
+// ***
+size_t traceEncode(const TraceRecord* record, uint64_t previousTick, uint8_t* buffer, size_t size)
+{
+  size_t returnValue = 0;
+
+  if (size >= TRACE_RECORD_SIZE && payloadLength(record->type) >= 0)
+  {
+    uint8_t* p = buffer;
+    *p++ = record->type;
+
+    // ***
+    // *** Tick delta as a varint (7 bits per byte, low bits first).
+    // ***
+    uint64_t delta = (record->type == TRACE_HEADER || record->tick < previousTick) ? record->tick : record->tick - previousTick;
+
+    do
+    {
+      *p = delta & 0x7F;
+      delta >>= 7;
+
+      if (delta)
+      {
+        *p |= 0x80;
+      }
+
+      p++;
+    } while (delta);
+
+    switch (record->type)
+    {
+      case TRACE_HEADER:
+        p = put32(p, TRACE_MAGIC);
+        *p++ = TRACE_VERSION;
+        *p++ = record->units;
+        p = putFloat(p, record->dryReading);
+        p = putFloat(p, record->wetReading);
+        break;
+      case TRACE_SAMPLE:
+        p = put16(p, record->levelCode);
+        p = put16(p, record->qualityCode);
+        p = put16(p, (uint16_t)record->soilTemperature);
+        p = put16(p, (uint16_t)record->airTemperature);
+        p = put16(p, record->humidity);
+        p = put32(p, record->luminosity);
+        break;
+      case TRACE_CHECK:
+        p = put16(p, record->qualityCode);
+        break;
+      case TRACE_EPOCH:
+        p = put32(p, record->epoch);
+        break;
+    }
+
+    returnValue = p - buffer;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Reads one record from the buffer. The number of bytes
+// *** consumed is returned in used when the result is TRACE_OK.
+// ***
+enum traceResult traceDecode(const uint8_t* buffer, size_t length, uint64_t previousTick, TraceRecord* record, size_t* used)
+{
+  enum traceResult returnValue = TRACE_OK;
+  size_t i = 0;
+  uint64_t delta = 0;
+  uint8_t shift = 0;
+  int payload = length ? payloadLength(buffer[0]) : 0;
+
+  memset(record, 0, sizeof(TraceRecord));
+
+  if (length == 0)
+  {
+    returnValue = TRACE_TRUNCATED;
+  }
+  else if (payload < 0)
+  {
+    returnValue = TRACE_BAD_TYPE;
+  }
+  else
+  {
+    record->type = buffer[i++];
+
+    // ***
+    // *** Tick delta.
+    // ***
+    while (i < length && shift < 64)
+    {
+      uint8_t b = buffer[i++];
+      delta |= (uint64_t)(b & 0x7F) << shift;
+      shift += 7;
+
+      if ((b & 0x80) == 0)
+      {
+        shift = 0xFF;
+      }
+    }
+
+    if (shift != 0xFF || (length - i) < (size_t)payload)
+    {
+      returnValue = TRACE_TRUNCATED;
+    }
+    else
+    {
+      const uint8_t* p = buffer + i;
+      record->tick = record->type == TRACE_HEADER ? delta : previousTick + delta;
+
+      switch (record->type)
+      {
+        case TRACE_HEADER:
+          if (get32(p) != TRACE_MAGIC)
+          {
+            returnValue = TRACE_BAD_MAGIC;
+          }
+          else if (p[4] != TRACE_VERSION)
+          {
+            returnValue = TRACE_BAD_VERSION;
+          }
+          else
+          {
+            record->units = p[5];
+            record->dryReading = getFloat(p + 6);
+            record->wetReading = getFloat(p + 10);
+          }
+          break;
+        case TRACE_SAMPLE:
+          record->levelCode = get16(p);
+          record->qualityCode = get16(p + 2);
+          record->soilTemperature = (int16_t)get16(p + 4);
+          record->airTemperature = (int16_t)get16(p + 6);
+          record->humidity = get16(p + 8);
+          record->luminosity = get32(p + 10);
+          break;
+        case TRACE_CHECK:
+          record->qualityCode = get16(p);
+          break;
+        case TRACE_EPOCH:
+          record->epoch = get32(p);
+          break;
+      }
+
+      *used = i + payload;
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Conversions to and from the stored units.
+// ***
+int16_t traceFromSoilTemperature(float celsius)
+{
+  return isnan(celsius) ? TRACE_NO_VALUE : (int16_t)lroundf(celsius * 128.0);
+}
+
+float traceToSoilTemperature(int16_t value)
+{
+  return value == TRACE_NO_VALUE ? NAN : value * 0.0078125;
+}
+
+int16_t traceFromAirTemperature(float celsius)
+{
+  return isnan(celsius) ? TRACE_NO_VALUE : (int16_t)lroundf(celsius * 10.0);
+}
+
+float traceToAirTemperature(int16_t value)
+{
+  return value == TRACE_NO_VALUE ? NAN : value * 0.1;
+}
+
+uint16_t traceFromHumidity(float humidity)
+{
+  return isnan(humidity) ? TRACE_NO_HUMIDITY : (uint16_t)lroundf(humidity * 10.0);
+}
+
+float traceToHumidity(uint16_t value)
+{
+  return value == TRACE_NO_HUMIDITY ? NAN : value * 0.1;
+}
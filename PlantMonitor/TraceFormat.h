@@ -0,0 +1,124 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+// ***
+// *** This file does not depend on the Arduino core so that it
+// *** can be shared with the Linux replay tool (see Tools/Replay).
+// ***
+#include <stdint.h>
+#include <stddef.h>
+
+// ***
+// *** A trace is a sequence of records holding the raw sensor
+// *** values read by the firmware. Each record is:
+// ***
+// ***   uint8   type
+// ***   varint  tick (ms) since the previous record; for a header
+// ***           this is the tick since boot
+// ***   ...     payload (little endian, see below)
+// ***
+// *** A header is written each time recording starts (normally
+// *** at boot) so a trace can hold several sessions.
+// ***
+#define TRACE_MAGIC               0x52544D50    // "PMTR" (little endian)
+#define TRACE_VERSION             1
+
+// ***
+// *** Prefix of each line of a trace written as hex text (to
+// *** the serial port) so that it can be picked out of a log.
+// ***
+#define TRACE_TEXT_PREFIX         "#T "
+
+// ***
+// *** Record types and their payloads.
+// ***
+enum traceRecordType {
+  TRACE_HEADER = 0x01,  // uint32 magic, uint8 version, uint8 units, float dry (V), float wet (V)
+  TRACE_SAMPLE = 0x10,  // uint16 level code, uint16 quality code, int16 soil temperature,
+                        // int16 air temperature, uint16 humidity, uint32 luminosity
+  TRACE_CHECK = 0x11,   // uint16 quality code read by the watering decision
+  TRACE_EPOCH = 0x12    // uint32 epoch time (s) at this tick
+};
+
+// ***
+// *** The largest encoded record.
+// ***
+#define TRACE_RECORD_SIZE         32
+
+// ***
+// *** Soil temperature is stored in the DS18B20's native 1/128 °C
+// *** and the DHT22 readings in its native 0.1 units so that the
+// *** values replay exactly. A value that was not a number is
+// *** stored as TRACE_NO_VALUE (TRACE_NO_HUMIDITY for humidity).
+// *** A check that did not read the sensor stores TRACE_NO_CODE.
+// ***
+#define TRACE_NO_VALUE            INT16_MIN
+#define TRACE_NO_HUMIDITY         0xFFFF
+#define TRACE_NO_CODE             0xFFFF
+
+typedef struct traceRecord
+{
+  uint8_t type;
+  uint64_t tick;
+
+  // ***
+  // *** TRACE_HEADER
+  // ***
+  uint8_t units;
+  float dryReading;
+  float wetReading;
+
+  // ***
+  // *** TRACE_SAMPLE and TRACE_CHECK
+  // ***
+  uint16_t levelCode;
+  uint16_t qualityCode;
+  int16_t soilTemperature;
+  int16_t airTemperature;
+  uint16_t humidity;
+  uint32_t luminosity;
+
+  // ***
+  // *** TRACE_EPOCH
+  // ***
+  uint32_t epoch;
+} TraceRecord;
+
+// ***
+// *** Result of decoding a record.
+// ***
+enum traceResult {
+  TRACE_OK,
+  TRACE_TRUNCATED,
+  TRACE_BAD_TYPE,
+  TRACE_BAD_MAGIC,
+  TRACE_BAD_VERSION
+};
+
+size_t traceEncode(const TraceRecord* record, uint64_t previousTick, uint8_t* buffer, size_t size);
+enum traceResult traceDecode(const uint8_t* buffer, size_t length, uint64_t previousTick, TraceRecord* record, size_t* used);
+int16_t traceFromSoilTemperature(float celsius);
+float traceToSoilTemperature(int16_t value);
+int16_t traceFromAirTemperature(float celsius);
+float traceToAirTemperature(int16_t value);
+uint16_t traceFromHumidity(float humidity);
+float traceToHumidity(uint16_t value);
+
+#endif
@@ -0,0 +1,169 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "TraceRecorder.h"
+
+void TraceRecorder::begin(Print* output, bool isText, uint32_t limit)
+{
+  this->_output = output;
+  this->_isText = isText;
+  this->_limit = limit;
+  this->_length = 0;
+  this->_bytesWritten = 0;
+  this->_recordCount = 0;
+}
+
+void TraceRecorder::end()
+{
+  this->flush();
+  this->_output = nullptr;
+}
+
+void TraceRecorder::writeHeader(uint64_t tick, enum temperatureUnit unit, float dryReading, float wetReading)
+{
+  TraceRecord record = {};
+  record.type = TRACE_HEADER;
+  record.tick = tick;
+  record.units = unit;
+  record.dryReading = dryReading;
+  record.wetReading = wetReading;
+  this->record(record);
+}
+
+void TraceRecorder::recordSample(uint64_t tick, SoilMonitor& soilMonitor, EnvironmentalMonitor& envMonitor, SpectrumMonitor& spectrumMonitor)
+{
+  // ***
+  // *** Uses the values of the last reads; nothing is read here.
+  // ***
+  TempAndHumidity reading = envMonitor.getLastReading();
+
+  TraceRecord record = {};
+  record.type = TRACE_SAMPLE;
+  record.tick = tick;
+  record.levelCode = soilMonitor.getLastLevelCode();
+  record.qualityCode = soilMonitor.getLastQualityCode();
+  record.soilTemperature = traceFromSoilTemperature(soilMonitor.getLastTemperature());
+  record.airTemperature = traceFromAirTemperature(reading.temperature);
+  record.humidity = traceFromHumidity(reading.humidity);
+  record.luminosity = spectrumMonitor.getLuminosity(false);
+  this->record(record);
+}
+
+void TraceRecorder::recordCheck(uint64_t tick, uint16_t qualityCode)
+{
+  TraceRecord record = {};
+  record.type = TRACE_CHECK;
+  record.tick = tick;
+  record.qualityCode = qualityCode;
+  this->record(record);
+}
+
+void TraceRecorder::recordEpoch(uint64_t tick, time_t epoch)
+{
+  TraceRecord record = {};
+  record.type = TRACE_EPOCH;
+  record.tick = tick;
+  record.epoch = (uint32_t)epoch;
+  this->record(record);
+}
+
+void TraceRecorder::record(const TraceRecord& record)
+{
+  if (this->isRecording())
+  {
+    if (this->_length + TRACE_RECORD_SIZE > TRACE_BUFFER_SIZE)
+    {
+      this->flush();
+    }
+
+    size_t length = traceEncode(&record, this->_previousTick, this->_buffer + this->_length, TRACE_BUFFER_SIZE - this->_length);
+
+    if (this->_bytesWritten + this->_length + length <= this->_limit)
+    {
+      this->_length += length;
+      this->_previousTick = record.tick;
+      this->_recordCount++;
+    }
+
+    // ***
+    // *** Each record is sent as its own line on the serial
+    // *** port so that the trace keeps up with the log.
+    // ***
+    if (this->_isText)
+    {
+      this->flush();
+    }
+  }
+}
+
+void TraceRecorder::flush()
+{
+  if (this->_output && this->_length)
+  {
+    if (this->_isText)
+    {
+      TraceRecorder::writeText(this->_output, this->_buffer, this->_length);
+    }
+    else
+    {
+      this->_output->write(this->_buffer, this->_length);
+      this->_output->flush();
+    }
+
+    this->_bytesWritten += this->_length;
+    this->_length = 0;
+  }
+}
+
+bool TraceRecorder::isRecording()
+{
+  return this->_output && this->_bytesWritten < this->_limit;
+}
+
+uint32_t TraceRecorder::getBytesWritten()
+{
+  return this->_bytesWritten + this->_length;
+}
+
+uint32_t TraceRecorder::getRecordCount()
+{
+  return this->_recordCount;
+}
+
+// ***
+// *** Writes bytes of a trace as a line of hex. Also used
+// *** to dump a trace file to the serial port.
+// ***
+void TraceRecorder::writeText(Print* output, const uint8_t* buffer, size_t length)
+{
+  static const char digits[] = "0123456789abcdef";
+  char line[4 + (TRACE_BUFFER_SIZE * 2) + 3];
+  size_t i = 0;
+
+  strcpy(line, TRACE_TEXT_PREFIX);
+  i = strlen(line);
+
+  for (size_t j = 0; j < length && j < TRACE_BUFFER_SIZE; j++)
+  {
+    line[i++] = digits[buffer[j] >> 4];
+    line[i++] = digits[buffer[j] & 0x0F];
+  }
+
+  line[i++] = '\r';
+  line[i++] = '\n';
+  output->write((const uint8_t*)line, i);
+}
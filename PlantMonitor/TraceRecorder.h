@@ -0,0 +1,73 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <Arduino.h>
+#include "TraceFormat.h"
+#include "SoilMonitor.h"
+#include "EnvironmentalMonitor.h"
+#include "SpectrumMonitor.h"
+
+// ***
+// *** Records are collected in this buffer and written to
+// *** the output when it is full or flush() is called.
+// ***
+#define TRACE_BUFFER_SIZE   128
+
+// ***
+// *** Records the raw sensor readings (see TraceFormat.h) so
+// *** that they can be replayed on Linux (see Tools/Replay).
+// ***
+class TraceRecorder
+{
+  public:
+    void begin(Print*, bool, uint32_t);
+    void end();
+    void writeHeader(uint64_t, enum temperatureUnit, float, float);
+    void recordSample(uint64_t, SoilMonitor&, EnvironmentalMonitor&, SpectrumMonitor&);
+    void recordCheck(uint64_t, uint16_t);
+    void recordEpoch(uint64_t, time_t);
+    void record(const TraceRecord&);
+    void flush();
+    bool isRecording();
+    uint32_t getBytesWritten();
+    uint32_t getRecordCount();
+
+    static void writeText(Print*, const uint8_t*, size_t);
+
+  private:
+    // ***
+    // *** Where the trace is written and whether as binary
+    // *** (to a file) or as hex lines (to the serial port).
+    // ***
+    Print* _output = nullptr;
+    bool _isText = false;
+
+    // ***
+    // *** Recording stops once this many bytes have been written.
+    // ***
+    uint32_t _limit = 0;
+
+    uint8_t _buffer[TRACE_BUFFER_SIZE];
+    size_t _length = 0;
+    uint64_t _previousTick = 0;
+    uint32_t _bytesWritten = 0;
+    uint32_t _recordCount = 0;
+};
+#endif
@@ -0,0 +1,341 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "Watchdog.h"
+#include <user_interface.h>
+
+static_assert(STAGE_COUNT <= 256, "The stage is kept in a byte.");
+
+Watchdog::Watchdog(RtcMemory& rtcMemory) : _rtcMemory(rtcMemory)
+{
+}
+
+// ***
+// *** Keeps the breadcrumbs of the previous boot, starts a new
+// *** ring and starts the stage check timer. Called right after
+// *** the RTC memory has been loaded.
+// ***
+void Watchdog::begin()
+{
+  RtcWatchdog& section = this->_rtcMemory.getState().watchdog;
+  this->_resetReason = ESP.getResetInfoPtr()->reason;
+
+  if (section.magic == RTC_WATCHDOG_MAGIC && section.head < RTC_BREADCRUMB_COUNT && section.count <= RTC_BREADCRUMB_COUNT && section.stalledStage < STAGE_COUNT)
+  {
+    memcpy(&this->_previous, &section, sizeof(RtcWatchdog));
+  }
+  else
+  {
+    memset(&this->_previous, 0, sizeof(RtcWatchdog));
+  }
+
+  memset(&section, 0, sizeof(RtcWatchdog));
+  section.magic = RTC_WATCHDOG_MAGIC;
+  this->_rtcMemory.write(&section, sizeof(RtcWatchdog));
+
+  this->_iterationStart = millis();
+
+  os_timer_setfn(&this->_timer, Watchdog::timerCallback, this);
+  os_timer_arm(&this->_timer, WATCHDOG_CHECK_INTERVAL, true);
+}
+
+// ***
+// *** Called as each stage starts. Only the new breadcrumb and
+// *** the ring position are written to RTC memory.
+// ***
+void Watchdog::enter(enum watchdogStage stage)
+{
+  RtcWatchdog& section = this->_rtcMemory.getState().watchdog;
+  uint32_t now = millis();
+
+  if (this->checkBudget(now))
+  {
+    this->_rtcMemory.write(&this->getCurrentBreadcrumb(), sizeof(RtcBreadcrumb));
+  }
+
+  this->_stage = stage;
+  this->_stageStart = now;
+
+  RtcBreadcrumb& breadcrumb = section.breadcrumbs[section.head];
+  breadcrumb.enteredAt = now;
+  breadcrumb.freeHeap = (uint16_t)min(ESP.getFreeHeap(), (uint32_t)0xFFFF);
+  breadcrumb.stage = stage;
+  breadcrumb.flags = 0;
+
+  section.head = (section.head + 1) % RTC_BREADCRUMB_COUNT;
+
+  if (section.count < RTC_BREADCRUMB_COUNT)
+  {
+    section.count++;
+  }
+
+  // ***
+  // *** The head, count, stalled stage and reserved
+  // *** bytes share one block.
+  // ***
+  this->_rtcMemory.write(&breadcrumb, sizeof(RtcBreadcrumb));
+  this->_rtcMemory.write(&section.head, 4);
+}
+
+// ***
+// *** Called at the end of each loop iteration. The iteration
+// *** has made progress so the hardware watchdog is fed.
+// ***
+void Watchdog::progress()
+{
+  uint32_t now = millis();
+
+  if (this->checkBudget(now))
+  {
+    this->_rtcMemory.write(&this->getCurrentBreadcrumb(), sizeof(RtcBreadcrumb));
+  }
+
+  if (this->_isIterationOverrun)
+  {
+    this->_slowIterations++;
+  }
+
+  this->_longestIteration = max(this->_longestIteration, now - this->_iterationStart);
+  this->_iterationStart = now;
+  this->_isIterationOverrun = false;
+  this->_stage = STAGE_NONE;
+  this->_stageStart = now;
+
+  ESP.wdtFeed();
+}
+
+// ***
+// *** Called by the timer. Flags a stage that is over its budget
+// *** and restarts the device when the stage is hung.
+// ***
+void Watchdog::check()
+{
+  RtcWatchdog& section = this->_rtcMemory.getState().watchdog;
+  uint32_t now = millis();
+  uint32_t budget = getStageBudget(this->_stage);
+
+  section.checkedAt = now;
+  this->checkBudget(now);
+
+  if (budget > 0 && (now - this->_stageStart) > (budget * WATCHDOG_STALL_FACTOR))
+  {
+    section.stalledStage = this->_stage;
+  }
+
+  this->_rtcMemory.write(&section, sizeof(RtcWatchdog));
+
+  if (section.stalledStage != STAGE_NONE)
+  {
+    system_restart();
+  }
+}
+
+enum watchdogStage Watchdog::getStage()
+{
+  return this->_stage;
+}
+
+uint32_t Watchdog::getResetReason()
+{
+  return this->_resetReason;
+}
+
+// ***
+// *** True when the last reset was a crash, a hardware or
+// *** software watchdog reset or a restart by this watchdog.
+// ***
+bool Watchdog::isAbnormalReset()
+{
+  return this->_resetReason == REASON_WDT_RST ||
+         this->_resetReason == REASON_EXCEPTION_RST ||
+         this->_resetReason == REASON_SOFT_WDT_RST ||
+         this->_previous.stalledStage != STAGE_NONE;
+}
+
+// ***
+// *** The breadcrumbs left by the previous boot, newest (index 0)
+// *** first, and how long (ms) each stage ran. For the newest
+// *** stage this is until the last check (a lower bound).
+// ***
+uint8_t Watchdog::getBreadcrumbCount()
+{
+  return this->_previous.count;
+}
+
+bool Watchdog::getBreadcrumb(uint8_t index, RtcBreadcrumb& breadcrumb, uint32_t& duration)
+{
+  bool returnValue = false;
+
+  if (index < this->_previous.count)
+  {
+    breadcrumb = this->_previous.breadcrumbs[(this->_previous.head + (RTC_BREADCRUMB_COUNT * 2) - 1 - index) % RTC_BREADCRUMB_COUNT];
+
+    if (index == 0)
+    {
+      int32_t elapsed = (int32_t)(this->_previous.checkedAt - breadcrumb.enteredAt);
+      duration = elapsed > 0 ? elapsed : 0;
+    }
+    else
+    {
+      duration = this->_previous.breadcrumbs[(this->_previous.head + (RTC_BREADCRUMB_COUNT * 2) - index) % RTC_BREADCRUMB_COUNT].enteredAt - breadcrumb.enteredAt;
+    }
+
+    returnValue = true;
+  }
+
+  return returnValue;
+}
+
+enum watchdogStage Watchdog::getStalledStage()
+{
+  return (enum watchdogStage)this->_previous.stalledStage;
+}
+
+// ***
+// *** A one line summary of the last reset for an alert, e.g.
+// *** "hw wdt reset: read 8120!, cloud 12, clock 0". Stages that
+// *** ran over their budget are marked with '!'. As many stages
+// *** as fit in the buffer are added, newest first.
+// ***
+size_t Watchdog::formatReport(char* buffer, size_t size)
+{
+  char name[12];
+  char item[24];
+  size_t length = 0;
+  bool isFull = false;
+  RtcBreadcrumb breadcrumb;
+  uint32_t duration = 0;
+
+  if (this->_previous.stalledStage != STAGE_NONE)
+  {
+    length = snprintf_P(buffer, size, PSTR("stalled in %s:"), getChannelText(name, sizeof(name), getStageName(this->getStalledStage())));
+  }
+  else
+  {
+    length = snprintf_P(buffer, size, PSTR("%s reset:"), getChannelText(name, sizeof(name), getResetReasonName(this->_resetReason)));
+  }
+
+  for (uint8_t i = 0; i < this->_previous.count && !isFull; i++)
+  {
+    this->getBreadcrumb(i, breadcrumb, duration);
+
+    size_t itemLength = snprintf_P(item, sizeof(item), PSTR("%s %s %lu%s"), i == 0 ? "" : ",",
+                                   getChannelText(name, sizeof(name), getStageName((enum watchdogStage)breadcrumb.stage)),
+                                   (unsigned long)duration, (breadcrumb.flags & BREADCRUMB_OVERRUN) ? "!" : "");
+
+    if ((length + itemLength) < size)
+    {
+      strcpy(buffer + length, item);
+      length += itemLength;
+    }
+    else
+    {
+      isFull = true;
+    }
+  }
+
+  return min(length, size - 1);
+}
+
+uint32_t Watchdog::getOverrunCount()
+{
+  return this->_overrunCount;
+}
+
+uint32_t Watchdog::getSlowIterations()
+{
+  return this->_slowIterations;
+}
+
+uint32_t Watchdog::getLongestIteration()
+{
+  return this->_longestIteration;
+}
+
+PGM_P Watchdog::getStageName(enum watchdogStage stage)
+{
+  switch (stage)
+  {
+#define WATCHDOG_NAME_CASE(id, name, budget) case id: return PSTR(name);
+    WATCHDOG_STAGES(WATCHDOG_NAME_CASE)
+    default: return PSTR("?");
+  }
+}
+
+uint32_t Watchdog::getStageBudget(enum watchdogStage stage)
+{
+  switch (stage)
+  {
+#define WATCHDOG_BUDGET_CASE(id, name, budget) case id: return budget;
+    WATCHDOG_STAGES(WATCHDOG_BUDGET_CASE)
+    default: return 0;
+  }
+}
+
+PGM_P Watchdog::getResetReasonName(uint32_t reason)
+{
+  switch (reason)
+  {
+    case REASON_DEFAULT_RST: return PSTR("power on");
+    case REASON_WDT_RST: return PSTR("hw wdt");
+    case REASON_EXCEPTION_RST: return PSTR("exception");
+    case REASON_SOFT_WDT_RST: return PSTR("sw wdt");
+    case REASON_SOFT_RESTART: return PSTR("restart");
+    case REASON_DEEP_SLEEP_AWAKE: return PSTR("wake");
+    case REASON_EXT_SYS_RST: return PSTR("external");
+    default: return PSTR("unknown");
+  }
+}
+
+// ***
+// *** Flags the running stage when it is over its budget.
+// *** Returns true when its breadcrumb was changed.
+// ***
+bool Watchdog::checkBudget(uint32_t now)
+{
+  bool returnValue = false;
+  uint32_t budget = getStageBudget(this->_stage);
+
+  if (budget > 0 && (now - this->_stageStart) > budget)
+  {
+    RtcBreadcrumb& breadcrumb = this->getCurrentBreadcrumb();
+    this->_isIterationOverrun = true;
+
+    if ((breadcrumb.flags & BREADCRUMB_OVERRUN) == 0)
+    {
+      breadcrumb.flags |= BREADCRUMB_OVERRUN;
+      this->_overrunCount++;
+      returnValue = true;
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** The breadcrumb of the running stage.
+// ***
+RtcBreadcrumb& Watchdog::getCurrentBreadcrumb()
+{
+  RtcWatchdog& section = this->_rtcMemory.getState().watchdog;
+  return section.breadcrumbs[(section.head + RTC_BREADCRUMB_COUNT - 1) % RTC_BREADCRUMB_COUNT];
+}
+
+void Watchdog::timerCallback(void* argument)
+{
+  ((Watchdog*)argument)->check();
+}
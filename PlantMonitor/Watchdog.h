@@ -0,0 +1,136 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <Arduino.h>
+#include "RtcMemory.h"
+
+// ***
+// *** The stages of setup() and loop() and how long (ms) each
+// *** one may take before it is considered to be over its
+// *** budget. A budget of 0 is not watched (e.g. the WiFi
+// *** configuration portal waits for the user).
+// ***
+// ***   X(id, name, budget)
+// ***
+#define WATCHDOG_STAGES(X) \
+  X(STAGE_NONE,          "none",    0) \
+  X(STAGE_SETUP,         "setup",   1000 * 30) \
+  X(STAGE_WIFI,          "wifi",    0) \
+  X(STAGE_CLOUD_CONNECT, "connect", 1000 * 60) \
+  X(STAGE_CLOUD,         "cloud",   1000 * 10) \
+  X(STAGE_CLOCK,         "clock",   1000) \
+  X(STAGE_STATUS,        "status",  1000) \
+  X(STAGE_READ,          "read",    1000 * 5) \
+  X(STAGE_SEND,          "send",    1000 * 30) \
+  X(STAGE_CHECK,         "check",   1000 * 60) \
+  X(STAGE_WATER,         "water",   1000) \
+  X(STAGE_UPLOAD,        "upload",  1000 * 60) \
+  X(STAGE_SERIAL,        "serial",  1000 * 5) \
+  X(STAGE_DUMP,          "dump",    0) \
+  X(STAGE_SLEEP,         "sleep",   0) \
+  X(STAGE_OTA,           "ota",     1000 * 60 * 2)
+
+#define WATCHDOG_STAGE_ENUM(id, name, budget) id,
+enum watchdogStage {
+  WATCHDOG_STAGES(WATCHDOG_STAGE_ENUM)
+  STAGE_COUNT
+};
+
+// ***
+// *** How often (ms) the running stage is checked.
+// ***
+#define WATCHDOG_CHECK_INTERVAL 1000
+
+// ***
+// *** A stage that runs for this many times its budget is
+// *** hung; the watchdog records it and restarts the device.
+// ***
+#define WATCHDOG_STALL_FACTOR   4
+
+// ***
+// *** Keeps track of the stage the firmware is in. Each stage
+// *** entered leaves a breadcrumb (stage, time and free heap) in
+// *** a ring in RTC memory, so after a crash or a watchdog reset
+// *** the last stages and how long they took are known on the
+// *** next boot. A timer checks the running stage against its
+// *** budget. The core feeds the hardware watchdog whenever the
+// *** firmware yields, so a stage that is stuck but yields (e.g.
+// *** waiting for a connection) is never reset by it; this
+// *** watchdog restarts the device instead. A stage that does
+// *** not yield is reset by the hardware watchdog and the last
+// *** breadcrumb shows where. The hardware watchdog is fed
+// *** explicitly only when the loop completes an iteration.
+// ***
+class Watchdog
+{
+  public:
+    Watchdog(RtcMemory&);
+    void begin();
+    void enter(enum watchdogStage);
+    void progress();
+    void check();
+    enum watchdogStage getStage();
+
+    uint32_t getResetReason();
+    bool isAbnormalReset();
+    uint8_t getBreadcrumbCount();
+    bool getBreadcrumb(uint8_t index, RtcBreadcrumb&, uint32_t& duration);
+    enum watchdogStage getStalledStage();
+    size_t formatReport(char*, size_t);
+
+    uint32_t getOverrunCount();
+    uint32_t getSlowIterations();
+    uint32_t getLongestIteration();
+
+    static PGM_P getStageName(enum watchdogStage);
+    static uint32_t getStageBudget(enum watchdogStage);
+    static PGM_P getResetReasonName(uint32_t);
+
+  private:
+    RtcMemory& _rtcMemory;
+    os_timer_t _timer;
+
+    // ***
+    // *** The running stage and when it was entered (ms).
+    // ***
+    enum watchdogStage _stage = STAGE_NONE;
+    uint32_t _stageStart = 0;
+
+    // ***
+    // *** The reset reason and the breadcrumbs left by the
+    // *** previous boot.
+    // ***
+    uint32_t _resetReason = REASON_DEFAULT_RST;
+    RtcWatchdog _previous;
+
+    // ***
+    // *** Loop statistics since boot.
+    // ***
+    uint32_t _iterationStart = 0;
+    bool _isIterationOverrun = false;
+    uint32_t _overrunCount = 0;
+    uint32_t _slowIterations = 0;
+    uint32_t _longestIteration = 0;
+
+    bool checkBudget(uint32_t now);
+    RtcBreadcrumb& getCurrentBreadcrumb();
+    static void timerCallback(void*);
+};
+#endif
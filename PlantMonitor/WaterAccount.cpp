@@ -0,0 +1,262 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "WaterAccount.h"
+#include "TelemetryPacket.h"
+
+static_assert(sizeof(WaterTotals) <= WATER_ACCOUNT_SIZE, "The water totals do not fit in the EEPROM area.");
+
+WaterAccount::WaterAccount(WaterPumpController& waterPumpController) : _waterPumpController(waterPumpController)
+{
+}
+
+// ***
+// *** Loads the totals from flash and applies the saved flow
+// *** calibration to the pump. Returns false if there were no
+// *** valid totals (they start again from zero).
+// ***
+bool WaterAccount::begin(float budget, float capacity, float reserve)
+{
+  this->_budget = budget;
+  this->_capacity = capacity;
+  this->_reserve = reserve;
+
+  EEPROM.begin(WATER_ACCOUNT_SIZE);
+  EEPROM.get(WATER_ACCOUNT_ADDRESS, this->_totals);
+
+  bool returnValue = this->_totals.magic == WATER_ACCOUNT_MAGIC &&
+                     this->_totals.version == WATER_ACCOUNT_VERSION &&
+                     this->_totals.size == sizeof(WaterTotals) &&
+                     this->_totals.checksum == this->computeChecksum() &&
+                     this->_totals.flowScale > 0.0;
+
+  if (!returnValue)
+  {
+    memset(&this->_totals, 0, sizeof(WaterTotals));
+    this->_totals.flowScale = 1.0;
+  }
+
+  this->_waterPumpController.setFlowScale(this->_totals.flowScale);
+  this->_bookedVolume = this->_waterPumpController.getTotalVolume();
+  this->_bookedEvents = this->_waterPumpController.getEventCount();
+
+  return returnValue;
+}
+
+// ***
+// *** Called from the loop with the current day (0 when the clock
+// *** is not set). Stops the pump when the budget or the reservoir
+// *** has run out and books the watering events that have ended,
+// *** saving the totals once per event. Returns true when the
+// *** pump was stopped.
+// ***
+bool WaterAccount::process(uint32_t day)
+{
+  bool returnValue = false;
+
+  this->rollover(day);
+
+  if (this->_waterPumpController.isOn() && this->getAllowance() <= 0.0)
+  {
+    this->_waterPumpController.off();
+    returnValue = true;
+  }
+
+  if (this->_waterPumpController.getEventCount() != this->_bookedEvents)
+  {
+    float volume = this->_waterPumpController.getTotalVolume() - this->_bookedVolume;
+
+    this->_totals.dayVolume += volume;
+    this->_totals.totalVolume += volume;
+    this->_totals.reservoirUsed += volume;
+    this->_totals.lastEventVolume = this->_waterPumpController.getLastEventVolume();
+    this->_totals.eventCount += this->_waterPumpController.getEventCount() - this->_bookedEvents;
+
+    this->_bookedVolume = this->_waterPumpController.getTotalVolume();
+    this->_bookedEvents = this->_waterPumpController.getEventCount();
+
+    this->save();
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** The volume (ml) that can still be delivered: the lesser of
+// *** what is left of today's budget and what is left in the
+// *** reservoir above the reserve, less what the pump has
+// *** delivered if it is running.
+// ***
+float WaterAccount::getAllowance()
+{
+  float returnValue = INFINITY;
+
+  if (this->_budget > 0.0)
+  {
+    returnValue = this->_budget - this->_totals.dayVolume;
+  }
+
+  if (this->_capacity > 0.0)
+  {
+    returnValue = min(returnValue, this->getReservoirLevel() - this->_reserve);
+  }
+
+  if (this->_waterPumpController.isOn())
+  {
+    returnValue -= this->_waterPumpController.getEventVolume();
+  }
+
+  return max(returnValue, 0.0f);
+}
+
+bool WaterAccount::isOverBudget()
+{
+  return this->_budget > 0.0 && (this->_budget - this->_totals.dayVolume) < WATER_MINIMUM_VOLUME;
+}
+
+bool WaterAccount::isReservoirLow()
+{
+  return this->_capacity > 0.0 && (this->getReservoirLevel() - this->_reserve) < WATER_MINIMUM_VOLUME;
+}
+
+float WaterAccount::getBudget()
+{
+  return this->_budget;
+}
+
+float WaterAccount::getDayVolume()
+{
+  return this->_totals.dayVolume;
+}
+
+float WaterAccount::getTotalVolume()
+{
+  return this->_totals.totalVolume;
+}
+
+float WaterAccount::getLastEventVolume()
+{
+  return this->_totals.lastEventVolume;
+}
+
+uint32_t WaterAccount::getEventCount()
+{
+  return this->_totals.eventCount;
+}
+
+float WaterAccount::getReservoirCapacity()
+{
+  return this->_capacity;
+}
+
+// ***
+// *** The estimated volume (ml) in the reservoir.
+// ***
+float WaterAccount::getReservoirLevel()
+{
+  return this->_capacity > 0.0 ? max(this->_capacity - this->_totals.reservoirUsed, 0.0f) : 0.0;
+}
+
+float WaterAccount::getReservoirPercent()
+{
+  return this->_capacity > 0.0 ? this->getReservoirLevel() * 100.0 / this->_capacity : 0.0;
+}
+
+// ***
+// *** Called when the reservoir has been filled.
+// ***
+void WaterAccount::refill()
+{
+  this->_totals.reservoirUsed = 0.0;
+  this->save();
+}
+
+// ***
+// *** Scales the pump's flow curve so that the last watering event
+// *** matches the volume that was measured (ml) and corrects the
+// *** totals by the difference.
+// ***
+bool WaterAccount::calibrate(float measuredVolume)
+{
+  bool returnValue = false;
+
+  if (measuredVolume > 0.0 && this->_totals.lastEventVolume > 0.0)
+  {
+    float correction = measuredVolume - this->_totals.lastEventVolume;
+
+    this->_totals.flowScale = this->_waterPumpController.getFlowScale() * measuredVolume / this->_totals.lastEventVolume;
+    this->_waterPumpController.setFlowScale(this->_totals.flowScale);
+
+    this->_totals.dayVolume = max(this->_totals.dayVolume + correction, 0.0f);
+    this->_totals.totalVolume = max(this->_totals.totalVolume + correction, 0.0f);
+    this->_totals.reservoirUsed = max(this->_totals.reservoirUsed + correction, 0.0f);
+    this->_totals.lastEventVolume = measuredVolume;
+
+    this->save();
+    returnValue = true;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** The number of times the totals were written to flash
+// *** since boot.
+// ***
+uint32_t WaterAccount::getWriteCount()
+{
+  return this->_writeCount;
+}
+
+// ***
+// *** Starts a new daily total when the day changes. This is not
+// *** saved until the next event; after a reset the saved day is
+// *** compared again.
+// ***
+void WaterAccount::rollover(uint32_t day)
+{
+  if (day != 0 && day != this->_totals.day)
+  {
+    if (this->_totals.day != 0)
+    {
+      this->_totals.dayVolume = 0.0;
+    }
+
+    this->_totals.day = day;
+  }
+}
+
+void WaterAccount::save()
+{
+  this->_totals.magic = WATER_ACCOUNT_MAGIC;
+  this->_totals.version = WATER_ACCOUNT_VERSION;
+  this->_totals.size = sizeof(WaterTotals);
+  this->_totals.checksum = this->computeChecksum();
+
+  EEPROM.put(WATER_ACCOUNT_ADDRESS, this->_totals);
+  EEPROM.commit();
+  this->_writeCount++;
+}
+
+// ***
+// *** CRC-32 of everything after the header.
+// ***
+uint32_t WaterAccount::computeChecksum()
+{
+  const uint8_t* data = (const uint8_t*)&this->_totals.day;
+  return telemetryCrc32(data, sizeof(WaterTotals) - offsetof(WaterTotals, day));
+}
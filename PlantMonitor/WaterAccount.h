@@ -0,0 +1,116 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef WATER_ACCOUNT_H
+#define WATER_ACCOUNT_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "WaterPumpController.h"
+
+// ***
+// *** The water totals are kept in the flash sector used by the
+// *** EEPROM library. The sector is rewritten on each commit so
+// *** the totals are only saved once per watering event (and
+// *** when the reservoir is refilled or the pump is calibrated),
+// *** which is a few writes a day.
+// ***
+#define WATER_ACCOUNT_ADDRESS   0
+#define WATER_ACCOUNT_SIZE      64
+#define WATER_ACCOUNT_MAGIC     0x54574D50
+#define WATER_ACCOUNT_VERSION   1
+
+// ***
+// *** Watering events shorter than this (ml) are not worth
+// *** starting.
+// ***
+#define WATER_MINIMUM_VOLUME    1.0
+
+// ***
+// *** The totals saved in flash. Days are counted from the epoch
+// *** in local time; day 0 means the clock was not set.
+// ***
+typedef struct waterTotals
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t size;
+  uint32_t checksum;
+
+  uint32_t day;
+  float dayVolume;          // ml delivered today.
+  float totalVolume;        // ml delivered since the totals were created.
+  float reservoirUsed;      // ml delivered since the reservoir was refilled.
+  float flowScale;          // See WaterPumpController::setFlowScale().
+  float lastEventVolume;    // ml
+  uint32_t eventCount;
+} WaterTotals;
+
+// ***
+// *** Keeps account of the water delivered by the pump: the
+// *** volume of each watering event, the daily total against a
+// *** daily budget and an estimate of the water left in the
+// *** reservoir (its capacity less what has been pumped since
+// *** it was last refilled; there is no level sensor). The
+// *** pump is stopped when the budget or the reservoir runs out.
+// ***
+class WaterAccount
+{
+  public:
+    WaterAccount(WaterPumpController&);
+    bool begin(float budget, float capacity, float reserve);
+    bool process(uint32_t day);
+    float getAllowance();
+    bool isOverBudget();
+    bool isReservoirLow();
+    float getBudget();
+    float getDayVolume();
+    float getTotalVolume();
+    float getLastEventVolume();
+    uint32_t getEventCount();
+    float getReservoirCapacity();
+    float getReservoirLevel();
+    float getReservoirPercent();
+    void refill();
+    bool calibrate(float measuredVolume);
+    uint32_t getWriteCount();
+
+  private:
+    WaterPumpController& _waterPumpController;
+    WaterTotals _totals;
+
+    // ***
+    // *** The daily budget, the capacity of the reservoir and the
+    // *** volume (ml) to leave in it. Zero turns off the budget
+    // *** or the reservoir estimate.
+    // ***
+    float _budget = 0.0;
+    float _capacity = 0.0;
+    float _reserve = 0.0;
+
+    // ***
+    // *** The pump's volume total that has been booked.
+    // ***
+    float _bookedVolume = 0.0;
+    uint32_t _bookedEvents = 0;
+    uint32_t _writeCount = 0;
+
+    void rollover(uint32_t day);
+    void save();
+    uint32_t computeChecksum();
+};
+#endif
@@ -56,6 +56,7 @@ void WaterPumpController::off()
   // *** Set the is on flag.
   // ***
   this->_isOn = false;
+  this->setPwm(0);
 }
 
 void WaterPumpController::on()
@@ -70,6 +71,7 @@ void WaterPumpController::on()
   // *** Set the is on flag.
   // ***
   this->_isOn = true;
+  this->setPwm(PWMRANGE);
 }
 
 // ***
@@ -93,7 +95,7 @@ void WaterPumpController::on(uint8_t speed)
     // *** Map a value from 0 to 255 to a range
     // *** the valid PWM range.
     // ***
-    uint16_t value = map(speed, 0, 255, MINIMUM_PUMP_PWM, PWMRANGE);
+    uint16_t value = toPwm(speed);
 
     // ***
     // *** Set the PWM.
@@ -104,6 +106,7 @@ void WaterPumpController::on(uint8_t speed)
     // *** Set the is on flag.
     // ***
     this->_isOn = true;
+    this->setPwm(value);
   }
 }
 
@@ -119,4 +122,126 @@ bool WaterPumpController::on(uint8_t speed, uint32_t duration)
   }
 
   this->off();
+
+  return true;
+}
+
+// ***
+// *** The PWM value used for a speed from 1 to 255.
+// ***
+uint16_t WaterPumpController::toPwm(uint8_t speed)
+{
+  return speed == 0 ? 0 : (speed == 255 ? PWMRANGE : map(speed, 0, 255, MINIMUM_PUMP_PWM, PWMRANGE));
+}
+
+// ***
+// *** The flow (ml per minute) at a PWM value, interpolated
+// *** on the flow curve. The pump does not move below
+// *** MINIMUM_PUMP_PWM.
+// ***
+float WaterPumpController::getFlowRate(uint16_t pwm)
+{
+  static const float curve[PUMP_FLOW_POINTS] = PUMP_FLOW_CURVE;
+  float returnValue = 0.0;
+
+  if (pwm >= PWMRANGE)
+  {
+    returnValue = curve[PUMP_FLOW_POINTS - 1];
+  }
+  else if (pwm >= MINIMUM_PUMP_PWM)
+  {
+    float position = (float)(pwm - MINIMUM_PUMP_PWM) * (PUMP_FLOW_POINTS - 1) / (PWMRANGE - MINIMUM_PUMP_PWM);
+    uint8_t index = (uint8_t)position;
+    returnValue = curve[index] + ((curve[index + 1] - curve[index]) * (position - index));
+  }
+
+  return returnValue * this->_flowScale;
+}
+
+// ***
+// *** Scales the flow curve (see PUMP_FLOW_CURVE).
+// ***
+void WaterPumpController::setFlowScale(float scale)
+{
+  this->accumulate();
+  this->_flowScale = scale;
+}
+
+float WaterPumpController::getFlowScale()
+{
+  return this->_flowScale;
+}
+
+uint16_t WaterPumpController::getPwm()
+{
+  return this->_pwm;
+}
+
+// ***
+// *** The volume (ml) pumped since the pump last turned on.
+// ***
+float WaterPumpController::getEventVolume()
+{
+  this->accumulate();
+  return this->_eventVolume;
+}
+
+// ***
+// *** The number of watering events that have ended since boot
+// *** and the volume (ml) and duration (ms) of the last one.
+// ***
+uint32_t WaterPumpController::getEventCount()
+{
+  return this->_eventCount;
+}
+
+float WaterPumpController::getLastEventVolume()
+{
+  return this->_lastEventVolume;
+}
+
+uint32_t WaterPumpController::getLastEventDuration()
+{
+  return this->_lastEventDuration;
+}
+
+// ***
+// *** The volume (ml) of all of the watering events that have
+// *** ended since boot.
+// ***
+float WaterPumpController::getTotalVolume()
+{
+  return this->_totalVolume;
+}
+
+void WaterPumpController::setPwm(uint16_t pwm)
+{
+  this->accumulate();
+
+  if (this->_pwm == 0 && pwm > 0)
+  {
+    this->_eventStart = this->_changedAt;
+    this->_eventVolume = 0.0;
+  }
+  else if (this->_pwm > 0 && pwm == 0)
+  {
+    this->_lastEventVolume = this->_eventVolume;
+    this->_lastEventDuration = this->_changedAt - this->_eventStart;
+    this->_totalVolume += this->_eventVolume;
+    this->_eventCount++;
+  }
+
+  this->_pwm = pwm;
+}
+
+void WaterPumpController::accumulate()
+{
+  uint32_t now = millis();
+
+  if (this->_pwm > 0)
+  {
+    this->_eventVolume += this->getFlowRate(this->_pwm) * (now - this->_changedAt) / 60000.0;
+  }
+
+  this->_changedAt = now;
 }
@@ -25,6 +25,16 @@
 // ***
 #define MINIMUM_PUMP_PWM  400
 
+// ***
+// *** The flow of the pump (ml per minute) at evenly spaced PWM
+// *** values from MINIMUM_PUMP_PWM to PWMRANGE (full speed). The
+// *** shape is typical of a small 5 V diaphragm pump; measure the
+// *** volume of a watering and use the "pump calibrate" command
+// *** to scale the curve to your pump, tubing and head height.
+// ***
+#define PUMP_FLOW_POINTS  5
+#define PUMP_FLOW_CURVE   { 120.0, 300.0, 450.0, 570.0, 660.0 }
+
 class WaterPumpController
 {
   public:
@@ -36,6 +46,17 @@ class WaterPumpController
     bool on(uint8_t, uint32_t);
     bool isOn();
 
+    static uint16_t toPwm(uint8_t);
+    float getFlowRate(uint16_t);
+    void setFlowScale(float);
+    float getFlowScale();
+    uint16_t getPwm();
+    float getEventVolume();
+    uint32_t getEventCount();
+    float getLastEventVolume();
+    uint32_t getLastEventDuration();
+    float getTotalVolume();
+
   private:
     // ***
     // *** The PWM pin on which the pump is connected.
@@ -46,5 +67,28 @@ class WaterPumpController
     // *** Flag to keep track of the pump state.
     // ***
     bool _isOn = false;
+
+    // ***
+    // *** The volume pumped is the flow at the PWM value integrated
+    // *** over time. It is added up each time the PWM value changes
+    // *** (and when it is asked for while the pump runs).
+    // ***
+    uint16_t _pwm = 0;
+    uint32_t _changedAt = 0;
+    float _flowScale = 1.0;
+
+    // ***
+    // *** A watering event lasts from the pump turning on until it
+    // *** turns off, whatever the speed changes in between.
+    // ***
+    uint32_t _eventStart = 0;
+    float _eventVolume = 0.0;
+    uint32_t _eventCount = 0;
+    float _lastEventVolume = 0.0;
+    uint32_t _lastEventDuration = 0;
+    float _totalVolume = 0.0;
+
+    void setPwm(uint16_t);
+    void accumulate();
 };
 #endif
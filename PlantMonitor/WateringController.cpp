@@ -0,0 +1,124 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include "WateringController.h"
+
+WateringController::WateringController(SoilMonitor& soilMonitor, WaterPumpController& waterPumpController) : _soilMonitor(soilMonitor), _waterPumpController(waterPumpController)
+{
+}
+
+void WateringController::begin(uint8_t runLevel, uint32_t runTime)
+{
+  this->_runLevel = runLevel;
+  this->_runTime = runTime;
+}
+
+void WateringController::setMoistureThreshold(float threshold)
+{
+  this->_moistureThreshold = threshold;
+}
+
+void WateringController::setAccount(WaterAccount* waterAccount)
+{
+  this->_waterAccount = waterAccount;
+}
+
+enum wateringDecision WateringController::decide(uint8_t moistureQuality, float moistureLevel)
+{
+  enum wateringDecision returnValue = WATERING_NOT_NEEDED;
+
+  // ***
+  // *** Do not make a watering decision from a sensor
+  // *** that is faulty or giving suspect readings.
+  // ***
+  if (moistureQuality != QUALITY_GOOD)
+  {
+    returnValue = WATERING_SKIPPED;
+  }
+  else
+  {
+    if (this->_moistureThreshold > 0.0)
+    {
+      this->_lastQuality = moistureLevel < this->_moistureThreshold ? "Dry" : "Good";
+    }
+    else
+    {
+      this->_lastQuality = this->_soilMonitor.getQuality();
+    }
+
+    if (this->_lastQuality == "Dry")
+    {
+      if (this->_waterAccount != nullptr && this->_waterAccount->isReservoirLow())
+      {
+        returnValue = WATERING_RESERVOIR_LOW;
+      }
+      else if (this->_waterAccount != nullptr && this->_waterAccount->getAllowance() < WATER_MINIMUM_VOLUME)
+      {
+        returnValue = WATERING_OVER_BUDGET;
+      }
+      else
+      {
+        returnValue = WATERING_NEEDED;
+      }
+    }
+  }
+
+  return returnValue;
+}
+
+void WateringController::water()
+{
+  uint32_t runTime = this->_runTime;
+
+  // ***
+  // *** Shorten the run so that no more than the allowance
+  // *** is delivered.
+  // ***
+  if (this->_waterAccount != nullptr)
+  {
+    float allowance = this->_waterAccount->getAllowance();
+    float flowRate = this->_waterPumpController.getFlowRate(WaterPumpController::toPwm(this->_runLevel));
+
+    if (flowRate > 0.0 && allowance < (flowRate * runTime / 60000.0))
+    {
+      runTime = (uint32_t)(allowance * 60000.0 / flowRate);
+    }
+  }
+
+  // ***
+  // *** Runs the pump; this blocks for the run time.
+  // ***
+  if (runTime > 0)
+  {
+    this->_waterPumpController.on(this->_runLevel, runTime);
+  }
+}
+
+String WateringController::getLastQuality()
+{
+  return this->_lastQuality;
+}
+
+uint8_t WateringController::getRunLevel()
+{
+  return this->_runLevel;
+}
+
+uint32_t WateringController::getRunTime()
+{
+  return this->_runTime;
+}
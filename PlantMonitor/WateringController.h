@@ -0,0 +1,86 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef WATERING_CONTROLLER_H
+#define WATERING_CONTROLLER_H
+
+#include <Arduino.h>
+#include "SoilMonitor.h"
+#include "WaterPumpController.h"
+#include "WaterAccount.h"
+#include "SensorHealth.h"
+
+// ***
+// *** The outcome of a soil check.
+// ***
+enum wateringDecision {
+  WATERING_SKIPPED,
+  WATERING_NOT_NEEDED,
+  WATERING_NEEDED,
+  WATERING_OVER_BUDGET,     // Needed but today's water budget is used up.
+  WATERING_RESERVOIR_LOW    // Needed but the reservoir is (estimated) empty.
+};
+
+// ***
+// *** Decides when the plant needs water and runs the pump. The
+// *** firmware and the replay tool (Tools/Replay) both use this
+// *** class so that a recorded trace reproduces the decisions
+// *** made on the device.
+// ***
+class WateringController
+{
+  public:
+    WateringController(SoilMonitor&, WaterPumpController&);
+    void begin(uint8_t, uint32_t);
+    void setMoistureThreshold(float);
+    void setAccount(WaterAccount*);
+    enum wateringDecision decide(uint8_t, float);
+    void water();
+    String getLastQuality();
+    uint8_t getRunLevel();
+    uint32_t getRunTime();
+
+  private:
+    SoilMonitor& _soilMonitor;
+    WaterPumpController& _waterPumpController;
+
+    // ***
+    // *** When set, watering is limited to the water allowed by
+    // *** the account (see WaterAccount.h).
+    // ***
+    WaterAccount* _waterAccount = nullptr;
+
+    // ***
+    // *** The pump speed (0 to 255) and run time (ms) used
+    // *** to water the plant.
+    // ***
+    uint8_t _runLevel = 200;
+    uint32_t _runTime = 30000;
+
+    // ***
+    // *** When greater than zero the soil is considered dry when the
+    // *** moisture level (%) is below this value. When zero the
+    // *** digital output of the sensor's comparator is used.
+    // ***
+    float _moistureThreshold = 0.0;
+
+    // ***
+    // *** The soil quality seen by the last decision.
+    // ***
+    String _lastQuality = "";
+};
+#endif
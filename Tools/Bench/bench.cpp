@@ -0,0 +1,819 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Micro-benchmarks of the firmware's sensor, conversion and control
+// paths, run on Linux against simulated devices. Each benchmark
+// reports the time (ns) and heap allocations per operation. The
+// results are written as tab separated lines and can be saved as a
+// baseline and compared with a later run; the exit code is 1 when a
+// benchmark is slower than the baseline by more than the threshold
+// or allocates more.
+//
+// Build:
+//   g++ -O2 -std=c++17 -I../Host -I../../PlantMonitor bench.cpp ../../PlantMonitor/*.cpp ../Host/HostArduino.cpp ../Host/HostWiFi.cpp -lcrypto -o bench
+//
+// Usage:
+//   bench [-f filter] [-m milliseconds] [-b baseline] [-t percent] [-o output]
+//
+//   -f  Only run the benchmarks whose name contains this text.
+//   -m  Time spent measuring each benchmark (default 200).
+//   -b  Compare with a saved result (e.g. baseline.tsv).
+//   -t  Regression threshold in percent (default 15).
+//   -o  Save the result (e.g. to update baseline.tsv).
+//
+// The timings depend on the machine; save a baseline on the machine
+// that runs the comparison. Allocation counts do not.
+//
+#include "Cloud.h"
+#include "SoilMonitor.h"
+#include "EnvironmentalMonitor.h"
+#include "SpectrumMonitor.h"
+#include "WaterPumpController.h"
+#include "WateringController.h"
+#include "SensorHealth.h"
+#include "Clock.h"
+#include "Rollup.h"
+#include "Telemetry.h"
+#include "TelemetryPacket.h"
+#include "TelemetryBatch.h"
+#include "TraceRecorder.h"
+#include "RtcMemory.h"
+#include "PowerManager.h"
+#include "OtaImage.h"
+#include "DerivedMetrics.h"
+
+// ***
+// *** Do not bind port 80 on the host.
+// ***
+#define STATUS_SERVER_PORT 0
+#include "StatusServer.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+// ***
+// *** The sketch is compiled into the benchmark so that loop()
+// *** can be run. These are the prototypes the Arduino IDE
+// *** generates; keep them in step with PlantMonitor.ino.
+// ***
+void setup();
+void loop();
+void runDutyCycle();
+void uploadSamples();
+void reportLastReset();
+void raiseAlert(uint16_t alert);
+void formatAlert(uint16_t alert, char* buffer, size_t size);
+void formatFaultAlert(enum sensorChannel channel, char* buffer, size_t size);
+void sendPendingAlerts();
+void displayBreadcrumbs();
+void restoreControllerState();
+void saveControllerState();
+void readSensorDataTimerCallback(void *pArg);
+void _sendSensorDataTimerCallback(void *pArg);
+void _checkSoilQualityTimerCallback(void *pArg);
+void _checkForUpdateTimerCallback(void *pArg);
+void processUpdates();
+void installLatestFirmware();
+void rollbackFirmware();
+void displayUpdateResult(enum otaResult result);
+void checkSoilQuality();
+void processWaterAccount();
+void sendWaterTotals();
+uint32_t getLocalDay();
+void readSensorData();
+void sendTelemetry();
+void sendTelemetryBatch(uint8_t count);
+void updateStatus();
+void sendSensorData();
+void sendRollups();
+void alignRollups();
+void getSensorData(uint8_t devices);
+void checkSensorHealth(uint8_t devices);
+void printQuality(enum sensorChannel channel);
+void printUnit(enum channelUnit unit);
+void displaySensorData();
+void handleWaterPumpMessage(AdafruitIO_Data *data);
+void processSerialCommands();
+void runSerialCommand(const char* command);
+void displayWaterTotals();
+void displayRollups(enum rollupResolution resolution);
+void startTrace();
+void dumpTrace();
+void clearTrace();
+
+#include "PlantMonitor.ino"
+
+// ***
+// *** Every heap allocation is counted.
+// ***
+static uint64_t _allocations = 0;
+
+void* operator new(size_t size)
+{
+  _allocations++;
+  void* p = malloc(size ? size : 1);
+
+  if (!p)
+  {
+    throw std::bad_alloc();
+  }
+
+  return p;
+}
+
+void* operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+  free(p);
+}
+
+// ***
+// *** Keeps the compiler from optimizing a result away.
+// ***
+template<typename T> static inline void keep(const T& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static uint64_t nanoseconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+// ***
+// *** Inputs are taken from small tables so that the work
+// *** cannot be folded into constants.
+// ***
+#define INPUTS 16
+static float _celsius[INPUTS];
+static float _fahrenheit[INPUTS];
+static uint16_t _levelCodes[INPUTS];
+static EnvironmentalMonitor* _envMonitors[INPUTS];
+static SpectrumMonitor* _spectrumMonitors[INPUTS];
+static CloudData _data[INPUTS];
+
+// ***
+// *** A run of readings taken 10 seconds apart, changing as slowly
+// *** (and in steps as coarse) as the real sensors, used to compare
+// *** the size of the upload formats.
+// ***
+#define READINGS 64
+static TelemetryRecord _readings[READINGS];
+static uint8_t _decimals[TELEMETRY_CHANNELS];
+static uint8_t _batch[TELEMETRY_BATCH_MAX_SIZE];
+static size_t _batchLength = 0;
+
+// ***
+// *** Sets the simulated devices to a plausible reading that
+// *** varies a little with i (wet soil, so the pump never runs).
+// ***
+static void simulateDevices(uint64_t i)
+{
+  float wobble = (float)((i * 7919) % 97) / 97.0;
+  Adafruit_MCP3008::hostSetCode(SOIL_ANALOG_CHANNEL, 380 + (i % 7));
+  Adafruit_MCP3008::hostSetCode(SOIL_DIGITAL_CHANNEL, 12);
+  DallasTemperature::hostSetRaw(2560 + (i % 13));
+  DHTesp::hostSetReading(22.0 + wobble, 48.0 + wobble);
+  Adafruit_TSL2591::hostSetLuminosity(((uint32_t)(300 + (i % 11)) << 16) | (1200 + (i % 17)));
+}
+
+static void prepare()
+{
+  for (uint8_t i = 0; i < INPUTS; i++)
+  {
+    _celsius[i] = -10.0 + (i * 3.3);
+    _fahrenheit[i] = 14.0 + (i * 6.1);
+    _levelCodes[i] = 290 + (i * 18);
+
+    // ***
+    // *** Span both branches of the heat index.
+    // ***
+    DHTesp::hostSetReading(15.0 + (i * 1.5), 10.0 + (i * 5.5));
+    _envMonitors[i] = new EnvironmentalMonitor(DHT22_DATA_PIN);
+    _envMonitors[i]->getTemperature(CELSIUS, true);
+
+    Adafruit_TSL2591::hostSetLuminosity(((uint32_t)(100 + (i * 40)) << 16) | (400 + (i * 300)));
+    _spectrumMonitors[i] = new SpectrumMonitor();
+    _spectrumMonitors[i]->begin();
+    _spectrumMonitors[i]->getLuminosity(true);
+
+    simulateDevices(i);
+    _data[i].initialized = true;
+    _data[i].capturedAt = i * 10000;
+    _data[i].environmentalTemperature = 70.0 + i;
+    _data[i].environmentalRelativeHumidity = 40.0 + i;
+    _data[i].soilMoistureLevel = 55.0 + i;
+    _data[i].soilMoistureQuality = "Good";
+    _data[i].soilTemperature = 68.0 + (i * 0.1);
+    _data[i].spectrumIr = 300 + i;
+    _data[i].spectrumFull = 1200 + i;
+    _data[i].spectrumLux = 85.5 + i;
+    _data[i].spectrumVisible = 900;
+    memset(_data[i].quality, 0, sizeof(_data[i].quality));
+    memset(_data[i].interval, 0, sizeof(_data[i].interval));
+  }
+
+  // ***
+  // *** Air temperature in 0.1 °C steps (shown in °F), humidity in
+  // *** 0.1% steps, soil temperature in 1/16 °C steps and a little
+  // *** noise on the light counts.
+  // ***
+  uint32_t seed = 12345;
+
+  for (uint8_t c = 0; c < TELEMETRY_CHANNELS; c++)
+  {
+    _decimals[c] = getChannelDecimals((enum sensorChannel)c);
+  }
+
+  for (uint16_t i = 0; i < READINGS; i++)
+  {
+    seed = (seed * 1103515245) + 12345;
+    int8_t noise = (int8_t)((seed >> 16) % 5) - 2;
+    float air = roundf((22.0 + sin(i / 20.0)) * 10.0) / 10.0;
+    float soil = roundf((19.5 + (i * 0.002)) * 16.0) / 16.0;
+    float light = 300.0 + (i * 2.0);
+
+    TelemetryRecord& record = _readings[i];
+    memset(&record, 0, sizeof(record));
+    record.flags = TELEMETRY_FLAG_EPOCH | TELEMETRY_FLAG_FAHRENHEIT;
+    record.deviceId = 0x00C0FFEE;
+    record.sequence = i;
+    record.timestamp = 1790000000000ULL + (i * 10000ULL) + (seed % 7);
+    record.value[CHANNEL_ENVIRONMENTAL_TEMPERATURE] = telemetryScale((air * 1.8) + 32.0);
+    record.value[CHANNEL_ENVIRONMENTAL_RELATIVE_HUMIDITY] = telemetryScale(roundf((48.0 - (air - 22.0) * 3.0) * 10.0) / 10.0);
+    record.value[CHANNEL_SOIL_MOISTURE_LEVEL] = telemetryScale(roundf((62.0 - (i * 0.01)) * 10.0) / 10.0);
+    record.value[CHANNEL_SOIL_TEMPERATURE] = telemetryScale((soil * 1.8) + 32.0);
+    record.value[CHANNEL_SPECTRUM_IR] = telemetryScale(roundf(light * 0.25) + noise);
+    record.value[CHANNEL_SPECTRUM_FULL] = telemetryScale(roundf(light) + noise);
+    record.value[CHANNEL_SPECTRUM_LUX] = telemetryScale(roundf(light * 0.28 * 100.0) / 100.0);
+    record.value[CHANNEL_SPECTRUM_VISIBLE] = telemetryScale(roundf(light * 0.75));
+
+    for (uint8_t c = 0; c < TELEMETRY_CHANNELS; c++)
+    {
+      record.interval[c] = 10;
+    }
+  }
+
+  TelemetryBatch batch;
+  telemetryBatchBegin(&batch, _batch, sizeof(_batch), _decimals);
+
+  for (uint16_t i = 0; i < READINGS; i++)
+  {
+    telemetryBatchAdd(&batch, &_readings[i]);
+  }
+
+  _batchLength = telemetryBatchFinish(&batch);
+}
+
+// ***
+// *** The benchmarks. Each runs the operation n times.
+// ***
+static void benchMoistureLevel(uint64_t n)
+{
+  // ***
+  // *** SoilMonitor::mapF() is private; it is measured through
+  // *** getMoistureLevel() with the ADC read simulated.
+  // ***
+  for (uint64_t i = 0; i < n; i++)
+  {
+    Adafruit_MCP3008::hostSetCode(SOIL_ANALOG_CHANNEL, _levelCodes[i % INPUTS]);
+    keep(_soilMonitor.getMoistureLevel());
+  }
+}
+
+static void benchCtoF(uint64_t n)
+{
+  Temperature temperature;
+
+  for (uint64_t i = 0; i < n; i++)
+  {
+    keep(temperature.convertCtoF(_celsius[i % INPUTS]));
+  }
+}
+
+static void benchFtoC(uint64_t n)
+{
+  Temperature temperature;
+
+  for (uint64_t i = 0; i < n; i++)
+  {
+    keep(temperature.convertFtoC(_fahrenheit[i % INPUTS]));
+  }
+}
+
+static void benchHeatIndex(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    keep(_envMonitors[i % INPUTS]->getHeatIndex(FAHRENHEIT));
+  }
+}
+
+static void benchDerivedMetrics(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    calculateDerivedMetrics(_data[i % INPUTS], FAHRENHEIT);
+    keep(_data[i % INPUTS].airVpd);
+  }
+}
+
+static void benchLux(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    keep(_spectrumMonitors[i % INPUTS]->getLux());
+  }
+}
+
+static void benchVisible(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    keep(_spectrumMonitors[i % INPUTS]->getVisible());
+  }
+}
+
+static void benchCloudDataConstruct(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    CloudData data;
+    data.initialized = true;
+    data.capturedAt = i;
+    data.environmentalTemperature = _celsius[i % INPUTS];
+    data.environmentalRelativeHumidity = _fahrenheit[i % INPUTS];
+    data.soilMoistureLevel = 50.0;
+    data.soilMoistureQuality = (i & 1) ? "Dry" : "Good";
+    data.soilTemperature = 20.0;
+    data.spectrumIr = i;
+    data.spectrumFull = i;
+    data.spectrumLux = 1.0;
+    data.spectrumVisible = 0;
+    memset(data.quality, 0, sizeof(data.quality));
+    keep(data);
+  }
+}
+
+static void benchCloudDataCopy(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    CloudData data = _data[i % INPUTS];
+    keep(data);
+  }
+}
+
+// ***
+// *** The virtual clock does not move while benchmarking so the
+// *** publish budget is refilled to have every upload made.
+// ***
+static void refillBudget()
+{
+  _cloud.getGovernor().begin(IO_RATE_LIMIT, IO_ACCOUNT_DEVICES);
+}
+
+static void benchCloudSerialize(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    refillBudget();
+    keep(_cloud.sendData(_data[i % INPUTS], 1790000000 + i));
+  }
+}
+
+static void benchTelemetryEncode(uint64_t n)
+{
+  uint8_t buffer[TELEMETRY_PACKET_SIZE];
+  TelemetryRecord record = {};
+
+  for (uint64_t i = 0; i < n; i++)
+  {
+    const CloudData& data = _data[i % INPUTS];
+    record.sequence = i;
+    record.timestamp = data.capturedAt;
+
+    for (uint8_t c = 0; c < CHANNEL_COUNT; c++)
+    {
+      record.value[c] = telemetryScale(getChannelValue(data, (enum sensorChannel)c));
+      record.quality[c] = data.quality[c];
+    }
+
+    keep(telemetryEncode(&record, buffer, sizeof(buffer)));
+  }
+}
+
+// ***
+// *** One reading added to a batch. A new batch is begun every
+// *** READINGS readings.
+// ***
+static void benchBatchEncode(uint64_t n)
+{
+  uint8_t buffer[TELEMETRY_BATCH_MAX_SIZE];
+  TelemetryBatch batch;
+  telemetryBatchBegin(&batch, buffer, sizeof(buffer), _decimals);
+
+  for (uint64_t i = 0; i < n; i++)
+  {
+    if (i > 0 && (i % READINGS) == 0)
+    {
+      keep(telemetryBatchFinish(&batch));
+      telemetryBatchBegin(&batch, buffer, sizeof(buffer), _decimals);
+    }
+
+    keep(telemetryBatchAdd(&batch, &_readings[i % READINGS]));
+  }
+}
+
+// ***
+// *** A batch of READINGS readings compressed.
+// ***
+static void benchBatchCompress(uint64_t n)
+{
+  uint8_t buffer[TELEMETRY_BATCH_MAX_SIZE];
+
+  for (uint64_t i = 0; i < n; i++)
+  {
+    keep(telemetryBatchCompress(_batch, _batchLength, buffer, sizeof(buffer)));
+  }
+}
+
+// ***
+// *** One reading read from a batch.
+// ***
+static void benchBatchDecode(uint64_t n)
+{
+  TelemetryBatchReader reader;
+  TelemetryRecord record;
+  telemetryBatchOpen(&reader, _batch, _batchLength);
+
+  for (uint64_t i = 0; i < n; i++)
+  {
+    if (!telemetryBatchNext(&reader, &record))
+    {
+      telemetryBatchOpen(&reader, _batch, _batchLength);
+      telemetryBatchNext(&reader, &record);
+    }
+
+    keep(record.timestamp);
+  }
+}
+
+static void benchStatusUpdate(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    _sensorData = _data[i % INPUTS];
+    updateStatus();
+  }
+}
+
+static void benchSamplerUpdate(uint64_t n)
+{
+  AdaptiveSampler sampler;
+  sampler.begin(0);
+
+  for (uint64_t i = 0; i < n; i++)
+  {
+    sampler.update(DEVICE_ALL, _data[i % INPUTS], (i + 1) * 10000);
+  }
+
+  keep(sampler.getNextDue());
+}
+
+// ***
+// *** The virtual clock does not move while benchmarking so the
+// *** sampler is restarted to have every device read.
+// ***
+static void makeDevicesDue()
+{
+  _sampler.begin(_clock.now());
+}
+
+static void benchLoopIdle(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    loop();
+  }
+}
+
+static void benchLoopRead(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    simulateDevices(i);
+    _readSensorData = true;
+    makeDevicesDue();
+    loop();
+  }
+}
+
+static void benchLoopFull(uint64_t n)
+{
+  for (uint64_t i = 0; i < n; i++)
+  {
+    simulateDevices(i);
+    _readSensorData = true;
+    makeDevicesDue();
+    refillBudget();
+    _sendSensorData = true;
+    _checkSoilQuality = true;
+    loop();
+  }
+}
+
+typedef struct benchmark
+{
+  const char* name;
+  void (*run)(uint64_t);
+} Benchmark;
+
+static const Benchmark _benchmarks[] = {
+  { "soil.moisture_level", benchMoistureLevel },
+  { "temperature.c_to_f", benchCtoF },
+  { "temperature.f_to_c", benchFtoC },
+  { "environment.heat_index", benchHeatIndex },
+  { "environment.derived_metrics", benchDerivedMetrics },
+  { "spectrum.lux", benchLux },
+  { "spectrum.visible", benchVisible },
+  { "cloud_data.construct", benchCloudDataConstruct },
+  { "cloud_data.copy", benchCloudDataCopy },
+  { "cloud.serialize", benchCloudSerialize },
+  { "telemetry.encode", benchTelemetryEncode },
+  { "batch.encode", benchBatchEncode },
+  { "batch.compress", benchBatchCompress },
+  { "batch.decode", benchBatchDecode },
+  { "status.update", benchStatusUpdate },
+  { "sampler.update", benchSamplerUpdate },
+  { "loop.idle", benchLoopIdle },
+  { "loop.read", benchLoopRead },
+  { "loop.full", benchLoopFull }
+};
+
+#define RUNS 7
+
+typedef struct result
+{
+  double nanoseconds;
+  double allocations;
+  uint64_t iterations;
+} Result;
+
+// ***
+// *** Finds an iteration count that takes about a seventh of the
+// *** measuring time, then reports the fastest of seven runs (the
+// *** least disturbed by the rest of the machine).
+// ***
+static Result measure(const Benchmark& benchmark, uint32_t milliseconds)
+{
+  Result returnValue = {};
+  uint64_t target = (uint64_t)milliseconds * 1000000ULL / RUNS;
+  uint64_t n = 1;
+  uint64_t elapsed = 0;
+
+  while (true)
+  {
+    uint64_t start = nanoseconds();
+    benchmark.run(n);
+    elapsed = nanoseconds() - start;
+
+    if (elapsed >= target / 10 || n >= (1ULL << 40))
+    {
+      break;
+    }
+
+    n *= 2;
+  }
+
+  n = std::max<uint64_t>(1, (uint64_t)((double)n * target / std::max<uint64_t>(elapsed, 1)));
+
+  std::vector<double> times;
+  uint64_t allocations = 0;
+
+  for (uint8_t i = 0; i < RUNS; i++)
+  {
+    uint64_t before = _allocations;
+    uint64_t start = nanoseconds();
+    benchmark.run(n);
+    times.push_back((double)(nanoseconds() - start) / n);
+    allocations += _allocations - before;
+  }
+
+  returnValue.nanoseconds = *std::min_element(times.begin(), times.end());
+  returnValue.allocations = (double)allocations / ((double)RUNS * n);
+  returnValue.iterations = n;
+
+  return returnValue;
+}
+
+// ***
+// *** Prints the bytes per reading of each upload format for the
+// *** run of readings (as comments, so that the output can still
+// *** be saved as a baseline).
+// ***
+static void printSizes()
+{
+  size_t json = 0;
+
+  for (uint16_t i = 0; i < READINGS; i++)
+  {
+    CloudData data;
+    data.initialized = true;
+    data.soilMoistureQuality = "Good";
+    memset(data.quality, 0, sizeof(data.quality));
+
+    for (uint8_t c = 0; c < CHANNEL_COUNT; c++)
+    {
+      setChannelValue(data, (enum sensorChannel)c, telemetryUnscale(_readings[i].value[c]));
+    }
+
+    refillBudget();
+    _cloud.sendData(data, (time_t)(_readings[i].timestamp / 1000));
+    json += HTTPClient::hostGetLastBodyLength();
+  }
+
+  uint8_t buffer[TELEMETRY_BATCH_MAX_SIZE];
+  size_t compressed = telemetryBatchCompress(_batch, _batchLength, buffer, sizeof(buffer));
+  compressed = compressed > 0 ? compressed : _batchLength;
+
+  printf("# bytes per reading over %u readings: cloud.serialize %.1f, telemetry.encode %u, batch.encode %.1f (%.1fx smaller), batch.compress %.1f (%.1fx smaller)\n",
+         READINGS, (double)json / READINGS, TELEMETRY_PACKET_SIZE, (double)_batchLength / READINGS, (double)json / _batchLength,
+         (double)compressed / READINGS, (double)json / compressed);
+}
+
+// ***
+// *** Reads a saved result: name, ns/op, allocations/op.
+// ***
+static std::map<std::string, Result> readResults(const char* path)
+{
+  std::map<std::string, Result> returnValue;
+  FILE* file = fopen(path, "r");
+
+  if (file)
+  {
+    char line[256];
+
+    while (fgets(line, sizeof(line), file))
+    {
+      char name[128];
+      Result result = {};
+
+      if (line[0] != '#' && sscanf(line, "%127s %lf %lf", name, &result.nanoseconds, &result.allocations) == 3)
+      {
+        returnValue[name] = result;
+      }
+    }
+
+    fclose(file);
+  }
+
+  return returnValue;
+}
+
+int main(int argc, char** argv)
+{
+  const char* filter = "";
+  const char* baselinePath = nullptr;
+  const char* outputPath = nullptr;
+  uint32_t milliseconds = 200;
+  double threshold = 15.0;
+  int option = 0;
+
+  while ((option = getopt(argc, argv, "f:m:b:t:o:")) != -1)
+  {
+    switch (option)
+    {
+      case 'f': filter = optarg; break;
+      case 'm': milliseconds = atoi(optarg); break;
+      case 'b': baselinePath = optarg; break;
+      case 't': threshold = atof(optarg); break;
+      case 'o': outputPath = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-f filter] [-m milliseconds] [-b baseline] [-t percent] [-o output]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  std::map<std::string, Result> baseline;
+
+  if (baselinePath)
+  {
+    baseline = readResults(baselinePath);
+
+    if (baseline.empty())
+    {
+      fprintf(stderr, "Could not read the baseline %s.\n", baselinePath);
+      return 1;
+    }
+  }
+
+  // ***
+  // *** Start the sketch against the simulated devices with
+  // *** the serial port off and a virtual clock.
+  // ***
+  hostSetSerialEnabled(false);
+  hostSetVirtualTime(0);
+  prepare();
+  setup();
+  loop();
+
+  FILE* output = outputPath ? fopen(outputPath, "w") : nullptr;
+  const char* header = "# name\tns_per_op\tallocations_per_op\titerations";
+  bool regressed = false;
+
+  printf("%s%s\n", header, baselinePath ? "\tbaseline_ns\tchange_percent\tstatus" : "");
+
+  if (output)
+  {
+    fprintf(output, "%s\n", header);
+  }
+
+  for (const Benchmark& benchmark : _benchmarks)
+  {
+    if (strstr(benchmark.name, filter))
+    {
+      Result result = measure(benchmark, milliseconds);
+      printf("%s\t%.2f\t%.2f\t%llu", benchmark.name, result.nanoseconds, result.allocations, (unsigned long long)result.iterations);
+
+      if (output)
+      {
+        fprintf(output, "%s\t%.2f\t%.2f\t%llu\n", benchmark.name, result.nanoseconds, result.allocations, (unsigned long long)result.iterations);
+      }
+
+      if (baselinePath)
+      {
+        auto base = baseline.find(benchmark.name);
+
+        if (base == baseline.end())
+        {
+          printf("\t-\t-\tnew");
+        }
+        else
+        {
+          double change = base->second.nanoseconds > 0 ? ((result.nanoseconds / base->second.nanoseconds) - 1.0) * 100.0 : 0.0;
+          bool slower = change > threshold;
+          bool allocates = result.allocations > base->second.allocations + 0.005;
+          regressed |= slower || allocates;
+          printf("\t%.2f\t%+.1f\t%s", base->second.nanoseconds, change, slower ? "SLOWER" : (allocates ? "ALLOCATES" : (change < -threshold ? "faster" : "ok")));
+        }
+      }
+
+      printf("\n");
+      fflush(stdout);
+    }
+  }
+
+  if (strstr("batch", filter) || strstr(filter, "batch"))
+  {
+    printSizes();
+  }
+
+  if (output)
+  {
+    fclose(output);
+  }
+
+  return regressed ? 1 : 0;
+}
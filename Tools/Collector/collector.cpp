@@ -0,0 +1,724 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Collects the telemetry packets (see PlantMonitor/TelemetryPacket.h)
+// and batches (see PlantMonitor/TelemetryBatch.h) sent by many Plant
+// Monitors on the local network and appends the readings to a
+// columnar file.
+//
+// Build:
+//   g++ -O2 -std=c++17 -pthread -I../../PlantMonitor collector.cpp ../../PlantMonitor/TelemetryPacket.cpp ../../PlantMonitor/TelemetryBatch.cpp ../../PlantMonitor/ByteOrder.cpp -o collector
+//
+// Usage:
+//   collector [-p port] [-g group] [-t threads] [-o file] [-b rows]
+//   collector -d file
+//
+//   -p  UDP port (default 5077).
+//   -g  Multicast group to join (default 239.255.80.77, "none" for unicast only).
+//   -t  Number of receive threads (default one per core).
+//   -o  Output file (default telemetry.pmc).
+//   -b  Rows per block (default 4096).
+//   -d  Dump a columnar file as CSV and exit.
+//
+#include "TelemetryPacket.h"
+#include "TelemetryBatch.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// ***
+// *** Columnar file format. The file is a sequence of blocks, each
+// *** holding up to -b rows. Within a block each column is stored
+// *** contiguously in the order of COLUMNS below.
+// ***
+// *** Block header (little endian):
+// ***   uint32  magic "PMCB"
+// ***   uint16  version
+// ***   uint16  column count
+// ***   uint32  row count
+// ***   uint32  payload size (bytes)
+// ***   uint32  CRC-32 of the payload
+// ***
+#define BLOCK_MAGIC         0x42434D50
+#define BLOCK_VERSION       2
+#define BLOCK_HEADER_SIZE   20
+
+#define MAX_BATCH           64
+#define DEDUPE_SHARDS       256
+#define DEDUPE_WINDOW       64
+
+// ***
+// *** A session not heard from for a day is forgotten (each boot
+// *** starts a new one). Each shard is swept once a minute.
+// ***
+#define DEDUPE_TIMEOUT      (24ULL * 3600ULL * 1000000000ULL)
+#define DEDUPE_SWEEP        (60ULL * 1000000000ULL)
+
+// ***
+// *** The columns written for each packet.
+// ***
+typedef struct column
+{
+  const char* name;
+  uint8_t width;
+} Column;
+
+static const Column COLUMNS[] = {
+  { "received_ns", 8 },
+  { "device_id", 4 },
+  { "session", 4 },
+  { "sequence", 4 },
+  { "flags", 1 },
+  { "timestamp", 8 },
+  { "value0", 4 }, { "value1", 4 }, { "value2", 4 }, { "value3", 4 },
+  { "value4", 4 }, { "value5", 4 }, { "value6", 4 }, { "value7", 4 },
+  { "quality0", 1 }, { "quality1", 1 }, { "quality2", 1 }, { "quality3", 1 },
+  { "quality4", 1 }, { "quality5", 1 }, { "quality6", 1 }, { "quality7", 1 },
+  { "interval0", 2 }, { "interval1", 2 }, { "interval2", 2 }, { "interval3", 2 },
+  { "interval4", 2 }, { "interval5", 2 }, { "interval6", 2 }, { "interval7", 2 }
+};
+
+static const size_t COLUMN_COUNT = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+static_assert(COLUMN_COUNT == 6 + (3 * TELEMETRY_CHANNELS), "Columns must match the telemetry record.");
+
+// ***
+// *** Options.
+// ***
+static uint16_t _port = 5077;
+static std::string _group = "239.255.80.77";
+static unsigned _threadCount = 0;
+static std::string _outputPath = "telemetry.pmc";
+static uint32_t _blockRows = 4096;
+
+// ***
+// *** Shared state.
+// ***
+static std::atomic<bool> _stop(false);
+static std::atomic<uint64_t> _received(0);
+static std::atomic<uint64_t> _batches(0);
+static std::atomic<uint64_t> _accepted(0);
+static std::atomic<uint64_t> _duplicates(0);
+static std::atomic<uint64_t> _invalid(0);
+static std::atomic<uint64_t> _rowsWritten(0);
+static int _outputFile = -1;
+static std::mutex _outputLock;
+
+// ***
+// *** Sequence window of one device session. Tracks the highest
+// *** sequence seen, which of the 64 before it were received and
+// *** when the session was last heard from.
+// ***
+typedef struct sequenceWindow
+{
+  uint32_t highest;
+  uint64_t seen;
+  uint64_t lastSeen;
+} SequenceWindow;
+
+// ***
+// *** Deduplication table sharded by device so that threads
+// *** rarely contend for the same lock.
+// ***
+typedef struct dedupeShard
+{
+  std::mutex lock;
+  std::unordered_map<uint64_t, SequenceWindow> windows;
+  uint64_t lastSweep;
+} DedupeShard;
+
+static DedupeShard _shards[DEDUPE_SHARDS];
+
+static uint64_t nowNanoseconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static uint32_t shardOf(uint32_t deviceId)
+{
+  // ***
+  // *** Chip ids are often sequential; mix the bits.
+  // ***
+  uint32_t h = deviceId * 0x9E3779B1;
+  return h >> 24;
+}
+
+// ***
+// *** Drops the sessions of the shard that have timed out. The
+// *** shard must be locked.
+// ***
+static void sweep(DedupeShard& shard, uint64_t now)
+{
+  if ((now - shard.lastSweep) > DEDUPE_SWEEP)
+  {
+    for (auto i = shard.windows.begin(); i != shard.windows.end();)
+    {
+      i = ((now - i->second.lastSeen) > DEDUPE_TIMEOUT) ? shard.windows.erase(i) : std::next(i);
+    }
+
+    shard.lastSweep = now;
+  }
+}
+
+// ***
+// *** Returns true if the packet has not been seen before.
+// ***
+static bool isNew(const TelemetryRecord& record, uint64_t receivedAt)
+{
+  bool returnValue = false;
+
+  DedupeShard& shard = _shards[shardOf(record.deviceId) % DEDUPE_SHARDS];
+  uint64_t key = ((uint64_t)record.deviceId << 32) | record.session;
+
+  std::lock_guard<std::mutex> guard(shard.lock);
+  sweep(shard, receivedAt);
+  auto found = shard.windows.find(key);
+
+  if (found == shard.windows.end())
+  {
+    shard.windows[key] = { record.sequence, 1, receivedAt };
+    returnValue = true;
+  }
+  else
+  {
+    SequenceWindow& window = found->second;
+    window.lastSeen = receivedAt;
+
+    if (record.sequence > window.highest)
+    {
+      uint32_t shift = record.sequence - window.highest;
+      window.seen = (shift >= DEDUPE_WINDOW) ? 1 : ((window.seen << shift) | 1);
+      window.highest = record.sequence;
+      returnValue = true;
+    }
+    else
+    {
+      uint32_t age = window.highest - record.sequence;
+
+      if (age < DEDUPE_WINDOW && !(window.seen & (1ULL << age)))
+      {
+        window.seen |= (1ULL << age);
+        returnValue = true;
+      }
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Rows buffered by one thread, one vector per column.
+// ***
+class Block
+{
+  public:
+    Block()
+    {
+      for (size_t i = 0; i < COLUMN_COUNT; i++)
+      {
+        this->_columns[i].reserve(_blockRows * COLUMNS[i].width);
+      }
+    }
+
+    void add(const TelemetryRecord& record, uint64_t receivedAt)
+    {
+      size_t c = 0;
+      this->put(c++, &receivedAt, 8);
+      this->put(c++, &record.deviceId, 4);
+      this->put(c++, &record.session, 4);
+      this->put(c++, &record.sequence, 4);
+      this->put(c++, &record.flags, 1);
+      this->put(c++, &record.timestamp, 8);
+
+      for (int i = 0; i < TELEMETRY_CHANNELS; i++)
+      {
+        this->put(c++, &record.value[i], 4);
+      }
+
+      for (int i = 0; i < TELEMETRY_CHANNELS; i++)
+      {
+        this->put(c++, &record.quality[i], 1);
+      }
+
+      for (int i = 0; i < TELEMETRY_CHANNELS; i++)
+      {
+        this->put(c++, &record.interval[i], 2);
+      }
+
+      this->_rows++;
+    }
+
+    uint32_t rows()
+    {
+      return this->_rows;
+    }
+
+    // ***
+    // *** Appends the block to the output file with a single write.
+    // ***
+    void flush()
+    {
+      if (this->_rows > 0)
+      {
+        std::vector<uint8_t> buffer(BLOCK_HEADER_SIZE);
+
+        for (size_t i = 0; i < COLUMN_COUNT; i++)
+        {
+          buffer.insert(buffer.end(), this->_columns[i].begin(), this->_columns[i].end());
+          this->_columns[i].clear();
+        }
+
+        uint32_t payload = buffer.size() - BLOCK_HEADER_SIZE;
+        uint32_t header[5] = { BLOCK_MAGIC, BLOCK_VERSION | ((uint32_t)COLUMN_COUNT << 16), this->_rows, payload,
+                               telemetryCrc32(buffer.data() + BLOCK_HEADER_SIZE, payload) };
+        memcpy(buffer.data(), header, BLOCK_HEADER_SIZE);
+
+        {
+          std::lock_guard<std::mutex> guard(_outputLock);
+
+          if (write(_outputFile, buffer.data(), buffer.size()) != (ssize_t)buffer.size())
+          {
+            perror("write");
+          }
+        }
+
+        _rowsWritten += this->_rows;
+        this->_rows = 0;
+      }
+    }
+
+  private:
+    std::vector<uint8_t> _columns[COLUMN_COUNT];
+    uint32_t _rows = 0;
+
+    // ***
+    // *** Host byte order; the collector only runs on little
+    // *** endian Linux machines.
+    // ***
+    void put(size_t column, const void* value, size_t width)
+    {
+      const uint8_t* p = (const uint8_t*)value;
+      this->_columns[column].insert(this->_columns[column].end(), p, p + width);
+    }
+};
+
+static int openSocket()
+{
+  int s = socket(AF_INET, SOCK_DGRAM, 0);
+  int on = 1;
+
+  // ***
+  // *** Every thread binds the same port; the kernel spreads
+  // *** unicast traffic across the sockets.
+  // ***
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+  // ***
+  // *** Report the destination address of each packet so that
+  // *** multicast and unicast packets can be told apart.
+  // ***
+  setsockopt(s, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on));
+
+  int size = 4 * 1024 * 1024;
+  setsockopt(s, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  struct timeval timeout = { 0, 200000 };
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(_port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  if (bind(s, (struct sockaddr*)&address, sizeof(address)) != 0)
+  {
+    perror("bind");
+    exit(1);
+  }
+
+  if (_group != "none")
+  {
+    struct ip_mreq request;
+    request.imr_multiaddr.s_addr = inet_addr(_group.c_str());
+    request.imr_interface.s_addr = htonl(INADDR_ANY);
+
+    if (setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) != 0)
+    {
+      perror("IP_ADD_MEMBERSHIP");
+    }
+  }
+
+  return s;
+}
+
+// ***
+// *** Returns true if the packet was sent to a multicast address.
+// ***
+static bool isMulticast(struct msghdr* message)
+{
+  bool returnValue = false;
+
+  for (struct cmsghdr* c = CMSG_FIRSTHDR(message); c != nullptr; c = CMSG_NXTHDR(message, c))
+  {
+    if (c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_PKTINFO)
+    {
+      struct in_pktinfo* info = (struct in_pktinfo*)CMSG_DATA(c);
+      returnValue = IN_MULTICAST(ntohl(info->ipi_addr.s_addr));
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Checks a batch, expanding it first if it is compressed.
+// ***
+static enum telemetryResult openBatch(const uint8_t* packet, size_t length, std::vector<uint8_t>& expanded, TelemetryBatchReader* reader)
+{
+  enum telemetryResult returnValue = telemetryBatchOpen(reader, packet, length);
+
+  if (returnValue == TELEMETRY_COMPRESSED)
+  {
+    size_t expandedLength = telemetryBatchExpand(packet, length, expanded.data(), expanded.size());
+    returnValue = expandedLength > 0 ? telemetryBatchOpen(reader, expanded.data(), expandedLength) : TELEMETRY_BAD_CRC;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Receive loop of one thread.
+// ***
+static void receive(unsigned index)
+{
+  int s = openSocket();
+  Block block;
+
+  uint8_t buffers[MAX_BATCH][TELEMETRY_BATCH_MAX_SIZE + 64];
+  struct iovec vectors[MAX_BATCH];
+  struct mmsghdr messages[MAX_BATCH];
+  struct sockaddr_in sources[MAX_BATCH];
+  uint8_t controls[MAX_BATCH][CMSG_SPACE(sizeof(struct in_pktinfo))];
+
+  // ***
+  // *** A compressed batch is expanded here (the record count
+  // *** and length are 16 bit).
+  // ***
+  std::vector<uint8_t> expanded(TELEMETRY_BATCH_HEADER_SIZE + UINT16_MAX + 4);
+
+  uint64_t lastFlush = nowNanoseconds();
+
+  while (!_stop)
+  {
+    for (int i = 0; i < MAX_BATCH; i++)
+    {
+      vectors[i].iov_base = buffers[i];
+      vectors[i].iov_len = sizeof(buffers[i]);
+      memset(&messages[i], 0, sizeof(messages[i]));
+      messages[i].msg_hdr.msg_iov = &vectors[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+      messages[i].msg_hdr.msg_name = &sources[i];
+      messages[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+      messages[i].msg_hdr.msg_control = controls[i];
+      messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+    }
+
+    int count = recvmmsg(s, messages, MAX_BATCH, MSG_WAITFORONE, nullptr);
+    uint64_t receivedAt = nowNanoseconds();
+
+    for (int i = 0; i < count; i++)
+    {
+      TelemetryRecord record;
+      TelemetryBatchReader reader;
+      bool isBatch = telemetryBatchIsBatch(buffers[i], messages[i].msg_len);
+      enum telemetryResult result = isBatch ? openBatch(buffers[i], messages[i].msg_len, expanded, &reader)
+                                            : telemetryDecode(buffers[i], messages[i].msg_len, &record);
+
+      // ***
+      // *** Multicast packets are delivered to every socket; each
+      // *** thread only handles its share of the devices (thread 0
+      // *** handles packets that cannot be decoded).
+      // ***
+      if (isMulticast(&messages[i].msg_hdr))
+      {
+        unsigned owner = (result == TELEMETRY_OK) ? (shardOf(isBatch ? reader.deviceId : record.deviceId) % _threadCount) : 0;
+
+        if (owner != index)
+        {
+          continue;
+        }
+      }
+
+      _received++;
+
+      if (result != TELEMETRY_OK)
+      {
+        _invalid++;
+      }
+      else if (isBatch)
+      {
+        _batches++;
+
+        while (telemetryBatchNext(&reader, &record))
+        {
+          if (isNew(record, receivedAt))
+          {
+            block.add(record, receivedAt);
+            _accepted++;
+          }
+          else
+          {
+            _duplicates++;
+          }
+        }
+
+        if (reader.index < reader.count)
+        {
+          _invalid++;
+        }
+      }
+      else if (!isNew(record, receivedAt))
+      {
+        _duplicates++;
+      }
+      else
+      {
+        block.add(record, receivedAt);
+        _accepted++;
+      }
+    }
+
+    // ***
+    // *** Write a block when it is full or once a second.
+    // ***
+    if (block.rows() >= _blockRows || (block.rows() > 0 && (receivedAt - lastFlush) > 1000000000ULL))
+    {
+      block.flush();
+      lastFlush = receivedAt;
+    }
+  }
+
+  block.flush();
+  close(s);
+}
+
+// ***
+// *** Prints a columnar file as CSV.
+// ***
+static int dump(const char* path)
+{
+  FILE* file = fopen(path, "rb");
+
+  if (!file)
+  {
+    perror(path);
+    return 1;
+  }
+
+  printf("received_ns,device_id,session,sequence,flags,timestamp");
+
+  for (int i = 0; i < TELEMETRY_CHANNELS; i++)
+  {
+    printf(",value%d", i);
+  }
+
+  for (int i = 0; i < TELEMETRY_CHANNELS; i++)
+  {
+    printf(",quality%d", i);
+  }
+
+  for (int i = 0; i < TELEMETRY_CHANNELS; i++)
+  {
+    printf(",interval%d", i);
+  }
+
+  printf("\n");
+
+  uint32_t header[5];
+
+  while (fread(header, 1, BLOCK_HEADER_SIZE, file) == BLOCK_HEADER_SIZE)
+  {
+    if (header[0] != BLOCK_MAGIC || (header[1] & 0xFFFF) != BLOCK_VERSION || (header[1] >> 16) != COLUMN_COUNT)
+    {
+      fprintf(stderr, "Unknown block.\n");
+      break;
+    }
+
+    uint32_t rows = header[2];
+    std::vector<uint8_t> payload(header[3]);
+
+    if (fread(payload.data(), 1, payload.size(), file) != payload.size() || telemetryCrc32(payload.data(), payload.size()) != header[4])
+    {
+      fprintf(stderr, "Corrupt block.\n");
+      break;
+    }
+
+    // ***
+    // *** Find the start of each column.
+    // ***
+    const uint8_t* columns[COLUMN_COUNT];
+    size_t offset = 0;
+
+    for (size_t c = 0; c < COLUMN_COUNT; c++)
+    {
+      columns[c] = payload.data() + offset;
+      offset += (size_t)rows * COLUMNS[c].width;
+    }
+
+    for (uint32_t r = 0; r < rows; r++)
+    {
+      for (size_t c = 0; c < COLUMN_COUNT; c++)
+      {
+        const uint8_t* p = columns[c] + ((size_t)r * COLUMNS[c].width);
+        uint64_t value = 0;
+        memcpy(&value, p, COLUMNS[c].width);
+
+        if (c > 0)
+        {
+          putchar(',');
+        }
+
+        if (COLUMNS[c].width == 4 && strncmp(COLUMNS[c].name, "value", 5) == 0)
+        {
+          int32_t scaled = (int32_t)value;
+
+          if (scaled != TELEMETRY_NO_VALUE)
+          {
+            printf("%.2f", telemetryUnscale(scaled));
+          }
+        }
+        else
+        {
+          printf("%llu", (unsigned long long)value);
+        }
+      }
+
+      putchar('\n');
+    }
+  }
+
+  fclose(file);
+  return 0;
+}
+
+static void onSignal(int)
+{
+  _stop = true;
+}
+
+int main(int argc, char** argv)
+{
+  int option;
+
+  while ((option = getopt(argc, argv, "p:g:t:o:b:d:")) != -1)
+  {
+    switch (option)
+    {
+      case 'p': _port = atoi(optarg); break;
+      case 'g': _group = optarg; break;
+      case 't': _threadCount = atoi(optarg); break;
+      case 'o': _outputPath = optarg; break;
+      case 'b': _blockRows = atoi(optarg); break;
+      case 'd': return dump(optarg);
+      default:
+        fprintf(stderr, "Usage: %s [-p port] [-g group|none] [-t threads] [-o file] [-b rows] | -d file\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if (_threadCount == 0)
+  {
+    _threadCount = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  _outputFile = open(_outputPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+  if (_outputFile < 0)
+  {
+    perror(_outputPath.c_str());
+    return 1;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  printf("Listening on port %u with %u threads, writing to %s.\n", _port, _threadCount, _outputPath.c_str());
+
+  std::vector<std::thread> threads;
+
+  for (unsigned i = 0; i < _threadCount; i++)
+  {
+    threads.emplace_back(receive, i);
+  }
+
+  // ***
+  // *** Report progress every five seconds.
+  // ***
+  uint64_t lastReceived = 0;
+  int ticks = 0;
+
+  while (!_stop)
+  {
+    usleep(100000);
+
+    if (++ticks == 50 || _stop)
+    {
+      ticks = 0;
+      uint64_t received = _received;
+      printf("received %llu (%llu/s)  batches %llu  accepted %llu  duplicates %llu  invalid %llu  written %llu\n",
+             (unsigned long long)received, (unsigned long long)((received - lastReceived) / 5),
+             (unsigned long long)_batches, (unsigned long long)_accepted, (unsigned long long)_duplicates,
+             (unsigned long long)_invalid, (unsigned long long)_rowsWritten);
+      fflush(stdout);
+      lastReceived = received;
+    }
+  }
+
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+
+  close(_outputFile);
+
+  printf("Stopped. received %llu  accepted %llu  duplicates %llu  invalid %llu  written %llu\n",
+         (unsigned long long)_received, (unsigned long long)_accepted, (unsigned long long)_duplicates,
+         (unsigned long long)_invalid, (unsigned long long)_rowsWritten);
+
+  return 0;
+}
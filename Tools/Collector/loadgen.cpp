@@ -0,0 +1,286 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Simulates a fleet of Plant Monitors sending telemetry packets
+// (see PlantMonitor/TelemetryPacket.h) or batches (see
+// PlantMonitor/TelemetryBatch.h) to test the collector.
+//
+// Build:
+//   g++ -O2 -std=c++17 -I../../PlantMonitor loadgen.cpp ../../PlantMonitor/TelemetryPacket.cpp ../../PlantMonitor/TelemetryBatch.cpp ../../PlantMonitor/ByteOrder.cpp -o loadgen
+//
+// Usage:
+//   loadgen [-a address] [-p port] [-n devices] [-i interval] [-s seconds] [-x duplicates] [-c corrupt] [-r readings] [-z]
+//
+//   -a  Destination address (default 239.255.80.77).
+//   -p  Destination port (default 5077).
+//   -n  Number of simulated devices (default 1000).
+//   -i  Seconds between packets from each device (default 10, fractions allowed).
+//   -s  Run time in seconds (default 30).
+//   -x  Fraction of packets sent twice (default 0.01).
+//   -c  Fraction of packets corrupted (default 0.001).
+//   -r  Readings sent in each packet; more than 1 sends batches
+//       of readings taken interval seconds apart (default 1).
+//   -z  Compress the batches.
+//
+#include "TelemetryPacket.h"
+#include "TelemetryBatch.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#define MAX_BATCH 64
+
+// ***
+// *** State of one simulated device.
+// ***
+typedef struct device
+{
+  TelemetryRecord record;
+  float value[TELEMETRY_CHANNELS];
+} Device;
+
+static uint64_t nowNanoseconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static uint64_t epochMilliseconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ((uint64_t)ts.tv_sec * 1000ULL) + (ts.tv_nsec / 1000000);
+}
+
+int main(int argc, char** argv)
+{
+  const char* address = "239.255.80.77";
+  uint16_t port = 5077;
+  uint32_t deviceCount = 1000;
+  double interval = 10.0;
+  double seconds = 30.0;
+  double duplicateRate = 0.01;
+  double corruptRate = 0.001;
+  uint32_t readings = 1;
+  bool isCompressed = false;
+
+  int option;
+
+  while ((option = getopt(argc, argv, "a:p:n:i:s:x:c:r:z")) != -1)
+  {
+    switch (option)
+    {
+      case 'a': address = optarg; break;
+      case 'p': port = atoi(optarg); break;
+      case 'n': deviceCount = atoi(optarg); break;
+      case 'i': interval = atof(optarg); break;
+      case 's': seconds = atof(optarg); break;
+      case 'x': duplicateRate = atof(optarg); break;
+      case 'c': corruptRate = atof(optarg); break;
+      case 'r': readings = std::max(1, atoi(optarg)); break;
+      case 'z': isCompressed = true; break;
+      default:
+        fprintf(stderr, "Usage: %s [-a address] [-p port] [-n devices] [-i interval] [-s seconds] [-x duplicates] [-c corrupt] [-r readings] [-z]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  int s = socket(AF_INET, SOCK_DGRAM, 0);
+  int size = 4 * 1024 * 1024;
+  setsockopt(s, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+  struct sockaddr_in destination;
+  memset(&destination, 0, sizeof(destination));
+  destination.sin_family = AF_INET;
+  destination.sin_port = htons(port);
+  destination.sin_addr.s_addr = inet_addr(address);
+
+  std::mt19937 random(12345);
+  std::uniform_real_distribution<float> step(-0.05f, 0.05f);
+  std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+  // ***
+  // *** Create the devices with plausible starting values.
+  // ***
+  static const float initial[TELEMETRY_CHANNELS] = { 72.0f, 45.0f, 60.0f, 68.0f, 300.0f, 1200.0f, 250.0f, 900.0f };
+  std::vector<Device> devices(deviceCount);
+
+  for (uint32_t i = 0; i < deviceCount; i++)
+  {
+    memset(&devices[i], 0, sizeof(Device));
+    devices[i].record.deviceId = 0x00A00000 + i;
+    devices[i].record.session = random();
+    devices[i].record.flags = TELEMETRY_FLAG_EPOCH | TELEMETRY_FLAG_FAHRENHEIT;
+
+    for (int c = 0; c < TELEMETRY_CHANNELS; c++)
+    {
+      devices[i].value[c] = initial[c];
+      devices[i].record.interval[c] = (uint16_t)interval;
+    }
+  }
+
+  // ***
+  // *** Send in batches, spacing the devices evenly over the interval.
+  // ***
+  uint8_t buffers[MAX_BATCH][TELEMETRY_BATCH_MAX_SIZE];
+  size_t lengths[MAX_BATCH];
+  struct iovec vectors[MAX_BATCH];
+  struct mmsghdr messages[MAX_BATCH];
+
+  uint8_t batchBuffer[TELEMETRY_BATCH_MAX_SIZE];
+  static const uint8_t decimals[TELEMETRY_CHANNELS] = { 2, 2, 2, 2, 0, 0, 2, 0 };
+
+  double packetsPerSecond = deviceCount / (interval * readings);
+  uint64_t readingCount = 0;
+  uint64_t bytes = 0;
+  uint64_t start = nowNanoseconds();
+  uint64_t end = start + (uint64_t)(seconds * 1e9);
+  uint64_t sent = 0;
+  uint64_t duplicates = 0;
+  uint64_t corrupted = 0;
+  uint32_t next = 0;
+
+  while (nowNanoseconds() < end)
+  {
+    // ***
+    // *** How many packets should have been sent by now.
+    // ***
+    uint64_t due = (uint64_t)(((nowNanoseconds() - start) / 1e9) * packetsPerSecond);
+    int count = 0;
+
+    while (sent < due && count < MAX_BATCH)
+    {
+      Device& device = devices[next];
+      next = (next + 1) % deviceCount;
+
+      TelemetryBatch batch;
+      uint64_t now = epochMilliseconds();
+
+      if (readings > 1)
+      {
+        telemetryBatchBegin(&batch, isCompressed ? batchBuffer : buffers[count], TELEMETRY_BATCH_MAX_SIZE, decimals);
+      }
+
+      for (uint32_t r = 0; r < readings; r++)
+      {
+        for (int c = 0; c < TELEMETRY_CHANNELS; c++)
+        {
+          device.value[c] += device.value[c] * step(random);
+          device.record.value[c] = telemetryScale(device.value[c]);
+        }
+
+        device.record.timestamp = now - (uint64_t)((readings - 1 - r) * interval * 1000.0);
+
+        if (readings == 1)
+        {
+          lengths[count] = telemetryEncode(&device.record, buffers[count], TELEMETRY_PACKET_SIZE);
+        }
+        else if (!telemetryBatchAdd(&batch, &device.record))
+        {
+          fprintf(stderr, "%u readings do not fit in a batch.\n", readings);
+          return 1;
+        }
+
+        device.record.sequence++;
+        readingCount++;
+      }
+
+      if (readings > 1)
+      {
+        lengths[count] = telemetryBatchFinish(&batch);
+
+        if (isCompressed)
+        {
+          size_t compressed = telemetryBatchCompress(batchBuffer, lengths[count], buffers[count], TELEMETRY_BATCH_MAX_SIZE);
+          lengths[count] = compressed > 0 ? compressed : lengths[count];
+
+          if (compressed == 0)
+          {
+            memcpy(buffers[count], batchBuffer, lengths[count]);
+          }
+        }
+      }
+
+      bytes += lengths[count];
+
+      if (chance(random) < corruptRate)
+      {
+        buffers[count][30] ^= 0xFF;
+        corrupted++;
+      }
+
+      count++;
+      sent++;
+
+      // ***
+      // *** Send some packets twice to exercise deduplication.
+      // ***
+      if (count < MAX_BATCH && chance(random) < duplicateRate)
+      {
+        memcpy(buffers[count], buffers[count - 1], lengths[count - 1]);
+        lengths[count] = lengths[count - 1];
+        count++;
+        duplicates++;
+      }
+    }
+
+    if (count > 0)
+    {
+      for (int i = 0; i < count; i++)
+      {
+        vectors[i].iov_base = buffers[i];
+        vectors[i].iov_len = lengths[i];
+        memset(&messages[i], 0, sizeof(messages[i]));
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = &destination;
+        messages[i].msg_hdr.msg_namelen = sizeof(destination);
+      }
+
+      if (sendmmsg(s, messages, count, 0) < 0)
+      {
+        perror("sendmmsg");
+        return 1;
+      }
+    }
+    else
+    {
+      usleep(1000);
+    }
+  }
+
+  double elapsed = (nowNanoseconds() - start) / 1e9;
+  printf("Sent %llu packets (%.0f/s) from %u devices, %llu duplicates, %llu corrupted.\n",
+         (unsigned long long)sent, sent / elapsed, deviceCount, (unsigned long long)duplicates, (unsigned long long)corrupted);
+  printf("Sent %llu readings in %llu bytes (%.1f bytes per reading).\n",
+         (unsigned long long)readingCount, (unsigned long long)bytes, readingCount ? (double)bytes / readingCount : 0.0);
+
+  close(s);
+  return 0;
+}
@@ -0,0 +1,363 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Estimates the battery use (mAh per day) of a power mode. The
+// firmware's PowerManager, RtcMemory, Clock and PublishGovernor run
+// under a virtual clock: the schedule, the reading buffer, the deep
+// sleep restarts, the RTC memory and the publish budget of each
+// upload are the firmware's own. The time each task keeps the
+// device awake and the current drawn in each state come from the
+// model below (typical ESP-12 figures; override with -p).
+//
+// Build:
+//   g++ -O2 -std=c++17 -I../Host -I../../PlantMonitor energy.cpp ../../PlantMonitor/PowerManager.cpp ../../PlantMonitor/PublishGovernor.cpp ../../PlantMonitor/RtcMemory.cpp ../../PlantMonitor/TelemetryPacket.cpp ../../PlantMonitor/ByteOrder.cpp ../../PlantMonitor/Clock.cpp ../../PlantMonitor/CloudData.cpp ../Host/HostArduino.cpp ../Host/HostWiFi.cpp -o energy
+//
+// Usage:
+//   energy [-m on|light|deep] [-r seconds] [-s seconds] [-c seconds] [-d days] [-b mAh] [-p name=value]...
+//
+//   -m  Power mode (default deep).
+//   -r  Read interval (default 300).
+//   -s  Upload interval (default 600).
+//   -c  Soil check interval (default 600).
+//   -d  Days to simulate (default 1).
+//   -b  Battery capacity for the battery life estimate (default 2500).
+//   -p  Set a model parameter (run with -p list to see them).
+//
+#include "PowerManager.h"
+#include "PublishGovernor.h"
+
+#include <unistd.h>
+
+// ***
+// *** The energy model. Times are in ms, currents in mA.
+// ***
+struct Parameter
+{
+  const char* name;
+  float value;
+  const char* description;
+};
+
+static Parameter _model[] = {
+  { "deep_sleep_ma",     0.02,  "Deep sleep (bare module; boards with a USB chip draw more)" },
+  { "light_sleep_ma",    0.9,   "Forced light sleep" },
+  { "active_ma",         16.0,  "CPU running, radio off" },
+  { "radio_ma",          75.0,  "CPU running, WiFi connected" },
+  { "transmit_ma",       140.0, "Average while uploading (TLS and transmit)" },
+  { "boot_ms",           120.0, "Boot after a deep sleep wake up" },
+  { "rf_boot_ms",        180.0, "Extra boot time when the radio is calibrated" },
+  { "read_ms",           900.0, "Reading the sensors (DS18B20 conversion, TSL2591 integration)" },
+  { "check_ms",          5.0,   "Soil check" },
+  { "connect_ms",        2500.0, "WiFi association and DHCP" },
+  { "upload_ms",         1200.0, "One HTTPS request" },
+  { "cold_boot_ms",      8000.0, "First boot (WiFiManager, cloud connection)" },
+  { "rate_limit",        IO_RATE_LIMIT / IO_ACCOUNT_DEVICES, "Adafruit IO data points per minute for this device" },
+  { "reading_points",    11.0,  "Data points in an uploaded reading" },
+  { "status_points",     3.0,   "Data points sent after the readings (awake time, water totals)" }
+};
+
+#define PARAMETER_COUNT (sizeof(_model) / sizeof(_model[0]))
+
+static float parameter(const char* name)
+{
+  float returnValue = 0;
+
+  for (size_t i = 0; i < PARAMETER_COUNT; i++)
+  {
+    if (strcmp(_model[i].name, name) == 0)
+    {
+      returnValue = _model[i].value;
+    }
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** The states the time is accounted to.
+// ***
+enum energyState {
+  STATE_SLEEP,
+  STATE_ACTIVE,
+  STATE_RADIO,
+  STATE_TRANSMIT,
+  STATE_COUNT
+};
+
+static const char* const _stateNames[STATE_COUNT] = { "sleep", "active", "radio", "transmit" };
+
+static double _stateTime[STATE_COUNT];    // ms
+static double _stateCharge[STATE_COUNT];  // mAms
+
+// ***
+// *** Spends time in a state on the virtual clock.
+// ***
+static void spend(enum energyState state, float milliseconds, float current)
+{
+  _stateTime[state] += milliseconds;
+  _stateCharge[state] += milliseconds * current;
+  hostAdvanceVirtualTime((uint64_t)(milliseconds * 1000));
+}
+
+int main(int argc, char** argv)
+{
+  uint8_t mode = POWER_DEEP_SLEEP;
+  uint32_t readInterval = 300;
+  uint32_t sendInterval = 600;
+  uint32_t checkInterval = 600;
+  float days = 1;
+  float battery = 2500;
+  int option = 0;
+
+  while ((option = getopt(argc, argv, "m:r:s:c:d:b:p:")) != -1)
+  {
+    switch (option)
+    {
+      case 'm':
+        mode = strcmp(optarg, "on") == 0 ? POWER_ALWAYS_ON : (strcmp(optarg, "light") == 0 ? POWER_LIGHT_SLEEP : POWER_DEEP_SLEEP);
+        break;
+      case 'r': readInterval = atoi(optarg); break;
+      case 's': sendInterval = atoi(optarg); break;
+      case 'c': checkInterval = atoi(optarg); break;
+      case 'd': days = atof(optarg); break;
+      case 'b': battery = atof(optarg); break;
+      case 'p':
+      {
+        const char* equals = strchr(optarg, '=');
+        bool isFound = false;
+
+        for (size_t i = 0; equals && i < PARAMETER_COUNT; i++)
+        {
+          if (strncmp(_model[i].name, optarg, equals - optarg) == 0 && strlen(_model[i].name) == (size_t)(equals - optarg))
+          {
+            _model[i].value = atof(equals + 1);
+            isFound = true;
+          }
+        }
+
+        if (!isFound)
+        {
+          for (size_t i = 0; i < PARAMETER_COUNT; i++)
+          {
+            fprintf(stderr, "  %-16s %8.2f  %s\n", _model[i].name, _model[i].value, _model[i].description);
+          }
+
+          return 1;
+        }
+
+        break;
+      }
+      default:
+        fprintf(stderr, "Usage: %s [-m on|light|deep] [-r seconds] [-s seconds] [-c seconds] [-d days] [-b mAh] [-p name=value]...\n", argv[0]);
+        return 1;
+    }
+  }
+
+  hostSetSerialEnabled(false);
+  hostSetVirtualTime(0);
+  hostSetResetReason(REASON_DEFAULT_RST);
+
+  uint64_t end = (uint64_t)(days * 86400000.0);
+  uint64_t now = 0;
+  uint32_t cycles = 0;
+  uint32_t uploads = 0;
+  uint32_t requests = 0;
+  uint32_t deferredReadings = 0;
+  uint32_t deferredStatus = 0;
+  uint64_t awakeTotal = 0;
+  uint32_t awakeMaximum = 0;
+  bool isColdBoot = true;
+
+  CloudData data = {};
+  data.soilMoistureQuality = "Good";
+
+  float sleepCurrent = mode == POWER_DEEP_SLEEP ? parameter("deep_sleep_ma") :
+                       (mode == POWER_LIGHT_SLEEP ? parameter("light_sleep_ma") : parameter("radio_ma"));
+
+  // ***
+  // *** Each pass of this loop is one boot; in deep sleep
+  // *** mode the device boots on every wake up.
+  // ***
+  while (now < end)
+  {
+    Clock clock;
+    RtcMemory rtcMemory;
+    PowerManager powerManager(clock, rtcMemory);
+    PublishGovernor governor;
+    governor.begin((uint16_t)parameter("rate_limit"), 1);
+
+    rtcMemory.begin();
+    bool isWake = powerManager.begin(mode, readInterval * 1000, sendInterval * 1000, checkInterval * 1000);
+
+    if (isColdBoot)
+    {
+      spend(STATE_RADIO, parameter("cold_boot_ms"), parameter("radio_ma"));
+      isColdBoot = false;
+    }
+    else if (isWake)
+    {
+      spend(STATE_ACTIVE, parameter("boot_ms"), parameter("active_ma"));
+
+      if (hostGetWakeMode() != WAKE_RF_DISABLED)
+      {
+        spend(STATE_ACTIVE, parameter("rf_boot_ms"), parameter("radio_ma"));
+      }
+    }
+
+    bool isBooted = true;
+
+    while (isBooted && now < end)
+    {
+      // ***
+      // *** The work done by runDutyCycle().
+      // ***
+      float taskCurrent = mode == POWER_ALWAYS_ON ? parameter("radio_ma") : parameter("active_ma");
+      enum energyState taskState = mode == POWER_ALWAYS_ON ? STATE_RADIO : STATE_ACTIVE;
+      uint8_t tasks = powerManager.getDueTasks();
+
+      if (tasks & POWER_TASK_READ)
+      {
+        spend(taskState, parameter("read_ms"), taskCurrent);
+        data.capturedAt = clock.now();
+        powerManager.addSample(data);
+      }
+
+      if (tasks & POWER_TASK_CHECK)
+      {
+        spend(taskState, parameter("check_ms"), taskCurrent);
+      }
+
+      if (((tasks & POWER_TASK_SEND) || powerManager.isBufferFull()) && powerManager.getSampleCount() > 0)
+      {
+        if (mode != POWER_ALWAYS_ON)
+        {
+          powerManager.startRadio();
+          spend(STATE_RADIO, parameter("connect_ms"), parameter("radio_ma"));
+        }
+
+        // ***
+        // *** The readings are sent in requests the governor can
+        // *** grant, as Cloud::sendData() does; those that do not
+        // *** fit are kept for the next upload. Each status value
+        // *** is a request of its own.
+        // ***
+        uint8_t count = powerManager.getSampleCount();
+        uint8_t sent = 0;
+        uint32_t uploadRequests = 0;
+        uint16_t limit = governor.getRequestLimit(PUBLISH_BULK);
+        bool isSending = true;
+
+        while (isSending && sent < count)
+        {
+          uint16_t points = (uint16_t)parameter("reading_points");
+
+          while (isSending && points > 0)
+          {
+            uint16_t requestPoints = min(points, limit);
+            isSending = governor.acquire(PUBLISH_BULK, requestPoints);
+            points -= isSending ? requestPoints : 0;
+            uploadRequests += isSending ? 1 : 0;
+          }
+
+          sent += isSending ? 1 : 0;
+        }
+
+        for (uint16_t i = 0; i < (uint16_t)parameter("status_points"); i++)
+        {
+          bool isSent = governor.acquire(PUBLISH_STATUS, 1);
+          uploadRequests += isSent ? 1 : 0;
+          deferredStatus += isSent ? 0 : 1;
+        }
+
+        spend(STATE_TRANSMIT, parameter("upload_ms") * uploadRequests, parameter("transmit_ma"));
+        powerManager.removeSamples(sent);
+        powerManager.resetAwakeTime();
+        uploads++;
+        requests += uploadRequests;
+        deferredReadings += count - sent;
+      }
+
+      // ***
+      // *** Sleep (or idle) until the next task.
+      // ***
+      uint32_t awakeTime = powerManager.getAwakeTime();
+      uint32_t sleepTime = powerManager.getSleepTime();
+      uint64_t cycleEnd = clock.now() + sleepTime;
+
+      cycles++;
+      awakeTotal += awakeTime;
+      awakeMaximum = max(awakeMaximum, awakeTime);
+
+      _stateTime[STATE_SLEEP] += sleepTime;
+      _stateCharge[STATE_SLEEP] += (double)sleepTime * sleepCurrent;
+
+      if (mode == POWER_ALWAYS_ON)
+      {
+        hostAdvanceVirtualTime((uint64_t)sleepTime * 1000);
+      }
+      else
+      {
+        powerManager.sleep();
+      }
+
+      now = cycleEnd;
+      isBooted = (mode != POWER_DEEP_SLEEP);
+    }
+  }
+
+  double totalTime = 0;
+  double totalCharge = 0;
+
+  for (uint8_t i = 0; i < STATE_COUNT; i++)
+  {
+    totalTime += _stateTime[i];
+    totalCharge += _stateCharge[i];
+  }
+
+  double scale = 86400000.0 / totalTime;
+  double mahPerDay = totalCharge / 3600000.0 * scale;
+
+  printf("mode              %s\n", mode == POWER_ALWAYS_ON ? "on" : (mode == POWER_LIGHT_SLEEP ? "light" : "deep"));
+  printf("intervals         read %u s, upload %u s, check %u s\n", readInterval, sendInterval, checkInterval);
+  printf("cycles per day    %.0f\n", cycles * scale);
+  printf("uploads per day   %.0f (%.0f requests)\n", uploads * scale, requests * scale);
+  printf("deferred per day  %.0f reading(s), %.0f status value(s) (publish budget %.0f points/min)\n", deferredReadings * scale, deferredStatus * scale, parameter("rate_limit"));
+
+  if (mode == POWER_ALWAYS_ON)
+  {
+    printf("awake per cycle   always awake\n");
+  }
+  else
+  {
+    printf("awake per cycle   %.0f ms average, %u ms maximum\n", cycles ? (double)awakeTotal / cycles : 0.0, awakeMaximum);
+  }
+
+  printf("\n%-10s %12s %12s\n", "state", "s/day", "mAh/day");
+
+  for (uint8_t i = 0; i < STATE_COUNT; i++)
+  {
+    const char* name = (i == STATE_SLEEP && mode == POWER_ALWAYS_ON) ? "idle" : _stateNames[i];
+    printf("%-10s %12.1f %12.2f\n", name, _stateTime[i] / 1000.0 * scale, _stateCharge[i] / 3600000.0 * scale);
+  }
+
+  printf("%-10s %12.1f %12.2f\n", "total", totalTime / 1000.0 * scale, mahPerDay);
+  printf("\naverage current   %.3f mA\n", mahPerDay / 24.0);
+  printf("battery life      %.1f days (%.0f mAh)\n", battery / mahPerDay, battery);
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the Adafruit IO Arduino library. It is always
+// connected; saved values are formatted (as the library does before
+// publishing) and counted but not sent anywhere.
+//
+#ifndef HOST_ADAFRUIT_IO_WIFI_H
+#define HOST_ADAFRUIT_IO_WIFI_H
+
+#include <Arduino.h>
+
+#define AIO_CONNECTED         21
+#define AIO_SSL_FINGERPRINT   "59 3C 48 0A B1 8B 39 4E 0D 58 50 47 9A 13 55 60 CC A0 1D AF"
+
+class AdafruitIO_Data
+{
+  public:
+    char* value() { return this->_value; }
+    char* toChar() { return this->_value; }
+    String toString() { return String(this->_value); }
+    int toInt() { return atoi(this->_value); }
+    unsigned int toUnsignedInt() { return (unsigned int)strtoul(this->_value, nullptr, 10); }
+    float toFloat() { return atof(this->_value); }
+    bool toBool() { return this->toInt() != 0; }
+    char* feedName() { return this->_feed; }
+
+    void hostSet(const char* feed, const char* value)
+    {
+      snprintf(this->_feed, sizeof(this->_feed), "%s", feed);
+      snprintf(this->_value, sizeof(this->_value), "%s", value);
+    }
+
+  private:
+    char _feed[64] = "";
+    char _value[64] = "";
+};
+
+typedef void (*AdafruitIODataCallbackType)(AdafruitIO_Data*);
+
+class AdafruitIO_Feed
+{
+  public:
+    AdafruitIO_Feed(const char* name) { snprintf(this->_name, sizeof(this->_name), "%s", name); }
+
+    bool save(const char* value, double = 0, double = 0, double = 0) { return this->publish(value); }
+    bool save(const String& value, double = 0, double = 0, double = 0) { return this->publish(value.c_str()); }
+    bool save(int value, double = 0, double = 0, double = 0) { return this->format("%d", value); }
+    bool save(unsigned int value, double = 0, double = 0, double = 0) { return this->format("%u", value); }
+    bool save(long value, double = 0, double = 0, double = 0) { return this->format("%ld", value); }
+    bool save(unsigned long value, double = 0, double = 0, double = 0) { return this->format("%lu", value); }
+    bool save(float value, double = 0, double = 0, double = 0, int precision = 6) { return this->format("%.*f", precision, (double)value); }
+    bool save(double value, double = 0, double = 0, double = 0, int precision = 6) { return this->format("%.*f", precision, value); }
+    bool save(uint8_t value, double = 0, double = 0, double = 0) { return this->format("%u", value); }
+    bool save(uint16_t value, double = 0, double = 0, double = 0) { return this->format("%u", value); }
+
+    void onMessage(AdafruitIODataCallbackType callback) { this->_callback = callback; }
+    bool get() { return true; }
+    const char* name() { return this->_name; }
+
+    // ***
+    // *** Delivers a message to the feed's callback as if it
+    // *** came from the broker.
+    // ***
+    void hostReceive(const char* value)
+    {
+      if (this->_callback)
+      {
+        AdafruitIO_Data data;
+        data.hostSet(this->_name, value);
+        this->_callback(&data);
+      }
+    }
+
+    static uint32_t hostGetPublishCount() { return _publishCount; }
+
+  private:
+    char _name[64];
+    char _value[32];
+    AdafruitIODataCallbackType _callback = nullptr;
+    static inline uint32_t _publishCount = 0;
+
+    template<typename... Arguments> bool format(const char* format, Arguments... arguments)
+    {
+      snprintf(this->_value, sizeof(this->_value), format, arguments...);
+      return this->publish(this->_value);
+    }
+
+    bool publish(const char*)
+    {
+      _publishCount++;
+      return true;
+    }
+};
+
+class AdafruitIO_WiFi
+{
+  public:
+    AdafruitIO_WiFi(const char*, const char*, const char*, const char*) {}
+    void connect() {}
+    int status() { return AIO_CONNECTED; }
+    const char* statusText() { return "Adafruit IO connected."; }
+    int run(uint16_t = 0, bool = false) { return AIO_CONNECTED; }
+    AdafruitIO_Feed* feed(const char* name) { return new AdafruitIO_Feed(name); }
+};
+
+#endif
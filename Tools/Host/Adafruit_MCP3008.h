@@ -0,0 +1,39 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the Adafruit MCP3008 library. Each channel
+// returns the code last set with hostSetCode().
+//
+#ifndef HOST_ADAFRUIT_MCP3008_H
+#define HOST_ADAFRUIT_MCP3008_H
+
+#include <Arduino.h>
+
+class Adafruit_MCP3008
+{
+  public:
+    bool begin(uint8_t = 15) { return true; }
+    int readADC(uint8_t channel) { return _codes[channel & 7]; }
+
+    static void hostSetCode(uint8_t channel, uint16_t code) { _codes[channel & 7] = code; }
+
+  private:
+    static inline uint16_t _codes[8] = {};
+};
+
+#endif
@@ -0,0 +1,87 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the Adafruit TSL2591 library. The sensor
+// reports the luminosity (IR << 16 | full) last set with
+// hostSetLuminosity(); lux is calculated as the library does.
+//
+#ifndef HOST_ADAFRUIT_TSL2591_H
+#define HOST_ADAFRUIT_TSL2591_H
+
+#include <Arduino.h>
+
+#define TSL2591_LUX_DF  408.0F
+
+typedef enum
+{
+  TSL2591_GAIN_LOW = 0x00,
+  TSL2591_GAIN_MED = 0x10,
+  TSL2591_GAIN_HIGH = 0x20,
+  TSL2591_GAIN_MAX = 0x30
+} tsl2591Gain_t;
+
+typedef enum
+{
+  TSL2591_INTEGRATIONTIME_100MS = 0x00,
+  TSL2591_INTEGRATIONTIME_200MS = 0x01,
+  TSL2591_INTEGRATIONTIME_300MS = 0x02,
+  TSL2591_INTEGRATIONTIME_400MS = 0x03,
+  TSL2591_INTEGRATIONTIME_500MS = 0x04,
+  TSL2591_INTEGRATIONTIME_600MS = 0x05
+} tsl2591IntegrationTime_t;
+
+class Adafruit_TSL2591
+{
+  public:
+    Adafruit_TSL2591(int32_t = -1) {}
+    bool begin() { return true; }
+    void setGain(tsl2591Gain_t gain) { this->_gain = gain; }
+    void setTiming(tsl2591IntegrationTime_t integration) { this->_integration = integration; }
+    uint32_t getFullLuminosity() { return _luminosity; }
+
+    float calculateLux(uint16_t ch0, uint16_t ch1)
+    {
+      if ((ch0 == 0xFFFF) | (ch1 == 0xFFFF))
+      {
+        return -1;
+      }
+
+      float atime = (this->_integration + 1) * 100.0F;
+      float again = 1.0F;
+
+      switch (this->_gain)
+      {
+        case TSL2591_GAIN_LOW: again = 1.0F; break;
+        case TSL2591_GAIN_MED: again = 25.0F; break;
+        case TSL2591_GAIN_HIGH: again = 428.0F; break;
+        case TSL2591_GAIN_MAX: again = 9876.0F; break;
+      }
+
+      float cpl = (atime * again) / TSL2591_LUX_DF;
+      return (((float)ch0 - (float)ch1)) * (1.0F - ((float)ch1 / (float)ch0)) / cpl;
+    }
+
+    static void hostSetLuminosity(uint32_t luminosity) { _luminosity = luminosity; }
+
+  private:
+    tsl2591Gain_t _gain = TSL2591_GAIN_MED;
+    tsl2591IntegrationTime_t _integration = TSL2591_INTEGRATIONTIME_100MS;
+    static inline uint32_t _luminosity = 0;
+};
+
+#endif
@@ -0,0 +1,310 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// A minimal stand-in for the ESP8266 Arduino core so that the
+// firmware classes can be compiled and run on Linux by the tools
+// in this folder. Only what the firmware uses is provided. Time
+// comes from a virtual clock when hostSetVirtualTime() is used,
+// otherwise from the system's monotonic clock.
+//
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+using std::isnan;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH            1
+#define LOW             0
+#define INPUT           0
+#define OUTPUT          1
+#define DEC             10
+#define HEX             16
+#define PWMRANGE        1023
+
+#define PROGMEM
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+#define PSTR(s)         (s)
+#define F(s)            ((const __FlashStringHelper*)(s))
+#define PGM_P           const char*
+#define FPSTR(p)        ((const __FlashStringHelper*)(p))
+#define pgm_read_byte(p)  (*(const uint8_t*)(p))
+#define pgm_read_word(p)  (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_float(p) (*(const float*)(p))
+#define pgm_read_ptr(p)   (*(void* const*)(p))
+#define strlen_P        strlen
+#define strcpy_P        strcpy
+#define strncpy_P       strncpy
+#define strcmp_P        strcmp
+#define strncmp_P       strncmp
+#define memcpy_P        memcpy
+#define snprintf_P      snprintf
+#define RANDOM_REG32    ((uint32_t)random())
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+class __FlashStringHelper;
+
+// ***
+// *** Arduino String backed by std::string.
+// ***
+class String
+{
+  public:
+    String() {}
+    String(const char* value) : _value(value ? value : "") {}
+    String(const __FlashStringHelper* value) : _value((const char*)value) {}
+    String(const std::string& value) : _value(value) {}
+    String(char value) : _value(1, value) {}
+    String(int value, unsigned char base = DEC) { this->format(base == HEX ? "%x" : "%d", value); }
+    String(unsigned int value, unsigned char base = DEC) { this->format(base == HEX ? "%x" : "%u", value); }
+    String(long value, unsigned char base = DEC) { this->format(base == HEX ? "%lx" : "%ld", value); }
+    String(unsigned long value, unsigned char base = DEC) { this->format(base == HEX ? "%lx" : "%lu", value); }
+    String(float value, unsigned char decimals = 2) { this->format("%.*f", decimals, (double)value); }
+    String(double value, unsigned char decimals = 2) { this->format("%.*f", decimals, value); }
+
+    const char* c_str() const { return this->_value.c_str(); }
+    unsigned int length() const { return this->_value.length(); }
+    bool reserve(unsigned int size) { this->_value.reserve(size); return true; }
+    bool equals(const char* other) const { return this->_value == other; }
+    bool startsWith(const char* prefix) const { return this->_value.compare(0, strlen(prefix), prefix) == 0; }
+    int indexOf(char c) const { size_t i = this->_value.find(c); return i == std::string::npos ? -1 : (int)i; }
+    String substring(unsigned int from) const { return String(this->_value.substr(from)); }
+    String substring(unsigned int from, unsigned int to) const { return String(this->_value.substr(from, to - from)); }
+    char charAt(unsigned int index) const { return this->_value[index]; }
+    long toInt() const { return atol(this->_value.c_str()); }
+    float toFloat() const { return atof(this->_value.c_str()); }
+
+    bool operator==(const String& other) const { return this->_value == other._value; }
+    bool operator==(const char* other) const { return this->_value == other; }
+    bool operator!=(const char* other) const { return this->_value != other; }
+    String& operator+=(const String& other) { this->_value += other._value; return *this; }
+    String& operator+=(const char* other) { this->_value += other; return *this; }
+    String& operator+=(char other) { this->_value += other; return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a._value + b._value); }
+    friend String operator+(const String& a, const char* b) { return String(a._value + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b._value); }
+
+  private:
+    std::string _value;
+
+    template<typename... Arguments> void format(const char* format, Arguments... arguments)
+    {
+      char buffer[48];
+      snprintf(buffer, sizeof(buffer), format, arguments...);
+      this->_value = buffer;
+    }
+};
+
+// ***
+// *** Print and Stream.
+// ***
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* text) { return this->write((const uint8_t*)text, strlen(text)); }
+
+    size_t print(const char* value) { return this->write(value); }
+    size_t print(const __FlashStringHelper* value) { return this->write((const char*)value); }
+    size_t print(const String& value) { return this->write(value.c_str()); }
+    size_t print(char value) { return this->write((uint8_t)value); }
+    size_t print(int value, int base = DEC) { return this->print(String(value, base)); }
+    size_t print(unsigned int value, int base = DEC) { return this->print(String(value, base)); }
+    size_t print(long value, int base = DEC) { return this->print(String(value, base)); }
+    size_t print(unsigned long value, int base = DEC) { return this->print(String(value, base)); }
+    size_t print(unsigned char value, int base = DEC) { return this->print(String((unsigned int)value, base)); }
+    size_t print(double value, int decimals = 2) { return this->print(String(value, decimals)); }
+
+    template<typename T> size_t println(T value) { return this->print(value) + this->println(); }
+    template<typename T> size_t println(T value, int format) { return this->print(value, format) + this->println(); }
+    size_t println() { return this->write("\r\n"); }
+
+    virtual void flush() {}
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() { return -1; }
+    void setTimeout(unsigned long) {}
+};
+
+// ***
+// *** Serial writes to stdout and reads from stdin (non-blocking).
+// ***
+class HardwareSerial : public Stream
+{
+  public:
+    void begin(unsigned long) {}
+    operator bool() { return true; }
+    size_t write(uint8_t value);
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+    int available();
+    int read();
+};
+
+extern HardwareSerial Serial;
+
+// ***
+// *** Turns the serial port off (output is discarded and
+// *** nothing is read), e.g. while benchmarking.
+// ***
+void hostSetSerialEnabled(bool enabled);
+
+// ***
+// *** Reset reasons (user_interface.h) and deep sleep radio modes.
+// ***
+enum rst_reason {
+  REASON_DEFAULT_RST = 0,
+  REASON_WDT_RST = 1,
+  REASON_EXCEPTION_RST = 2,
+  REASON_SOFT_WDT_RST = 3,
+  REASON_SOFT_RESTART = 4,
+  REASON_DEEP_SLEEP_AWAKE = 5,
+  REASON_EXT_SYS_RST = 6
+};
+
+struct rst_info
+{
+  uint32_t reason;
+  uint32_t exccause;
+  uint32_t epc1;
+  uint32_t epc2;
+  uint32_t epc3;
+  uint32_t excvaddr;
+  uint32_t depc;
+};
+
+enum RFMode {
+  RF_DEFAULT = 0,
+  RF_CAL = 1,
+  RF_NO_CAL = 2,
+  RF_DISABLED = 4
+};
+
+#define WAKE_RF_DEFAULT  RF_DEFAULT
+#define WAKE_RFCAL       RF_CAL
+#define WAKE_NO_RFCAL    RF_NO_CAL
+#define WAKE_RF_DISABLED RF_DISABLED
+
+// ***
+// *** ESP class.
+// ***
+class EspClass
+{
+  public:
+    uint32_t getChipId() { return 0x00C0FFEE; }
+    uint32_t getFlashChipId() { return 0x001640EF; }
+    uint32_t getFreeHeap() { return 40000; }
+    uint32_t getMaxFreeBlockSize() { return 32000; }
+    uint32_t getCycleCount();
+    String getResetReason() { return "External System"; }
+    void restart() { exit(0); }
+    void wdtFeed() {}
+    void wdtEnable(uint32_t) {}
+    void wdtDisable() {}
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+    void deepSleep(uint64_t microseconds, RFMode mode = RF_DEFAULT);
+    uint64_t deepSleepMax() { return 3ULL * 3600 * 1000000; }
+    rst_info* getResetInfoPtr();
+    uint32_t getSketchSize();
+    uint32_t getFreeSketchSpace() { return 1024 * 1024; }
+    bool flashRead(uint32_t address, uint32_t* data, size_t size);
+};
+
+extern EspClass ESP;
+
+// ***
+// *** The reason reported for the last reset. Deep sleep sets
+// *** it to REASON_DEEP_SLEEP_AWAKE and returns the radio mode
+// *** requested for the wake up.
+// ***
+void hostSetResetReason(enum rst_reason reason);
+RFMode hostGetWakeMode();
+
+// ***
+// *** The running firmware, which the flash (from address 0)
+// *** holds. It is empty until set; a completed update replaces
+// *** it (see Updater.h).
+// ***
+void hostSetSketch(const uint8_t* data, size_t size);
+
+// ***
+// *** Time.
+// ***
+unsigned long millis();
+unsigned long micros();
+uint64_t micros64();
+void delay(unsigned long milliseconds);
+void delayMicroseconds(unsigned int microseconds);
+void yield();
+
+// ***
+// *** Switches time to a virtual clock (used for replay). Delays
+// *** then advance the virtual clock instead of sleeping.
+// ***
+void hostSetVirtualTime(uint64_t microseconds);
+void hostAdvanceVirtualTime(uint64_t microseconds);
+bool hostIsVirtualTime();
+
+// ***
+// *** Pins. The last value written to each pin is kept.
+// ***
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+int hostGetPinValue(uint8_t pin);
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+// ***
+// *** Timers are not used on the host.
+// ***
+typedef void (*os_timer_func_t)(void*);
+typedef struct os_timer { int unused; } os_timer_t;
+inline void os_timer_setfn(os_timer_t*, os_timer_func_t, void*) {}
+inline void os_timer_arm(os_timer_t*, uint32_t, bool) {}
+inline void os_timer_disarm(os_timer_t*) {}
+
+void configTime(int timezone, int daylightOffset, const char* server1, const char* server2 = nullptr, const char* server3 = nullptr);
+
+#endif
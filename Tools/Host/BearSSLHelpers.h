@@ -0,0 +1,109 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the BearSSL helpers of the ESP8266 core
+// (SHA-256, public keys and signature checks), built on OpenSSL.
+// A tool that uses them links with -lcrypto.
+//
+#ifndef HOST_BEARSSL_HELPERS_H
+#define HOST_BEARSSL_HELPERS_H
+
+#include <Updater.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <string.h>
+
+namespace BearSSL
+{
+  class PublicKey
+  {
+    public:
+      PublicKey(const char* pemKey)
+      {
+        BIO* bio = BIO_new_mem_buf(pemKey, -1);
+        _key = bio ? PEM_read_bio_PUBKEY(bio, NULL, NULL, NULL) : NULL;
+        BIO_free(bio);
+      }
+
+      ~PublicKey() { EVP_PKEY_free(_key); }
+
+      bool isRSA() { return _key && EVP_PKEY_get_base_id(_key) == EVP_PKEY_RSA; }
+      bool isEC() { return _key && EVP_PKEY_get_base_id(_key) == EVP_PKEY_EC; }
+      EVP_PKEY* hostGetKey() { return _key; }
+
+    private:
+      EVP_PKEY* _key;
+  };
+
+  class HashSHA256 : public UpdaterHashClass
+  {
+    public:
+      HashSHA256() { _context = EVP_MD_CTX_new(); }
+      ~HashSHA256() { EVP_MD_CTX_free(_context); }
+
+      void begin() override { EVP_DigestInit_ex(_context, EVP_sha256(), NULL); }
+      void add(const void* data, uint32_t length) override { EVP_DigestUpdate(_context, data, length); }
+      void end() override { EVP_DigestFinal_ex(_context, _hash, NULL); }
+      int len() override { return sizeof(_hash); }
+      const void* hash() override { return _hash; }
+      const unsigned char* oid() override { return NULL; }
+
+    private:
+      EVP_MD_CTX* _context;
+      uint8_t _hash[32];
+  };
+
+  class SigningVerifier : public UpdaterVerifyClass
+  {
+    public:
+      SigningVerifier(PublicKey* key) : _key(key) {}
+
+      uint32_t length() override
+      {
+        return _key->isRSA() ? (uint32_t)EVP_PKEY_get_size(_key->hostGetKey()) : 0;
+      }
+
+      // ***
+      // *** As on the device, an RSA signature is PKCS #1 v1.5 over
+      // *** the SHA-256 of the data and must be the size of the key.
+      // ***
+      bool verify(UpdaterHashClass* hash, const void* signature, uint32_t signatureLength) override
+      {
+        bool returnValue = false;
+
+        if (hash && signature && signatureLength > 0 && signatureLength == this->length())
+        {
+          EVP_PKEY_CTX* context = EVP_PKEY_CTX_new(_key->hostGetKey(), NULL);
+
+          returnValue = context && EVP_PKEY_verify_init(context) == 1 && EVP_PKEY_CTX_set_rsa_padding(context, RSA_PKCS1_PADDING) == 1 &&
+                        EVP_PKEY_CTX_set_signature_md(context, EVP_sha256()) == 1 &&
+                        EVP_PKEY_verify(context, (const unsigned char*)signature, signatureLength, (const unsigned char*)hash->hash(), hash->len()) == 1;
+
+          EVP_PKEY_CTX_free(context);
+        }
+
+        return returnValue;
+      }
+
+    private:
+      PublicKey* _key;
+  };
+}
+
+#endif
@@ -0,0 +1,50 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the DHT sensor library for ESPx. The
+// sensor reports the reading last set with hostSetReading().
+//
+#ifndef HOST_DHTESP_H
+#define HOST_DHTESP_H
+
+#include <Arduino.h>
+
+struct TempAndHumidity
+{
+  float temperature;
+  float humidity;
+};
+
+class DHTesp
+{
+  public:
+    enum DHT_MODEL_t { AUTO_DETECT, DHT11, DHT22, AM2302, RHT03 };
+    enum DHT_ERROR_t { ERROR_NONE = 0, ERROR_TIMEOUT, ERROR_CHECKSUM };
+
+    void setup(uint8_t, DHT_MODEL_t) {}
+    TempAndHumidity getTempAndHumidity() { return _reading; }
+    DHT_ERROR_t getStatus() { return isnan(_reading.temperature) ? ERROR_TIMEOUT : ERROR_NONE; }
+    int getMinimumSamplingPeriod() { return 2000; }
+
+    static void hostSetReading(float temperature, float humidity) { _reading.temperature = temperature; _reading.humidity = humidity; }
+
+  private:
+    static inline TempAndHumidity _reading = { NAN, NAN };
+};
+
+#endif
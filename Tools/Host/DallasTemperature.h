@@ -0,0 +1,51 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the Dallas Temperature library. The
+// sensor reports the raw value (1/128 °C) last set with
+// hostSetRaw().
+//
+#ifndef HOST_DALLAS_TEMPERATURE_H
+#define HOST_DALLAS_TEMPERATURE_H
+
+#include <OneWire.h>
+
+#define DEVICE_DISCONNECTED_C     -127
+#define DEVICE_DISCONNECTED_RAW   -7040
+
+typedef uint8_t DeviceAddress[8];
+
+class DallasTemperature
+{
+  public:
+    DallasTemperature() {}
+    void setOneWire(OneWire*) {}
+    void begin() {}
+    void requestTemperatures() {}
+    void setWaitForConversion(bool) {}
+    bool isConversionComplete() { return true; }
+    float getTempCByIndex(uint8_t) { return rawToCelsius(_raw); }
+    static float rawToCelsius(int16_t raw) { return raw * 0.0078125; }
+
+    static void hostSetRaw(int16_t raw) { _raw = raw; }
+
+  private:
+    static inline int16_t _raw = DEVICE_DISCONNECTED_C * 128;
+};
+
+#endif
@@ -0,0 +1,65 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the ESP8266 EEPROM library, which keeps a copy
+// of a flash sector in RAM and writes it back on commit(). Here the
+// sector only lives in memory; the commits are counted so that
+// tools can see how often the firmware would write the flash.
+//
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <Arduino.h>
+
+#define HOST_EEPROM_SIZE  4096
+
+class EEPROMClass
+{
+  public:
+    void begin(size_t size) { _size = size < HOST_EEPROM_SIZE ? size : HOST_EEPROM_SIZE; }
+    bool commit() { _commitCount++; return _size > 0; }
+    bool end() { bool returnValue = this->commit(); _size = 0; return returnValue; }
+    uint8_t read(int address) { return _data[address]; }
+    void write(int address, uint8_t value) { _data[address] = value; }
+    uint8_t* getDataPtr() { return _data; }
+    size_t length() { return _size; }
+
+    template<typename T> T& get(int address, T& value)
+    {
+      memcpy(&value, _data + address, sizeof(T));
+      return value;
+    }
+
+    template<typename T> const T& put(int address, const T& value)
+    {
+      memcpy(_data + address, &value, sizeof(T));
+      return value;
+    }
+
+    static uint32_t hostGetCommitCount() { return _commitCount; }
+    static void hostErase() { memset(_data, 0xFF, sizeof(_data)); }
+
+  private:
+    static inline uint8_t _data[HOST_EEPROM_SIZE] = {};
+    static inline size_t _size = 0;
+    static inline uint32_t _commitCount = 0;
+};
+
+inline EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,153 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for ESP8266HTTPClient. Nothing is sent; each
+// request is answered with the code set by hostSetResponse()
+// (200 by default) and the request is kept (without allocating,
+// so that it does not count in benchmarks) for tools to inspect.
+//
+// When a document root is set, GET serves the file named by the
+// path of the URL from that folder instead (404 if there is no
+// such file), like a local update server. The response can be
+// cut short to test failed transfers, and with the virtual clock
+// reading it takes the time it would over a link of the given
+// rate.
+//
+#ifndef HOST_ESP8266_HTTP_CLIENT_H
+#define HOST_ESP8266_HTTP_CLIENT_H
+
+#include <ESP8266WiFi.h>
+#include <string>
+
+#define HTTP_CODE_OK                    200
+#define HTTP_CODE_NOT_MODIFIED          304
+#define HTTP_CODE_NOT_FOUND             404
+#define HTTPC_ERROR_CONNECTION_REFUSED  -1
+#define HTTPC_ERROR_STREAM_WRITE        -10
+#define HTTPC_ERROR_READ_TIMEOUT        -11
+
+#define HOST_HTTP_CHUNK_SIZE            1460
+
+class HTTPClient
+{
+  public:
+    bool begin(WiFiClient& client, const String& url) { return this->begin(client, url.c_str()); }
+    bool begin(WiFiClient&, const char* url) { snprintf(_url, sizeof(_url), "%s", url); return true; }
+    void addHeader(const String&, const String&) {}
+    void setTimeout(uint16_t) {}
+    void setReuse(bool) {}
+    void end() {}
+
+    int POST(const uint8_t* body, size_t length)
+    {
+      _bodyLength = length < sizeof(_body) ? length : sizeof(_body) - 1;
+      memcpy(_body, body, _bodyLength);
+      _body[_bodyLength] = 0;
+      _requestCount++;
+      return _responseCode;
+    }
+
+    int POST(const String& body) { return this->POST((const uint8_t*)body.c_str(), body.length()); }
+    int GET()
+    {
+      int returnValue = _responseCode;
+
+      _body[0] = 0;
+      _bodyLength = 0;
+      _document.clear();
+      _requestCount++;
+
+      if (!_root.empty())
+      {
+        const char* path = strstr(_url, "://");
+        path = path ? strchr(path + 3, '/') : nullptr;
+        FILE* file = path ? fopen((_root + path).c_str(), "rb") : nullptr;
+        returnValue = file ? HTTP_CODE_OK : HTTP_CODE_NOT_FOUND;
+
+        if (file)
+        {
+          char buffer[4096];
+          size_t length;
+
+          while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+          {
+            _document.append(buffer, length);
+          }
+
+          fclose(file);
+        }
+      }
+
+      return returnValue;
+    }
+
+    String getString() { return String(_document); }
+    int getSize() { return _root.empty() ? 0 : (int)_document.size(); }
+
+    // ***
+    // *** Sends the response body to the stream a segment at a time
+    // *** and returns the number of bytes sent or an error.
+    // ***
+    int writeToStream(Stream* stream)
+    {
+      size_t limit = _document.size() < _readLimit ? _document.size() : _readLimit;
+      size_t position = 0;
+      bool isWritten = true;
+
+      while (isWritten && position < limit)
+      {
+        size_t length = std::min((size_t)HOST_HTTP_CHUNK_SIZE, limit - position);
+
+        if (_linkRate > 0 && hostIsVirtualTime())
+        {
+          hostAdvanceVirtualTime((uint64_t)length * 1000000 / _linkRate);
+        }
+
+        isWritten = (stream->write((const uint8_t*)_document.data() + position, length) == length);
+        position += isWritten ? length : 0;
+        _bytesSent += isWritten ? length : 0;
+      }
+
+      return !isWritten ? HTTPC_ERROR_STREAM_WRITE : (position < _document.size() ? HTTPC_ERROR_READ_TIMEOUT : (int)position);
+    }
+    static String errorToString(int) { return String("host error"); }
+
+    static void hostSetResponse(int code) { _responseCode = code; }
+    static const char* hostGetLastUrl() { return _url; }
+    static const char* hostGetLastBody() { return _body; }
+    static size_t hostGetLastBodyLength() { return _bodyLength; }
+    static uint32_t hostGetRequestCount() { return _requestCount; }
+    static void hostSetDocumentRoot(const char* root) { _root = root ? root : ""; }
+    static void hostSetReadLimit(size_t limit) { _readLimit = limit; }
+    static void hostSetLinkRate(uint32_t bytesPerSecond) { _linkRate = bytesPerSecond; }
+    static uint64_t hostGetBytesSent() { return _bytesSent; }
+
+  private:
+    static inline int _responseCode = HTTP_CODE_OK;
+    static inline char _url[256] = "";
+    static inline char _body[4096] = "";
+    static inline size_t _bodyLength = 0;
+    static inline uint32_t _requestCount = 0;
+    static inline std::string _root;
+    static inline std::string _document;
+    static inline size_t _readLimit = SIZE_MAX;
+    static inline uint32_t _linkRate = 0;
+    static inline uint64_t _bytesSent = 0;
+};
+
+#endif
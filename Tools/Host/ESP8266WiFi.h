@@ -0,0 +1,104 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the ESP8266 WiFi library. WiFiServer and
+// WiFiClient are non-blocking POSIX TCP sockets and WiFiUDP is a
+// POSIX UDP socket, so the firmware's network code can be tested
+// on Linux with the usual tools (curl, the collector, etc.).
+//
+#ifndef HOST_ESP8266_WIFI_H
+#define HOST_ESP8266_WIFI_H
+
+#include <Arduino.h>
+#include <memory>
+
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+enum WiFiMode_t { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA };
+enum WiFiSleepType_t { WIFI_NONE_SLEEP, WIFI_LIGHT_SLEEP, WIFI_MODEM_SLEEP };
+
+class IPAddress
+{
+  public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _address((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    bool fromString(const char* text);
+    String toString() const;
+    operator uint32_t() const { return this->_address; }
+
+  private:
+    uint32_t _address = 0;
+};
+
+class WiFiClient : public Stream
+{
+  public:
+    WiFiClient() {}
+    explicit WiFiClient(int socket);
+    size_t write(uint8_t value) { return this->write(&value, 1); }
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+    int available();
+    int read();
+    int read(uint8_t* buffer, size_t size);
+    int connect(const char* host, uint16_t port);
+    uint8_t connected();
+    size_t availableForWrite();
+    void stop();
+    void setNoDelay(bool) {}
+    operator bool() { return this->connected() || this->available() > 0; }
+
+  private:
+    // ***
+    // *** Copies share the socket like they do on the ESP8266.
+    // ***
+    std::shared_ptr<int> _socket;
+};
+
+class WiFiServer
+{
+  public:
+    WiFiServer(uint16_t port) : _port(port) {}
+    void begin();
+    void setNoDelay(bool) {}
+    WiFiClient available();
+
+  private:
+    uint16_t _port;
+    int _socket = -1;
+};
+
+class ESP8266WiFiClass
+{
+  public:
+    int status() { return WL_CONNECTED; }
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+    int32_t RSSI() { return -55; }
+    bool mode(WiFiMode_t) { return true; }
+    bool forceSleepBegin(uint32_t = 0) { return true; }
+    bool forceSleepWake() { return true; }
+    bool setSleepMode(WiFiSleepType_t, uint8_t = 0) { return true; }
+    bool disconnect(bool = false) { return true; }
+    bool persistent(bool) { return true; }
+    int begin() { return WL_CONNECTED; }
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,312 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include <Arduino.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <vector>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+// ***
+// *** Virtual clock used for replay; zero based.
+// ***
+static bool _isVirtualTime = false;
+static uint64_t _virtualTime = 0;
+
+// ***
+// *** The serial port can be turned off.
+// ***
+static bool _isSerialEnabled = true;
+
+// ***
+// *** Last value written to each pin.
+// ***
+static int _pins[32];
+
+// ***
+// *** 512 bytes of user RTC memory, like the ESP8266.
+// ***
+static uint32_t _rtcMemory[128];
+
+// ***
+// *** The reason for the last reset and the radio
+// *** mode requested by the last deep sleep.
+// ***
+static rst_info _resetInfo = { REASON_DEFAULT_RST, 0, 0, 0, 0, 0, 0 };
+static RFMode _wakeMode = RF_DEFAULT;
+
+// ***
+// *** The running firmware.
+// ***
+static std::vector<uint8_t> _sketch;
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+  size_t returnValue = 0;
+
+  for (size_t i = 0; i < size; i++)
+  {
+    returnValue += this->write(buffer[i]);
+  }
+
+  return returnValue;
+}
+
+size_t HardwareSerial::write(uint8_t value)
+{
+  return _isSerialEnabled ? fwrite(&value, 1, 1, stdout) : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+  return _isSerialEnabled ? fwrite(buffer, 1, size, stdout) : size;
+}
+
+int HardwareSerial::available()
+{
+  if (!_isSerialEnabled)
+  {
+    return 0;
+  }
+
+  struct pollfd descriptor = { STDIN_FILENO, POLLIN, 0 };
+  return (poll(&descriptor, 1, 0) > 0 && (descriptor.revents & POLLIN)) ? 1 : 0;
+}
+
+int HardwareSerial::read()
+{
+  uint8_t value = 0;
+  return (this->available() && ::read(STDIN_FILENO, &value, 1) == 1) ? value : -1;
+}
+
+void hostSetSerialEnabled(bool enabled)
+{
+  _isSerialEnabled = enabled;
+}
+
+uint32_t EspClass::getCycleCount()
+{
+  // ***
+  // *** The ESP8266 runs at 80 MHz.
+  // ***
+  return (uint32_t)(micros64() * 80);
+}
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size)
+{
+  bool returnValue = false;
+
+  if ((offset * 4) + size <= sizeof(_rtcMemory))
+  {
+    memcpy(data, &_rtcMemory[offset], size);
+    returnValue = true;
+  }
+
+  return returnValue;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size)
+{
+  bool returnValue = false;
+
+  if ((offset * 4) + size <= sizeof(_rtcMemory))
+  {
+    memcpy(&_rtcMemory[offset], data, size);
+    returnValue = true;
+  }
+
+  return returnValue;
+}
+
+void EspClass::deepSleep(uint64_t microseconds, RFMode mode)
+{
+  // ***
+  // *** RTC memory survives; the program does not. With the
+  // *** virtual clock the caller is expected to start the program
+  // *** again; time restarts from zero as it does after a reset.
+  // ***
+  if (_isVirtualTime)
+  {
+    _virtualTime = 0;
+  }
+  else
+  {
+    usleep(microseconds);
+  }
+
+  _resetInfo.reason = REASON_DEEP_SLEEP_AWAKE;
+  _wakeMode = mode;
+}
+
+rst_info* EspClass::getResetInfoPtr()
+{
+  return &_resetInfo;
+}
+
+void hostSetResetReason(enum rst_reason reason)
+{
+  _resetInfo.reason = reason;
+}
+
+RFMode hostGetWakeMode()
+{
+  return _wakeMode;
+}
+
+uint32_t EspClass::getSketchSize()
+{
+  return _sketch.size();
+}
+
+// ***
+// *** As on the device, the address and size must be multiples
+// *** of four.
+// ***
+bool EspClass::flashRead(uint32_t address, uint32_t* data, size_t size)
+{
+  bool returnValue = false;
+
+  if ((address % 4) == 0 && (size % 4) == 0)
+  {
+    for (size_t i = 0; i < size; i++)
+    {
+      ((uint8_t*)data)[i] = (address + i < _sketch.size()) ? _sketch[address + i] : 0xFF;
+    }
+
+    returnValue = true;
+  }
+
+  return returnValue;
+}
+
+void hostSetSketch(const uint8_t* data, size_t size)
+{
+  _sketch.assign(data, data + size);
+}
+
+uint64_t micros64()
+{
+  uint64_t returnValue = _virtualTime;
+
+  if (!_isVirtualTime)
+  {
+    static uint64_t start = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = ((uint64_t)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+
+    if (start == 0)
+    {
+      start = now;
+    }
+
+    returnValue = now - start;
+  }
+
+  return returnValue;
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(uint32_t)(micros64() / 1000);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)(uint32_t)micros64();
+}
+
+void delay(unsigned long milliseconds)
+{
+  delayMicroseconds(milliseconds * 1000);
+}
+
+void delayMicroseconds(unsigned int microseconds)
+{
+  if (_isVirtualTime)
+  {
+    _virtualTime += microseconds;
+  }
+  else
+  {
+    usleep(microseconds);
+  }
+}
+
+void yield()
+{
+  // ***
+  // *** Busy waits on yield() must still make progress
+  // *** under the virtual clock.
+  // ***
+  if (_isVirtualTime)
+  {
+    _virtualTime += 1000;
+  }
+}
+
+void hostSetVirtualTime(uint64_t microseconds)
+{
+  _isVirtualTime = true;
+  _virtualTime = microseconds;
+}
+
+void hostAdvanceVirtualTime(uint64_t microseconds)
+{
+  _virtualTime += microseconds;
+}
+
+bool hostIsVirtualTime()
+{
+  return _isVirtualTime;
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  _pins[pin % 32] = value ? PWMRANGE : 0;
+}
+
+int digitalRead(uint8_t pin)
+{
+  return _pins[pin % 32] ? HIGH : LOW;
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+  _pins[pin % 32] = value;
+}
+
+int hostGetPinValue(uint8_t pin)
+{
+  return _pins[pin % 32];
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+void configTime(int, int, const char*, const char*, const char*)
+{
+}
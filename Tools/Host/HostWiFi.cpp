@@ -0,0 +1,304 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/sockios.h>
+
+ESP8266WiFiClass WiFi;
+
+bool IPAddress::fromString(const char* text)
+{
+  struct in_addr address;
+  bool returnValue = (inet_pton(AF_INET, text, &address) == 1);
+
+  if (returnValue)
+  {
+    this->_address = address.s_addr;
+  }
+
+  return returnValue;
+}
+
+String IPAddress::toString() const
+{
+  struct in_addr address;
+  address.s_addr = this->_address;
+  return String(inet_ntoa(address));
+}
+
+WiFiClient::WiFiClient(int socket) : _socket(new int(socket))
+{
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size)
+{
+  ssize_t returnValue = -1;
+
+  if (this->_socket && *this->_socket >= 0)
+  {
+    returnValue = send(*this->_socket, buffer, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+
+  return returnValue < 0 ? 0 : returnValue;
+}
+
+int WiFiClient::available()
+{
+  int returnValue = 0;
+
+  if (this->_socket && *this->_socket >= 0)
+  {
+    ioctl(*this->_socket, FIONREAD, &returnValue);
+  }
+
+  return returnValue;
+}
+
+int WiFiClient::read()
+{
+  uint8_t value = 0;
+  return this->read(&value, 1) == 1 ? value : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size)
+{
+  ssize_t returnValue = -1;
+
+  if (this->_socket && *this->_socket >= 0)
+  {
+    returnValue = recv(*this->_socket, buffer, size, MSG_DONTWAIT);
+  }
+
+  return (int)returnValue;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port)
+{
+  int returnValue = 0;
+
+  struct addrinfo hints;
+  struct addrinfo* result = nullptr;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+
+  if (getaddrinfo(host, service, &hints, &result) == 0)
+  {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (::connect(s, result->ai_addr, result->ai_addrlen) == 0)
+    {
+      this->_socket.reset(new int(s));
+      returnValue = 1;
+    }
+    else
+    {
+      close(s);
+    }
+
+    freeaddrinfo(result);
+  }
+
+  return returnValue;
+}
+
+uint8_t WiFiClient::connected()
+{
+  uint8_t returnValue = 0;
+
+  if (this->_socket && *this->_socket >= 0)
+  {
+    // ***
+    // *** A readable socket with nothing to read has been closed.
+    // ***
+    struct pollfd descriptor = { *this->_socket, POLLIN, 0 };
+    returnValue = !(poll(&descriptor, 1, 0) > 0 && (descriptor.revents & (POLLIN | POLLHUP)) && this->available() == 0);
+  }
+
+  return returnValue;
+}
+
+size_t WiFiClient::availableForWrite()
+{
+  size_t returnValue = 0;
+
+  if (this->_socket && *this->_socket >= 0)
+  {
+    int size = 0;
+    int queued = 0;
+    socklen_t length = sizeof(size);
+    getsockopt(*this->_socket, SOL_SOCKET, SO_SNDBUF, &size, &length);
+    ioctl(*this->_socket, SIOCOUTQ, &queued);
+    returnValue = (size > queued) ? (size - queued) : 0;
+
+    // ***
+    // *** Use the ESP8266's TCP window so that the host exercises
+    // *** the same partial write path as the device.
+    // ***
+    returnValue = std::min(returnValue, (size_t)1460);
+  }
+
+  return returnValue;
+}
+
+void WiFiClient::stop()
+{
+  if (this->_socket && *this->_socket >= 0)
+  {
+    close(*this->_socket);
+    *this->_socket = -1;
+  }
+}
+
+void WiFiServer::begin()
+{
+  this->_socket = socket(AF_INET, SOCK_STREAM, 0);
+
+  int on = 1;
+  setsockopt(this->_socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(this->_port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  if (bind(this->_socket, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(this->_socket, 4) != 0)
+  {
+    perror("WiFiServer");
+    exit(1);
+  }
+
+  fcntl(this->_socket, F_SETFL, O_NONBLOCK);
+}
+
+WiFiClient WiFiServer::available()
+{
+  int s = accept(this->_socket, nullptr, nullptr);
+  return (s >= 0) ? WiFiClient(s) : WiFiClient();
+}
+
+WiFiUDP::~WiFiUDP()
+{
+  if (this->_socket >= 0)
+  {
+    close(this->_socket);
+  }
+}
+
+void WiFiUDP::open()
+{
+  if (this->_socket < 0)
+  {
+    this->_socket = socket(AF_INET, SOCK_DGRAM, 0);
+  }
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+  this->open();
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  return bind(this->_socket, (struct sockaddr*)&address, sizeof(address)) == 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress address, uint16_t port)
+{
+  this->open();
+  this->_address = (uint32_t)address;
+  this->_port = port;
+  this->_outgoing.clear();
+  return 1;
+}
+
+int WiFiUDP::beginPacketMulticast(IPAddress address, uint16_t port, IPAddress, int ttl)
+{
+  this->open();
+  setsockopt(this->_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+  return this->beginPacket(address, port);
+}
+
+size_t WiFiUDP::write(const uint8_t* buffer, size_t size)
+{
+  this->_outgoing.append((const char*)buffer, size);
+  return size;
+}
+
+int WiFiUDP::endPacket()
+{
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(this->_port);
+  address.sin_addr.s_addr = this->_address;
+
+  return sendto(this->_socket, this->_outgoing.data(), this->_outgoing.size(), 0, (struct sockaddr*)&address, sizeof(address)) >= 0;
+}
+
+int WiFiUDP::parsePacket()
+{
+  int returnValue = 0;
+  char buffer[1500];
+
+  ssize_t size = recv(this->_socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+  if (size > 0)
+  {
+    this->_incoming.assign(buffer, size);
+    this->_incomingRead = 0;
+    returnValue = size;
+  }
+
+  return returnValue;
+}
+
+int WiFiUDP::available()
+{
+  return this->_incoming.size() - this->_incomingRead;
+}
+
+int WiFiUDP::read()
+{
+  return this->available() > 0 ? (uint8_t)this->_incoming[this->_incomingRead++] : -1;
+}
+
+int WiFiUDP::read(uint8_t* buffer, size_t size)
+{
+  size_t count = std::min(size, (size_t)this->available());
+  memcpy(buffer, this->_incoming.data() + this->_incomingRead, count);
+  this->_incomingRead += count;
+  return count;
+}
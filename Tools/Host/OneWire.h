@@ -0,0 +1,34 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the OneWire library.
+//
+#ifndef HOST_ONE_WIRE_H
+#define HOST_ONE_WIRE_H
+
+#include <Arduino.h>
+
+class OneWire
+{
+  public:
+    OneWire() {}
+    OneWire(uint8_t) {}
+    void begin(uint8_t) {}
+};
+
+#endif
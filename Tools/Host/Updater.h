@@ -0,0 +1,147 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the ESP8266 Updater, which writes a new
+// firmware into the free flash and has the boot loader copy it
+// over the running one on the next boot. Here the firmware is
+// kept in memory so that tools can compare it with what was
+// sent; ending an update that is complete "installs" it as the
+// sketch (see hostSetSketch()).
+//
+#ifndef HOST_UPDATER_H
+#define HOST_UPDATER_H
+
+#include <Arduino.h>
+#include <vector>
+
+#define U_FLASH                     0
+#define UPDATE_ERROR_OK             0
+#define UPDATE_ERROR_WRITE          1
+#define UPDATE_ERROR_SPACE          4
+#define UPDATE_ERROR_SIZE           5
+#define UPDATE_ERROR_STREAM         6
+#define UPDATE_ERROR_MAGIC_BYTE     10
+
+#define HOST_UPDATER_SPACE          (1024 * 1024)
+
+// ***
+// *** The hash and signature interfaces of the core (see
+// *** BearSSLHelpers.h).
+// ***
+class UpdaterHashClass
+{
+  public:
+    virtual ~UpdaterHashClass() {}
+    virtual void begin() = 0;
+    virtual void add(const void* data, uint32_t length) = 0;
+    virtual void end() = 0;
+    virtual int len() = 0;
+    virtual const void* hash() = 0;
+    virtual const unsigned char* oid() = 0;
+};
+
+class UpdaterVerifyClass
+{
+  public:
+    virtual ~UpdaterVerifyClass() {}
+    virtual uint32_t length() = 0;
+    virtual bool verify(UpdaterHashClass* hash, const void* signature, uint32_t signatureLength) = 0;
+};
+
+class UpdaterClass
+{
+  public:
+    bool begin(size_t size, int = U_FLASH)
+    {
+      _image.clear();
+      _size = size;
+      _error = (size == 0 || size > HOST_UPDATER_SPACE) ? UPDATE_ERROR_SPACE : UPDATE_ERROR_OK;
+      _isRunning = (_error == UPDATE_ERROR_OK);
+      _isFinished = false;
+      return _isRunning;
+    }
+
+    size_t write(uint8_t* data, size_t length)
+    {
+      size_t returnValue = 0;
+
+      if (_isRunning && _error == UPDATE_ERROR_OK && length <= this->remaining())
+      {
+        _error = (_image.empty() && length > 0 && data[0] != 0xE9) ? UPDATE_ERROR_MAGIC_BYTE : UPDATE_ERROR_OK;
+
+        if (_error == UPDATE_ERROR_OK)
+        {
+          _image.insert(_image.end(), data, data + length);
+          returnValue = length;
+        }
+      }
+      else if (_isRunning)
+      {
+        _error = UPDATE_ERROR_SPACE;
+      }
+
+      return returnValue;
+    }
+
+    // ***
+    // *** As on the device, an update that is not complete is
+    // *** abandoned unless evenIfRemaining is set.
+    // ***
+    bool end(bool evenIfRemaining = false)
+    {
+      bool returnValue = false;
+
+      if (_isRunning && _error == UPDATE_ERROR_OK && (evenIfRemaining || this->remaining() == 0))
+      {
+        _isFinished = true;
+        _installCount++;
+        hostSetSketch(_image.data(), _image.size());
+        returnValue = true;
+      }
+      else if (_isRunning && _error == UPDATE_ERROR_OK)
+      {
+        _error = UPDATE_ERROR_SIZE;
+      }
+
+      _isRunning = false;
+      return returnValue;
+    }
+
+    bool hasError() { return _error != UPDATE_ERROR_OK; }
+    uint8_t getError() { return _error; }
+    bool isRunning() { return _isRunning; }
+    bool isFinished() { return _isFinished; }
+    size_t size() { return _size; }
+    size_t progress() { return _image.size(); }
+    size_t remaining() { return _size - _image.size(); }
+    void printError(Print& output) { output.print("Updater error "); output.println((int)_error); }
+
+    static uint32_t hostGetInstallCount() { return _installCount; }
+
+  private:
+    static inline std::vector<uint8_t> _image;
+    static inline size_t _size = 0;
+    static inline uint8_t _error = UPDATE_ERROR_OK;
+    static inline bool _isRunning = false;
+    static inline bool _isFinished = false;
+    static inline uint32_t _installCount = 0;
+};
+
+inline UpdaterClass Update;
+
+#endif
@@ -0,0 +1,39 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for BearSSL::WiFiClientSecure. TLS is not
+// used on the host (see ESP8266HTTPClient.h).
+//
+#ifndef HOST_WIFI_CLIENT_SECURE_BEARSSL_H
+#define HOST_WIFI_CLIENT_SECURE_BEARSSL_H
+
+#include <ESP8266WiFi.h>
+
+namespace BearSSL
+{
+  class WiFiClientSecure : public WiFiClient
+  {
+    public:
+      bool setFingerprint(const char*) { return true; }
+      void setInsecure() {}
+      void setBufferSizes(int, int) {}
+      static bool probeMaxFragmentLength(const char*, uint16_t, uint16_t) { return true; }
+  };
+}
+
+#endif
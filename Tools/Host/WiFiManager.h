@@ -0,0 +1,36 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for WiFiManager; the host is always connected.
+//
+#ifndef HOST_WIFI_MANAGER_H
+#define HOST_WIFI_MANAGER_H
+
+#include <ESP8266WiFi.h>
+
+class WiFiManager
+{
+  public:
+    bool autoConnect() { return true; }
+    bool autoConnect(const char*, const char* = nullptr) { return true; }
+    void setConfigPortalTimeout(unsigned long) {}
+    void setDebugOutput(bool) {}
+    void resetSettings() {}
+};
+
+#endif
@@ -0,0 +1,50 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+#ifndef HOST_WIFI_UDP_H
+#define HOST_WIFI_UDP_H
+
+#include <ESP8266WiFi.h>
+
+class WiFiUDP : public Stream
+{
+  public:
+    ~WiFiUDP();
+    uint8_t begin(uint16_t port);
+    int beginPacket(IPAddress address, uint16_t port);
+    int beginPacketMulticast(IPAddress address, uint16_t port, IPAddress, int ttl = 1);
+    size_t write(uint8_t value) { return this->write(&value, 1); }
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+    int endPacket();
+    int parsePacket();
+    int available();
+    int read();
+    int read(uint8_t* buffer, size_t size);
+
+  private:
+    int _socket = -1;
+    uint32_t _address = 0;
+    uint16_t _port = 0;
+    std::string _outgoing;
+    std::string _incoming;
+    size_t _incomingRead = 0;
+
+    void open();
+};
+
+#endif
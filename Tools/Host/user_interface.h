@@ -0,0 +1,53 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Host stand-in for the parts of the ESP8266 SDK's user_interface.h
+// used for forced light sleep and by the watchdog. The sleep itself
+// is the delay() that follows wifi_fpm_do_sleep(), which advances
+// the virtual clock.
+//
+#ifndef HOST_USER_INTERFACE_H
+#define HOST_USER_INTERFACE_H
+
+#include <Arduino.h>
+
+#define NULL_MODE     0x00
+#define STATION_MODE  0x01
+
+enum sleep_type {
+  NONE_SLEEP_T = 0,
+  LIGHT_SLEEP_T,
+  MODEM_SLEEP_T
+};
+
+typedef void (*fpm_wakeup_cb)(void);
+
+inline bool wifi_set_opmode_current(uint8_t) { return true; }
+inline bool wifi_fpm_set_sleep_type(enum sleep_type) { return true; }
+inline void wifi_fpm_open() {}
+inline void wifi_fpm_close() {}
+inline void wifi_fpm_set_wakeup_cb(fpm_wakeup_cb) {}
+inline int8_t wifi_fpm_do_sleep(uint32_t) { return 0; }
+
+// ***
+// *** The watchdog restarts the device from a timer, where
+// *** ESP.restart() cannot be used. The program ends.
+// ***
+inline void system_restart() { exit(0); }
+
+#endif
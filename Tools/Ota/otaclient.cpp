@@ -0,0 +1,191 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Runs the firmware's OtaUpdater against a folder of update images
+// built by otadelta, served by the host HTTP stand-in as a local
+// update server would. The running firmware is the given .bin file.
+// The transfer runs under a virtual clock at the given link rate so
+// that the times of delta and full images can be compared (each
+// 256 bytes written to flash also yields, which the host counts as
+// 1 ms, roughly the time the flash takes to write them). The
+// update can be cut short (-c) and the new firmware can be made to
+// fail its first boots (-x) to see it rolled back.
+//
+// Build:
+//   g++ -O2 -std=c++17 -I../Host -I../../PlantMonitor otaclient.cpp ../../PlantMonitor/OtaUpdater.cpp ../../PlantMonitor/OtaImage.cpp ../../PlantMonitor/ByteOrder.cpp ../../PlantMonitor/RtcMemory.cpp ../../PlantMonitor/TelemetryPacket.cpp ../Host/HostArduino.cpp ../Host/HostWiFi.cpp -lcrypto -o otaclient
+//
+// Usage:
+//   otaclient -k public.key [-r rate] [-c bytes] [-x] folder version firmware.bin
+//
+//   -k  The public key the images are checked with (PEM, see
+//       OTA_PUBLIC_KEY in Credentials.h).
+//   -r  The link rate (bytes per second, default 50000).
+//   -c  Cut every transfer short after this many bytes.
+//   -x  The new firmware restarts before it is confirmed.
+//
+#include <Arduino.h>
+#include <Updater.h>
+#include "OtaUpdater.h"
+
+#include <string>
+#include <vector>
+
+#define OTA_CLIENT_URL "http://updates.local"
+
+// ***
+// *** Shows the result and the transfer compared with the whole
+// *** firmware.
+// ***
+static void report(OtaUpdater& updater, enum otaResult result)
+{
+  printf("  result: %s\n", OtaUpdater::getResultName(result));
+
+  if (updater.getFirmwareSize() > 0)
+  {
+    printf("  %s image: %u bytes in %u ms (%.1f%% of the %u byte firmware)\n", updater.getImageType() == OTA_TYPE_DELTA ? "delta" : "full",
+           updater.getTransferSize(), updater.getTransferTime(), updater.getTransferSize() * 100.0 / updater.getFirmwareSize(), updater.getFirmwareSize());
+  }
+}
+
+// ***
+// *** A restart: the RTC memory is kept and the updater counts
+// *** the boot.
+// ***
+static void boot(RtcMemory& rtcMemory, OtaUpdater& updater, uint32_t version, const std::string& key)
+{
+  rtcMemory.begin();
+  updater.begin(version, OTA_CLIENT_URL, key.c_str());
+  printf("Boot of firmware %u: %s, attempt %u\n", version,
+         updater.isRollbackNeeded() ? "rollback needed" : (updater.isPending() ? "not confirmed" : "confirmed"), updater.getBootAttempts());
+}
+
+int main(int argc, char** argv)
+{
+  std::string key;
+  uint32_t rate = 50000;
+  bool isFailing = false;
+  int option = 1;
+
+  for (; option < argc && argv[option][0] == '-'; option++)
+  {
+    switch (argv[option][1])
+    {
+      case 'k': key = (option + 1 < argc) ? argv[++option] : ""; break;
+      case 'r': rate = (option + 1 < argc) ? strtoul(argv[++option], NULL, 10) : 0; break;
+      case 'c': HTTPClient::hostSetReadLimit((option + 1 < argc) ? strtoul(argv[++option], NULL, 10) : 0); break;
+      case 'x': isFailing = true; break;
+    }
+  }
+
+  if (key.empty() || rate == 0 || option + 3 != argc)
+  {
+    fprintf(stderr, "usage: otaclient -k public.key [-r rate] [-c bytes] [-x] folder version firmware.bin\n");
+    return 2;
+  }
+
+  std::string publicKey;
+  FILE* file = fopen(key.c_str(), "r");
+  int c;
+
+  while (file && (c = fgetc(file)) != EOF)
+  {
+    publicKey.push_back((char)c);
+  }
+
+  if (!file || publicKey.empty())
+  {
+    fprintf(stderr, "otaclient: cannot read %s\n", key.c_str());
+    return 1;
+  }
+
+  fclose(file);
+
+  std::vector<uint8_t> firmware;
+  file = fopen(argv[option + 2], "rb");
+
+  while (file && (c = fgetc(file)) != EOF)
+  {
+    firmware.push_back((uint8_t)c);
+  }
+
+  if (!file || firmware.empty())
+  {
+    fprintf(stderr, "otaclient: cannot read %s\n", argv[option + 2]);
+    return 1;
+  }
+
+  fclose(file);
+  uint32_t version = strtoul(argv[option + 1], NULL, 10);
+
+  hostSetVirtualTime(0);
+  hostSetSketch(firmware.data(), firmware.size());
+  HTTPClient::hostSetDocumentRoot(argv[option]);
+  HTTPClient::hostSetLinkRate(rate);
+
+  RtcMemory rtcMemory;
+  OtaUpdater updater(rtcMemory);
+  boot(rtcMemory, updater, version, publicKey);
+
+  uint32_t latest = updater.checkForUpdate();
+
+  if (latest == 0)
+  {
+    printf("Firmware %u is up to date.\n", version);
+    return 0;
+  }
+
+  printf("Installing firmware %u over firmware %u (%zu bytes) at %u bytes/s\n", latest, version, firmware.size(), rate);
+  enum otaResult result = updater.update(latest);
+  report(updater, result);
+  printf("  %u update(s) installed\n", Update.hostGetInstallCount());
+
+  if (result == OTA_OK)
+  {
+    boot(rtcMemory, updater, latest, publicKey);
+
+    for (uint8_t i = 0; isFailing && !updater.isRollbackNeeded(); i++)
+    {
+      boot(rtcMemory, updater, latest, publicKey);
+    }
+
+    if (updater.isRollbackNeeded())
+    {
+      printf("Reinstalling firmware %u\n", updater.getPreviousVersion());
+      result = updater.rollback();
+      report(updater, result);
+
+      if (result == OTA_OK)
+      {
+        std::vector<uint8_t> installed((ESP.getSketchSize() + 3) & ~3);
+        ESP.flashRead(0, (uint32_t*)installed.data(), installed.size());
+        installed.resize(ESP.getSketchSize());
+
+        boot(rtcMemory, updater, updater.getPreviousVersion(), publicKey);
+        printf("The firmware %s the firmware before the update; firmware %u will not be installed again.\n",
+               installed == firmware ? "matches" : "does not match", updater.getFailedVersion());
+      }
+    }
+    else
+    {
+      updater.confirm();
+      printf("Firmware %u confirmed.\n", latest);
+    }
+  }
+
+  return result == OTA_OK ? 0 : 1;
+}
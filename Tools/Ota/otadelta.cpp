@@ -0,0 +1,636 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Builds the signed firmware update images served to the Plant
+// Monitors by a local update server (see PlantMonitor/OtaImage.h
+// and PlantMonitor/OtaUpdater.h): a full image of the firmware, a
+// delta image from each earlier release and a full image of it
+// (for a rollback), and the "latest" file.
+// Each image is checked by applying it with the firmware's own
+// decoder before it is written. The report compares the bytes (and
+// the time over a link of the given rate) of each image with the
+// firmware.
+//
+// Build:
+//   g++ -O2 -std=c++17 -I../../PlantMonitor otadelta.cpp ../../PlantMonitor/OtaImage.cpp ../../PlantMonitor/ByteOrder.cpp -lcrypto -o otadelta
+//
+// Usage:
+//   otadelta -k private.key -v version [-o folder] [-r rate] firmware.bin [version:firmware.bin ...]
+//
+//   -k  The private key the images are signed with (PEM, RSA-2048;
+//       OTA_PUBLIC_KEY in Credentials.h is its public key).
+//   -v  The version of the firmware (FIRMWARE_VERSION in PlantMonitor.ino).
+//   -o  The folder served by the update server (default the current folder).
+//   -r  The link rate used for the transfer times (bytes per second, default 50000).
+//
+//   Each version:firmware.bin is an earlier release to build a delta
+//   image from (the .bin file the Arduino IDE exported for it).
+//
+#include "OtaImage.h"
+#include "ByteOrder.h"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+// ***
+// *** Matches shorter than this are sent as literals.
+// ***
+#define MINIMUM_MATCH     16
+
+// ***
+// *** Runs of unchanged bytes at least this long inside a match
+// *** are copied rather than added.
+// ***
+#define MINIMUM_COPY      12
+
+// ***
+// *** Candidate positions tried for each match.
+// ***
+#define MATCH_CANDIDATES  64
+#define HASH_BITS         20
+
+static bool readFile(const char* path, Bytes& data)
+{
+  bool returnValue = false;
+  FILE* file = fopen(path, "rb");
+
+  if (file)
+  {
+    uint8_t buffer[65536];
+    size_t length;
+
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+      data.insert(data.end(), buffer, buffer + length);
+    }
+
+    returnValue = !ferror(file);
+    fclose(file);
+  }
+
+  return returnValue;
+}
+
+static bool writeFile(const std::string& path, const Bytes& data)
+{
+  bool returnValue = false;
+  FILE* file = fopen(path.c_str(), "wb");
+
+  if (file)
+  {
+    returnValue = fwrite(data.data(), 1, data.size(), file) == data.size();
+    returnValue = (fclose(file) == 0) && returnValue;
+  }
+
+  return returnValue;
+}
+
+static void putVarint(Bytes& out, uint64_t v)
+{
+  do
+  {
+    out.push_back((v & 0x7F) | (v >= 0x80 ? 0x80 : 0));
+    v >>= 7;
+  } while (v);
+}
+
+static uint32_t hash8(const uint8_t* p)
+{
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return (uint32_t)((v * 0x9E3779B97F4A7C15ULL) >> (64 - HASH_BITS));
+}
+
+static uint32_t hash3(const uint8_t* p)
+{
+  return (((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2]) * 2654435761U >> (32 - HASH_BITS);
+}
+
+// ***
+// *** Writes the operations of the payload (see OtaImage.h).
+// ***
+class Operations
+{
+  public:
+    Bytes data;
+
+    void literal(const uint8_t* bytes, size_t length)
+    {
+      if (length > 0)
+      {
+        putVarint(this->data, ((uint64_t)length << 2) | OTA_OP_LITERAL);
+        this->data.insert(this->data.end(), bytes, bytes + length);
+      }
+    }
+
+    void fromBase(uint8_t op, const Bytes& base, size_t position, const uint8_t* target, size_t length)
+    {
+      putVarint(this->data, ((uint64_t)length << 2) | op);
+      putVarint(this->data, zigzag((int64_t)position - (int64_t)this->_basePosition));
+
+      for (size_t i = 0; op == OTA_OP_ADD && i < length; i++)
+      {
+        this->data.push_back((uint8_t)(target[i] - base[position + i]));
+      }
+
+      this->_basePosition = position + length;
+    }
+
+  private:
+    size_t _basePosition = 0;
+};
+
+// ***
+// *** Finds the parts of the target that are in the base, bsdiff
+// *** style: an exact match of at least MINIMUM_MATCH bytes is
+// *** extended for as long as most bytes still match, so that code
+// *** that has moved (with its addresses changed) becomes one run
+// *** of mostly zero differences.
+// ***
+static Bytes diff(const Bytes& base, const Bytes& target)
+{
+  Operations operations;
+  std::vector<int32_t> head(1 << HASH_BITS, -1);
+  std::vector<int32_t> previous(base.size(), -1);
+
+  for (size_t i = 0; i + 8 <= base.size(); i++)
+  {
+    uint32_t h = hash8(&base[i]);
+    previous[i] = head[h];
+    head[h] = (int32_t)i;
+  }
+
+  size_t literalStart = 0;
+  size_t expected = 0;
+  size_t i = 0;
+
+  while (i + 8 <= target.size())
+  {
+    size_t bestLength = 0;
+    size_t bestPosition = 0;
+    int32_t candidate = head[hash8(&target[i])];
+    size_t limit = target.size() - i;
+
+    // ***
+    // *** The base position following the last match is tried
+    // *** first; it is where unchanged code continues.
+    // ***
+    for (int tries = -1; tries < MATCH_CANDIDATES && (tries < 0 || candidate >= 0); tries++)
+    {
+      size_t position = (tries < 0) ? expected : (size_t)candidate;
+      size_t length = 0;
+
+      while (position < base.size() && length < limit && position + length < base.size() && base[position + length] == target[i + length])
+      {
+        length++;
+      }
+
+      if (length > bestLength)
+      {
+        bestLength = length;
+        bestPosition = position;
+      }
+
+      candidate = (tries < 0) ? candidate : previous[candidate];
+    }
+
+    if (bestLength >= MINIMUM_MATCH)
+    {
+      // ***
+      // *** Take back matching bytes from the literal before it.
+      // ***
+      while (i > literalStart && bestPosition > 0 && base[bestPosition - 1] == target[i - 1])
+      {
+        i--;
+        bestPosition--;
+        bestLength++;
+      }
+
+      // ***
+      // *** Extend while twice the matching bytes exceed the length.
+      // ***
+      long score = (long)bestLength;
+      long bestScore = score;
+      size_t extended = bestLength;
+
+      for (size_t k = bestLength; i + k < target.size() && bestPosition + k < base.size() && score > bestScore - 64; k++)
+      {
+        score += (base[bestPosition + k] == target[i + k]) ? 1 : -1;
+
+        if (score > bestScore)
+        {
+          bestScore = score;
+          extended = k + 1;
+        }
+      }
+
+      operations.literal(&target[literalStart], i - literalStart);
+
+      // ***
+      // *** Copy the unchanged runs, add the rest.
+      // ***
+      size_t start = 0;
+      size_t k = 0;
+
+      while (k < extended)
+      {
+        size_t run = 0;
+
+        while (k + run < extended && base[bestPosition + k + run] == target[i + k + run])
+        {
+          run++;
+        }
+
+        if (run >= MINIMUM_COPY || (run > 0 && k + run == extended && start == k))
+        {
+          if (k > start)
+          {
+            operations.fromBase(OTA_OP_ADD, base, bestPosition + start, &target[i + start], k - start);
+          }
+
+          operations.fromBase(OTA_OP_COPY, base, bestPosition + k, &target[i + k], run);
+          start = k + run;
+        }
+
+        k += (run > 0) ? run : 1;
+      }
+
+      if (extended > start)
+      {
+        operations.fromBase(OTA_OP_ADD, base, bestPosition + start, &target[i + start], extended - start);
+      }
+
+      i += extended;
+      expected = bestPosition + extended;
+      literalStart = i;
+    }
+    else
+    {
+      i++;
+    }
+  }
+
+  operations.literal(&target[literalStart], target.size() - literalStart);
+
+  return operations.data;
+}
+
+// ***
+// *** LZSS with the token format of telemetryBatchCompress() and
+// *** an OTA_WINDOW_SIZE window, finding matches with hash chains.
+// ***
+static Bytes compress(const Bytes& input)
+{
+  Bytes output;
+  std::vector<int32_t> head(1 << HASH_BITS, -1);
+  std::vector<int32_t> previous(input.size(), -1);
+  size_t control = 0;
+  uint8_t bit = 8;
+  size_t i = 0;
+
+  auto insert = [&](size_t position)
+  {
+    if (position + 3 <= input.size())
+    {
+      uint32_t h = hash3(&input[position]);
+      previous[position] = head[h];
+      head[h] = (int32_t)position;
+    }
+  };
+
+  while (i < input.size())
+  {
+    if (bit == 8)
+    {
+      control = output.size();
+      output.push_back(0);
+      bit = 0;
+    }
+
+    size_t best = 0;
+    size_t offset = 0;
+
+    if (i + 3 <= input.size())
+    {
+      int32_t candidate = head[hash3(&input[i])];
+
+      for (int tries = 0; tries < MATCH_CANDIDATES && candidate >= 0 && i - candidate <= OTA_WINDOW_SIZE; tries++)
+      {
+        size_t k = 0;
+
+        while (k < 18 && i + k < input.size() && input[candidate + k] == input[i + k])
+        {
+          k++;
+        }
+
+        if (k > best)
+        {
+          best = k;
+          offset = i - candidate;
+        }
+
+        candidate = previous[candidate];
+      }
+    }
+
+    if (best >= 3)
+    {
+      output[control] |= (1 << bit);
+      output.push_back((offset - 1) & 0xFF);
+      output.push_back((((offset - 1) >> 8) << 4) | (best - 3));
+
+      for (size_t k = 0; k < best; k++)
+      {
+        insert(i + k);
+      }
+
+      i += best;
+    }
+    else
+    {
+      output.push_back(input[i]);
+      insert(i);
+      i++;
+    }
+
+    bit++;
+  }
+
+  return output;
+}
+
+static void sha256(const Bytes& data, uint8_t* hash)
+{
+  EVP_Digest(data.data(), data.size(), hash, NULL, EVP_sha256(), NULL);
+}
+
+// ***
+// *** Reads the private key; the devices only take RSA-2048
+// *** signatures (see OtaImage.h).
+// ***
+static EVP_PKEY* readKey(const char* path)
+{
+  EVP_PKEY* returnValue = NULL;
+  FILE* file = fopen(path, "r");
+
+  if (file)
+  {
+    returnValue = PEM_read_PrivateKey(file, NULL, NULL, NULL);
+    fclose(file);
+  }
+
+  if (returnValue && (EVP_PKEY_get_base_id(returnValue) != EVP_PKEY_RSA || EVP_PKEY_get_size(returnValue) != OTA_SIGNATURE_SIZE))
+  {
+    EVP_PKEY_free(returnValue);
+    returnValue = NULL;
+  }
+
+  return returnValue;
+}
+
+// ***
+// *** Signs or checks the signed bytes of the header (PKCS #1
+// *** v1.5 over their SHA-256).
+// ***
+static bool sign(EVP_PKEY* key, uint8_t* image)
+{
+  size_t length = OTA_SIGNATURE_SIZE;
+  EVP_MD_CTX* context = EVP_MD_CTX_new();
+  bool returnValue = context && EVP_DigestSignInit(context, NULL, EVP_sha256(), NULL, key) == 1 &&
+                     EVP_DigestSign(context, image + OTA_SIGNED_SIZE, &length, image, OTA_SIGNED_SIZE) == 1 && length == OTA_SIGNATURE_SIZE;
+
+  EVP_MD_CTX_free(context);
+  return returnValue;
+}
+
+static bool isSigned(EVP_PKEY* key, const uint8_t* image)
+{
+  EVP_MD_CTX* context = EVP_MD_CTX_new();
+  bool returnValue = context && EVP_DigestVerifyInit(context, NULL, EVP_sha256(), NULL, key) == 1 &&
+                     EVP_DigestVerify(context, image + OTA_SIGNED_SIZE, OTA_SIGNATURE_SIZE, image, OTA_SIGNED_SIZE) == 1;
+
+  EVP_MD_CTX_free(context);
+  return returnValue;
+}
+
+static Bytes buildImage(EVP_PKEY* key, uint32_t version, const Bytes& firmware, uint32_t baseVersion, const Bytes* base)
+{
+  OtaHeader header;
+  Operations full;
+  Bytes image(OTA_HEADER_SIZE);
+
+  memset(&header, 0, sizeof(header));
+  header.type = base ? OTA_TYPE_DELTA : OTA_TYPE_FULL;
+  header.version = version;
+  header.size = firmware.size();
+  sha256(firmware, header.hash);
+
+  if (base)
+  {
+    header.baseVersion = baseVersion;
+    header.baseSize = base->size();
+    sha256(*base, header.baseHash);
+  }
+  else
+  {
+    full.literal(firmware.data(), firmware.size());
+  }
+
+  Bytes payload = compress(base ? diff(*base, firmware) : full.data);
+  header.payloadSize = payload.size();
+  otaHeaderWrite(&header, image.data(), image.size());
+  image.insert(image.end(), payload.begin(), payload.end());
+
+  if (!sign(key, image.data()))
+  {
+    image.clear();
+  }
+
+  return image;
+}
+
+// ***
+// *** Applies the image as a device would, a segment at a time.
+// ***
+static uint8_t readBase(void* context, uint32_t position)
+{
+  return (*(const Bytes*)((void**)context)[0])[position];
+}
+
+static bool writeOutput(void* context, const uint8_t* data, size_t length)
+{
+  Bytes* output = (Bytes*)((void**)context)[1];
+  output->insert(output->end(), data, data + length);
+  return true;
+}
+
+static bool checkImage(EVP_PKEY* key, const Bytes& image, const Bytes& firmware, const Bytes* base)
+{
+  OtaHeader header;
+  OtaDecoder decoder;
+  Bytes window(OTA_WINDOW_SIZE);
+  Bytes output;
+  Bytes empty;
+  void* context[2] = { (void*)(base ? base : &empty), &output };
+  bool returnValue = otaHeaderRead(image.data(), image.size(), &header) == OTA_OK && isSigned(key, image.data());
+
+  if (returnValue)
+  {
+    otaDecoderBegin(&decoder, &header, window.data(), readBase, writeOutput, context);
+
+    for (size_t i = OTA_HEADER_SIZE; returnValue && i < image.size(); i += 1460)
+    {
+      returnValue = otaDecoderAdd(&decoder, image.data() + i, std::min((size_t)1460, image.size() - i));
+    }
+
+    returnValue = otaDecoderFinish(&decoder) && returnValue && output == firmware;
+  }
+
+  return returnValue;
+}
+
+static void report(const char* name, const char* type, size_t size, size_t firmwareSize, size_t fullSize, uint32_t rate)
+{
+  printf("  %-16s %-5s %9zu bytes %6.1f%% of the firmware %7.2f s", name, type, size, size * 100.0 / firmwareSize, (double)size / rate);
+
+  if (fullSize > 0)
+  {
+    printf(" (%.1f%% of the full image)", size * 100.0 / fullSize);
+  }
+
+  printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+  const char* keyPath = NULL;
+  std::string folder = ".";
+  uint32_t version = 0;
+  uint32_t rate = 50000;
+  int option = 1;
+
+  for (; option + 1 < argc && argv[option][0] == '-'; option += 2)
+  {
+    switch (argv[option][1])
+    {
+      case 'k': keyPath = argv[option + 1]; break;
+      case 'v': version = strtoul(argv[option + 1], NULL, 10); break;
+      case 'o': folder = argv[option + 1]; break;
+      case 'r': rate = strtoul(argv[option + 1], NULL, 10); break;
+    }
+  }
+
+  if (!keyPath || version == 0 || rate == 0 || option >= argc)
+  {
+    fprintf(stderr, "usage: otadelta -k private.key -v version [-o folder] [-r rate] firmware.bin [version:firmware.bin ...]\n");
+    return 2;
+  }
+
+  EVP_PKEY* key = readKey(keyPath);
+
+  if (!key)
+  {
+    fprintf(stderr, "otadelta: %s is not an RSA-2048 private key\n", keyPath);
+    return 1;
+  }
+
+  Bytes firmware;
+
+  if (!readFile(argv[option], firmware) || firmware.empty())
+  {
+    fprintf(stderr, "otadelta: cannot read %s\n", argv[option]);
+    return 1;
+  }
+
+  int returnValue = 0;
+  char name[64];
+  Bytes full = buildImage(key, version, firmware, 0, NULL);
+  snprintf(name, sizeof(name), "%u.pmota", version);
+
+  printf("Firmware %u: %zu bytes, %.2f s at %u bytes/s\n", version, firmware.size(), (double)firmware.size() / rate, rate);
+
+  if (!checkImage(key, full, firmware, NULL) || !writeFile(folder + "/" + name, full))
+  {
+    fprintf(stderr, "otadelta: cannot build %s\n", name);
+    returnValue = 1;
+  }
+  else
+  {
+    report(name, "full", full.size(), firmware.size(), 0, rate);
+  }
+
+  for (int i = option + 1; returnValue == 0 && i < argc; i++)
+  {
+    const char* colon = strchr(argv[i], ':');
+    uint32_t baseVersion = strtoul(argv[i], NULL, 10);
+    Bytes base;
+
+    if (!colon || baseVersion == 0 || baseVersion == version || !readFile(colon + 1, base) || base.empty())
+    {
+      fprintf(stderr, "otadelta: cannot read the release %s\n", argv[i]);
+      returnValue = 1;
+    }
+    else
+    {
+      Bytes delta = buildImage(key, version, firmware, baseVersion, &base);
+      snprintf(name, sizeof(name), "%u-%u.pmota", baseVersion, version);
+
+      // ***
+      // *** A device that rolls back to the release reinstalls
+      // *** it from a full image.
+      // ***
+      Bytes previous = buildImage(key, baseVersion, base, 0, NULL);
+      char previousName[64];
+      snprintf(previousName, sizeof(previousName), "%u.pmota", baseVersion);
+
+      if (!checkImage(key, delta, firmware, &base) || !writeFile(folder + "/" + name, delta))
+      {
+        fprintf(stderr, "otadelta: cannot build %s\n", name);
+        returnValue = 1;
+      }
+      else if (!checkImage(key, previous, base, NULL) || !writeFile(folder + "/" + previousName, previous))
+      {
+        fprintf(stderr, "otadelta: cannot build %s\n", previousName);
+        returnValue = 1;
+      }
+      else
+      {
+        report(name, "delta", delta.size(), firmware.size(), full.size(), rate);
+        report(previousName, "full", previous.size(), base.size(), 0, rate);
+      }
+    }
+  }
+
+  if (returnValue == 0)
+  {
+    std::string latest = std::to_string(version) + "\n";
+    returnValue = writeFile(folder + "/latest", Bytes(latest.begin(), latest.end())) ? 0 : 1;
+  }
+
+  EVP_PKEY_free(key);
+  return returnValue;
+}
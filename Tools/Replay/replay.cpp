@@ -0,0 +1,429 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Replays a sensor trace recorded by the firmware (see
+// PlantMonitor/TraceRecorder.h) through the firmware's own monitor,
+// sensor health and watering code under a virtual clock. A month
+// of readings replays in seconds. The decisions are written to
+// stdout one per line so that the output of two runs (e.g. with a
+// different threshold or a code change) can be compared with diff.
+// A summary is written to stderr.
+//
+// Build:
+//   g++ -O2 -std=c++17 -I../Host -I../../PlantMonitor replay.cpp ../../PlantMonitor/TraceFormat.cpp ../../PlantMonitor/CloudData.cpp ../../PlantMonitor/SensorHealth.cpp ../../PlantMonitor/SoilMonitor.cpp ../../PlantMonitor/EnvironmentalMonitor.cpp ../../PlantMonitor/DerivedMetrics.cpp ../../PlantMonitor/SpectrumMonitor.cpp ../../PlantMonitor/Temperature.cpp ../../PlantMonitor/WaterPumpController.cpp ../../PlantMonitor/WateringController.cpp ../../PlantMonitor/WaterAccount.cpp ../../PlantMonitor/TelemetryPacket.cpp ../../PlantMonitor/ByteOrder.cpp ../Host/HostArduino.cpp -o replay
+//
+// Usage:
+//   replay [-c minutes] [-t percent] [-q] trace
+//
+//   trace  A trace file (/trace.bin copied from the device) or a
+//          serial log containing "#T " lines ("trace dump" or
+//          TRACE_TO_SERIAL).
+//   -c     Check the soil every this many minutes instead of when
+//          the device did.
+//   -t     Water when the moisture level is below this value instead
+//          of when the sensor's comparator reports dry soil.
+//   -q     Only write the summary.
+//
+#include "TraceFormat.h"
+#include "CloudData.h"
+#include "SensorHealth.h"
+#include "SoilMonitor.h"
+#include "EnvironmentalMonitor.h"
+#include "SpectrumMonitor.h"
+#include "WaterPumpController.h"
+#include "WateringController.h"
+#include "MyPins.h"
+
+#include <stdarg.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+// ***
+// *** The firmware's pump run settings (PlantMonitor.ino).
+// ***
+#define WATER_PUMP_RUN_TIME  1000 * 30
+#define WATER_PUMP_RUN_LEVEL 200
+
+// ***
+// *** The firmware objects being driven.
+// ***
+static SoilMonitor _soilMonitor(SOIL_ANALOG_CHANNEL, SOIL_DIGITAL_CHANNEL, SOIL_TEMPERATURE_PIN);
+static EnvironmentalMonitor _envMonitor(DHT22_DATA_PIN);
+static SpectrumMonitor _spectrumMonitor;
+static WaterPumpController _waterPumpController(WATER_PUMP_PIN);
+static WateringController _wateringController(_soilMonitor, _waterPumpController);
+static SensorHealth _sensorHealth[CHANNEL_COUNT];
+static bool _reportedFault[CHANNEL_COUNT];
+static CloudData _sensorData;
+static enum temperatureUnit _myUnits = FAHRENHEIT;
+
+// ***
+// *** Replay state. The virtual time (ms) keeps increasing
+// *** across sessions (reboots).
+// ***
+static bool _quiet = false;
+static uint64_t _sessionBase = 0;
+static uint64_t _virtualTime = 0;
+static bool _hasEpoch = false;
+static int64_t _epochOffset = 0;
+
+// ***
+// *** Totals for the summary.
+// ***
+static uint32_t _sessions = 0;
+static uint32_t _samples = 0;
+static uint32_t _checks = 0;
+static uint32_t _skipped = 0;
+static uint32_t _waterings = 0;
+static uint32_t _faults = 0;
+
+// ***
+// *** Writes a log line prefixed with the time: UTC when the
+// *** device's clock was known, otherwise the virtual time.
+// ***
+static void logLine(const char* format, ...)
+{
+  if (!_quiet)
+  {
+    if (_hasEpoch)
+    {
+      time_t seconds = (time_t)((_epochOffset + (int64_t)_virtualTime) / 1000);
+      struct tm t;
+      gmtime_r(&seconds, &t);
+      printf("%04d-%02d-%02d %02d:%02d:%02d ", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    }
+    else
+    {
+      uint64_t s = _virtualTime / 1000;
+      printf("+%03ud%02u:%02u:%02u  ", (unsigned)(s / 86400), (unsigned)((s / 3600) % 24), (unsigned)((s / 60) % 60), (unsigned)(s % 60));
+    }
+
+    va_list arguments;
+    va_start(arguments, format);
+    vprintf(format, arguments);
+    va_end(arguments);
+    putchar('\n');
+  }
+}
+
+// ***
+// *** Moves the virtual clock forward to a record's tick. The
+// *** clock is never moved back (the pump run advances it).
+// ***
+static void advanceTo(uint64_t tick)
+{
+  uint64_t target = _sessionBase + tick;
+
+  if (target > _virtualTime)
+  {
+    _virtualTime = target;
+  }
+
+  hostSetVirtualTime(_virtualTime * 1000);
+}
+
+static void startSession(const TraceRecord& record)
+{
+  _sessions++;
+  _sessionBase = _virtualTime;
+  advanceTo(record.tick);
+
+  _myUnits = record.units == CELSIUS ? CELSIUS : FAHRENHEIT;
+  _soilMonitor.setCalibration(record.dryReading, record.wetReading);
+
+  // ***
+  // *** A reboot starts the health monitors over.
+  // ***
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    _sensorHealth[i] = SensorHealth();
+    _reportedFault[i] = false;
+  }
+
+  configureSensorHealth(_sensorHealth, _myUnits);
+  memset(&_sensorData.quality, 0, sizeof(_sensorData.quality));
+  _sensorData.initialized = false;
+
+  logLine("boot units=%s dry=%.2f wet=%.2f", _myUnits == FAHRENHEIT ? "F" : "C", record.dryReading, record.wetReading);
+}
+
+// ***
+// *** Loads the recorded values into the simulated devices and
+// *** reads them exactly as getSensorData() does.
+// ***
+static void replaySample(const TraceRecord& record)
+{
+  _samples++;
+  advanceTo(record.tick);
+
+  Adafruit_MCP3008::hostSetCode(SOIL_ANALOG_CHANNEL, record.levelCode);
+  Adafruit_MCP3008::hostSetCode(SOIL_DIGITAL_CHANNEL, record.qualityCode);
+  DallasTemperature::hostSetRaw(record.soilTemperature == TRACE_NO_VALUE ? DEVICE_DISCONNECTED_C * 128 : record.soilTemperature);
+  DHTesp::hostSetReading(traceToAirTemperature(record.airTemperature), traceToHumidity(record.humidity));
+  Adafruit_TSL2591::hostSetLuminosity(record.luminosity);
+
+  _sensorData.capturedAt = _virtualTime;
+#define READ_CHANNEL(id, type, field, key, label, name, unit, decimals, policy, device, sensitivity, read) _sensorData.field = read;
+  SENSOR_CHANNELS(READ_CHANNEL)
+
+  _sensorData.soilMoistureQuality = _soilMonitor.getQuality();
+  _sensorData.initialized = true;
+
+  // ***
+  // *** The health checks use the tick since boot, as on the device.
+  // ***
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    enum sensorChannel channel = (enum sensorChannel)i;
+    _sensorData.quality[i] = _sensorHealth[i].check(getChannelValue(_sensorData, channel), (uint32_t)record.tick);
+
+    bool faulty = _sensorHealth[i].isFaulty();
+
+    if (faulty != _reportedFault[i])
+    {
+      _reportedFault[i] = faulty;
+
+      if (faulty)
+      {
+        _faults++;
+      }
+
+      logLine("%s %s quality=0x%02x value=%.2f", faulty ? "fault" : "recover", getChannelName(channel), _sensorData.quality[i], getChannelValue(_sensorData, channel));
+    }
+  }
+}
+
+// ***
+// *** Runs the watering decision as checkSoilQuality() does.
+// ***
+static void replayCheck()
+{
+  _checks++;
+
+  if (_sensorData.initialized)
+  {
+    enum wateringDecision decision = _wateringController.decide(_sensorData.quality[CHANNEL_SOIL_MOISTURE_LEVEL], _sensorData.soilMoistureLevel);
+
+    if (decision == WATERING_SKIPPED)
+    {
+      _skipped++;
+      logLine("skip moisture=%.1f quality=0x%02x", _sensorData.soilMoistureLevel, _sensorData.quality[CHANNEL_SOIL_MOISTURE_LEVEL]);
+    }
+    else if (decision == WATERING_NEEDED)
+    {
+      _waterings++;
+      logLine("water moisture=%.1f level=%u time=%us", _sensorData.soilMoistureLevel, _wateringController.getRunLevel(), _wateringController.getRunTime() / 1000);
+
+      // ***
+      // *** The pump blocks; the virtual clock advances with it.
+      // ***
+      _wateringController.water();
+      _virtualTime = micros64() / 1000;
+    }
+    else
+    {
+      logLine("check moisture=%.1f quality=%s", _sensorData.soilMoistureLevel, _wateringController.getLastQuality().c_str());
+    }
+  }
+}
+
+// ***
+// *** Reads a trace file. A serial log is recognized by its
+// *** "#T " lines, which are decoded from hex.
+// ***
+static bool readTrace(const char* path, std::vector<uint8_t>& trace)
+{
+  bool returnValue = false;
+  FILE* file = fopen(path, "rb");
+
+  if (file)
+  {
+    std::vector<uint8_t> content;
+    uint8_t buffer[65536];
+    size_t length = 0;
+
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+      content.insert(content.end(), buffer, buffer + length);
+    }
+
+    fclose(file);
+
+    bool isText = content.size() >= 3 && memcmp(content.data(), TRACE_TEXT_PREFIX, 3) == 0;
+
+    for (size_t i = 0; !isText && i + 3 < content.size(); i++)
+    {
+      isText = content[i] == '\n' && memcmp(&content[i + 1], TRACE_TEXT_PREFIX, 3) == 0;
+    }
+
+    if (isText)
+    {
+      content.push_back('\n');
+      size_t start = 0;
+
+      for (size_t i = 0; i < content.size(); i++)
+      {
+        if (content[i] == '\n')
+        {
+          std::string line((const char*)&content[start], i - start);
+          size_t prefix = line.find(TRACE_TEXT_PREFIX);
+
+          if (prefix != std::string::npos)
+          {
+            for (size_t j = prefix + 3; j + 1 < line.size() && isxdigit(line[j]) && isxdigit(line[j + 1]); j += 2)
+            {
+              trace.push_back((uint8_t)strtoul(line.substr(j, 2).c_str(), nullptr, 16));
+            }
+          }
+
+          start = i + 1;
+        }
+      }
+    }
+    else
+    {
+      trace.swap(content);
+    }
+
+    returnValue = true;
+  }
+
+  return returnValue;
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t checkInterval = 0;
+  int option = 0;
+
+  while ((option = getopt(argc, argv, "c:t:q")) != -1)
+  {
+    switch (option)
+    {
+      case 'c': checkInterval = (uint32_t)(atof(optarg) * 60000.0); break;
+      case 't': _wateringController.setMoistureThreshold(atof(optarg)); break;
+      case 'q': _quiet = true; break;
+      default:
+        fprintf(stderr, "Usage: %s [-c minutes] [-t percent] [-q] trace\n", argv[0]);
+        return 1;
+    }
+  }
+
+  std::vector<uint8_t> trace;
+
+  if (optind >= argc || !readTrace(argv[optind], trace))
+  {
+    fprintf(stderr, "Could not read the trace.\n");
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  hostSetVirtualTime(0);
+  _wateringController.begin(WATER_PUMP_RUN_LEVEL, WATER_PUMP_RUN_TIME);
+
+  size_t offset = 0;
+  uint64_t previousTick = 0;
+  uint64_t nextCheck = 0;
+  uint64_t firstTime = 0;
+  bool started = false;
+  enum traceResult result = TRACE_OK;
+
+  while (offset < trace.size())
+  {
+    TraceRecord record;
+    size_t used = 0;
+    result = traceDecode(trace.data() + offset, trace.size() - offset, previousTick, &record, &used);
+
+    if (result != TRACE_OK)
+    {
+      break;
+    }
+
+    offset += used;
+    previousTick = record.tick;
+
+    if (record.type == TRACE_HEADER)
+    {
+      startSession(record);
+      nextCheck = _virtualTime + checkInterval;
+
+      if (!started)
+      {
+        started = true;
+        firstTime = _virtualTime;
+      }
+    }
+    else if (!started)
+    {
+      // ***
+      // *** Records before the first header cannot be placed.
+      // ***
+    }
+    else if (record.type == TRACE_SAMPLE)
+    {
+      replaySample(record);
+
+      if (checkInterval && _virtualTime >= nextCheck)
+      {
+        nextCheck += checkInterval * (1 + (_virtualTime - nextCheck) / checkInterval);
+        replayCheck();
+      }
+    }
+    else if (record.type == TRACE_CHECK)
+    {
+      if (!checkInterval)
+      {
+        advanceTo(record.tick);
+
+        // ***
+        // *** Use the comparator output read by the device's decision.
+        // ***
+        if (record.qualityCode != TRACE_NO_CODE)
+        {
+          Adafruit_MCP3008::hostSetCode(SOIL_DIGITAL_CHANNEL, record.qualityCode);
+        }
+
+        replayCheck();
+      }
+    }
+    else if (record.type == TRACE_EPOCH)
+    {
+      advanceTo(record.tick);
+      _epochOffset = ((int64_t)record.epoch * 1000) - (int64_t)_virtualTime;
+      _hasEpoch = true;
+    }
+  }
+
+  fflush(stdout);
+
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double span = (_virtualTime - firstTime) / 1000.0;
+
+  if (result != TRACE_OK)
+  {
+    fprintf(stderr, "Trace %s at byte %zu; replay stopped.\n", result == TRACE_TRUNCATED ? "truncated" : "corrupt", offset);
+  }
+
+  fprintf(stderr, "Replayed %zu bytes: %u session(s), %u samples over %.1f days in %.2f s (%.0fx).\n", offset, _sessions, _samples, span / 86400.0, elapsed, elapsed > 0 ? span / elapsed : 0.0);
+  fprintf(stderr, "Checks: %u, waterings: %u (%u s of pumping), skipped (unreliable sensor): %u, faults: %u.\n", _checks, _waterings, _waterings * (WATER_PUMP_RUN_TIME / 1000), _skipped, _faults);
+
+  return result == TRACE_OK ? 0 : 2;
+}
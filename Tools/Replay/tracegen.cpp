@@ -0,0 +1,225 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Writes a synthetic trace of a plant (drying soil, watering,
+// day and night, a soil probe dropout and a reboot) using the
+// firmware's TraceRecorder, for testing the replay tool without
+// a device.
+//
+// Build:
+//   g++ -O2 -std=c++17 -I../Host -I../../PlantMonitor tracegen.cpp ../../PlantMonitor/TraceRecorder.cpp ../../PlantMonitor/TraceFormat.cpp ../../PlantMonitor/SoilMonitor.cpp ../../PlantMonitor/EnvironmentalMonitor.cpp ../../PlantMonitor/DerivedMetrics.cpp ../../PlantMonitor/SpectrumMonitor.cpp ../../PlantMonitor/Temperature.cpp ../Host/HostArduino.cpp -o tracegen
+//
+// Usage:
+//   tracegen [-d days] [-s seed] [-x] output
+//
+//   -d  Days to simulate (default 30).
+//   -s  Random seed (default 1).
+//   -x  Write "#T " text lines (as TRACE_TO_SERIAL does) instead of binary.
+//
+#include "TraceRecorder.h"
+#include "MyPins.h"
+
+#include <unistd.h>
+
+#include <random>
+
+#define SOIL_MOISTURE_DRY     1.91
+#define SOIL_MOISTURE_WET     0.96
+#define SAMPLE_INTERVAL       10000
+#define CHECK_INTERVAL        600000
+#define WATER_PUMP_RUN_TIME   30000
+#define START_EPOCH           1788220800    // 2026-09-01 00:00:00 UTC
+
+// ***
+// *** Writes the trace to a file.
+// ***
+class FilePrint : public Print
+{
+  public:
+    FilePrint(FILE* file) : _file(file) {}
+    size_t write(uint8_t value) { return fwrite(&value, 1, 1, this->_file); }
+    size_t write(const uint8_t* buffer, size_t size) { return fwrite(buffer, 1, size, this->_file); }
+    using Print::write;
+
+  private:
+    FILE* _file;
+};
+
+int main(int argc, char** argv)
+{
+  uint32_t days = 30;
+  uint32_t seed = 1;
+  bool isText = false;
+  int option = 0;
+
+  while ((option = getopt(argc, argv, "d:s:x")) != -1)
+  {
+    switch (option)
+    {
+      case 'd': days = atoi(optarg); break;
+      case 's': seed = atoi(optarg); break;
+      case 'x': isText = true; break;
+      default:
+        fprintf(stderr, "Usage: %s [-d days] [-s seed] [-x] output\n", argv[0]);
+        return 1;
+    }
+  }
+
+  FILE* file = optind < argc ? fopen(argv[optind], "wb") : nullptr;
+
+  if (!file)
+  {
+    fprintf(stderr, "Could not open the output.\n");
+    return 1;
+  }
+
+  std::mt19937 random(seed);
+  std::normal_distribution<float> noise(0.0, 1.0);
+  std::uniform_real_distribution<float> uniform(0.0, 1.0);
+
+  SoilMonitor soilMonitor(SOIL_ANALOG_CHANNEL, SOIL_DIGITAL_CHANNEL, SOIL_TEMPERATURE_PIN, SOIL_MOISTURE_DRY, SOIL_MOISTURE_WET);
+  EnvironmentalMonitor envMonitor(DHT22_DATA_PIN);
+  SpectrumMonitor spectrumMonitor;
+  spectrumMonitor.begin();
+
+  FilePrint output(file);
+  TraceRecorder recorder;
+
+  // ***
+  // *** Time since the start (ms) and since the last boot.
+  // ***
+  uint64_t time = 0;
+  uint64_t bootTime = 0;
+  uint64_t end = (uint64_t)days * 86400000ULL;
+  uint64_t nextCheck = CHECK_INTERVAL;
+  uint64_t rebootAt = end * 2 / 3;
+  bool booted = false;
+  bool epochRecorded = false;
+  float moisture = 70.0;
+  uint32_t waterings = 0;
+
+  while (time < end)
+  {
+    if (!booted || (rebootAt && time >= rebootAt))
+    {
+      // ***
+      // *** Boot (once more two thirds of the way through).
+      // ***
+      if (booted)
+      {
+        rebootAt = 0;
+        recorder.end();
+        time += 15000;
+      }
+
+      bootTime = time;
+      booted = true;
+      epochRecorded = false;
+      recorder.begin(&output, isText, 0xFFFFFFFF);
+      recorder.writeHeader(3000, FAHRENHEIT, SOIL_MOISTURE_DRY, SOIL_MOISTURE_WET);
+      time += SAMPLE_INTERVAL;
+      nextCheck = time + CHECK_INTERVAL;
+    }
+
+    uint64_t tick = time - bootTime;
+    float day = (time / 86400000.0) + (START_EPOCH % 86400) / 86400.0;
+    float sun = sinf((day - floorf(day) - 0.25) * 2.0 * M_PI);
+
+    // ***
+    // *** The soil dries faster in daylight.
+    // ***
+    moisture -= (sun > 0 ? 0.6 + sun * 0.9 : 0.3) * (SAMPLE_INTERVAL / 3600000.0);
+    moisture = constrain(moisture, 0.0, 100.0);
+
+    // ***
+    // *** Soil moisture sensor: analog level and the comparator.
+    // ***
+    float voltage = SOIL_MOISTURE_DRY - ((SOIL_MOISTURE_DRY - SOIL_MOISTURE_WET) * moisture / 100.0) + (noise(random) * 0.004);
+    Adafruit_MCP3008::hostSetCode(SOIL_ANALOG_CHANNEL, (uint16_t)constrain(voltage / 3.3 * 1024.0, 0.0, 1023.0));
+    Adafruit_MCP3008::hostSetCode(SOIL_DIGITAL_CHANNEL, moisture < 30.0 ? 1023 : 12);
+
+    // ***
+    // *** The soil probe drops out for an hour on day 12.
+    // ***
+    bool dropout = days > 12 && time >= 12 * 86400000ULL + 32400000ULL && time < 12 * 86400000ULL + 36000000ULL;
+    float soilTemperature = 20.0 + (sun * 1.5) + (noise(random) * 0.05);
+    DallasTemperature::hostSetRaw(dropout ? DEVICE_DISCONNECTED_C * 128 : (int16_t)(lroundf(soilTemperature * 16.0) * 8));
+
+    // ***
+    // *** Air temperature and humidity (DHT22, 0.1 resolution),
+    // *** with the occasional failed read.
+    // ***
+    float air = roundf((22.0 + (sun * 4.0) + (noise(random) * 0.2)) * 10.0) * 0.1;
+    float humidity = roundf((55.0 - (sun * 10.0) + (noise(random) * 0.5)) * 10.0) * 0.1;
+    bool failedRead = uniform(random) < 0.0005;
+    DHTesp::hostSetReading(failedRead ? NAN : air, failedRead ? NAN : humidity);
+
+    // ***
+    // *** Light; a little stray light at night.
+    // ***
+    float light = sun > 0 ? sun * 18000.0 * (0.8 + (uniform(random) * 0.2)) : 0;
+    uint16_t full = (uint16_t)(light + 4);
+    uint16_t ir = (uint16_t)((light * 0.3) + 2);
+    Adafruit_TSL2591::hostSetLuminosity(((uint32_t)ir << 16) | full);
+
+    // ***
+    // *** Read the sensors as getSensorData() does and record them.
+    // ***
+    envMonitor.getTemperature(FAHRENHEIT);
+    envMonitor.getRelativeHumidity();
+    soilMonitor.getMoistureLevel();
+    soilMonitor.getQuality();
+    soilMonitor.getTemperature(FAHRENHEIT);
+    spectrumMonitor.getFull(true);
+    recorder.recordSample(tick, soilMonitor, envMonitor, spectrumMonitor);
+
+    if (!epochRecorded)
+    {
+      epochRecorded = true;
+      recorder.recordEpoch(tick, START_EPOCH + (time / 1000));
+    }
+
+    time += SAMPLE_INTERVAL;
+
+    // ***
+    // *** The device checks the soil every 10 minutes and waters
+    // *** when the comparator reports dry soil (during the dropout
+    // *** the moisture channel is still good).
+    // ***
+    if (time >= nextCheck)
+    {
+      nextCheck += CHECK_INTERVAL;
+      uint16_t code = soilMonitor.getQuality() == "Dry" ? 1023 : 12;
+      recorder.recordCheck(time - bootTime, code);
+
+      if (code == 1023)
+      {
+        waterings++;
+        moisture += 35.0;
+        time += WATER_PUMP_RUN_TIME;
+      }
+    }
+
+  }
+
+  recorder.end();
+  fclose(file);
+
+  fprintf(stderr, "Wrote %u days (%u records, %u waterings).\n", days, recorder.getRecordCount(), waterings);
+  return 0;
+}
@@ -0,0 +1,130 @@
+// Copyright © 2019 Daniel Porrey
+//
+// This file is part of the Plant Monitor and Watering System.
+// 
+// This software is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this software. If not, see http://www.gnu.org/licenses/.
+//
+//
+// Runs the firmware's StatusServer on Linux with simulated readings
+// so that /metrics and /status.json can be tested with curl.
+//
+// Build:
+//   g++ -O2 -std=c++17 -I../Host -I../../PlantMonitor statusserver.cpp ../../PlantMonitor/StatusServer.cpp ../../PlantMonitor/CloudData.cpp ../../PlantMonitor/DerivedMetrics.cpp ../Host/HostArduino.cpp ../Host/HostWiFi.cpp -o statusserver
+//
+// Usage:
+//   statusserver [port]
+//   curl http://localhost:8080/metrics
+//   curl http://localhost:8080/status.json
+//
+#include "StatusServer.h"
+#include "DerivedMetrics.h"
+#include <signal.h>
+#include <unistd.h>
+
+static volatile bool _stop = false;
+
+static void onSignal(int)
+{
+  _stop = true;
+}
+
+int main(int argc, char** argv)
+{
+  uint16_t port = (argc > 1) ? atoi(argv[1]) : 8080;
+
+  StatusServer server(port);
+  server.begin();
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  printf("Serving on port %u.\n", port);
+  fflush(stdout);
+
+  CloudData data;
+  memset(data.quality, 0, sizeof(data.quality));
+  data.initialized = true;
+
+  for (uint8_t i = 0; i < CHANNEL_COUNT; i++)
+  {
+    data.interval[i] = 120;
+  }
+
+  uint32_t lastSnapshot = 0;
+  uint32_t loops = 0;
+  uint64_t busy = 0;
+
+  while (!_stop)
+  {
+    // ***
+    // *** A new set of readings every two seconds, like
+    // *** readSensorData() but faster.
+    // ***
+    if (lastSnapshot == 0 || (millis() - lastSnapshot) >= 2000)
+    {
+      lastSnapshot = millis();
+      float t = lastSnapshot / 1000.0;
+
+      data.capturedAt = micros64() / 1000;
+      data.environmentalTemperature = 72.0 + sin(t / 60.0) * 3.0;
+      data.environmentalRelativeHumidity = 45.0 + cos(t / 60.0) * 5.0;
+      data.soilMoistureLevel = 60.0 - fmod(t, 600.0) / 20.0;
+      data.soilMoistureQuality = data.soilMoistureLevel < 40.0 ? "Dry" : "Good";
+      data.soilTemperature = 68.0;
+      data.spectrumFull = 1200;
+      data.spectrumIr = 300;
+      data.spectrumVisible = 900;
+      data.spectrumLux = 250.5;
+      calculateDerivedMetrics(data, FAHRENHEIT);
+
+      StatusSnapshot snapshot;
+      snapshot.data = &data;
+      snapshot.isFahrenheit = true;
+      snapshot.capturedAt = time(nullptr);
+      snapshot.uptime = millis() / 1000;
+      snapshot.freeHeap = ESP.getFreeHeap();
+      snapshot.rssi = WiFi.RSSI();
+      snapshot.isPumpOn = false;
+      snapshot.isClockSynchronized = true;
+      snapshot.clockSyncCount = 1;
+      snapshot.clockDriftRate = 0.0;
+      snapshot.cloudTokens = 30.0;
+      snapshot.cloudPendingReadings = 0;
+      snapshot.cloudPendingAlerts = 0;
+      snapshot.cloudThrottleCount = 0;
+      memset(snapshot.cloudDeferred, 0, sizeof(snapshot.cloudDeferred));
+      snapshot.waterDayVolume = 250.0;
+      snapshot.waterTotalVolume = 12500.0;
+      snapshot.waterBudget = 1500.0;
+      snapshot.waterEventCount = 48;
+      snapshot.reservoirLevel = 2800.0;
+      snapshot.reservoirPercent = 70.0;
+
+      server.update(snapshot);
+    }
+
+    // ***
+    // *** Measure how long process() takes per loop.
+    // ***
+    uint64_t start = micros64();
+    server.process();
+    busy += micros64() - start;
+    loops++;
+
+    usleep(1000);
+  }
+
+  printf("Served %u requests; process() averaged %.2f us over %u loops.\n", server.getRequestCount(), (double)busy / loops, loops);
+  return 0;
+}